@@ -2,6 +2,7 @@
 #include "imgui.h"
 #include "imgui_internal.h" // For ImTextCharFromUtf8
 #include <algorithm> // For std::remove_if, std::find_if, std::sort, std::clamp, std::replace
+#include <cmath>      // For sinf, cosf
 #include <cctype>     // For std::isdigit
 #include <cstdio>     // For std::sprintf, std::sscanf, std::snprintf
 #include <cstring>    // For std::strncpy, std::memset
@@ -306,6 +307,32 @@ void VerticalSplitter(const char *str_id, float *width, float min_width,
     }
 }
 
+// Индикатор ожидания: дуга, вращающаяся со временем. radius <= 0 - по высоте
+// строки текста
+void Spinner(const char *label, float radius, float thickness) {
+    if (radius <= 0.0f)
+        radius = ImGui::GetTextLineHeight() * 0.5f;
+    ImVec2 pos = ImGui::GetCursorScreenPos();
+    ImGui::PushID(label);
+    ImGui::Dummy(ImVec2(radius * 2.0f, radius * 2.0f));
+    ImGui::PopID();
+
+    const int segments = 24;
+    float time = (float)ImGui::GetTime();
+    float start = time * 6.0f;
+    float length = 4.0f + 1.5f * sinf(time * 2.0f); // радианы
+    ImVec2 center(pos.x + radius, pos.y + radius);
+    ImDrawList *draw_list = ImGui::GetWindowDrawList();
+    draw_list->PathClear();
+    for (int i = 0; i <= segments; i++) {
+        float angle = start + length * i / segments;
+        draw_list->PathLineTo(ImVec2(center.x + cosf(angle) * (radius - thickness),
+                                     center.y + sinf(angle) * (radius - thickness)));
+    }
+    draw_list->PathStroke(ImGui::GetColorU32(ImGuiCol_ButtonHovered), 0,
+                          thickness);
+}
+
 // Виджет для ввода даты с автоформатированием
 bool InputDate(const char *label, std::string &date) {
 
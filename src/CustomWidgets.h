@@ -31,6 +31,9 @@ void VerticalSplitter(const char *str_id, float *width,
 
 bool InputDate(const char *label, std::string &date);
 
+// Индикатор ожидания (вращающаяся дуга) для фоновых запросов
+void Spinner(const char *label, float radius = 0.0f, float thickness = 3.0f);
+
 bool AmountInput(const char *label, double &value, const char *format = "%.2f",
                  ImGuiInputTextFlags flags = 0);
 
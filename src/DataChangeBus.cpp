@@ -0,0 +1,22 @@
+#include "DataChangeBus.h"
+
+#include <iterator>
+
+void DataChangeBus::publish(std::vector<DataChange> &&changes) {
+    if (changes.empty())
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (pending.empty()) {
+        pending = std::move(changes);
+    } else {
+        pending.insert(pending.end(), std::make_move_iterator(changes.begin()),
+                       std::make_move_iterator(changes.end()));
+    }
+}
+
+std::vector<DataChange> DataChangeBus::takePending() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<DataChange> changes;
+    changes.swap(pending);
+    return changes;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Изменение строки таблицы базы, полученное через sqlite3_update_hook.
+// Reload (rowid == -1) означает, что в таблице изменилось слишком много
+// строк и подписчику проще перечитать её целиком.
+struct DataChange {
+    enum Type { Insert, Update, Delete, Reload };
+
+    std::string table;
+    Type type;
+    long long rowid;
+};
+
+// Шина изменений данных. Соединения DatabaseManager публикуют изменения
+// после фиксации транзакции (из любого потока), UIManager раз в кадр
+// забирает накопленное и раздаёт представлениям в UI-потоке.
+class DataChangeBus {
+public:
+    void publish(std::vector<DataChange>&& changes);
+    std::vector<DataChange> takePending();
+
+private:
+    std::mutex mutex;
+    std::vector<DataChange> pending;
+};
@@ -1,6 +1,12 @@
 #include "DatabaseManager.h"
+#include "DatabaseStats.h"
 #include "ExportManager.h"
+#include "MappedFile.h"
+#include "RowDecoder.h"
 #include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <sstream>
 #include <vector>
@@ -11,6 +17,7 @@ DatabaseManager::DatabaseManager()
 DatabaseManager::~DatabaseManager() { close(); }
 
 bool DatabaseManager::open(const std::string &filepath) {
+    DB_STATS_SCOPE();
     if (db) {
         close();
     }
@@ -18,28 +25,459 @@ bool DatabaseManager::open(const std::string &filepath) {
     if (rc != SQLITE_OK) {
         std::cerr << "Cannot open database: " << sqlite3_errmsg(db)
                   << std::endl;
+        sqlite3_close(db);
+        db = nullptr;
         return false;
     }
 
+    // WAL: читатели видят согласованный снимок и не блокируются, пока
+    // поток записи выполняет длинную транзакцию импорта
+    sqlite3_busy_timeout(db, busyTimeoutMs);
+    execute("PRAGMA journal_mode = WAL;");
+    execute("PRAGMA synchronous = NORMAL;");
+    installChangeHooks();
+    DatabaseStats::attach(db);
+
     checkAndUpdateDatabaseSchema();
 
     return true;
 }
 
+bool DatabaseManager::openReadOnly(const std::string &filepath) {
+    DB_STATS_SCOPE();
+    if (db) {
+        close();
+    }
+    int rc = sqlite3_open_v2(filepath.c_str(), &db, SQLITE_OPEN_READONLY,
+                             nullptr);
+    if (rc != SQLITE_OK) {
+        std::cerr << "Cannot open database (read-only): "
+                  << sqlite3_errmsg(db) << std::endl;
+        sqlite3_close(db);
+        db = nullptr;
+        return false;
+    }
+    sqlite3_busy_timeout(db, busyTimeoutMs);
+    DatabaseStats::attach(db);
+    return true;
+}
+
+// Суммы хранятся в столбцах REAL, округлёнными до копеек (см. миграцию 6),
+// и записываются только через bindMoney. Суммируются они в целых копейках:
+// SUM(SQL_KOPECKS(amount)) точен при любом числе строк, результат читается
+// через columnMoney.
+#define SQL_KOPECKS(column) "CAST(ROUND(" column " * 100) AS INTEGER)"
+
+static void bindMoney(sqlite3_stmt *stmt, int index, double amount) {
+    sqlite3_bind_double(stmt, index, Money::fromDouble(amount).toDouble());
+}
+
+static Money columnMoney(sqlite3_stmt *stmt, int column) {
+    return Money(sqlite3_column_int64(stmt, column));
+}
+
+// Миграции схемы. Версия схемы хранится в PRAGMA user_version; миграция с
+// номером N переводит базу из версии N-1 в версию N. Новые миграции
+// добавляются только в конец списка, существующие не меняются.
+struct SchemaMigration {
+    int version;
+    const char *description;
+    std::vector<std::string> statements;
+};
+
+// Пересчёт таблиц итогов (KosguTotals, ContractTotals, CounterpartyTotals)
+// с нуля по PaymentDetails/Payments
+static std::vector<std::string> aggregateTotalsRebuildStatements() {
+    return {
+        "DELETE FROM KosguTotals;",
+        "INSERT INTO KosguTotals (kosgu_id, total) "
+        "SELECT kosgu_id, ROUND(SUM(amount), 2) FROM PaymentDetails "
+        "WHERE kosgu_id IS NOT NULL GROUP BY kosgu_id;",
+        "DELETE FROM ContractTotals;",
+        "INSERT INTO ContractTotals (contract_id, total) "
+        "SELECT contract_id, ROUND(SUM(amount), 2) FROM PaymentDetails "
+        "WHERE contract_id IS NOT NULL GROUP BY contract_id;",
+        "DELETE FROM CounterpartyTotals;",
+        "INSERT INTO CounterpartyTotals (counterparty_id, total) "
+        "SELECT counterparty_id, ROUND(SUM(amount), 2) FROM Payments "
+        "WHERE counterparty_id IS NOT NULL GROUP BY counterparty_id;",
+    };
+}
+
+// Миграция 2: таблицы итогов, которые поддерживаются триггерами на
+// PaymentDetails и Payments. Суммы округляются до копеек на каждом шаге,
+// чтобы при многократных изменениях не накапливалась ошибка округления.
+static std::vector<std::string> aggregateTotalsMigration() {
+    std::vector<std::string> statements = {
+        "CREATE TABLE IF NOT EXISTS KosguTotals ("
+        "kosgu_id INTEGER PRIMARY KEY,"
+        "total REAL NOT NULL DEFAULT 0);",
+        "CREATE TABLE IF NOT EXISTS ContractTotals ("
+        "contract_id INTEGER PRIMARY KEY,"
+        "total REAL NOT NULL DEFAULT 0);",
+        "CREATE TABLE IF NOT EXISTS CounterpartyTotals ("
+        "counterparty_id INTEGER PRIMARY KEY,"
+        "total REAL NOT NULL DEFAULT 0);",
+
+        // Расшифровки платежей -> итоги по КОСГУ и договорам
+        "CREATE TRIGGER IF NOT EXISTS trg_payment_details_totals_insert "
+        "AFTER INSERT ON PaymentDetails BEGIN "
+        "INSERT INTO KosguTotals (kosgu_id, total) "
+        "SELECT NEW.kosgu_id, ROUND(IFNULL(NEW.amount, 0), 2) "
+        "WHERE NEW.kosgu_id IS NOT NULL "
+        "ON CONFLICT(kosgu_id) DO UPDATE SET total = ROUND(total + excluded.total, 2); "
+        "INSERT INTO ContractTotals (contract_id, total) "
+        "SELECT NEW.contract_id, ROUND(IFNULL(NEW.amount, 0), 2) "
+        "WHERE NEW.contract_id IS NOT NULL "
+        "ON CONFLICT(contract_id) DO UPDATE SET total = ROUND(total + excluded.total, 2); "
+        "END;",
+        "CREATE TRIGGER IF NOT EXISTS trg_payment_details_totals_delete "
+        "AFTER DELETE ON PaymentDetails BEGIN "
+        "UPDATE KosguTotals SET total = ROUND(total - IFNULL(OLD.amount, 0), 2) "
+        "WHERE kosgu_id = OLD.kosgu_id; "
+        "UPDATE ContractTotals SET total = ROUND(total - IFNULL(OLD.amount, 0), 2) "
+        "WHERE contract_id = OLD.contract_id; "
+        "END;",
+        "CREATE TRIGGER IF NOT EXISTS trg_payment_details_totals_update "
+        "AFTER UPDATE OF kosgu_id, contract_id, amount ON PaymentDetails BEGIN "
+        "UPDATE KosguTotals SET total = ROUND(total - IFNULL(OLD.amount, 0), 2) "
+        "WHERE kosgu_id = OLD.kosgu_id; "
+        "UPDATE ContractTotals SET total = ROUND(total - IFNULL(OLD.amount, 0), 2) "
+        "WHERE contract_id = OLD.contract_id; "
+        "INSERT INTO KosguTotals (kosgu_id, total) "
+        "SELECT NEW.kosgu_id, ROUND(IFNULL(NEW.amount, 0), 2) "
+        "WHERE NEW.kosgu_id IS NOT NULL "
+        "ON CONFLICT(kosgu_id) DO UPDATE SET total = ROUND(total + excluded.total, 2); "
+        "INSERT INTO ContractTotals (contract_id, total) "
+        "SELECT NEW.contract_id, ROUND(IFNULL(NEW.amount, 0), 2) "
+        "WHERE NEW.contract_id IS NOT NULL "
+        "ON CONFLICT(contract_id) DO UPDATE SET total = ROUND(total + excluded.total, 2); "
+        "END;",
+
+        // Платежи -> итоги по контрагентам
+        "CREATE TRIGGER IF NOT EXISTS trg_payments_totals_insert "
+        "AFTER INSERT ON Payments BEGIN "
+        "INSERT INTO CounterpartyTotals (counterparty_id, total) "
+        "SELECT NEW.counterparty_id, ROUND(IFNULL(NEW.amount, 0), 2) "
+        "WHERE NEW.counterparty_id IS NOT NULL "
+        "ON CONFLICT(counterparty_id) DO UPDATE SET total = ROUND(total + excluded.total, 2); "
+        "END;",
+        "CREATE TRIGGER IF NOT EXISTS trg_payments_totals_delete "
+        "AFTER DELETE ON Payments BEGIN "
+        "UPDATE CounterpartyTotals SET total = ROUND(total - IFNULL(OLD.amount, 0), 2) "
+        "WHERE counterparty_id = OLD.counterparty_id; "
+        "END;",
+        "CREATE TRIGGER IF NOT EXISTS trg_payments_totals_update "
+        "AFTER UPDATE OF counterparty_id, amount ON Payments BEGIN "
+        "UPDATE CounterpartyTotals SET total = ROUND(total - IFNULL(OLD.amount, 0), 2) "
+        "WHERE counterparty_id = OLD.counterparty_id; "
+        "INSERT INTO CounterpartyTotals (counterparty_id, total) "
+        "SELECT NEW.counterparty_id, ROUND(IFNULL(NEW.amount, 0), 2) "
+        "WHERE NEW.counterparty_id IS NOT NULL "
+        "ON CONFLICT(counterparty_id) DO UPDATE SET total = ROUND(total + excluded.total, 2); "
+        "END;",
+    };
+    for (auto &sql : aggregateTotalsRebuildStatements()) {
+        statements.push_back(std::move(sql));
+    }
+    return statements;
+}
+
+// Миграция 3: полнотекстовые индексы FTS5 по назначению, получателю и
+// примечанию платежей и по содержанию операций документов основания.
+// Таблицы с внешним содержимым (content=) хранят только индекс, тексты
+// читаются из исходных таблиц; синхронизацию ведут триггеры. Диакритика не
+// снимается, чтобы "й" не совпадала с "и".
+static std::vector<std::string> fullTextSearchMigration() {
+    return {
+        "CREATE VIRTUAL TABLE IF NOT EXISTS PaymentsFts USING fts5("
+        "description, recipient, note, "
+        "content='Payments', content_rowid='id', "
+        "tokenize='unicode61 remove_diacritics 0');",
+        "CREATE TRIGGER IF NOT EXISTS trg_payments_fts_insert "
+        "AFTER INSERT ON Payments BEGIN "
+        "INSERT INTO PaymentsFts (rowid, description, recipient, note) "
+        "VALUES (NEW.id, NEW.description, NEW.recipient, NEW.note); "
+        "END;",
+        "CREATE TRIGGER IF NOT EXISTS trg_payments_fts_delete "
+        "AFTER DELETE ON Payments BEGIN "
+        "INSERT INTO PaymentsFts (PaymentsFts, rowid, description, recipient, note) "
+        "VALUES ('delete', OLD.id, OLD.description, OLD.recipient, OLD.note); "
+        "END;",
+        "CREATE TRIGGER IF NOT EXISTS trg_payments_fts_update "
+        "AFTER UPDATE OF description, recipient, note ON Payments BEGIN "
+        "INSERT INTO PaymentsFts (PaymentsFts, rowid, description, recipient, note) "
+        "VALUES ('delete', OLD.id, OLD.description, OLD.recipient, OLD.note); "
+        "INSERT INTO PaymentsFts (rowid, description, recipient, note) "
+        "VALUES (NEW.id, NEW.description, NEW.recipient, NEW.note); "
+        "END;",
+        "INSERT INTO PaymentsFts (PaymentsFts) VALUES ('rebuild');",
+
+        "CREATE VIRTUAL TABLE IF NOT EXISTS BasePaymentDocumentDetailsFts "
+        "USING fts5(operation_content, "
+        "content='BasePaymentDocumentDetails', content_rowid='id', "
+        "tokenize='unicode61 remove_diacritics 0');",
+        "CREATE TRIGGER IF NOT EXISTS trg_base_document_details_fts_insert "
+        "AFTER INSERT ON BasePaymentDocumentDetails BEGIN "
+        "INSERT INTO BasePaymentDocumentDetailsFts (rowid, operation_content) "
+        "VALUES (NEW.id, NEW.operation_content); "
+        "END;",
+        "CREATE TRIGGER IF NOT EXISTS trg_base_document_details_fts_delete "
+        "AFTER DELETE ON BasePaymentDocumentDetails BEGIN "
+        "INSERT INTO BasePaymentDocumentDetailsFts "
+        "(BasePaymentDocumentDetailsFts, rowid, operation_content) "
+        "VALUES ('delete', OLD.id, OLD.operation_content); "
+        "END;",
+        "CREATE TRIGGER IF NOT EXISTS trg_base_document_details_fts_update "
+        "AFTER UPDATE OF operation_content ON BasePaymentDocumentDetails BEGIN "
+        "INSERT INTO BasePaymentDocumentDetailsFts "
+        "(BasePaymentDocumentDetailsFts, rowid, operation_content) "
+        "VALUES ('delete', OLD.id, OLD.operation_content); "
+        "INSERT INTO BasePaymentDocumentDetailsFts (rowid, operation_content) "
+        "VALUES (NEW.id, NEW.operation_content); "
+        "END;",
+        "INSERT INTO BasePaymentDocumentDetailsFts "
+        "(BasePaymentDocumentDetailsFts) VALUES ('rebuild');",
+    };
+}
+
+static const std::vector<SchemaMigration> &schemaMigrations() {
+    static const std::vector<SchemaMigration> migrations = {
+        {1,
+         "Индексы для поиска и соединений",
+         {
+             // Расшифровки платежей: соединения с платежами, КОСГУ,
+             // договорами и документами основания. amount включён в индекс,
+             // чтобы суммы по КОСГУ/договору считались только по индексу
+             "CREATE INDEX IF NOT EXISTS idx_payment_details_payment "
+             "ON PaymentDetails(payment_id);",
+             "CREATE INDEX IF NOT EXISTS idx_payment_details_kosgu "
+             "ON PaymentDetails(kosgu_id, amount);",
+             "CREATE INDEX IF NOT EXISTS idx_payment_details_contract "
+             "ON PaymentDetails(contract_id, amount);",
+             "CREATE INDEX IF NOT EXISTS idx_payment_details_invoice "
+             "ON PaymentDetails(invoice_id);",
+             // Платежи: суммы по контрагенту и отбор по периоду
+             "CREATE INDEX IF NOT EXISTS idx_payments_counterparty "
+             "ON Payments(counterparty_id, amount);",
+             "CREATE INDEX IF NOT EXISTS idx_payments_date "
+             "ON Payments(date);",
+             // Поиск договора и контрагента при импорте
+             "CREATE INDEX IF NOT EXISTS idx_contracts_number_date "
+             "ON Contracts(number, date);",
+             "CREATE INDEX IF NOT EXISTS idx_counterparties_name "
+             "ON Counterparties(name, inn);",
+             // Документы основания и их расшифровки
+             "CREATE INDEX IF NOT EXISTS idx_base_documents_number_date "
+             "ON BasePaymentDocuments(number, date);",
+             "CREATE INDEX IF NOT EXISTS idx_base_document_details_document "
+             "ON BasePaymentDocumentDetails(document_id, amount);",
+             "ANALYZE;",
+         }},
+        {2, "Итоги по КОСГУ, договорам и контрагентам",
+         aggregateTotalsMigration()},
+        {3, "Полнотекстовый поиск по платежам и документам основания",
+         fullTextSearchMigration()},
+        {4,
+         "Коды КОСГУ в индексе расшифровок по договору",
+         {
+             // Списки КОСГУ по договорам (getContractsForExport) читаются
+             // только по индексу, суммы по договору - как и прежде
+             "DROP INDEX IF EXISTS idx_payment_details_contract;",
+             "CREATE INDEX idx_payment_details_contract "
+             "ON PaymentDetails(contract_id, kosgu_id, amount);",
+         }},
+        {5,
+         "Порядок платежей (дата, номер) в индексе по дате",
+         {
+             // Постраничная выборка сверки идёт по индексу в порядке
+             // (дата, номер, id) без сортировки; отбор по периоду - как и
+             // прежде, по первому столбцу
+             "DROP INDEX IF EXISTS idx_payments_date;",
+             "CREATE INDEX idx_payments_date "
+             "ON Payments(date, IFNULL(doc_number, ''));",
+         }},
+        {6,
+         "Суммы, округлённые до копеек",
+         {
+             // Остатки, посчитанные прежде в double (100.1 - 33.37 =
+             // 66.72999...), приводятся к целым копейкам; дальше суммы
+             // пишутся через bindMoney и складываются в копейках
+             "UPDATE Payments SET amount = ROUND(amount, 2) "
+             "WHERE amount <> ROUND(amount, 2);",
+             "UPDATE PaymentDetails SET amount = ROUND(amount, 2) "
+             "WHERE amount <> ROUND(amount, 2);",
+             "UPDATE BasePaymentDocumentDetails SET amount = ROUND(amount, 2) "
+             "WHERE amount <> ROUND(amount, 2);",
+             "UPDATE Contracts SET contract_amount = ROUND(contract_amount, 2) "
+             "WHERE contract_amount <> ROUND(contract_amount, 2);",
+         }},
+        {7,
+         "Номер дня даты платежа с индексом для отбора по периоду",
+         {
+             // Вычисляемый столбец (Date::days): хранится только в индексе,
+             // запись таблицы не меняется. Для дат не в формате ГГГГ-ММ-ДД -
+             // NULL. Отбор по периоду - поиск диапазона по индексу вместо
+             // сравнения строк в каждой записи
+             "ALTER TABLE Payments ADD COLUMN date_day INTEGER "
+             "GENERATED ALWAYS AS "
+             "(CAST(julianday(date) - 2440587.5 AS INTEGER)) VIRTUAL;",
+             "CREATE INDEX IF NOT EXISTS idx_payments_date_day "
+             "ON Payments(date_day);",
+         }},
+        {8,
+         "Настройка снимка платежей для быстрого открытия",
+         {
+             "ALTER TABLE Settings ADD COLUMN use_snapshot INTEGER DEFAULT 1;",
+         }},
+    };
+    return migrations;
+}
+
+static int readUserVersion(sqlite3 *db) {
+    int version = 0;
+    sqlite3_stmt *stmt = nullptr;
+    if (sqlite3_prepare_v2(db, "PRAGMA user_version;", -1, &stmt, nullptr) ==
+            SQLITE_OK &&
+        sqlite3_step(stmt) == SQLITE_ROW) {
+        version = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return version;
+}
+
 void DatabaseManager::checkAndUpdateDatabaseSchema() {
     if (!db)
         return;
-    // пока ничего не делает
-    // Потом возможно напишем проверку структуры и миграцию
+
+    // Пустой файл (createDatabase ещё не создал таблицы) не мигрируем:
+    // createDatabase вызовет проверку повторно после создания таблиц
+    std::vector<std::string> columns;
+    std::vector<std::vector<std::string>> rows;
+    if (!executeSelect("SELECT name FROM sqlite_master WHERE type = 'table' "
+                       "AND name = 'Payments';",
+                       columns, rows) ||
+        rows.empty()) {
+        return;
+    }
+
+    int current_version = readUserVersion(db);
+    for (const auto &migration : schemaMigrations()) {
+        if (migration.version <= current_version)
+            continue;
+
+        bool success = execute("BEGIN;");
+        for (const auto &sql : migration.statements) {
+            if (!success)
+                break;
+            success = execute(sql);
+        }
+        if (success) {
+            success = execute("PRAGMA user_version = " +
+                              std::to_string(migration.version) + ";");
+        }
+        if (!success || !execute("COMMIT;")) {
+            std::cerr << "Schema migration " << migration.version << " ("
+                      << migration.description << ") failed" << std::endl;
+            execute("ROLLBACK;");
+            break;
+        }
+        std::cout << "Schema migrated to version " << migration.version
+                  << ": " << migration.description << std::endl;
+        current_version = migration.version;
+    }
+
+    // После изменения схемы ранее подготовленные запросы не нужны
+    clearStatementCache();
 }
 
 void DatabaseManager::close() {
     if (db) {
-        sqlite3_close(db);
+        clearStatementCache();
+        DatabaseStats::detach(db);
+        // sqlite3_close_v2 дожидается финализации запросов, которые ещё
+        // удерживаются другим потоком (они будут финализированы в
+        // releaseCached)
+        sqlite3_close_v2(db);
         db = nullptr;
     }
 }
 
+int DatabaseManager::prepareCached(const std::string &sql,
+                                   sqlite3_stmt **stmt) {
+    *stmt = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(statementCacheMutex);
+        auto it = statementCache.find(sql);
+        if (it != statementCache.end() && !it->second.empty()) {
+            *stmt = it->second.back();
+            it->second.pop_back();
+            checkedOutStatements.insert(*stmt);
+            statementsReused++;
+            return SQLITE_OK;
+        }
+    }
+
+    // Компилируем вне блокировки: подготовка может быть долгой
+    int rc = sqlite3_prepare_v3(db, sql.c_str(), -1, SQLITE_PREPARE_PERSISTENT,
+                                stmt, nullptr);
+    if (rc != SQLITE_OK) {
+        sqlite3_finalize(*stmt);
+        *stmt = nullptr;
+        return rc;
+    }
+
+    std::lock_guard<std::mutex> lock(statementCacheMutex);
+    checkedOutStatements.insert(*stmt);
+    statementsPrepared++;
+    return SQLITE_OK;
+}
+
+void DatabaseManager::releaseCached(sqlite3_stmt *stmt) {
+    if (!stmt)
+        return;
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+
+    std::lock_guard<std::mutex> lock(statementCacheMutex);
+    if (checkedOutStatements.erase(stmt) == 0) {
+        // Кэш был очищен, пока запрос был выдан - он больше не нужен
+        sqlite3_finalize(stmt);
+        return;
+    }
+    statementCache[sqlite3_sql(stmt)].push_back(stmt);
+}
+
+void DatabaseManager::clearStatementCache() {
+    std::lock_guard<std::mutex> lock(statementCacheMutex);
+    for (auto &entry : statementCache) {
+        for (sqlite3_stmt *stmt : entry.second) {
+            sqlite3_finalize(stmt);
+        }
+    }
+    statementCache.clear();
+    // Выданные запросы будут финализированы при возврате в releaseCached
+    checkedOutStatements.clear();
+}
+
+DatabaseManager::StatementCacheStats DatabaseManager::getStatementCacheStats() {
+    std::lock_guard<std::mutex> lock(statementCacheMutex);
+    StatementCacheStats stats;
+    stats.prepared = statementsPrepared;
+    stats.reused = statementsReused;
+    stats.cached = checkedOutStatements.size();
+    for (const auto &entry : statementCache) {
+        stats.cached += entry.second.size();
+    }
+    return stats;
+}
+
+void DatabaseManager::resetStatementCacheStats() {
+    std::lock_guard<std::mutex> lock(statementCacheMutex);
+    statementsPrepared = 0;
+    statementsReused = 0;
+}
+
 bool DatabaseManager::execute(const std::string &sql) {
     char *errmsg = nullptr;
     int rc = sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &errmsg);
@@ -53,7 +491,384 @@ bool DatabaseManager::execute(const std::string &sql) {
 
 bool DatabaseManager::is_open() const { return db != nullptr; }
 
+void DatabaseManager::interrupt() {
+    if (db) {
+        sqlite3_interrupt(db);
+    }
+}
+
+void DatabaseManager::setInterruptFlag(const std::atomic<bool> *flag) {
+    if (!db)
+        return;
+    // Проверка раз в 1000 инструкций VDBE: на скорость запросов не влияет
+    sqlite3_progress_handler(db, flag ? 1000 : 0,
+                             flag ? &DatabaseManager::onProgress : nullptr,
+                             const_cast<std::atomic<bool> *>(flag));
+}
+
+int DatabaseManager::onProgress(void *flag) {
+    return static_cast<std::atomic<bool> *>(flag)->load() ? 1 : 0;
+}
+
+bool DatabaseManager::isReadOnlyQuery(const std::string &sql) {
+    DB_STATS_SCOPE();
+    if (!db)
+        return false;
+    sqlite3_stmt *stmt = nullptr;
+    const char *tail = nullptr;
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, &tail) != SQLITE_OK ||
+        !stmt) {
+        sqlite3_finalize(stmt);
+        return false;
+    }
+    // BEGIN/COMMIT тоже считаются "только чтение", но строк не возвращают
+    bool read_only = sqlite3_stmt_readonly(stmt) != 0 &&
+                     sqlite3_column_count(stmt) > 0;
+    sqlite3_finalize(stmt);
+    // После первой инструкции допускаются только пробелы и ';'
+    for (; read_only && tail && *tail; ++tail) {
+        if (!isspace(static_cast<unsigned char>(*tail)) && *tail != ';')
+            read_only = false;
+    }
+    return read_only;
+}
+
+void DatabaseManager::setChangeBus(DataChangeBus *bus) {
+    changeBus = bus;
+    installChangeHooks();
+}
+
+// Хуки нужны и без шины изменений: по ним сбрасываются справочники
+// идентификаторов (resolveKosguId и др.)
+void DatabaseManager::installChangeHooks() {
+    if (!db)
+        return;
+    uncommittedChanges.clear();
+    uncommittedCounts.clear();
+    savepointMarks.clear();
+    invalidateReferenceCache();
+    sqlite3_update_hook(db, &DatabaseManager::onRowChanged, this);
+    sqlite3_commit_hook(db, &DatabaseManager::onCommit, this);
+    sqlite3_rollback_hook(db, &DatabaseManager::onRollback, this);
+}
+
+void DatabaseManager::onRowChanged(void *self, int op, const char *,
+                                   const char *table, sqlite3_int64 rowid) {
+    auto *manager = static_cast<DatabaseManager *>(self);
+    // Добавленные строки справочник не портят: их просто нет в нём, и
+    // поиск дойдёт до базы. Изменённые и удалённые - сбрасывают его.
+    if (op != SQLITE_INSERT) {
+        if (strcmp(table, "KOSGU") == 0) {
+            manager->kosguByCode = ReferenceMap();
+        } else if (strcmp(table, "Counterparties") == 0) {
+            manager->counterpartyByName = ReferenceMap();
+        } else if (strcmp(table, "Contracts") == 0) {
+            manager->contractByNumberDate = ReferenceMap();
+        }
+    }
+    if (!manager->changeBus)
+        return;
+
+    size_t &count = manager->uncommittedCounts[table];
+    if (count > maxRowChangesPerTable)
+        return; // изменения таблицы уже сведены в Reload
+
+    auto &changes = manager->uncommittedChanges;
+    if (++count > maxRowChangesPerTable) {
+        manager->queueTableReload(table);
+        return;
+    }
+
+    DataChange::Type type = DataChange::Update;
+    if (op == SQLITE_INSERT)
+        type = DataChange::Insert;
+    else if (op == SQLITE_DELETE)
+        type = DataChange::Delete;
+    changes.push_back({table, type, rowid});
+}
+
+int DatabaseManager::onCommit(void *self) {
+    auto *manager = static_cast<DatabaseManager *>(self);
+    manager->referenceCheckedInTransaction = false;
+    if (manager->changeBus) {
+        manager->compactUncommittedChanges();
+        manager->changeBus->publish(std::move(manager->uncommittedChanges));
+    }
+    manager->uncommittedChanges.clear();
+    manager->uncommittedCounts.clear();
+    manager->savepointMarks.clear();
+    return 0; // 0 - фиксацию не отменяем
+}
+
+// Нужен и там, где хук строк не вызывается: DELETE без WHERE выполняется
+// усечением таблицы. Изменения строк таблицы остаются в очереди до
+// фиксации (см. savepointMarks) и убираются compactUncommittedChanges.
+void DatabaseManager::queueTableReload(const std::string &table) {
+    if (!changeBus)
+        return;
+    size_t &count = uncommittedCounts[table];
+    if (count > maxRowChangesPerTable)
+        return; // Reload уже в очереди
+    count = maxRowChangesPerTable + 1;
+    uncommittedChanges.push_back({table, DataChange::Reload, -1});
+}
+
+void DatabaseManager::compactUncommittedChanges() {
+    auto &changes = uncommittedChanges;
+    changes.erase(std::remove_if(changes.begin(), changes.end(),
+                                 [this](const DataChange &change) {
+                                     return change.type != DataChange::Reload &&
+                                            uncommittedCounts[change.table] >
+                                                maxRowChangesPerTable;
+                                 }),
+                  changes.end());
+}
+
+void DatabaseManager::recountUncommittedChanges() {
+    uncommittedCounts.clear();
+    for (const DataChange &change : uncommittedChanges) {
+        size_t &count = uncommittedCounts[change.table];
+        if (change.type == DataChange::Reload)
+            count = maxRowChangesPerTable + 1;
+        else if (count <= maxRowChangesPerTable)
+            ++count;
+    }
+}
+
+void DatabaseManager::onRollback(void *self) {
+    auto *manager = static_cast<DatabaseManager *>(self);
+    // Справочник мог получить id записей, добавленных в этой транзакции
+    manager->invalidateReferenceCache();
+    manager->uncommittedChanges.clear();
+    manager->uncommittedCounts.clear();
+    manager->savepointMarks.clear();
+}
+
+// Открывает курсор по SELECT без параметров; запрос берётся из кэша
+template <typename Row>
+RowCursor<Row>
+DatabaseManager::openCursor(const std::string &sql,
+                            void (*decode)(sqlite3_stmt *, Row &),
+                            const char *what) {
+    if (!db)
+        return RowCursor<Row>();
+    sqlite3_stmt *stmt = nullptr;
+    if (prepareCached(sql, &stmt) != SQLITE_OK) {
+        std::cerr << "Failed to select " << what << ": " << sqlite3_errmsg(db)
+                  << std::endl;
+        return RowCursor<Row>();
+    }
+    return RowCursor<Row>(this, stmt, decode);
+}
+
+// Дочитывает курсор в вектор (для методов, возвращающих всю выборку)
+template <typename Row>
+static bool drainCursor(RowCursor<Row> &cursor, std::vector<Row> &rows) {
+    if (!cursor.isOpen())
+        return false;
+    while (true) {
+        rows.emplace_back();
+        if (!cursor.next(rows.back())) {
+            rows.pop_back();
+            break;
+        }
+    }
+    return !cursor.failed();
+}
+
+// Читает одну строку по id (единственный параметр запроса)
+template <typename Decoder, typename Row>
+bool DatabaseManager::selectRowById(const std::string &sql, int id, Row &row) {
+    if (!db)
+        return false;
+    sqlite3_stmt *stmt = nullptr;
+    if (prepareCached(sql, &stmt) != SQLITE_OK) {
+        std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(db)
+                  << std::endl;
+        return false;
+    }
+    sqlite3_bind_int(stmt, 1, id);
+    bool found = sqlite3_step(stmt) == SQLITE_ROW;
+    if (found) {
+        Decoder::decode(stmt, row);
+    }
+    releaseCached(stmt);
+    return found;
+}
+
+// Выполняет SELECT без параметров через кэш запросов и декодирует каждую
+// строку по номерам столбцов (см. RowDecoder)
+template <typename Decoder, typename Row>
+bool DatabaseManager::selectRows(const std::string &sql, std::vector<Row> &rows,
+                                 const char *what) {
+    RowCursor<Row> cursor =
+        openCursor<Row>(sql, &Decoder::template decode<Row>, what);
+    return drainCursor(cursor, rows);
+}
+
+// Выполняет запрос без параметров и результата через кэш подготовленных
+// запросов (для BEGIN/COMMIT/SAVEPOINT, которые выполняются на каждой строке
+// импорта)
+bool DatabaseManager::executeCached(const std::string &sql) {
+    if (!db)
+        return false;
+    sqlite3_stmt *stmt = nullptr;
+    if (prepareCached(sql, &stmt) != SQLITE_OK) {
+        std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(db)
+                  << std::endl;
+        return false;
+    }
+    int rc = sqlite3_step(stmt);
+    releaseCached(stmt);
+    if (rc != SQLITE_DONE) {
+        std::cerr << "SQL error (" << sql << "): " << sqlite3_errmsg(db)
+                  << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool DatabaseManager::beginTransaction() {
+    DB_STATS_SCOPE();
+    return executeCached("BEGIN IMMEDIATE;");
+}
+
+bool DatabaseManager::commitTransaction() {
+    DB_STATS_SCOPE();
+    return executeCached("COMMIT;");
+}
+
+bool DatabaseManager::rollbackTransaction() {
+    DB_STATS_SCOPE();
+    return executeCached("ROLLBACK;");
+}
+
+bool DatabaseManager::inTransaction() const {
+    return db && sqlite3_get_autocommit(db) == 0;
+}
+
+bool DatabaseManager::savepoint(const std::string &name) {
+    DB_STATS_SCOPE();
+    if (!executeCached("SAVEPOINT " + name + ";"))
+        return false;
+    savepointMarks.emplace_back(name, uncommittedChanges.size());
+    return true;
+}
+
+// Индекс последней открытой точки сохранения с именем name или -1
+static int findSavepointMark(
+    const std::vector<std::pair<std::string, size_t>> &marks,
+    const std::string &name) {
+    for (int i = static_cast<int>(marks.size()) - 1; i >= 0; --i) {
+        if (marks[i].first == name)
+            return i;
+    }
+    return -1;
+}
+
+bool DatabaseManager::releaseSavepoint(const std::string &name) {
+    DB_STATS_SCOPE();
+    if (!executeCached("RELEASE SAVEPOINT " + name + ";"))
+        return false;
+    // Закрываются точка и вложенные в неё. RELEASE внешней точки фиксирует
+    // транзакцию, и отметки уже очищены хуком фиксации
+    int mark = findSavepointMark(savepointMarks, name);
+    if (mark >= 0)
+        savepointMarks.resize(mark);
+    return true;
+}
+
+bool DatabaseManager::rollbackToSavepoint(const std::string &name) {
+    DB_STATS_SCOPE();
+    // Хук отката на ROLLBACK TO не вызывается, а справочник мог получить id
+    // записей, добавленных после точки сохранения
+    invalidateReferenceCache();
+    if (!executeCached("ROLLBACK TO SAVEPOINT " + name + ";"))
+        return false;
+    // Точка остаётся открытой, вложенные в неё закрываются; изменения,
+    // записанные после неё, отменены и не публикуются
+    int mark = findSavepointMark(savepointMarks, name);
+    if (mark >= 0) {
+        savepointMarks.resize(mark + 1);
+        if (savepointMarks[mark].second < uncommittedChanges.size()) {
+            uncommittedChanges.resize(savepointMarks[mark].second);
+            recountUncommittedChanges();
+        }
+    }
+    return true;
+}
+
+// ==================== TransactionSession ====================
+
+static const char *IMPORT_ROW_SAVEPOINT = "import_row";
+
+TransactionSession::TransactionSession(DatabaseManager *dbManager,
+                                       int commit_every)
+    : dbManager(dbManager), commitEvery(commit_every) {
+    // Вложенные транзакции SQLite не поддерживает: если транзакция уже
+    // открыта, работаем в ней без собственной фиксации
+    if (dbManager && dbManager->is_open() && !dbManager->inTransaction()) {
+        active = dbManager->beginTransaction();
+    }
+}
+
+TransactionSession::~TransactionSession() { rollback(); }
+
+bool TransactionSession::beginRow() {
+    if (!active)
+        return true;
+    inRow = dbManager->savepoint(IMPORT_ROW_SAVEPOINT);
+    return inRow;
+}
+
+bool TransactionSession::endRow(bool success) {
+    if (!active)
+        return true;
+    if (inRow) {
+        if (!success) {
+            dbManager->rollbackToSavepoint(IMPORT_ROW_SAVEPOINT);
+        }
+        dbManager->releaseSavepoint(IMPORT_ROW_SAVEPOINT);
+        inRow = false;
+    }
+
+    if (commitEvery > 0 && ++rowsInBatch >= commitEvery) {
+        rowsInBatch = 0;
+        if (!dbManager->commitTransaction()) {
+            dbManager->rollbackTransaction();
+            active = false;
+            return false;
+        }
+        active = dbManager->beginTransaction();
+    }
+    return active;
+}
+
+bool TransactionSession::commit() {
+    if (!active)
+        return true;
+    if (inRow) {
+        dbManager->releaseSavepoint(IMPORT_ROW_SAVEPOINT);
+        inRow = false;
+    }
+    active = false;
+    if (!dbManager->commitTransaction()) {
+        dbManager->rollbackTransaction();
+        return false;
+    }
+    return true;
+}
+
+void TransactionSession::rollback() {
+    if (!active)
+        return;
+    active = false;
+    inRow = false;
+    dbManager->rollbackTransaction();
+}
+
 bool DatabaseManager::createDatabase(const std::string &filepath) {
+    DB_STATS_SCOPE();
     if (!open(filepath)) {
         return false;
     }
@@ -209,59 +1024,49 @@ bool DatabaseManager::createDatabase(const std::string &filepath) {
         }
     }
 
+    // Таблицы созданы - доводим схему (индексы и т.п.) до последней версии
+    checkAndUpdateDatabaseSchema();
+
     return true;
 }
 
-// Callback функция для getKosguEntries
-static int kosgu_select_callback(void *data, int argc, char **argv,
-                                 char **azColName) {
-    std::vector<Kosgu> *kosgu_list = static_cast<std::vector<Kosgu> *>(data);
-    Kosgu entry;
-    for (int i = 0; i < argc; i++) {
-        std::string colName = azColName[i];
-        if (colName == "id") {
-            entry.id = argv[i] ? std::stoi(argv[i]) : -1;
-        } else if (colName == "code") {
-            entry.code = argv[i] ? argv[i] : "";
-        } else if (colName == "name") {
-            entry.name = argv[i] ? argv[i] : "";
-        } else if (colName == "note") {
-            entry.note = argv[i] ? argv[i] : "";
-        } else if (colName == "total_amount") {
-            entry.total_amount = argv[i] ? std::stod(argv[i]) : 0.0;
-        }
-    }
-    kosgu_list->push_back(entry);
-    return 0;
-}
+using KosguRow = RowDecoder<&Kosgu::id, &Kosgu::code, &Kosgu::name,
+                            &Kosgu::note, &Kosgu::total_amount>;
 
 std::vector<Kosgu> DatabaseManager::getKosguEntries() {
+    DB_STATS_SCOPE();
     std::vector<Kosgu> entries;
     if (!db)
         return entries;
 
+    // Итоги берутся из KosguTotals (поддерживается триггерами)
     std::string sql =
-        "SELECT k.id, k.code, k.name, k.note, IFNULL(SUM(pd.amount), "
+        "SELECT k.id, k.code, k.name, k.note, IFNULL(t.total, "
         "0.0) as total_amount "
         "FROM KOSGU k "
-        "LEFT JOIN PaymentDetails pd ON k.id = pd.kosgu_id "
-        "GROUP BY k.id, k.code, k.name, k.note;";
-    char *errmsg = nullptr;
-    int rc =
-        sqlite3_exec(db, sql.c_str(), kosgu_select_callback, &entries, &errmsg);
-    if (rc != SQLITE_OK) {
-        std::cerr << "Failed to select KOSGU entries: " << errmsg << std::endl;
-        sqlite3_free(errmsg);
-    }
+        "LEFT JOIN KosguTotals t ON t.kosgu_id = k.id;";
+    selectRows<KosguRow>(sql, entries, "KOSGU entries");
     return entries;
 }
 
+bool DatabaseManager::getKosguEntryById(int id, Kosgu &entry) {
+    DB_STATS_SCOPE();
+    std::string sql =
+        "SELECT k.id, k.code, k.name, k.note, IFNULL(t.total, "
+        "0.0) as total_amount "
+        "FROM KOSGU k "
+        "LEFT JOIN KosguTotals t ON t.kosgu_id = k.id "
+        "WHERE k.id = ?;";
+    return selectRowById<KosguRow>(sql, id, entry);
+}
+
 bool DatabaseManager::addKosguEntry(Kosgu &entry) {
+    DB_STATS_SCOPE();
     if (!db)
         return false;
     std::string sql = "INSERT INTO KOSGU (code, name, note) VALUES (?, ?, ?);";
     sqlite3_stmt *stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(db)
                   << std::endl;
@@ -277,21 +1082,22 @@ bool DatabaseManager::addKosguEntry(Kosgu &entry) {
         std::cerr << "Failed to add KOSGU entry: " << sqlite3_errmsg(db)
                   << " (code: " << rc << ", extended code: " << extended_code
                   << ")" << std::endl;
-        sqlite3_finalize(stmt);
+        releaseCached(stmt);
         return false;
     }
     entry.id = sqlite3_last_insert_rowid(db);
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
     return true;
 }
 
 bool DatabaseManager::updateKosguEntry(const Kosgu &entry) {
+    DB_STATS_SCOPE();
     if (!db)
         return false;
     std::string sql =
         "UPDATE KOSGU SET code = ?, name = ?, note = ? WHERE id = ?;";
     sqlite3_stmt *stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(db)
                   << std::endl;
@@ -303,7 +1109,7 @@ bool DatabaseManager::updateKosguEntry(const Kosgu &entry) {
     sqlite3_bind_int(stmt, 4, entry.id);
 
     rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
 
     if (rc != SQLITE_DONE) {
         int extended_code = sqlite3_extended_errcode(db);
@@ -316,11 +1122,12 @@ bool DatabaseManager::updateKosguEntry(const Kosgu &entry) {
 }
 
 bool DatabaseManager::deleteKosguEntry(int id) {
+    DB_STATS_SCOPE();
     if (!db)
         return false;
     std::string sql = "DELETE FROM KOSGU WHERE id = ?;";
     sqlite3_stmt *stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(db)
                   << std::endl;
@@ -329,7 +1136,7 @@ bool DatabaseManager::deleteKosguEntry(int id) {
     sqlite3_bind_int(stmt, 1, id);
 
     rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
 
     if (rc != SQLITE_DONE) {
         int extended_code = sqlite3_extended_errcode(db);
@@ -342,11 +1149,12 @@ bool DatabaseManager::deleteKosguEntry(int id) {
 }
 
 int DatabaseManager::getKosguIdByCode(const std::string &code) {
+    DB_STATS_SCOPE();
     if (!db)
         return -1;
     std::string sql = "SELECT id FROM KOSGU WHERE code = ?;";
     sqlite3_stmt *stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement for KOSGU lookup by code: "
                   << sqlite3_errmsg(db) << std::endl;
@@ -358,18 +1166,19 @@ int DatabaseManager::getKosguIdByCode(const std::string &code) {
     if (sqlite3_step(stmt) == SQLITE_ROW) {
         id = sqlite3_column_int(stmt, 0);
     }
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
     return id;
 }
 
 // Counterparty CRUD
 bool DatabaseManager::addCounterparty(Counterparty &counterparty) {
+    DB_STATS_SCOPE();
     if (!db)
         return false;
     std::string sql = "INSERT INTO Counterparties (name, inn, "
                       "is_contract_optional) VALUES (?, ?, ?);";
     sqlite3_stmt *stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(db)
                   << std::endl;
@@ -389,22 +1198,23 @@ bool DatabaseManager::addCounterparty(Counterparty &counterparty) {
         std::cerr << "Failed to add counterparty: " << sqlite3_errmsg(db)
                   << " (code: " << rc << ", extended code: " << extended_code
                   << ")" << std::endl;
-        sqlite3_finalize(stmt);
+        releaseCached(stmt);
         return false;
     }
     counterparty.id = sqlite3_last_insert_rowid(db);
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
     return true;
 }
 
 int DatabaseManager::getCounterpartyIdByNameInn(const std::string &name,
                                                 const std::string &inn) {
+    DB_STATS_SCOPE();
     if (!db)
         return -1;
     std::string sql =
         "SELECT id FROM Counterparties WHERE name = ? AND inn = ?;";
     sqlite3_stmt *stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(db)
                   << std::endl;
@@ -417,11 +1227,12 @@ int DatabaseManager::getCounterpartyIdByNameInn(const std::string &name,
     if (sqlite3_step(stmt) == SQLITE_ROW) {
         id = sqlite3_column_int(stmt, 0);
     }
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
     return id;
 }
 
 int DatabaseManager::getCounterpartyIdByName(const std::string &name) {
+    DB_STATS_SCOPE();
     if (!db)
         return -1;
     std::string sql =
@@ -430,7 +1241,7 @@ int DatabaseManager::getCounterpartyIdByName(const std::string &name) {
                                                                          // NULL
                                                                          // INN
     sqlite3_stmt *stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr
             << "Failed to prepare statement for counterparty lookup by name: "
@@ -443,67 +1254,39 @@ int DatabaseManager::getCounterpartyIdByName(const std::string &name) {
     if (sqlite3_step(stmt) == SQLITE_ROW) {
         id = sqlite3_column_int(stmt, 0);
     }
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
     return id;
 }
 
-// Callback функция для getCounterparties
-static int counterparty_select_callback(void *data, int argc, char **argv,
-                                        char **azColName) {
-    std::vector<Counterparty> *counterparty_list =
-        static_cast<std::vector<Counterparty> *>(data);
-    Counterparty entry;
-    for (int i = 0; i < argc; i++) {
-        std::string colName = azColName[i];
-        if (colName == "id") {
-            entry.id = argv[i] ? std::stoi(argv[i]) : -1;
-        } else if (colName == "name") {
-            entry.name = argv[i] ? argv[i] : "";
-        } else if (colName == "inn") {
-            entry.inn = argv[i] ? argv[i] : "";
-        } else if (colName == "is_contract_optional") {
-            entry.is_contract_optional =
-                argv[i] ? (std::stoi(argv[i]) == 1) : false;
-        } else if (colName == "total_amount") {
-            entry.total_amount = argv[i] ? std::stod(argv[i]) : 0.0;
-        }
-    }
-    counterparty_list->push_back(entry);
-    return 0;
-}
+using CounterpartyRow =
+    RowDecoder<&Counterparty::id, &Counterparty::name, &Counterparty::inn,
+               &Counterparty::is_contract_optional,
+               &Counterparty::total_amount>;
 
 std::vector<Counterparty> DatabaseManager::getCounterparties() {
+    DB_STATS_SCOPE();
     std::vector<Counterparty> entries;
     if (!db)
         return entries;
 
+    // Итоги берутся из CounterpartyTotals (поддерживается триггерами)
     std::string sql = "SELECT c.id, c.name, c.inn, c.is_contract_optional, "
-                      "IFNULL(p_sum.total, 0.0) as total_amount "
+                      "IFNULL(t.total, 0.0) as total_amount "
                       "FROM Counterparties c "
-                      "LEFT JOIN ( "
-                      "    SELECT counterparty_id, SUM(amount) as total "
-                      "    FROM Payments "
-                      "    WHERE counterparty_id IS NOT NULL "
-                      "    GROUP BY counterparty_id "
-                      ") p_sum ON c.id = p_sum.counterparty_id;";
-    char *errmsg = nullptr;
-    int rc = sqlite3_exec(db, sql.c_str(), counterparty_select_callback,
-                          &entries, &errmsg);
-    if (rc != SQLITE_OK) {
-        std::cerr << "Failed to select Counterparty entries: " << errmsg
-                  << std::endl;
-        sqlite3_free(errmsg);
-    }
+                      "LEFT JOIN CounterpartyTotals t "
+                      "ON t.counterparty_id = c.id;";
+    selectRows<CounterpartyRow>(sql, entries, "Counterparty entries");
     return entries;
 }
 
 bool DatabaseManager::updateCounterparty(const Counterparty &counterparty) {
+    DB_STATS_SCOPE();
     if (!db)
         return false;
     std::string sql = "UPDATE Counterparties SET name = ?, inn = ?, "
                       "is_contract_optional = ? WHERE id = ?;";
     sqlite3_stmt *stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement for counterparty update: "
                   << sqlite3_errmsg(db) << std::endl;
@@ -519,7 +1302,7 @@ bool DatabaseManager::updateCounterparty(const Counterparty &counterparty) {
     sqlite3_bind_int(stmt, 4, counterparty.id);
 
     rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
 
     if (rc != SQLITE_DONE) {
         std::cerr << "Failed to update Counterparty entry: "
@@ -530,11 +1313,12 @@ bool DatabaseManager::updateCounterparty(const Counterparty &counterparty) {
 }
 
 bool DatabaseManager::deleteCounterparty(int id) {
+    DB_STATS_SCOPE();
     if (!db)
         return false;
     std::string sql = "DELETE FROM Counterparties WHERE id = ?;";
     sqlite3_stmt *stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(db)
                   << std::endl;
@@ -543,7 +1327,7 @@ bool DatabaseManager::deleteCounterparty(int id) {
     sqlite3_bind_int(stmt, 1, id);
 
     rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
 
     if (rc != SQLITE_DONE) {
         std::cerr << "Failed to delete Counterparty entry: "
@@ -555,6 +1339,7 @@ bool DatabaseManager::deleteCounterparty(int id) {
 
 std::vector<ContractPaymentInfo>
 DatabaseManager::getPaymentInfoForCounterparty(int counterparty_id) {
+    DB_STATS_SCOPE();
     std::vector<ContractPaymentInfo> results;
     if (!db)
         return results;
@@ -567,7 +1352,7 @@ DatabaseManager::getPaymentInfoForCounterparty(int counterparty_id) {
                       "WHERE p.counterparty_id = ?;";
 
     sqlite3_stmt *stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+    if (prepareCached(sql, &stmt) != SQLITE_OK) {
         std::cerr
             << "Failed to prepare statement for getPaymentInfoForCounterparty: "
             << sqlite3_errmsg(db) << std::endl;
@@ -591,12 +1376,13 @@ DatabaseManager::getPaymentInfoForCounterparty(int counterparty_id) {
         results.push_back(info);
     }
 
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
     return results;
 }
 
 // Contract CRUD
 int DatabaseManager::addContract(Contract &contract) {
+    DB_STATS_SCOPE();
     if (!db)
         return -1;
     std::string sql = "INSERT INTO Contracts (number, date, counterparty_id, "
@@ -604,7 +1390,7 @@ int DatabaseManager::addContract(Contract &contract) {
                       "is_for_checking, is_for_special_control, is_found) "
                       "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?);";
     sqlite3_stmt *stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(db)
                   << std::endl;
@@ -617,7 +1403,7 @@ int DatabaseManager::addContract(Contract &contract) {
     } else {
         sqlite3_bind_null(stmt, 3);
     }
-    sqlite3_bind_double(stmt, 4, contract.contract_amount);
+    bindMoney(stmt, 4, contract.contract_amount);
     sqlite3_bind_text(stmt, 5, contract.end_date.c_str(), -1, SQLITE_STATIC);
     sqlite3_bind_text(stmt, 6, contract.procurement_code.c_str(), -1,
                       SQLITE_STATIC);
@@ -632,22 +1418,23 @@ int DatabaseManager::addContract(Contract &contract) {
         std::cerr << "Failed to add contract: " << sqlite3_errmsg(db)
                   << " (code: " << rc << ", extended code: " << extended_code
                   << ")" << std::endl;
-        sqlite3_finalize(stmt);
+        releaseCached(stmt);
         return -1;
     }
     int id = sqlite3_last_insert_rowid(db);
     contract.id = id; // Записываем ID в объект для последующего использования
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
     return id;
 }
 
 int DatabaseManager::getContractIdByNumberDate(const std::string &number,
                                                const std::string &date) {
+    DB_STATS_SCOPE();
     if (!db)
         return -1;
     std::string sql = "SELECT id FROM Contracts WHERE number = ? AND date = ?;";
     sqlite3_stmt *stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(db)
                   << std::endl;
@@ -660,13 +1447,308 @@ int DatabaseManager::getContractIdByNumberDate(const std::string &number,
     if (sqlite3_step(stmt) == SQLITE_ROW) {
         id = sqlite3_column_int(stmt, 0);
     }
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
     return id;
 }
 
+// ==================== Справочники идентификаторов ====================
+
+static std::string contractReferenceKey(const std::string &number,
+                                        const std::string &date) {
+    return number + '\x1f' + date;
+}
+
+void DatabaseManager::invalidateReferenceCache() {
+    kosguByCode = ReferenceMap();
+    counterpartyByName = ReferenceMap();
+    contractByNumberDate = ReferenceMap();
+    referenceCheckedInTransaction = false;
+}
+
+// Проверяет, не меняли ли базу другие соединения (тогда справочники
+// сбрасываются), и загружает справочник, если он ещё не загружен. Внутри
+// транзакции data_version проверяется один раз: пока транзакция пишет,
+// другие соединения базу не меняют.
+bool DatabaseManager::prepareReferenceMap(ReferenceMap &map, const char *sql) {
+    if (!db)
+        return false;
+
+    bool in_transaction = inTransaction();
+    if (!in_transaction || !referenceCheckedInTransaction) {
+        sqlite3_stmt *stmt = nullptr;
+        if (prepareCached("PRAGMA data_version;", &stmt) != SQLITE_OK) {
+            std::cerr << "Failed to read data_version: " << sqlite3_errmsg(db)
+                      << std::endl;
+            return false;
+        }
+        long long version = -1;
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            version = sqlite3_column_int64(stmt, 0);
+        }
+        releaseCached(stmt);
+        if (version != referenceDataVersion) {
+            invalidateReferenceCache();
+            referenceDataVersion = version;
+        }
+        referenceCheckedInTransaction = in_transaction;
+    }
+    if (map.loaded)
+        return true;
+
+    // Запрос возвращает (ключ, id) по возрастанию id; при повторяющихся
+    // ключах остаётся меньший id, как у прежних поисковых запросов
+    sqlite3_stmt *stmt = nullptr;
+    if (prepareCached(sql, &stmt) != SQLITE_OK) {
+        std::cerr << "Failed to load reference map: " << sqlite3_errmsg(db)
+                  << std::endl;
+        return false;
+    }
+    std::string key;
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        readColumn(stmt, 0, key);
+        map.ids.emplace(key, sqlite3_column_int(stmt, 1));
+    }
+    releaseCached(stmt);
+    if (rc != SQLITE_DONE) {
+        std::cerr << "Failed to load reference map: " << sqlite3_errmsg(db)
+                  << std::endl;
+        map.ids.clear();
+        return false;
+    }
+    map.loaded = true;
+    return true;
+}
+
+static const char *KOSGU_REFERENCE_SQL =
+    "SELECT code, id FROM KOSGU ORDER BY id;";
+static const char *COUNTERPARTY_REFERENCE_SQL =
+    "SELECT name, id FROM Counterparties WHERE inn IS NULL ORDER BY id;";
+static const char *CONTRACT_REFERENCE_SQL =
+    "SELECT number || char(31) || date, id FROM Contracts ORDER BY id;";
+
+// Добавляет коды КОСГУ многострочными INSERT ... ON CONFLICT(code) DO
+// NOTHING и дочитывает их id одним SELECT ... IN на каждую порцию
+bool DatabaseManager::insertMissingKosgu(const std::vector<std::string> &codes) {
+    const size_t chunk_size = 200; // 2 параметра на строку, < 999
+    for (size_t begin = 0; begin < codes.size(); begin += chunk_size) {
+        size_t end = std::min(codes.size(), begin + chunk_size);
+        size_t count = end - begin;
+
+        std::string insert_sql = "INSERT INTO KOSGU (code, name) VALUES ";
+        std::string select_sql = "SELECT code, id FROM KOSGU WHERE code IN (";
+        for (size_t i = 0; i < count; i++) {
+            insert_sql += i ? ", (?, ?)" : "(?, ?)";
+            select_sql += i ? ", ?" : "?";
+        }
+        insert_sql += " ON CONFLICT(code) DO NOTHING;";
+        select_sql += ");";
+
+        sqlite3_stmt *stmt = nullptr;
+        if (prepareCached(insert_sql, &stmt) != SQLITE_OK) {
+            std::cerr << "Failed to prepare KOSGU batch insert: "
+                      << sqlite3_errmsg(db) << std::endl;
+            return false;
+        }
+        std::vector<std::string> names;
+        names.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            names.push_back("КОСГУ " + codes[begin + i]);
+            sqlite3_bind_text(stmt, (int)(2 * i + 1), codes[begin + i].c_str(),
+                              -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, (int)(2 * i + 2), names[i].c_str(), -1,
+                              SQLITE_STATIC);
+        }
+        int rc = sqlite3_step(stmt);
+        releaseCached(stmt);
+        if (rc != SQLITE_DONE) {
+            std::cerr << "Failed to insert KOSGU batch: " << sqlite3_errmsg(db)
+                      << std::endl;
+            return false;
+        }
+
+        if (prepareCached(select_sql, &stmt) != SQLITE_OK) {
+            std::cerr << "Failed to prepare KOSGU batch lookup: "
+                      << sqlite3_errmsg(db) << std::endl;
+            return false;
+        }
+        for (size_t i = 0; i < count; i++) {
+            sqlite3_bind_text(stmt, (int)(i + 1), codes[begin + i].c_str(), -1,
+                              SQLITE_STATIC);
+        }
+        std::string code;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            readColumn(stmt, 0, code);
+            kosguByCode.ids.emplace(code, sqlite3_column_int(stmt, 1));
+        }
+        releaseCached(stmt);
+        if (rc != SQLITE_DONE) {
+            std::cerr << "Failed to read KOSGU batch ids: "
+                      << sqlite3_errmsg(db) << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool DatabaseManager::resolveKosguIds(const std::vector<std::string> &codes,
+                                      std::vector<int> &ids, bool create) {
+    DB_STATS_SCOPE();
+    ids.assign(codes.size(), -1);
+    if (!prepareReferenceMap(kosguByCode, KOSGU_REFERENCE_SQL))
+        return false;
+
+    std::vector<std::string> missing;
+    std::unordered_set<std::string> missing_set;
+    for (size_t i = 0; i < codes.size(); i++) {
+        auto it = kosguByCode.ids.find(codes[i]);
+        if (it != kosguByCode.ids.end()) {
+            ids[i] = it->second;
+        } else if (create && !codes[i].empty() &&
+                   missing_set.insert(codes[i]).second) {
+            missing.push_back(codes[i]);
+        }
+    }
+    if (missing.empty())
+        return true;
+
+    // Точка сохранения: пакет добавляется целиком или не добавляется
+    if (!executeCached("SAVEPOINT reference_insert;"))
+        return false;
+    if (!insertMissingKosgu(missing)) {
+        rollbackToSavepoint("reference_insert");
+        executeCached("RELEASE SAVEPOINT reference_insert;");
+        return false;
+    }
+    executeCached("RELEASE SAVEPOINT reference_insert;");
+
+    for (size_t i = 0; i < codes.size(); i++) {
+        if (ids[i] == -1) {
+            auto it = kosguByCode.ids.find(codes[i]);
+            if (it != kosguByCode.ids.end())
+                ids[i] = it->second;
+        }
+    }
+    return true;
+}
+
+bool DatabaseManager::resolveCounterpartyIds(
+    const std::vector<std::string> &names, std::vector<int> &ids,
+    bool create) {
+    DB_STATS_SCOPE();
+    ids.assign(names.size(), -1);
+    if (!prepareReferenceMap(counterpartyByName, COUNTERPARTY_REFERENCE_SQL))
+        return false;
+
+    bool savepoint_open = false;
+    bool success = true;
+    for (size_t i = 0; i < names.size(); i++) {
+        auto it = counterpartyByName.ids.find(names[i]);
+        if (it != counterpartyByName.ids.end()) {
+            ids[i] = it->second;
+            continue;
+        }
+        if (!create || names[i].empty())
+            continue;
+        // У наименования нет уникального ключа, поэтому без ON CONFLICT:
+        // справочник полон, и отсутствующее в нём наименование в базе тоже
+        // отсутствует
+        if (!savepoint_open) {
+            if (!executeCached("SAVEPOINT reference_insert;"))
+                return false;
+            savepoint_open = true;
+        }
+        Counterparty counterparty{-1, names[i], ""};
+        if (!addCounterparty(counterparty)) {
+            success = false;
+            break;
+        }
+        counterpartyByName.ids.emplace(names[i], counterparty.id);
+        ids[i] = counterparty.id;
+    }
+    if (savepoint_open) {
+        if (!success) {
+            rollbackToSavepoint("reference_insert");
+            ids.assign(names.size(), -1);
+        }
+        executeCached("RELEASE SAVEPOINT reference_insert;");
+    }
+    return success;
+}
+
+bool DatabaseManager::resolveContractIds(
+    const std::vector<std::pair<std::string, std::string>> &keys,
+    const std::vector<int> &counterparty_ids, std::vector<int> &ids,
+    bool create) {
+    DB_STATS_SCOPE();
+    ids.assign(keys.size(), -1);
+    if (!prepareReferenceMap(contractByNumberDate, CONTRACT_REFERENCE_SQL))
+        return false;
+
+    bool savepoint_open = false;
+    bool success = true;
+    for (size_t i = 0; i < keys.size(); i++) {
+        std::string key = contractReferenceKey(keys[i].first, keys[i].second);
+        auto it = contractByNumberDate.ids.find(key);
+        if (it != contractByNumberDate.ids.end()) {
+            ids[i] = it->second;
+            continue;
+        }
+        if (!create || keys[i].first.empty())
+            continue;
+        if (!savepoint_open) {
+            if (!executeCached("SAVEPOINT reference_insert;"))
+                return false;
+            savepoint_open = true;
+        }
+        int counterparty_id =
+            i < counterparty_ids.size() ? counterparty_ids[i] : -1;
+        Contract contract{-1, keys[i].first, keys[i].second, counterparty_id};
+        if (addContract(contract) == -1) {
+            success = false;
+            break;
+        }
+        contractByNumberDate.ids.emplace(key, contract.id);
+        ids[i] = contract.id;
+    }
+    if (savepoint_open) {
+        if (!success) {
+            rollbackToSavepoint("reference_insert");
+            ids.assign(keys.size(), -1);
+        }
+        executeCached("RELEASE SAVEPOINT reference_insert;");
+    }
+    return success;
+}
+
+int DatabaseManager::resolveKosguId(const std::string &code, bool create) {
+    DB_STATS_SCOPE();
+    std::vector<int> ids;
+    resolveKosguIds({code}, ids, create);
+    return ids[0];
+}
+
+int DatabaseManager::resolveCounterpartyId(const std::string &name,
+                                           bool create) {
+    DB_STATS_SCOPE();
+    std::vector<int> ids;
+    resolveCounterpartyIds({name}, ids, create);
+    return ids[0];
+}
+
+int DatabaseManager::resolveContractId(const std::string &number,
+                                       const std::string &date,
+                                       int counterparty_id, bool create) {
+    DB_STATS_SCOPE();
+    std::vector<int> ids;
+    resolveContractIds({{number, date}}, {counterparty_id}, ids, create);
+    return ids[0];
+}
+
 int DatabaseManager::updateContractProcurementCode(
     const std::string &number, const std::string &date,
     const std::string &procurement_code) {
+    DB_STATS_SCOPE();
     if (!db)
         return 0;
     std::string sql =
@@ -674,7 +1756,7 @@ int DatabaseManager::updateContractProcurementCode(
         "(date = ? OR date = ?) AND (procurement_code IS NULL OR "
         "procurement_code = '');";
     sqlite3_stmt *stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr
             << "Failed to prepare statement for contract procurement code "
@@ -696,7 +1778,7 @@ int DatabaseManager::updateContractProcurementCode(
     sqlite3_bind_text(stmt, 4, date_ddmmyyyy.c_str(), -1, SQLITE_STATIC);
 
     int rc_step = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
 
     if (rc_step != SQLITE_DONE) {
         std::cerr << "Failed to update Contract procurement code: "
@@ -709,12 +1791,13 @@ int DatabaseManager::updateContractProcurementCode(
 
 bool DatabaseManager::updateContractProcurementCode(
     int contract_id, const std::string &procurement_code) {
+    DB_STATS_SCOPE();
     if (!db)
         return false;
 
     std::string sql = "UPDATE Contracts SET procurement_code = ? WHERE id = ?;";
     sqlite3_stmt *stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement for "
                      "updateContractProcurementCode by id: "
@@ -725,7 +1808,7 @@ bool DatabaseManager::updateContractProcurementCode(
     sqlite3_bind_int(stmt, 2, contract_id);
 
     int rc_step = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
 
     if (rc_step != SQLITE_DONE) {
         std::cerr << "Failed to update Contract procurement code by id: "
@@ -735,46 +1818,16 @@ bool DatabaseManager::updateContractProcurementCode(
     return true;
 }
 
-// Callback функция для getContracts
-static int contract_select_callback(void *data, int argc, char **argv,
-                                    char **azColName) {
-    std::vector<Contract> *contract_list =
-        static_cast<std::vector<Contract> *>(data);
-    Contract entry;
-    for (int i = 0; i < argc; i++) {
-        std::string colName = azColName[i];
-        if (colName == "id") {
-            entry.id = argv[i] ? std::stoi(argv[i]) : -1;
-        } else if (colName == "number") {
-            entry.number = argv[i] ? argv[i] : "";
-        } else if (colName == "date") {
-            entry.date = argv[i] ? argv[i] : "";
-        } else if (colName == "counterparty_id") {
-            entry.counterparty_id = argv[i] ? std::stoi(argv[i]) : -1;
-        } else if (colName == "total_amount") {
-            entry.total_amount = argv[i] ? std::stod(argv[i]) : 0.0;
-        } else if (colName == "contract_amount") {
-            entry.contract_amount = argv[i] ? std::stod(argv[i]) : 0.0;
-        } else if (colName == "end_date") {
-            entry.end_date = argv[i] ? argv[i] : "";
-        } else if (colName == "procurement_code") {
-            entry.procurement_code = argv[i] ? argv[i] : "";
-        } else if (colName == "note") {
-            entry.note = argv[i] ? argv[i] : "";
-        } else if (colName == "is_for_checking") {
-            entry.is_for_checking = argv[i] ? (std::stoi(argv[i]) == 1) : false;
-        } else if (colName == "is_for_special_control") {
-            entry.is_for_special_control =
-                argv[i] ? (std::stoi(argv[i]) == 1) : false;
-        } else if (colName == "is_found") {
-            entry.is_found = argv[i] ? (std::stoi(argv[i]) == 1) : false;
-        }
-    }
-    contract_list->push_back(entry);
-    return 0;
-}
+using ContractRow =
+    RowDecoder<&Contract::id, &Contract::number, &Contract::date,
+               &Contract::counterparty_id, &Contract::contract_amount,
+               &Contract::end_date, &Contract::procurement_code,
+               &Contract::note, &Contract::is_for_checking,
+               &Contract::is_for_special_control, &Contract::is_found,
+               &Contract::total_amount>;
 
 std::vector<Contract> DatabaseManager::getContracts() {
+    DB_STATS_SCOPE();
     std::vector<Contract> entries;
     if (!db)
         return entries;
@@ -782,22 +1835,27 @@ std::vector<Contract> DatabaseManager::getContracts() {
     std::string sql = "SELECT c.id, c.number, c.date, c.counterparty_id, "
                       "c.contract_amount, c.end_date, c.procurement_code, "
                       "c.note, c.is_for_checking, c.is_for_special_control, "
-                      "c.is_found, IFNULL(SUM(pd.amount), 0.0) as total_amount "
+                      "c.is_found, IFNULL(t.total, 0.0) as total_amount "
                       "FROM Contracts c "
-                      "LEFT JOIN PaymentDetails pd ON c.id = pd.contract_id "
-                      "GROUP BY c.id, c.number, c.date, c.counterparty_id;";
-    char *errmsg = nullptr;
-    int rc = sqlite3_exec(db, sql.c_str(), contract_select_callback, &entries,
-                          &errmsg);
-    if (rc != SQLITE_OK) {
-        std::cerr << "Failed to select Contract entries: " << errmsg
-                  << std::endl;
-        sqlite3_free(errmsg);
-    }
+                      "LEFT JOIN ContractTotals t ON t.contract_id = c.id;";
+    selectRows<ContractRow>(sql, entries, "Contract entries");
     return entries;
 }
 
+bool DatabaseManager::getContractById(int id, Contract &contract) {
+    DB_STATS_SCOPE();
+    std::string sql = "SELECT c.id, c.number, c.date, c.counterparty_id, "
+                      "c.contract_amount, c.end_date, c.procurement_code, "
+                      "c.note, c.is_for_checking, c.is_for_special_control, "
+                      "c.is_found, IFNULL(t.total, 0.0) as total_amount "
+                      "FROM Contracts c "
+                      "LEFT JOIN ContractTotals t ON t.contract_id = c.id "
+                      "WHERE c.id = ?;";
+    return selectRowById<ContractRow>(sql, id, contract);
+}
+
 bool DatabaseManager::updateContract(const Contract &contract) {
+    DB_STATS_SCOPE();
     if (!db)
         return false;
     std::string sql = "UPDATE Contracts SET number = ?, date = ?, "
@@ -805,7 +1863,7 @@ bool DatabaseManager::updateContract(const Contract &contract) {
                       "procurement_code = ?, note = ?, is_for_checking = ?, "
                       "is_for_special_control = ?, is_found = ? WHERE id = ?;";
     sqlite3_stmt *stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement for contract update: "
                   << sqlite3_errmsg(db) << std::endl;
@@ -818,7 +1876,7 @@ bool DatabaseManager::updateContract(const Contract &contract) {
     } else {
         sqlite3_bind_null(stmt, 3);
     }
-    sqlite3_bind_double(stmt, 4, contract.contract_amount);
+    bindMoney(stmt, 4, contract.contract_amount);
     sqlite3_bind_text(stmt, 5, contract.end_date.c_str(), -1, SQLITE_STATIC);
     sqlite3_bind_text(stmt, 6, contract.procurement_code.c_str(), -1,
                       SQLITE_STATIC);
@@ -829,7 +1887,7 @@ bool DatabaseManager::updateContract(const Contract &contract) {
     sqlite3_bind_int(stmt, 11, contract.id);
 
     int rc_step = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
 
     if (rc_step != SQLITE_DONE) {
         std::cerr << "Failed to update Contract entry: " << sqlite3_errmsg(db)
@@ -840,11 +1898,12 @@ bool DatabaseManager::updateContract(const Contract &contract) {
 }
 
 bool DatabaseManager::deleteContract(int id) {
+    DB_STATS_SCOPE();
     if (!db)
         return false;
     std::string sql = "DELETE FROM Contracts WHERE id = ?;";
     sqlite3_stmt *stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(db)
                   << std::endl;
@@ -853,7 +1912,7 @@ bool DatabaseManager::deleteContract(int id) {
     sqlite3_bind_int(stmt, 1, id);
 
     int rc_step = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
 
     if (rc_step != SQLITE_DONE) {
         std::cerr << "Failed to delete Contract entry: " << sqlite3_errmsg(db)
@@ -865,13 +1924,14 @@ bool DatabaseManager::deleteContract(int id) {
 
 bool DatabaseManager::updateContractFlags(int contract_id, bool is_for_checking,
                                           bool is_for_special_control) {
+    DB_STATS_SCOPE();
     if (!db)
         return false;
 
     std::string sql = "UPDATE Contracts SET is_for_checking = ?, "
                       "is_for_special_control = ? WHERE id = ?;";
     sqlite3_stmt *stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement for updateContractFlags: "
                   << sqlite3_errmsg(db) << std::endl;
@@ -882,7 +1942,7 @@ bool DatabaseManager::updateContractFlags(int contract_id, bool is_for_checking,
     sqlite3_bind_int(stmt, 3, contract_id);
 
     rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
 
     if (rc != SQLITE_DONE) {
         std::cerr << "Failed to update contract flags: " << sqlite3_errmsg(db)
@@ -894,13 +1954,14 @@ bool DatabaseManager::updateContractFlags(int contract_id, bool is_for_checking,
 
 void DatabaseManager::transferPaymentDetails(int from_contract_id,
                                              int to_contract_id) {
+    DB_STATS_SCOPE();
     if (!db)
         return;
 
     std::string sql =
         "UPDATE PaymentDetails SET contract_id = ? WHERE contract_id = ?;";
     sqlite3_stmt *stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr
             << "Failed to prepare statement for transferring payment details: "
@@ -912,7 +1973,7 @@ void DatabaseManager::transferPaymentDetails(int from_contract_id,
     sqlite3_bind_int(stmt, 2, from_contract_id);
 
     rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
 
     if (rc != SQLITE_DONE) {
         std::cerr << "Failed to transfer payment details: "
@@ -922,6 +1983,7 @@ void DatabaseManager::transferPaymentDetails(int from_contract_id,
 
 std::vector<ContractPaymentInfo>
 DatabaseManager::getPaymentInfoForContract(int contract_id) {
+    DB_STATS_SCOPE();
     std::vector<ContractPaymentInfo> results;
     if (!db)
         return results;
@@ -934,7 +1996,7 @@ DatabaseManager::getPaymentInfoForContract(int contract_id) {
         "WHERE pd.contract_id = ?;";
 
     sqlite3_stmt *stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+    if (prepareCached(sql, &stmt) != SQLITE_OK) {
         std::cerr
             << "Failed to prepare statement for getPaymentInfoForContract: "
             << sqlite3_errmsg(db) << std::endl;
@@ -958,12 +2020,13 @@ DatabaseManager::getPaymentInfoForContract(int contract_id) {
         results.push_back(info);
     }
 
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
     return results;
 }
 
 // Payment CRUD
 bool DatabaseManager::addPayment(Payment &payment) {
+    DB_STATS_SCOPE();
     if (!db)
         return false;
 
@@ -976,7 +2039,7 @@ bool DatabaseManager::addPayment(Payment &payment) {
                       "recipient, description, counterparty_id, note) "
                       "VALUES (?, ?, ?, ?, ?, ?, ?, ?);";
     sqlite3_stmt *stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(db)
                   << std::endl;
@@ -985,7 +2048,7 @@ bool DatabaseManager::addPayment(Payment &payment) {
     sqlite3_bind_text(stmt, 1, payment.date.c_str(), -1, SQLITE_STATIC);
     sqlite3_bind_text(stmt, 2, payment.doc_number.c_str(), -1, SQLITE_STATIC);
     sqlite3_bind_int(stmt, 3, payment.type ? 1 : 0);
-    sqlite3_bind_double(stmt, 4, payment.amount);
+    bindMoney(stmt, 4, payment.amount);
     sqlite3_bind_text(stmt, 5, payment.recipient.c_str(), -1, SQLITE_STATIC);
     sqlite3_bind_text(stmt, 6, payment.description.c_str(), -1, SQLITE_STATIC);
     if (payment.counterparty_id != -1) {
@@ -1001,62 +2064,448 @@ bool DatabaseManager::addPayment(Payment &payment) {
         std::cerr << "Failed to add payment: " << sqlite3_errmsg(db)
                   << " (code: " << rc << ", extended code: " << extended_code
                   << ")" << std::endl;
-        sqlite3_finalize(stmt);
+        releaseCached(stmt);
         return false;
     }
     payment.id = sqlite3_last_insert_rowid(db);
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
     return true;
 }
 
-// Callback for getPayments
-static int payment_select_callback(void *data, int argc, char **argv,
-                                   char **azColName) {
-    auto *payments = static_cast<std::vector<Payment> *>(data);
-    Payment p;
-    for (int i = 0; i < argc; i++) {
-        std::string colName = azColName[i];
-        if (colName == "id")
-            p.id = argv[i] ? std::stoi(argv[i]) : -1;
-        else if (colName == "date")
-            p.date = argv[i] ? argv[i] : "";
-        else if (colName == "doc_number")
-            p.doc_number = argv[i] ? argv[i] : "";
-        else if (colName == "type")
-            p.type = (argv[i] && std::stoi(argv[i]) == 1);
-        else if (colName == "amount")
-            p.amount = argv[i] ? std::stod(argv[i]) : 0.0;
-        else if (colName == "recipient")
-            p.recipient = argv[i] ? argv[i] : "";
-        else if (colName == "description")
-            p.description = argv[i] ? argv[i] : "";
-        else if (colName == "counterparty_id")
-            p.counterparty_id = argv[i] ? std::stoi(argv[i]) : -1;
-        else if (colName == "note")
-            p.note = argv[i] ? argv[i] : "";
-    }
-    payments->push_back(p);
-    return 0;
+using PaymentRow =
+    RowDecoder<&Payment::id, &Payment::date, &Payment::doc_number,
+               &Payment::type, &Payment::amount, &Payment::recipient,
+               &Payment::description, &Payment::counterparty_id,
+               &Payment::note>;
+
+RowCursor<Payment> DatabaseManager::openPaymentsCursor() {
+    DB_STATS_SCOPE();
+    std::string sql = "SELECT id, date, doc_number, type, amount, recipient, "
+                      "description, counterparty_id, note FROM Payments "
+                      "ORDER BY id;";
+    return openCursor<Payment>(sql, &PaymentRow::decode<Payment>, "Payments");
 }
 
 std::vector<Payment> DatabaseManager::getPayments() {
+    DB_STATS_SCOPE();
     std::vector<Payment> payments;
+    RowCursor<Payment> cursor = openPaymentsCursor();
+    drainCursor(cursor, payments);
+    return payments;
+}
+
+bool DatabaseManager::getPaymentById(int id, Payment &payment) {
+    DB_STATS_SCOPE();
+    std::string sql = "SELECT id, date, doc_number, type, amount, recipient, "
+                      "description, counterparty_id, note FROM Payments "
+                      "WHERE id = ?;";
+    return selectRowById<PaymentRow>(sql, id, payment);
+}
+
+// Условие WHERE списка платежей (таблицы p - Payments, c - Counterparties).
+// Условие собирается из фиксированных фрагментов, пользовательский текст
+// передаётся только нумерованными параметрами (?1, ?2, ...), поэтому
+// условие можно повторить в одном запросе несколько раз.
+static std::string
+paymentListWhere(const DatabaseManager::PaymentListQuery &query,
+                 std::vector<std::string> &params) {
+    using Filter = DatabaseManager::PaymentListFilter;
+    auto param = [&params](const std::string &value) {
+        params.push_back(value);
+        return "?" + std::to_string(params.size());
+    };
+
+    std::string where = "1";
+    for (const auto &term : query.terms) {
+        std::string lowered = term;
+        std::transform(lowered.begin(), lowered.end(), lowered.begin(),
+                       ::tolower);
+        std::string match = DatabaseManager::buildFullTextQuery(term);
+        std::string text = param(lowered);
+        where += " AND (";
+        if (!match.empty()) {
+            where += "p.id IN (SELECT rowid FROM PaymentsFts "
+                     "WHERE PaymentsFts MATCH " + param(match) + ") OR ";
+        }
+        where += "instr(lower(p.date), " + text + ") > 0 "
+                 "OR instr(lower(IFNULL(p.doc_number, '')), " + text + ") > 0 "
+                 "OR instr(printf('%.2f', p.amount), " + text + ") > 0)";
+    }
+
+    // Период - диапазон по индексу idx_payments_date_day
+    if (query.date_from.valid()) {
+        where += " AND p.date_day >= " +
+                 param(std::to_string(query.date_from.days));
+    }
+    if (query.date_to.valid()) {
+        where += " AND p.date_day <= " +
+                 param(std::to_string(query.date_to.days));
+    }
+
+    const char *missing_detail = nullptr;
+    switch (query.filter) {
+    case Filter::All:
+        break;
+    case Filter::WithoutKosgu:
+        missing_detail = "kosgu_id";
+        break;
+    case Filter::WithoutContract:
+        missing_detail = "contract_id";
+        where += " AND IFNULL(c.is_contract_optional, 0) = 0";
+        break;
+    case Filter::WithoutInvoice:
+        missing_detail = "invoice_id";
+        break;
+    case Filter::WithoutDetails:
+        where += " AND NOT EXISTS (SELECT 1 FROM PaymentDetails pd "
+                 "WHERE pd.payment_id = p.id)";
+        break;
+    case Filter::SuspiciousWords:
+        where += " AND EXISTS (SELECT 1 FROM SuspiciousWords sw "
+                 "WHERE instr(lower(IFNULL(p.description, '')), "
+                 "lower(sw.word)) > 0)";
+        break;
+    case Filter::Incoming:
+        where += " AND p.type = 1";
+        break;
+    case Filter::WithNote:
+        where += " AND IFNULL(p.note, '') <> ''";
+        break;
+    }
+    if (missing_detail) {
+        where += std::string(" AND EXISTS (SELECT 1 FROM PaymentDetails pd "
+                             "WHERE pd.payment_id = p.id AND (pd.") +
+                 missing_detail + " IS NULL OR pd." + missing_detail +
+                 " = -1))";
+    }
+    return where;
+}
+
+static bool bindTextParams(sqlite3_stmt *stmt,
+                           const std::vector<std::string> &params) {
+    for (size_t i = 0; i < params.size(); i++) {
+        if (sqlite3_bind_text(stmt, (int)i + 1, params[i].c_str(), -1,
+                              SQLITE_TRANSIENT) != SQLITE_OK)
+            return false;
+    }
+    return true;
+}
+
+bool DatabaseManager::getPaymentIds(const PaymentListQuery &query,
+                                    std::vector<int> &ids) {
+    DB_STATS_SCOPE();
+    ids.clear();
     if (!db)
+        return false;
+
+    std::vector<std::string> params;
+    std::string where = paymentListWhere(query, params);
+
+    // Дата сортируется вместе с номером: такой порядок есть в индексе
+    // idx_payments_date, и без отбора выборка читается только из индекса
+    std::string order;
+    for (const auto &key : query.sort) {
+        static const char *columns[] = {
+            "p.date %s, IFNULL(p.doc_number, '') %s",
+            "IFNULL(p.doc_number, '') %s",
+            "p.amount %s",
+            "IFNULL(c.name, ' ') %s",
+            "IFNULL(p.description, '') %s",
+            "IFNULL(p.note, '') %s"};
+        if (key.column < 0 ||
+            key.column >= (int)(sizeof(columns) / sizeof(columns[0])))
+            continue;
+        const char *direction = key.descending ? "DESC" : "ASC";
+        char buf[128];
+        snprintf(buf, sizeof(buf), columns[key.column], direction, direction);
+        order += buf;
+        order += ", ";
+    }
+    bool descending = !query.sort.empty() && query.sort.front().descending;
+    order += descending ? "p.id DESC" : "p.id";
+
+    std::string sql = "SELECT p.id FROM Payments p "
+                      "LEFT JOIN Counterparties c ON c.id = p.counterparty_id "
+                      "WHERE " + where + " ORDER BY " + order + ";";
+    sqlite3_stmt *stmt = nullptr;
+    if (prepareCached(sql, &stmt) != SQLITE_OK) {
+        std::cerr << "Failed to prepare payment list query: "
+                  << sqlite3_errmsg(db) << std::endl;
+        return false;
+    }
+    bindTextParams(stmt, params);
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        ids.push_back(sqlite3_column_int(stmt, 0));
+    }
+    releaseCached(stmt);
+    if (rc != SQLITE_DONE) {
+        std::cerr << "Payment list query failed: " << sqlite3_errmsg(db)
+                  << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool DatabaseManager::getPaymentListTotals(const PaymentListQuery &query,
+                                           PaymentListTotals &totals) {
+    DB_STATS_SCOPE();
+    totals = PaymentListTotals();
+    if (!db)
+        return false;
+
+    std::vector<std::string> params;
+    std::string where = paymentListWhere(query, params);
+    // Расшифровки суммируются просмотром таблицы с соединением по первичному
+    // ключу платежа, а не поиском расшифровок каждого платежа
+    std::string sql =
+        "SELECT "
+        "(SELECT IFNULL(SUM(" SQL_KOPECKS("p.amount") "), 0) FROM Payments p "
+        " LEFT JOIN Counterparties c ON c.id = p.counterparty_id "
+        " WHERE " + where + "), "
+        "(SELECT IFNULL(SUM(" SQL_KOPECKS("pd.amount") "), 0) "
+        " FROM PaymentDetails pd "
+        " JOIN Payments p ON p.id = pd.payment_id "
+        " LEFT JOIN Counterparties c ON c.id = p.counterparty_id "
+        " WHERE " + where + ");";
+    sqlite3_stmt *stmt = nullptr;
+    if (prepareCached(sql, &stmt) != SQLITE_OK) {
+        std::cerr << "Failed to prepare payment totals query: "
+                  << sqlite3_errmsg(db) << std::endl;
+        return false;
+    }
+    bindTextParams(stmt, params);
+    bool success = sqlite3_step(stmt) == SQLITE_ROW;
+    if (success) {
+        totals.amount = columnMoney(stmt, 0);
+        totals.details_amount = columnMoney(stmt, 1);
+    } else {
+        std::cerr << "Payment totals query failed: " << sqlite3_errmsg(db)
+                  << std::endl;
+    }
+    releaseCached(stmt);
+    return success;
+}
+
+// Выборка платежей по списку id с постоянным числом параметров
+// (недостающие - -1), чтобы запрос брался из кэша при любом размере списка
+static const size_t paymentsByIdChunk = 64;
+
+static const std::string &paymentsByIdSql() {
+    static const std::string sql = []() {
+        std::string text = "SELECT id, date, doc_number, type, amount, "
+                           "recipient, description, counterparty_id, note "
+                           "FROM Payments WHERE id IN (";
+        for (size_t i = 0; i < paymentsByIdChunk; i++) {
+            text += i ? ", ?" : "?";
+        }
+        return text + ") ORDER BY id;";
+    }();
+    return sql;
+}
+
+static void bindPaymentIdChunk(sqlite3_stmt *stmt, const std::vector<int> &ids,
+                               size_t begin) {
+    for (size_t i = 0; i < paymentsByIdChunk; i++) {
+        size_t index = begin + i;
+        sqlite3_bind_int(stmt, (int)i + 1, index < ids.size() ? ids[index] : -1);
+    }
+}
+
+std::vector<Payment> DatabaseManager::getPaymentsByIds(const std::vector<int> &ids) {
+    DB_STATS_SCOPE();
+    std::vector<Payment> payments;
+    if (!db || ids.empty())
         return payments;
 
-    std::string sql = "SELECT id, date, doc_number, type, amount, recipient, "
-                      "description, counterparty_id, note FROM Payments;";
-    char *errmsg = nullptr;
-    int rc = sqlite3_exec(db, sql.c_str(), payment_select_callback, &payments,
-                          &errmsg);
-    if (rc != SQLITE_OK) {
-        std::cerr << "Failed to select Payments: " << errmsg << std::endl;
-        sqlite3_free(errmsg);
+    std::unordered_map<int, Payment> found;
+    for (size_t begin = 0; begin < ids.size(); begin += paymentsByIdChunk) {
+        sqlite3_stmt *stmt = nullptr;
+        if (prepareCached(paymentsByIdSql(), &stmt) != SQLITE_OK) {
+            std::cerr << "Failed to select payments by id: "
+                      << sqlite3_errmsg(db) << std::endl;
+            return payments;
+        }
+        bindPaymentIdChunk(stmt, ids, begin);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            Payment payment;
+            PaymentRow::decode(stmt, payment);
+            found.emplace(payment.id, std::move(payment));
+        }
+        releaseCached(stmt);
+    }
+
+    payments.reserve(found.size());
+    for (int id : ids) {
+        auto it = found.find(id);
+        if (it != found.end()) {
+            payments.push_back(std::move(it->second));
+        }
     }
     return payments;
 }
 
+static std::string_view columnView(sqlite3_stmt *stmt, int column) {
+    const char *text =
+        reinterpret_cast<const char *>(sqlite3_column_text(stmt, column));
+    return text ? std::string_view(text, sqlite3_column_bytes(stmt, column))
+                : std::string_view();
+}
+
+// Строка выборки платежей (столбцы как у PaymentRow) - в хранилище; текст
+// берётся прямо из буфера SQLite, без промежуточных std::string
+static void appendPaymentRow(sqlite3_stmt *stmt, PaymentStore &store) {
+    int counterparty_id = sqlite3_column_type(stmt, 7) == SQLITE_NULL
+                              ? -1
+                              : sqlite3_column_int(stmt, 7);
+    store.append(sqlite3_column_int(stmt, 0), columnView(stmt, 1),
+                 columnView(stmt, 2), sqlite3_column_int(stmt, 3) == 1,
+                 sqlite3_column_double(stmt, 4), columnView(stmt, 5),
+                 columnView(stmt, 6), counterparty_id, columnView(stmt, 8));
+}
+
+bool DatabaseManager::loadPaymentStore(PaymentStore &store) {
+    DB_STATS_SCOPE();
+    store.clear();
+    if (!db)
+        return false;
+
+    sqlite3_stmt *stmt = nullptr;
+    if (prepareCached("SELECT count(*) FROM Payments;", &stmt) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            store.reserve((size_t)sqlite3_column_int64(stmt, 0));
+        }
+        releaseCached(stmt);
+    }
+
+    const std::string sql =
+        "SELECT id, date, doc_number, type, amount, recipient, description, "
+        "counterparty_id, note FROM Payments ORDER BY id;";
+    if (prepareCached(sql, &stmt) != SQLITE_OK) {
+        std::cerr << "Failed to load payments: " << sqlite3_errmsg(db)
+                  << std::endl;
+        return false;
+    }
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        appendPaymentRow(stmt, store);
+    }
+    releaseCached(stmt);
+    if (rc != SQLITE_DONE) {
+        std::cerr << "Failed to load payments: " << sqlite3_errmsg(db)
+                  << std::endl;
+        store.clear();
+        return false;
+    }
+    store.shrinkToFit();
+    return true;
+}
+
+std::string DatabaseManager::paymentSnapshotPath() {
+    if (!db)
+        return std::string();
+    // Пустое имя - база в памяти или временная, снимок не ведётся
+    const char *filename = sqlite3_db_filename(db, "main");
+    if (!filename || !*filename)
+        return std::string();
+    return std::string(filename) + ".snapshot";
+}
+
+uint32_t DatabaseManager::getSchemaVersion() {
+    return db ? (uint32_t)readUserVersion(db) : 0;
+}
+
+bool DatabaseManager::getPaymentSnapshotStamp(PaymentStore::SnapshotStamp &stamp) {
+    DB_STATS_SCOPE();
+    if (!db)
+        return false;
+    sqlite3_stmt *stmt = nullptr;
+    if (prepareCached("SELECT count(*), IFNULL(max(id), 0) FROM Payments;",
+                      &stmt) != SQLITE_OK) {
+        std::cerr << "Failed to read payments stamp: " << sqlite3_errmsg(db)
+                  << std::endl;
+        return false;
+    }
+    bool found = sqlite3_step(stmt) == SQLITE_ROW;
+    if (found) {
+        stamp.schemaVersion = (uint32_t)readUserVersion(db);
+        stamp.rows = (uint64_t)sqlite3_column_int64(stmt, 0);
+        stamp.maxId = sqlite3_column_int64(stmt, 1);
+    }
+    releaseCached(stmt);
+    return found;
+}
+
+bool DatabaseManager::loadPaymentSnapshot(PaymentStore &store) {
+    DB_STATS_SCOPE();
+    std::string path = paymentSnapshotPath();
+    MappedFile file;
+    if (path.empty() || !file.open(path))
+        return false;
+
+    PaymentStore::SnapshotStamp snapshot_stamp;
+    PaymentStore::SnapshotStamp database_stamp;
+    if (!PaymentStore::readSnapshotStamp(file.view(), snapshot_stamp) ||
+        !getPaymentSnapshotStamp(database_stamp) ||
+        snapshot_stamp != database_stamp) {
+        return false;
+    }
+    if (!store.readSnapshot(file.view())) {
+        std::cerr << "Payments snapshot is damaged: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool DatabaseManager::savePaymentSnapshot(const PaymentStore &store) {
+    DB_STATS_SCOPE();
+    std::string path = paymentSnapshotPath();
+    if (path.empty())
+        return false;
+    return store.writeSnapshot(path, (uint32_t)readUserVersion(db));
+}
+
+void DatabaseManager::removePaymentSnapshot() {
+    DB_STATS_SCOPE();
+    std::string path = paymentSnapshotPath();
+    if (!path.empty())
+        std::remove(path.c_str());
+}
+
+bool DatabaseManager::loadPaymentStore(const std::vector<int> &ids,
+                                       PaymentStore &store) {
+    DB_STATS_SCOPE();
+    store.clear();
+    if (!db)
+        return false;
+
+    // Порции по возрастанию id: хранилище остаётся упорядоченным по id
+    std::vector<int> sorted_ids(ids);
+    std::sort(sorted_ids.begin(), sorted_ids.end());
+    sorted_ids.erase(std::unique(sorted_ids.begin(), sorted_ids.end()),
+                     sorted_ids.end());
+    store.reserve(sorted_ids.size());
+    for (size_t begin = 0; begin < sorted_ids.size();
+         begin += paymentsByIdChunk) {
+        sqlite3_stmt *stmt = nullptr;
+        if (prepareCached(paymentsByIdSql(), &stmt) != SQLITE_OK) {
+            std::cerr << "Failed to select payments by id: "
+                      << sqlite3_errmsg(db) << std::endl;
+            store.clear();
+            return false;
+        }
+        bindPaymentIdChunk(stmt, sorted_ids, begin);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            appendPaymentRow(stmt, store);
+        }
+        releaseCached(stmt);
+    }
+    store.shrinkToFit();
+    return true;
+}
+
 bool DatabaseManager::updatePayment(const Payment &payment) {
+    DB_STATS_SCOPE();
     if (!db)
         return false;
     std::string sql =
@@ -1064,7 +2513,7 @@ bool DatabaseManager::updatePayment(const Payment &payment) {
         "recipient = ?, description = ?, counterparty_id = ?, note = ? "
         "WHERE id = ?;";
     sqlite3_stmt *stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement for payment update: "
                   << sqlite3_errmsg(db) << std::endl;
@@ -1073,7 +2522,7 @@ bool DatabaseManager::updatePayment(const Payment &payment) {
     sqlite3_bind_text(stmt, 1, payment.date.c_str(), -1, SQLITE_STATIC);
     sqlite3_bind_text(stmt, 2, payment.doc_number.c_str(), -1, SQLITE_STATIC);
     sqlite3_bind_int(stmt, 3, payment.type ? 1 : 0);
-    sqlite3_bind_double(stmt, 4, payment.amount);
+    bindMoney(stmt, 4, payment.amount);
     sqlite3_bind_text(stmt, 5, payment.recipient.c_str(), -1, SQLITE_STATIC);
     sqlite3_bind_text(stmt, 6, payment.description.c_str(), -1, SQLITE_STATIC);
     if (payment.counterparty_id != -1) {
@@ -1085,7 +2534,7 @@ bool DatabaseManager::updatePayment(const Payment &payment) {
     sqlite3_bind_int(stmt, 9, payment.id);
 
     rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
 
     if (rc != SQLITE_DONE) {
         int extended_code = sqlite3_extended_errcode(db);
@@ -1098,11 +2547,12 @@ bool DatabaseManager::updatePayment(const Payment &payment) {
 }
 
 bool DatabaseManager::deletePayment(int id) {
+    DB_STATS_SCOPE();
     if (!db)
         return false;
     std::string sql = "DELETE FROM Payments WHERE id = ?;";
     sqlite3_stmt *stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement for payment delete: "
                   << sqlite3_errmsg(db) << std::endl;
@@ -1111,7 +2561,7 @@ bool DatabaseManager::deletePayment(int id) {
     sqlite3_bind_int(stmt, 1, id);
 
     rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
 
     if (rc != SQLITE_DONE) {
         int extended_code = sqlite3_extended_errcode(db);
@@ -1125,6 +2575,7 @@ bool DatabaseManager::deletePayment(int id) {
 
 std::vector<ContractPaymentInfo>
 DatabaseManager::getPaymentInfoForKosgu(int kosgu_id) {
+    DB_STATS_SCOPE();
     std::vector<ContractPaymentInfo> results;
     if (!db)
         return results;
@@ -1137,7 +2588,7 @@ DatabaseManager::getPaymentInfoForKosgu(int kosgu_id) {
         "WHERE pd.kosgu_id = ?;";
 
     sqlite3_stmt *stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+    if (prepareCached(sql, &stmt) != SQLITE_OK) {
         std::cerr << "Failed to prepare statement for getPaymentInfoForKosgu: "
                   << sqlite3_errmsg(db) << std::endl;
         return results;
@@ -1162,13 +2613,14 @@ DatabaseManager::getPaymentInfoForKosgu(int kosgu_id) {
         results.push_back(info);
     }
 
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
     return results;
 }
 
 std::vector<ContractPaymentInfo>
 DatabaseManager::getDecodingForKosgu(int kosgu_id,
                                      const std::string &filterText) {
+    DB_STATS_SCOPE();
     std::vector<ContractPaymentInfo> results;
     if (!db)
         return results;
@@ -1217,52 +2669,12 @@ DatabaseManager::getDecodingForKosgu(int kosgu_id,
         const char *desc_text = (const char *)sqlite3_column_text(stmt, 4);
         const unsigned char *counterparty_name_text =
             sqlite3_column_text(stmt, 5);
-
-        info.kosgu_code = kosgu_text ? kosgu_text : "";
-        info.date = date_text ? date_text : "";
-        info.doc_number = doc_text ? doc_text : "";
-        info.amount = sqlite3_column_double(stmt, 3);
-        info.description = desc_text ? desc_text : "";
-        info.counterparty_name =
-            counterparty_name_text ? (const char *)counterparty_name_text : "";
-        results.push_back(info);
-    }
-
-    sqlite3_finalize(stmt);
-    return results;
-}
-
-std::vector<KosguPaymentDetailInfo> DatabaseManager::getAllKosguPaymentInfo() {
-    std::vector<KosguPaymentDetailInfo> results;
-    if (!db)
-        return results;
-
-    std::string sql = "SELECT pd.kosgu_id, p.date, p.doc_number, pd.amount, "
-                      "p.description, c.name "
-                      "FROM PaymentDetails pd "
-                      "JOIN Payments p ON pd.payment_id = p.id "
-                      "LEFT JOIN Counterparties c ON p.counterparty_id = c.id "
-                      "WHERE pd.kosgu_id IS NOT NULL;";
-
-    sqlite3_stmt *stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
-        std::cerr << "Failed to prepare statement for getAllKosguPaymentInfo: "
-                  << sqlite3_errmsg(db) << std::endl;
-        return results;
-    }
-
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        KosguPaymentDetailInfo info;
-        info.kosgu_id = sqlite3_column_int(stmt, 0);
-        const unsigned char *date_text = sqlite3_column_text(stmt, 1);
-        info.date = date_text ? (const char *)date_text : "";
-        const unsigned char *doc_num_text = sqlite3_column_text(stmt, 2);
-        info.doc_number = doc_num_text ? (const char *)doc_num_text : "";
-        info.amount = sqlite3_column_double(stmt, 3);
-        const unsigned char *desc_text = sqlite3_column_text(stmt, 4);
-        info.description = desc_text ? (const char *)desc_text : "";
-        const unsigned char *counterparty_name_text =
-            sqlite3_column_text(stmt, 5);
+
+        info.kosgu_code = kosgu_text ? kosgu_text : "";
+        info.date = date_text ? date_text : "";
+        info.doc_number = doc_text ? doc_text : "";
+        info.amount = sqlite3_column_double(stmt, 3);
+        info.description = desc_text ? desc_text : "";
         info.counterparty_name =
             counterparty_name_text ? (const char *)counterparty_name_text : "";
         results.push_back(info);
@@ -1272,32 +2684,50 @@ std::vector<KosguPaymentDetailInfo> DatabaseManager::getAllKosguPaymentInfo() {
     return results;
 }
 
-static int contract_payment_detail_info_select_callback(void *data, int argc,
-                                                        char **argv,
-                                                        char **azColName) {
-    auto *results = static_cast<std::vector<ContractPaymentInfo> *>(data);
-    ContractPaymentInfo info;
-    for (int i = 0; i < argc; i++) {
-        std::string colName = azColName[i];
-        if (colName == "contract_id") {
-            info.contract_id = argv[i] ? std::stoi(argv[i]) : -1;
-        } else if (colName == "date") {
-            info.date = argv[i] ? argv[i] : "";
-        } else if (colName == "doc_number") {
-            info.doc_number = argv[i] ? argv[i] : "";
-        } else if (colName == "amount") {
-            info.amount = argv[i] ? std::stod(argv[i]) : 0.0;
-        } else if (colName == "description") {
-            info.description = argv[i] ? argv[i] : "";
-        } else if (colName == "kosgu_code") {
-            info.kosgu_code = argv[i] ? argv[i] : "";
-        }
-    }
-    results->push_back(info);
-    return 0;
+static void decodeKosguPaymentDetailInfo(sqlite3_stmt *stmt,
+                                         KosguPaymentDetailInfo &info) {
+    info.kosgu_id = sqlite3_column_int(stmt, 0);
+    const unsigned char *date_text = sqlite3_column_text(stmt, 1);
+    info.date = date_text ? (const char *)date_text : "";
+    const unsigned char *doc_num_text = sqlite3_column_text(stmt, 2);
+    info.doc_number = doc_num_text ? (const char *)doc_num_text : "";
+    info.amount = sqlite3_column_double(stmt, 3);
+    const unsigned char *desc_text = sqlite3_column_text(stmt, 4);
+    info.description = desc_text ? (const char *)desc_text : "";
+    const unsigned char *counterparty_name_text =
+        sqlite3_column_text(stmt, 5);
+    info.counterparty_name =
+        counterparty_name_text ? (const char *)counterparty_name_text : "";
+}
+
+RowCursor<KosguPaymentDetailInfo> DatabaseManager::openKosguPaymentInfoCursor() {
+    DB_STATS_SCOPE();
+    std::string sql = "SELECT pd.kosgu_id, p.date, p.doc_number, pd.amount, "
+                      "p.description, c.name "
+                      "FROM PaymentDetails pd "
+                      "JOIN Payments p ON pd.payment_id = p.id "
+                      "LEFT JOIN Counterparties c ON p.counterparty_id = c.id "
+                      "WHERE pd.kosgu_id IS NOT NULL;";
+    return openCursor<KosguPaymentDetailInfo>(sql, &decodeKosguPaymentDetailInfo,
+                                              "getAllKosguPaymentInfo");
+}
+
+std::vector<KosguPaymentDetailInfo> DatabaseManager::getAllKosguPaymentInfo() {
+    DB_STATS_SCOPE();
+    std::vector<KosguPaymentDetailInfo> results;
+    RowCursor<KosguPaymentDetailInfo> cursor = openKosguPaymentInfoCursor();
+    drainCursor(cursor, results);
+    return results;
 }
 
+using ContractPaymentInfoRow =
+    RowDecoder<&ContractPaymentInfo::contract_id, &ContractPaymentInfo::date,
+               &ContractPaymentInfo::doc_number, &ContractPaymentInfo::amount,
+               &ContractPaymentInfo::description,
+               &ContractPaymentInfo::kosgu_code>;
+
 std::vector<ContractPaymentInfo> DatabaseManager::getAllContractPaymentInfo() {
+    DB_STATS_SCOPE();
     std::vector<ContractPaymentInfo> results;
     if (!db)
         return results;
@@ -1308,47 +2738,22 @@ std::vector<ContractPaymentInfo> DatabaseManager::getAllContractPaymentInfo() {
                       "JOIN Payments p ON pd.payment_id = p.id "
                       "LEFT JOIN KOSGU k ON pd.kosgu_id = k.id "
                       "WHERE pd.contract_id IS NOT NULL;";
-
-    char *errmsg = nullptr;
-    int rc = sqlite3_exec(db, sql.c_str(),
-                          contract_payment_detail_info_select_callback,
-                          &results, &errmsg);
-    if (rc != SQLITE_OK) {
-        std::cerr << "Failed to select getAllContractPaymentInfo: " << errmsg
-                  << std::endl;
-        sqlite3_free(errmsg);
-    }
+    selectRows<ContractPaymentInfoRow>(sql, results,
+                                       "getAllContractPaymentInfo");
     return results;
 }
 
-static int counterparty_payment_detail_info_select_callback(void *data,
-                                                            int argc,
-                                                            char **argv,
-                                                            char **azColName) {
-    auto *results = static_cast<std::vector<CounterpartyPaymentInfo> *>(data);
-    CounterpartyPaymentInfo info;
-    for (int i = 0; i < argc; i++) {
-        std::string colName = azColName[i];
-        if (colName == "counterparty_id") {
-            info.counterparty_id = argv[i] ? std::stoi(argv[i]) : -1;
-        } else if (colName == "date") {
-            info.date = argv[i] ? argv[i] : "";
-        } else if (colName == "doc_number") {
-            info.doc_number = argv[i] ? argv[i] : "";
-        } else if (colName == "amount") {
-            info.amount = argv[i] ? std::stod(argv[i]) : 0.0;
-        } else if (colName == "description") {
-            info.description = argv[i] ? argv[i] : "";
-        } else if (colName == "kosgu_code") {
-            info.kosgu_code = argv[i] ? argv[i] : "";
-        }
-    }
-    results->push_back(info);
-    return 0;
-}
+using CounterpartyPaymentInfoRow =
+    RowDecoder<&CounterpartyPaymentInfo::counterparty_id,
+               &CounterpartyPaymentInfo::date,
+               &CounterpartyPaymentInfo::doc_number,
+               &CounterpartyPaymentInfo::amount,
+               &CounterpartyPaymentInfo::description,
+               &CounterpartyPaymentInfo::kosgu_code>;
 
 std::vector<CounterpartyPaymentInfo>
 DatabaseManager::getAllCounterpartyPaymentInfo() {
+    DB_STATS_SCOPE();
     std::vector<CounterpartyPaymentInfo> results;
     if (!db)
         return results;
@@ -1359,161 +2764,168 @@ DatabaseManager::getAllCounterpartyPaymentInfo() {
                       "LEFT JOIN PaymentDetails pd ON p.id = pd.payment_id "
                       "LEFT JOIN KOSGU k ON pd.kosgu_id = k.id "
                       "WHERE p.counterparty_id IS NOT NULL;";
-
-    char *errmsg = nullptr;
-    int rc = sqlite3_exec(db, sql.c_str(),
-                          counterparty_payment_detail_info_select_callback,
-                          &results, &errmsg);
-    if (rc != SQLITE_OK) {
-        std::cerr << "Failed to select getAllCounterpartyPaymentInfo: "
-                  << errmsg << std::endl;
-        sqlite3_free(errmsg);
-    }
+    selectRows<CounterpartyPaymentInfoRow>(sql, results,
+                                           "getAllCounterpartyPaymentInfo");
     return results;
 }
 
+using ContractExportRow =
+    RowDecoder<&ContractExportData::contract_number,
+               &ContractExportData::contract_date,
+               &ContractExportData::counterparty_name,
+               &ContractExportData::kosgu_codes,
+               &ContractExportData::is_for_special_control,
+               &ContractExportData::note,
+               &ContractExportData::procurement_code>;
+
+RowCursor<ContractExportData> DatabaseManager::openContractsForExportCursor() {
+    DB_STATS_SCOPE();
+    // Один запрос вместо двух дополнительных на каждый договор: пары
+    // (договор, КОСГУ) сначала сворачиваются по индексу
+    // idx_payment_details_contract, затем коды собираются в список по
+    // каждому договору и присоединяются вместе с контрагентом. CROSS JOIN
+    // фиксирует порядок соединения: расшифровки читаются только для
+    // отмеченных договоров. Договоры идут по id, коды - по возрастанию.
+    std::string sql =
+        "WITH contract_kosgu AS ("
+        "  SELECT pd.contract_id, pd.kosgu_id "
+        "  FROM Contracts ch "
+        "  CROSS JOIN PaymentDetails pd ON pd.contract_id = ch.id "
+        "  WHERE ch.is_for_checking = 1 "
+        "  GROUP BY pd.contract_id, pd.kosgu_id"
+        "), kosgu_lists AS ("
+        "  SELECT contract_id, group_concat(code, ', ') AS codes "
+        "  FROM (SELECT ck.contract_id, k.code FROM contract_kosgu ck "
+        "        JOIN KOSGU k ON k.id = ck.kosgu_id "
+        "        ORDER BY ck.contract_id, k.code) "
+        "  GROUP BY contract_id"
+        ") "
+        "SELECT c.number, c.date, cp.name, kl.codes, "
+        "  c.is_for_special_control, c.note, c.procurement_code "
+        "FROM Contracts c "
+        "LEFT JOIN Counterparties cp ON cp.id = c.counterparty_id "
+        "LEFT JOIN kosgu_lists kl ON kl.contract_id = c.id "
+        "WHERE c.is_for_checking = 1 "
+        "ORDER BY c.id;";
+    return openCursor<ContractExportData>(
+        sql, &ContractExportRow::decode<ContractExportData>,
+        "getContractsForExport");
+}
+
 std::vector<ContractExportData> DatabaseManager::getContractsForExport() {
+    DB_STATS_SCOPE();
     std::vector<ContractExportData> results;
+    RowCursor<ContractExportData> cursor = openContractsForExportCursor();
+    drainCursor(cursor, results);
+    return results;
+}
+
+// PaymentDetail CRUD
+// Добавляет строки одним подготовленным запросом внутри точки сохранения:
+// пакет записывается целиком или не записывается вовсе, id каждой
+// добавленной строки сохраняется в row.id. Вне транзакции пакет
+// фиксируется одной записью на диск вместо записи на каждую строку.
+template <typename Row, typename Bind>
+bool DatabaseManager::insertBatch(const std::string &sql,
+                                  std::vector<Row> &rows, Bind bind,
+                                  const char *what) {
     if (!db)
-        return results;
+        return false;
+    if (rows.empty())
+        return true;
 
-    // 1. Get all contracts marked for checking
-    std::string sql_contracts =
-        "SELECT id, number, date, counterparty_id, is_for_special_control, "
-        "note, procurement_code FROM Contracts WHERE is_for_checking = 1;";
-    sqlite3_stmt *stmt_contracts = nullptr;
-    if (sqlite3_prepare_v2(db, sql_contracts.c_str(), -1, &stmt_contracts,
-                           nullptr) != SQLITE_OK) {
-        std::cerr << "Failed to prepare statement for getContractsForExport: "
+    sqlite3_stmt *stmt = nullptr;
+    if (prepareCached(sql, &stmt) != SQLITE_OK) {
+        std::cerr << "Failed to prepare statement for " << what << ": "
                   << sqlite3_errmsg(db) << std::endl;
-        return results;
+        return false;
+    }
+    if (!executeCached("SAVEPOINT batch_insert;")) {
+        releaseCached(stmt);
+        return false;
     }
 
-    while (sqlite3_step(stmt_contracts) == SQLITE_ROW) {
-        ContractExportData data;
-        int contract_id = sqlite3_column_int(stmt_contracts, 0);
-        data.contract_number =
-            (const char *)sqlite3_column_text(stmt_contracts, 1);
-        data.contract_date =
-            (const char *)sqlite3_column_text(stmt_contracts, 2);
-        int counterparty_id = sqlite3_column_int(stmt_contracts, 3);
-        data.is_for_special_control =
-            sqlite3_column_int(stmt_contracts, 4) == 1;
-        const unsigned char *note_text = sqlite3_column_text(stmt_contracts, 5);
-        data.note = note_text ? (const char *)note_text : "";
-        const unsigned char *pk_text = sqlite3_column_text(stmt_contracts, 6);
-        data.procurement_code = pk_text ? (const char *)pk_text : "";
-
-        // 2. Get counterparty name
-        if (counterparty_id != 0) {
-            std::string sql_cp =
-                "SELECT name FROM Counterparties WHERE id = ?;";
-            sqlite3_stmt *stmt_cp = nullptr;
-            if (sqlite3_prepare_v2(db, sql_cp.c_str(), -1, &stmt_cp, nullptr) ==
-                SQLITE_OK) {
-                sqlite3_bind_int(stmt_cp, 1, counterparty_id);
-                if (sqlite3_step(stmt_cp) == SQLITE_ROW) {
-                    const unsigned char *cp_name =
-                        sqlite3_column_text(stmt_cp, 0);
-                    data.counterparty_name =
-                        cp_name ? (const char *)cp_name : "";
-                }
-                sqlite3_finalize(stmt_cp);
-            }
+    bool success = true;
+    for (auto &row : rows) {
+        bind(stmt, row);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            std::cerr << "Failed to add " << what << ": " << sqlite3_errmsg(db)
+                      << std::endl;
+            success = false;
+            break;
         }
+        row.id = (int)sqlite3_last_insert_rowid(db);
+        sqlite3_reset(stmt);
+    }
+    releaseCached(stmt);
 
-        // 3. Get KOSGU codes
-        std::string sql_kosgu =
-            "SELECT DISTINCT k.code FROM KOSGU k JOIN PaymentDetails pd ON "
-            "k.id = pd.kosgu_id WHERE pd.contract_id = ?;";
-        sqlite3_stmt *stmt_kosgu = nullptr;
-        if (sqlite3_prepare_v2(db, sql_kosgu.c_str(), -1, &stmt_kosgu,
-                               nullptr) == SQLITE_OK) {
-            sqlite3_bind_int(stmt_kosgu, 1, contract_id);
-            std::string kosgu_list;
-            while (sqlite3_step(stmt_kosgu) == SQLITE_ROW) {
-                const unsigned char *code = sqlite3_column_text(stmt_kosgu, 0);
-                if (code) {
-                    if (!kosgu_list.empty()) {
-                        kosgu_list += ", ";
-                    }
-                    kosgu_list += (const char *)code;
-                }
-            }
-            data.kosgu_codes = kosgu_list;
-            sqlite3_finalize(stmt_kosgu);
+    if (!success) {
+        rollbackToSavepoint("batch_insert");
+        for (auto &row : rows) {
+            row.id = -1;
         }
-
-        results.push_back(data);
     }
+    executeCached("RELEASE SAVEPOINT batch_insert;");
+    return success;
+}
 
-    sqlite3_finalize(stmt_contracts);
-    return results;
+static const char *INSERT_PAYMENT_DETAIL_SQL =
+    "INSERT INTO PaymentDetails (payment_id, kosgu_id, contract_id, "
+    "invoice_id, amount) VALUES (?, ?, ?, ?, ?);";
+
+static void bindPaymentDetail(sqlite3_stmt *stmt, const PaymentDetail &detail) {
+    sqlite3_bind_int(stmt, 1, detail.payment_id);
+    sqlite3_bind_int(stmt, 2, detail.kosgu_id);
+    sqlite3_bind_int(stmt, 3, detail.contract_id);
+    sqlite3_bind_int(stmt, 4, detail.invoice_id);
+    bindMoney(stmt, 5, detail.amount);
+}
+
+bool DatabaseManager::addPaymentDetails(std::vector<PaymentDetail> &details) {
+    DB_STATS_SCOPE();
+    return insertBatch(INSERT_PAYMENT_DETAIL_SQL, details, bindPaymentDetail,
+                       "payment details");
 }
 
-// PaymentDetail CRUD
 bool DatabaseManager::addPaymentDetail(PaymentDetail &detail) {
+    DB_STATS_SCOPE();
     if (!db)
         return false;
-    std::string sql =
-        "INSERT INTO PaymentDetails (payment_id, kosgu_id, contract_id, "
-        "invoice_id, amount) VALUES (?, ?, ?, ?, ?);";
     sqlite3_stmt *stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(INSERT_PAYMENT_DETAIL_SQL, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement for payment detail: "
                   << sqlite3_errmsg(db) << std::endl;
         return false;
     }
-    sqlite3_bind_int(stmt, 1, detail.payment_id);
-    sqlite3_bind_int(stmt, 2, detail.kosgu_id);
-    sqlite3_bind_int(stmt, 3, detail.contract_id);
-    sqlite3_bind_int(stmt, 4, detail.invoice_id);
-    sqlite3_bind_double(stmt, 5, detail.amount);
+    bindPaymentDetail(stmt, detail);
 
     rc = sqlite3_step(stmt);
     if (rc != SQLITE_DONE) {
         std::cerr << "Failed to add payment detail: " << sqlite3_errmsg(db)
                   << std::endl;
-        sqlite3_finalize(stmt);
+        releaseCached(stmt);
         return false;
     }
     detail.id = sqlite3_last_insert_rowid(db);
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
     return true;
 }
 
-static int payment_detail_select_callback(void *data, int argc, char **argv,
-                                          char **azColName) {
-    auto *details = static_cast<std::vector<PaymentDetail> *>(data);
-    PaymentDetail pd;
-    for (int i = 0; i < argc; i++) {
-        std::string colName = azColName[i];
-        if (colName == "id")
-            pd.id = argv[i] ? std::stoi(argv[i]) : -1;
-        else if (colName == "payment_id")
-            pd.payment_id = argv[i] ? std::stoi(argv[i]) : -1;
-        else if (colName == "kosgu_id")
-            pd.kosgu_id = argv[i] ? std::stoi(argv[i]) : -1;
-        else if (colName == "contract_id")
-            pd.contract_id = argv[i] ? std::stoi(argv[i]) : -1;
-        else if (colName == "invoice_id")
-            pd.invoice_id = argv[i] ? std::stoi(argv[i]) : -1;
-        else if (colName == "amount")
-            pd.amount = argv[i] ? std::stod(argv[i]) : 0.0;
-    }
-    details->push_back(pd);
-    return 0;
-}
+using PaymentDetailRow =
+    RowDecoder<&PaymentDetail::id, &PaymentDetail::payment_id,
+               &PaymentDetail::kosgu_id, &PaymentDetail::contract_id,
+               &PaymentDetail::invoice_id, &PaymentDetail::amount>;
 
 std::vector<PaymentDetail> DatabaseManager::getPaymentDetails(int payment_id) {
+    DB_STATS_SCOPE();
     std::vector<PaymentDetail> details;
     if (!db)
         return details;
 
     std::string sql = "SELECT * FROM PaymentDetails WHERE payment_id = ?;";
     sqlite3_stmt *stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement for getting payment details: "
                   << sqlite3_errmsg(db) << std::endl;
@@ -1532,34 +2944,35 @@ std::vector<PaymentDetail> DatabaseManager::getPaymentDetails(int payment_id) {
         details.push_back(pd);
     }
 
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
     return details;
 }
 
+RowCursor<PaymentDetail> DatabaseManager::openPaymentDetailsCursor() {
+    DB_STATS_SCOPE();
+    std::string sql = "SELECT id, payment_id, kosgu_id, contract_id, "
+                      "invoice_id, amount FROM PaymentDetails;";
+    return openCursor<PaymentDetail>(sql,
+                                     &PaymentDetailRow::decode<PaymentDetail>,
+                                     "all PaymentDetails");
+}
+
 std::vector<PaymentDetail> DatabaseManager::getAllPaymentDetails() {
+    DB_STATS_SCOPE();
     std::vector<PaymentDetail> details;
-    if (!db)
-        return details;
-
-    std::string sql = "SELECT * FROM PaymentDetails;";
-    char *errmsg = nullptr;
-    int rc = sqlite3_exec(db, sql.c_str(), payment_detail_select_callback,
-                          &details, &errmsg);
-    if (rc != SQLITE_OK) {
-        std::cerr << "Failed to select all PaymentDetails: " << errmsg
-                  << std::endl;
-        sqlite3_free(errmsg);
-    }
+    RowCursor<PaymentDetail> cursor = openPaymentDetailsCursor();
+    drainCursor(cursor, details);
     return details;
 }
 
 bool DatabaseManager::updatePaymentDetail(const PaymentDetail &detail) {
+    DB_STATS_SCOPE();
     if (!db)
         return false;
     std::string sql = "UPDATE PaymentDetails SET kosgu_id = ?, contract_id = "
                       "?, invoice_id = ?, amount = ? WHERE id = ?;";
     sqlite3_stmt *stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement for updating payment detail: "
                   << sqlite3_errmsg(db) << std::endl;
@@ -1569,11 +2982,11 @@ bool DatabaseManager::updatePaymentDetail(const PaymentDetail &detail) {
     sqlite3_bind_int(stmt, 1, detail.kosgu_id);
     sqlite3_bind_int(stmt, 2, detail.contract_id);
     sqlite3_bind_int(stmt, 3, detail.invoice_id);
-    sqlite3_bind_double(stmt, 4, detail.amount);
+    bindMoney(stmt, 4, detail.amount);
     sqlite3_bind_int(stmt, 5, detail.id);
 
     rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
 
     if (rc != SQLITE_DONE) {
         std::cerr << "Failed to update payment detail: " << sqlite3_errmsg(db)
@@ -1584,11 +2997,12 @@ bool DatabaseManager::updatePaymentDetail(const PaymentDetail &detail) {
 }
 
 bool DatabaseManager::deletePaymentDetail(int id) {
+    DB_STATS_SCOPE();
     if (!db)
         return false;
     std::string sql = "DELETE FROM PaymentDetails WHERE id = ?;";
     sqlite3_stmt *stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement for deleting payment detail: "
                   << sqlite3_errmsg(db) << std::endl;
@@ -1597,7 +3011,7 @@ bool DatabaseManager::deletePaymentDetail(int id) {
     sqlite3_bind_int(stmt, 1, id);
 
     rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
 
     if (rc != SQLITE_DONE) {
         std::cerr << "Failed to delete payment detail: " << sqlite3_errmsg(db)
@@ -1608,11 +3022,12 @@ bool DatabaseManager::deletePaymentDetail(int id) {
 }
 
 bool DatabaseManager::deleteAllPaymentDetails(int payment_id) {
+    DB_STATS_SCOPE();
     if (!db)
         return false;
     std::string sql = "DELETE FROM PaymentDetails WHERE payment_id = ?;";
     sqlite3_stmt *stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr
             << "Failed to prepare statement for deleting all payment details: "
@@ -1622,7 +3037,7 @@ bool DatabaseManager::deleteAllPaymentDetails(int payment_id) {
     sqlite3_bind_int(stmt, 1, payment_id);
 
     rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
 
     if (rc != SQLITE_DONE) {
         std::cerr << "Failed to delete all payment details: "
@@ -1635,6 +3050,7 @@ bool DatabaseManager::deleteAllPaymentDetails(int payment_id) {
 bool DatabaseManager::bulkUpdatePaymentDetails(
     const std::vector<int> &payment_ids, const std::string &field_to_update,
     int new_id) {
+    DB_STATS_SCOPE();
     if (!db || payment_ids.empty()) {
         return false;
     }
@@ -1683,48 +3099,28 @@ bool DatabaseManager::bulkUpdatePaymentDetails(
 }
 
 // Regex CRUD
-static int regex_select_callback(void *data, int argc, char **argv,
-                                 char **azColName) {
-    std::vector<Regex> *regex_list = static_cast<std::vector<Regex> *>(data);
-    Regex entry;
-    for (int i = 0; i < argc; i++) {
-        std::string colName = azColName[i];
-        if (colName == "id") {
-            entry.id = argv[i] ? std::stoi(argv[i]) : -1;
-        } else if (colName == "name") {
-            entry.name = argv[i] ? argv[i] : "";
-        } else if (colName == "pattern") {
-            entry.pattern = argv[i] ? argv[i] : "";
-        }
-    }
-    regex_list->push_back(entry);
-    return 0;
-}
+using RegexRow = RowDecoder<&Regex::id, &Regex::name, &Regex::pattern>;
 
 std::vector<Regex> DatabaseManager::getRegexes() {
+    DB_STATS_SCOPE();
     std::vector<Regex> entries;
     if (!db)
         return entries;
 
     std::string sql = "SELECT id, name, pattern FROM Regexes;";
-    char *errmsg = nullptr;
-    int rc =
-        sqlite3_exec(db, sql.c_str(), regex_select_callback, &entries, &errmsg);
-    if (rc != SQLITE_OK) {
-        std::cerr << "Failed to select Regex entries: " << errmsg << std::endl;
-        sqlite3_free(errmsg);
-    }
+    selectRows<RegexRow>(sql, entries, "Regex entries");
     return entries;
 }
 
 bool DatabaseManager::addRegex(Regex &regex) {
+    DB_STATS_SCOPE();
     if (!db)
         return false;
 
     std::cout << "regex: " << regex.name << " " << regex.pattern << std::endl;
     std::string sql = "INSERT INTO Regexes (name, pattern) VALUES (?, ?);";
     sqlite3_stmt *stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(db)
                   << std::endl;
@@ -1735,20 +3131,21 @@ bool DatabaseManager::addRegex(Regex &regex) {
 
     rc = sqlite3_step(stmt);
     if (rc != SQLITE_DONE) {
-        sqlite3_finalize(stmt);
+        releaseCached(stmt);
         return false;
     }
     regex.id = sqlite3_last_insert_rowid(db);
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
     return true;
 }
 
 bool DatabaseManager::updateRegex(const Regex &regex) {
+    DB_STATS_SCOPE();
     if (!db)
         return false;
     std::string sql = "UPDATE Regexes SET name = ?, pattern = ? WHERE id = ?;";
     sqlite3_stmt *stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(db)
                   << std::endl;
@@ -1759,17 +3156,18 @@ bool DatabaseManager::updateRegex(const Regex &regex) {
     sqlite3_bind_int(stmt, 3, regex.id);
 
     rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
 
     return rc == SQLITE_DONE;
 }
 
 bool DatabaseManager::deleteRegex(int id) {
+    DB_STATS_SCOPE();
     if (!db)
         return false;
     std::string sql = "DELETE FROM Regexes WHERE id = ?;";
     sqlite3_stmt *stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(db)
                   << std::endl;
@@ -1778,17 +3176,18 @@ bool DatabaseManager::deleteRegex(int id) {
     sqlite3_bind_int(stmt, 1, id);
 
     rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
 
     return rc == SQLITE_DONE;
 }
 
 int DatabaseManager::getRegexIdByName(const std::string &name) {
+    DB_STATS_SCOPE();
     if (!db)
         return -1;
     std::string sql = "SELECT id FROM Regexes WHERE name = ?;";
     sqlite3_stmt *stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement for regex lookup by name: "
                   << sqlite3_errmsg(db) << std::endl;
@@ -1800,50 +3199,32 @@ int DatabaseManager::getRegexIdByName(const std::string &name) {
     if (sqlite3_step(stmt) == SQLITE_ROW) {
         id = sqlite3_column_int(stmt, 0);
     }
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
     return id;
 }
 
 // Suspicious Words CRUD
-static int suspicious_word_select_callback(void *data, int argc, char **argv,
-                                           char **azColName) {
-    auto *words = static_cast<std::vector<SuspiciousWord> *>(data);
-    SuspiciousWord sw;
-    for (int i = 0; i < argc; i++) {
-        std::string colName = azColName[i];
-        if (colName == "id") {
-            sw.id = argv[i] ? std::stoi(argv[i]) : -1;
-        } else if (colName == "word") {
-            sw.word = argv[i] ? argv[i] : "";
-        }
-    }
-    words->push_back(sw);
-    return 0;
-}
+using SuspiciousWordRow =
+    RowDecoder<&SuspiciousWord::id, &SuspiciousWord::word>;
 
 std::vector<SuspiciousWord> DatabaseManager::getSuspiciousWords() {
+    DB_STATS_SCOPE();
     std::vector<SuspiciousWord> words;
     if (!db)
         return words;
 
     std::string sql = "SELECT id, word FROM SuspiciousWords;";
-    char *errmsg = nullptr;
-    int rc = sqlite3_exec(db, sql.c_str(), suspicious_word_select_callback,
-                          &words, &errmsg);
-    if (rc != SQLITE_OK) {
-        std::cerr << "Failed to select SuspiciousWords: " << errmsg
-                  << std::endl;
-        sqlite3_free(errmsg);
-    }
+    selectRows<SuspiciousWordRow>(sql, words, "SuspiciousWords");
     return words;
 }
 
 bool DatabaseManager::addSuspiciousWord(SuspiciousWord &word) {
+    DB_STATS_SCOPE();
     if (!db)
         return false;
     std::string sql = "INSERT INTO SuspiciousWords (word) VALUES (?);";
     sqlite3_stmt *stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(db)
                   << std::endl;
@@ -1853,20 +3234,21 @@ bool DatabaseManager::addSuspiciousWord(SuspiciousWord &word) {
 
     rc = sqlite3_step(stmt);
     if (rc != SQLITE_DONE) {
-        sqlite3_finalize(stmt);
+        releaseCached(stmt);
         return false;
     }
     word.id = sqlite3_last_insert_rowid(db);
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
     return true;
 }
 
 bool DatabaseManager::updateSuspiciousWord(const SuspiciousWord &word) {
+    DB_STATS_SCOPE();
     if (!db)
         return false;
     std::string sql = "UPDATE SuspiciousWords SET word = ? WHERE id = ?;";
     sqlite3_stmt *stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(db)
                   << std::endl;
@@ -1876,17 +3258,18 @@ bool DatabaseManager::updateSuspiciousWord(const SuspiciousWord &word) {
     sqlite3_bind_int(stmt, 2, word.id);
 
     rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
 
     return rc == SQLITE_DONE;
 }
 
 bool DatabaseManager::deleteSuspiciousWord(int id) {
+    DB_STATS_SCOPE();
     if (!db)
         return false;
     std::string sql = "DELETE FROM SuspiciousWords WHERE id = ?;";
     sqlite3_stmt *stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(db)
                   << std::endl;
@@ -1895,17 +3278,18 @@ bool DatabaseManager::deleteSuspiciousWord(int id) {
     sqlite3_bind_int(stmt, 1, id);
 
     rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
 
     return rc == SQLITE_DONE;
 }
 
 int DatabaseManager::getSuspiciousWordIdByWord(const std::string &word) {
+    DB_STATS_SCOPE();
     if (!db)
         return -1;
     std::string sql = "SELECT id FROM SuspiciousWords WHERE word = ?;";
     sqlite3_stmt *stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement for suspicious word lookup "
                      "by word: "
@@ -1918,17 +3302,22 @@ int DatabaseManager::getSuspiciousWordIdByWord(const std::string &word) {
     if (sqlite3_step(stmt) == SQLITE_ROW) {
         id = sqlite3_column_int(stmt, 0);
     }
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
     return id;
 }
 
 // Maintenance methods
 bool DatabaseManager::ClearPayments() {
+    DB_STATS_SCOPE();
     if (!db)
         return false;
+    // DELETE без WHERE выполняется усечением таблицы, без вызова хуков:
+    // Reload ставится до запроса и публикуется при его фиксации
+    queueTableReload("PaymentDetails");
     // Delete details first, although ON DELETE CASCADE should handle it.
     bool success = execute("DELETE FROM PaymentDetails;");
     if (success) {
+        queueTableReload("Payments");
         success = execute("DELETE FROM Payments;");
     }
     if (success) {
@@ -1938,38 +3327,50 @@ bool DatabaseManager::ClearPayments() {
 }
 
 bool DatabaseManager::ClearCounterparties() {
+    DB_STATS_SCOPE();
     if (!db)
         return false;
     // Note: This can fail if foreign key constraints are violated.
     // The UI should warn the user about this.
+    queueTableReload("Counterparties");
     bool success = execute("DELETE FROM Counterparties;");
+    // DELETE без WHERE выполняется усечением таблицы, без вызова хуков
+    invalidateReferenceCache();
     if (success)
         execute("VACUUM;");
     return success;
 }
 
 bool DatabaseManager::ClearContracts() {
+    DB_STATS_SCOPE();
     if (!db)
         return false;
+    queueTableReload("Contracts");
     bool success = execute("DELETE FROM Contracts;");
+    invalidateReferenceCache();
     if (success)
         execute("VACUUM;");
     return success;
 }
 
 bool DatabaseManager::ClearBasePaymentDocuments() {
+    DB_STATS_SCOPE();
     if (!db)
         return false;
     // Сначала удаляем расшифровки, затем сами документы
+    queueTableReload("BasePaymentDocumentDetails");
     bool success = execute("DELETE FROM BasePaymentDocumentDetails;");
-    if (success)
+    if (success) {
+        queueTableReload("BasePaymentDocuments");
         success = execute("DELETE FROM BasePaymentDocuments;");
+    }
     if (success)
         execute("VACUUM;");
     return success;
 }
 
 bool DatabaseManager::CleanOrphanPaymentDetails() {
+    DB_STATS_SCOPE();
     if (!db)
         return false;
     // Deletes details for which the corresponding payment does not exist.
@@ -1980,35 +3381,153 @@ bool DatabaseManager::CleanOrphanPaymentDetails() {
     return success;
 }
 
+bool DatabaseManager::rebuildAggregateTotals() {
+    DB_STATS_SCOPE();
+    if (!db)
+        return false;
+    bool success = execute("BEGIN;");
+    for (const auto &sql : aggregateTotalsRebuildStatements()) {
+        if (!success)
+            break;
+        success = execute(sql);
+    }
+    if (!success || !execute("COMMIT;")) {
+        execute("ROLLBACK;");
+        return false;
+    }
+    return true;
+}
+
+// Переводит строку поиска пользователя в выражение MATCH для FTS5. Текст в
+// двойных кавычках ищется как фраза, остальные слова - по префиксу; все
+// части должны встретиться (неявное AND). Каждая часть заключается в
+// кавычки, поэтому служебный синтаксис FTS5 (AND, OR, NEAR, *, :, -) во
+// вводе пользователя не интерпретируется.
+std::string DatabaseManager::buildFullTextQuery(const std::string &text) {
+    DB_STATS_SCOPE();
+    std::string query;
+    auto append = [&query](const std::string &token, bool prefix) {
+        if (token.empty())
+            return;
+        if (!query.empty())
+            query += ' ';
+        query += '"';
+        for (char ch : token) {
+            if (ch == '"')
+                query += '"'; // кавычка внутри строки FTS5 удваивается
+            query += ch;
+        }
+        query += '"';
+        if (prefix)
+            query += '*';
+    };
+
+    std::string token;
+    bool in_phrase = false;
+    for (char ch : text) {
+        if (ch == '"') {
+            append(token, !in_phrase);
+            token.clear();
+            in_phrase = !in_phrase;
+        } else if (!in_phrase &&
+                   (ch == ' ' || ch == '\t' || ch == ',' || ch == '\n')) {
+            append(token, true);
+            token.clear();
+        } else {
+            token += ch;
+        }
+    }
+    append(token, !in_phrase);
+    return query;
+}
+
+// Выполняет MATCH по таблице FTS5 и возвращает rowid найденных строк в
+// порядке возрастания
+std::vector<int> DatabaseManager::searchFullText(const std::string &fts_table,
+                                                 const std::string &text) {
+    std::vector<int> ids;
+    std::string match = buildFullTextQuery(text);
+    if (!db || match.empty())
+        return ids;
+
+    std::string sql = "SELECT rowid FROM " + fts_table + " WHERE " +
+                      fts_table + " MATCH ? ORDER BY rowid;";
+    sqlite3_stmt *stmt = nullptr;
+    if (prepareCached(sql, &stmt) != SQLITE_OK) {
+        std::cerr << "Failed to prepare full-text search: "
+                  << sqlite3_errmsg(db) << std::endl;
+        return ids;
+    }
+    sqlite3_bind_text(stmt, 1, match.c_str(), -1, SQLITE_TRANSIENT);
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        ids.push_back(sqlite3_column_int(stmt, 0));
+    }
+    if (rc != SQLITE_DONE) {
+        std::cerr << "Full-text search failed: " << sqlite3_errmsg(db)
+                  << std::endl;
+    }
+    releaseCached(stmt);
+    return ids;
+}
+
+std::vector<int> DatabaseManager::searchPayments(const std::string &text) {
+    DB_STATS_SCOPE();
+    return searchFullText("PaymentsFts", text);
+}
+
+std::vector<int>
+DatabaseManager::searchBasePaymentDocumentDetails(const std::string &text) {
+    DB_STATS_SCOPE();
+    return searchFullText("BasePaymentDocumentDetailsFts", text);
+}
+
+// Состояние построчного обхода произвольного SELECT (streamSelect)
+struct StreamSelectState {
+    const DatabaseManager::SelectRowVisitor *visitor;
+    std::vector<std::string> columns;
+    std::vector<std::string> row;
+};
+
 // Callback for generic SELECT queries
-static int callback_collect_data(void *data, int argc, char **argv,
-                                 char **azColName) {
-    auto *result_pair =
-        static_cast<std::pair<std::vector<std::string> *,
-                              std::vector<std::vector<std::string>> *> *>(data);
-    std::vector<std::string> *columns = result_pair->first;
-    std::vector<std::vector<std::string>> *rows = result_pair->second;
+static int callback_stream_rows(void *data, int argc, char **argv,
+                                char **azColName) {
+    auto *state = static_cast<StreamSelectState *>(data);
 
     // Populate columns if not already done (first row)
-    if (columns->empty()) {
+    if (state->columns.empty()) {
         for (int i = 0; i < argc; i++) {
-            columns->push_back(azColName[i]);
+            state->columns.push_back(azColName[i]);
         }
     }
 
-    // Populate row data
-    std::vector<std::string> row_data;
+    // Буфер строки переиспользуется, строки выборки не накапливаются
+    state->row.resize(argc);
     for (int i = 0; i < argc; i++) {
-        row_data.push_back(argv[i] ? argv[i] : "NULL");
+        state->row[i].assign(argv[i] ? argv[i] : "NULL");
     }
-    rows->push_back(row_data);
 
-    return 0;
+    // Ненулевой код прерывает sqlite3_exec (SQLITE_ABORT)
+    return (*state->visitor)(state->columns, state->row) ? 0 : 1;
+}
+
+// Счётчик изменений схемы базы (PRAGMA schema_version)
+static int readSchemaVersion(sqlite3 *db) {
+    int version = 0;
+    sqlite3_stmt *stmt = nullptr;
+    if (sqlite3_prepare_v2(db, "PRAGMA schema_version;", -1, &stmt,
+                           nullptr) == SQLITE_OK &&
+        sqlite3_step(stmt) == SQLITE_ROW) {
+        version = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return version;
 }
 
 bool DatabaseManager::executeSelect(
     const std::string &sql, std::vector<std::string> &columns,
     std::vector<std::vector<std::string>> &rows) {
+    DB_STATS_SCOPE();
     if (!db)
         return false;
 
@@ -2016,26 +3535,55 @@ bool DatabaseManager::executeSelect(
     columns.clear();
     rows.clear();
 
-    // Use a pair to pass both vectors to the callback
-    std::pair<std::vector<std::string> *,
-              std::vector<std::vector<std::string>> *>
-        result_pair(&columns, &rows);
+    return streamSelect(sql, [&](const std::vector<std::string> &row_columns,
+                                 const std::vector<std::string> &row) {
+        if (columns.empty()) {
+            columns = row_columns;
+        }
+        rows.push_back(row);
+        return true;
+    });
+}
+
+bool DatabaseManager::streamSelect(const std::string &sql,
+                                   const SelectRowVisitor &visitor) {
+    DB_STATS_SCOPE();
+    if (!db)
+        return false;
+
+    StreamSelectState state{&visitor, {}, {}};
+
+    // Произвольный запрос пользователя может изменить схему (CREATE/DROP...)
+    // и данные справочников (DELETE без WHERE не вызывает хуков)
+    int schema_version_before = readSchemaVersion(db);
+    int changes_before = sqlite3_total_changes(db);
 
     char *errmsg = nullptr;
-    int rc = sqlite3_exec(db, sql.c_str(), callback_collect_data, &result_pair,
+    int rc = sqlite3_exec(db, sql.c_str(), callback_stream_rows, &state,
                           &errmsg);
 
-    if (rc != SQLITE_OK) {
-        std::cerr << "SQL SELECT error: " << errmsg << std::endl;
+    if (readSchemaVersion(db) != schema_version_before) {
+        clearStatementCache();
+    }
+    if (sqlite3_total_changes(db) != changes_before) {
+        invalidateReferenceCache();
+    }
+
+    // SQLITE_ABORT - обход остановлен самим visitor, это не ошибка
+    if (rc != SQLITE_OK && rc != SQLITE_ABORT) {
+        std::cerr << "SQL SELECT error: " << (errmsg ? errmsg : sqlite3_errstr(rc))
+                  << std::endl;
         sqlite3_free(errmsg);
         return false;
     }
+    sqlite3_free(errmsg);
 
     return true;
 }
 
 // Settings
 Settings DatabaseManager::getSettings() {
+    DB_STATS_SCOPE();
     Settings settings = {
         1,
         "",
@@ -2048,17 +3596,18 @@ Settings DatabaseManager::getSettings() {
         "https://zakupki.gov.ru/epz/contract/contractCard/"
         "common-info.html?reestrNumber={IKZ}",
         "https://zakupki.gov.ru/epz/contract/search/"
-        "results.html?searchString={NUMBER}"}; // Default settings
+        "results.html?searchString={NUMBER}",
+        true}; // Default settings
     if (!db)
         return settings;
 
     std::string sql =
         "SELECT organization_name, period_start_date, "
         "period_end_date, note, import_preview_lines, theme, font_size, "
-        "zakupki_url_template, zakupki_url_search_template FROM "
+        "zakupki_url_template, zakupki_url_search_template, use_snapshot FROM "
         "Settings WHERE id = 1;";
     sqlite3_stmt *stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement for getSettings: "
                   << sqlite3_errmsg(db) << std::endl;
@@ -2088,23 +3637,26 @@ Settings DatabaseManager::getSettings() {
         settings.zakupki_url_search_template = zakupki_search_url
                                             ? (const char *)zakupki_search_url
                                             : settings.zakupki_url_search_template;
+        if (sqlite3_column_type(stmt, 9) != SQLITE_NULL)
+            settings.use_snapshot = sqlite3_column_int(stmt, 9) != 0;
     }
 
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
     return settings;
 }
 
 bool DatabaseManager::updateSettings(const Settings &settings) {
+    DB_STATS_SCOPE();
     if (!db)
         return false;
 
     std::string sql =
         "UPDATE Settings SET organization_name = ?, period_start_date = ?, "
         "period_end_date = ?, note = ?, import_preview_lines = ?, theme = ?, "
-        "font_size = ?, zakupki_url_template = ?, zakupki_url_search_template = ? "
-        "WHERE id = 1;";
+        "font_size = ?, zakupki_url_template = ?, zakupki_url_search_template = ?, "
+        "use_snapshot = ? WHERE id = 1;";
     sqlite3_stmt *stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement for updateSettings: "
                   << sqlite3_errmsg(db) << std::endl;
@@ -2126,9 +3678,10 @@ bool DatabaseManager::updateSettings(const Settings &settings) {
                       SQLITE_STATIC);
     sqlite3_bind_text(stmt, 9, settings.zakupki_url_search_template.c_str(), -1,
                       SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 10, settings.use_snapshot ? 1 : 0);
 
     rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
 
     if (rc != SQLITE_DONE) {
         std::cerr << "Failed to update Settings: " << sqlite3_errmsg(db)
@@ -2139,6 +3692,7 @@ bool DatabaseManager::updateSettings(const Settings &settings) {
 }
 
 bool DatabaseManager::backupTo(const std::string &backupFilepath) {
+    DB_STATS_SCOPE();
     if (!db) {
         return false;
     }
@@ -2185,13 +3739,14 @@ bool DatabaseManager::backupTo(const std::string &backupFilepath) {
 // ==================== BasePaymentDocument Methods ====================
 
 int DatabaseManager::addBasePaymentDocument(BasePaymentDocument& doc) {
+    DB_STATS_SCOPE();
     if (!db) return -1;
     std::string sql =
         "INSERT INTO BasePaymentDocuments (date, number, document_name, "
         "counterparty_name, contract_id, payment_id, note, is_for_checking, is_checked) "
         "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?);";
     sqlite3_stmt* stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement for addBasePaymentDocument: "
                   << sqlite3_errmsg(db) << std::endl;
@@ -2211,19 +3766,20 @@ int DatabaseManager::addBasePaymentDocument(BasePaymentDocument& doc) {
     if (rc != SQLITE_DONE) {
         std::cerr << "Failed to add BasePaymentDocument: "
                   << sqlite3_errmsg(db) << std::endl;
-        sqlite3_finalize(stmt);
+        releaseCached(stmt);
         return -1;
     }
     doc.id = sqlite3_last_insert_rowid(db);
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
     return doc.id;
 }
 
 int DatabaseManager::getBasePaymentDocumentIdByNumberDate(const std::string& number, const std::string& date) {
+    DB_STATS_SCOPE();
     if (!db) return -1;
     std::string sql = "SELECT id FROM BasePaymentDocuments WHERE number = ? AND date = ?;";
     sqlite3_stmt* stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement for getBasePaymentDocumentIdByNumberDate: "
                   << sqlite3_errmsg(db) << std::endl;
@@ -2236,11 +3792,12 @@ int DatabaseManager::getBasePaymentDocumentIdByNumberDate(const std::string& num
     if (sqlite3_step(stmt) == SQLITE_ROW) {
         id = sqlite3_column_int(stmt, 0);
     }
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
     return id;
 }
 
 std::vector<BasePaymentDocument> DatabaseManager::getBasePaymentDocuments() {
+    DB_STATS_SCOPE();
     std::vector<BasePaymentDocument> docs;
     if (!db) return docs;
 
@@ -2248,14 +3805,15 @@ std::vector<BasePaymentDocument> DatabaseManager::getBasePaymentDocuments() {
         "SELECT bpd.id, bpd.date, bpd.number, bpd.document_name, "
         "bpd.counterparty_name, bpd.contract_id, bpd.payment_id, bpd.note, "
         "bpd.is_for_checking, bpd.is_checked, "
-        "IFNULL(SUM(bpdd.amount), 0.0) as total_amount "
+        "IFNULL(SUM(" SQL_KOPECKS("bpdd.amount") "), 0) / 100.0 "
+        "as total_amount "
         "FROM BasePaymentDocuments bpd "
         "LEFT JOIN BasePaymentDocumentDetails bpdd ON bpd.id = bpdd.document_id "
         "GROUP BY bpd.id, bpd.date, bpd.number, bpd.document_name, "
         "bpd.counterparty_name, bpd.contract_id, bpd.payment_id, bpd.note, "
         "bpd.is_for_checking, bpd.is_checked;";
     sqlite3_stmt* stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement for getBasePaymentDocuments: "
                   << sqlite3_errmsg(db) << std::endl;
@@ -2282,18 +3840,19 @@ std::vector<BasePaymentDocument> DatabaseManager::getBasePaymentDocuments() {
         doc.total_amount = sqlite3_column_double(stmt, 10);
         docs.push_back(doc);
     }
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
     return docs;
 }
 
 bool DatabaseManager::updateBasePaymentDocument(const BasePaymentDocument& doc) {
+    DB_STATS_SCOPE();
     if (!db) return false;
     std::string sql =
         "UPDATE BasePaymentDocuments SET date = ?, number = ?, document_name = ?, "
         "counterparty_name = ?, contract_id = ?, payment_id = ?, note = ?, "
         "is_for_checking = ?, is_checked = ? WHERE id = ?;";
     sqlite3_stmt* stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement for updateBasePaymentDocument: "
                   << sqlite3_errmsg(db) << std::endl;
@@ -2311,7 +3870,7 @@ bool DatabaseManager::updateBasePaymentDocument(const BasePaymentDocument& doc)
     sqlite3_bind_int(stmt, 10, doc.id);
 
     rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
     if (rc != SQLITE_DONE) {
         std::cerr << "Failed to update BasePaymentDocument: "
                   << sqlite3_errmsg(db) << std::endl;
@@ -2321,10 +3880,11 @@ bool DatabaseManager::updateBasePaymentDocument(const BasePaymentDocument& doc)
 }
 
 bool DatabaseManager::deleteBasePaymentDocument(int id) {
+    DB_STATS_SCOPE();
     if (!db) return false;
     std::string sql = "DELETE FROM BasePaymentDocuments WHERE id = ?;";
     sqlite3_stmt* stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement for deleteBasePaymentDocument: "
                   << sqlite3_errmsg(db) << std::endl;
@@ -2332,7 +3892,7 @@ bool DatabaseManager::deleteBasePaymentDocument(int id) {
     }
     sqlite3_bind_int(stmt, 1, id);
     rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
     if (rc != SQLITE_DONE) {
         std::cerr << "Failed to delete BasePaymentDocument: "
                   << sqlite3_errmsg(db) << std::endl;
@@ -2342,10 +3902,13 @@ bool DatabaseManager::deleteBasePaymentDocument(int id) {
 }
 
 bool DatabaseManager::clearBasePaymentDocuments() {
+    DB_STATS_SCOPE();
+    queueTableReload("BasePaymentDocuments");
     return execute("DELETE FROM BasePaymentDocuments;");
 }
 
 std::vector<ContractPaymentInfo> DatabaseManager::getPaymentInfoForBasePaymentDocument(int doc_id) {
+    DB_STATS_SCOPE();
     std::vector<ContractPaymentInfo> result;
     if (!db) return result;
 
@@ -2357,7 +3920,7 @@ std::vector<ContractPaymentInfo> DatabaseManager::getPaymentInfoForBasePaymentDo
         "LEFT JOIN Counterparties c ON p.counterparty_id = c.id "
         "WHERE pd.invoice_id = ?;";
     sqlite3_stmt* stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement for getPaymentInfoForBasePaymentDocument: "
                   << sqlite3_errmsg(db) << std::endl;
@@ -2379,64 +3942,70 @@ std::vector<ContractPaymentInfo> DatabaseManager::getPaymentInfoForBasePaymentDo
         info.counterparty_name = name ? (const char*)name : "";
         result.push_back(info);
     }
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
     return result;
 }
 
 // ==================== BasePaymentDocumentDetail Methods ====================
 
+static const char *INSERT_BASE_DOCUMENT_DETAIL_SQL =
+    "INSERT INTO BasePaymentDocumentDetails (document_id, operation_content, "
+    "debit_account, credit_account, kosgu_id, amount, note) "
+    "VALUES (?, ?, ?, ?, ?, ?, ?);";
+
+static void bindBasePaymentDocumentDetail(sqlite3_stmt* stmt,
+                                          const BasePaymentDocumentDetail& detail) {
+    sqlite3_bind_int(stmt, 1, detail.document_id);
+    sqlite3_bind_text(stmt, 2, detail.operation_content.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 3, detail.debit_account.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 4, detail.credit_account.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 5, detail.kosgu_id);
+    bindMoney(stmt, 6, detail.amount);
+    sqlite3_bind_text(stmt, 7, detail.note.c_str(), -1, SQLITE_STATIC);
+}
+
+bool DatabaseManager::addBasePaymentDocumentDetails(
+    std::vector<BasePaymentDocumentDetail>& details) {
+    DB_STATS_SCOPE();
+    return insertBatch(INSERT_BASE_DOCUMENT_DETAIL_SQL, details,
+                       bindBasePaymentDocumentDetail,
+                       "base payment document details");
+}
+
 bool DatabaseManager::addBasePaymentDocumentDetail(BasePaymentDocumentDetail& detail) {
+    DB_STATS_SCOPE();
     if (!db) return false;
-    std::string sql =
-        "INSERT INTO BasePaymentDocumentDetails (document_id, operation_content, "
-        "debit_account, credit_account, kosgu_id, amount, note) "
-        "VALUES (?, ?, ?, ?, ?, ?, ?);";
     sqlite3_stmt* stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(INSERT_BASE_DOCUMENT_DETAIL_SQL, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement for addBasePaymentDocumentDetail: "
                   << sqlite3_errmsg(db) << std::endl;
         return false;
     }
-    sqlite3_bind_int(stmt, 1, detail.document_id);
-    sqlite3_bind_text(stmt, 2, detail.operation_content.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 3, detail.debit_account.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 4, detail.credit_account.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_int(stmt, 5, detail.kosgu_id);
-    sqlite3_bind_double(stmt, 6, detail.amount);
-    sqlite3_bind_text(stmt, 7, detail.note.c_str(), -1, SQLITE_STATIC);
+    bindBasePaymentDocumentDetail(stmt, detail);
 
     rc = sqlite3_step(stmt);
     if (rc != SQLITE_DONE) {
         std::cerr << "Failed to add BasePaymentDocumentDetail: "
                   << sqlite3_errmsg(db) << std::endl;
-        sqlite3_finalize(stmt);
+        releaseCached(stmt);
         return false;
     }
     detail.id = sqlite3_last_insert_rowid(db);
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
     return true;
 }
 
-static int base_payment_document_detail_select_callback(void* data, int argc, char** argv, char** azColName) {
-    auto* details = static_cast<std::vector<BasePaymentDocumentDetail>*>(data);
-    BasePaymentDocumentDetail d;
-    for (int i = 0; i < argc; i++) {
-        std::string colName = azColName[i];
-        if (colName == "id") d.id = argv[i] ? std::stoi(argv[i]) : -1;
-        else if (colName == "document_id") d.document_id = argv[i] ? std::stoi(argv[i]) : -1;
-        else if (colName == "operation_content") d.operation_content = argv[i] ? argv[i] : "";
-        else if (colName == "debit_account") d.debit_account = argv[i] ? argv[i] : "";
-        else if (colName == "credit_account") d.credit_account = argv[i] ? argv[i] : "";
-        else if (colName == "kosgu_id") d.kosgu_id = argv[i] ? std::stoi(argv[i]) : -1;
-        else if (colName == "amount") d.amount = argv[i] ? std::stod(argv[i]) : 0.0;
-        else if (colName == "note") d.note = argv[i] ? argv[i] : "";
-    }
-    details->push_back(d);
-    return 0;
-}
+using BasePaymentDocumentDetailRow =
+    RowDecoder<&BasePaymentDocumentDetail::id, &BasePaymentDocumentDetail::document_id,
+               &BasePaymentDocumentDetail::operation_content,
+               &BasePaymentDocumentDetail::debit_account,
+               &BasePaymentDocumentDetail::credit_account,
+               &BasePaymentDocumentDetail::kosgu_id, &BasePaymentDocumentDetail::amount,
+               &BasePaymentDocumentDetail::note>;
 
 std::vector<BasePaymentDocumentDetail> DatabaseManager::getBasePaymentDocumentDetails(int document_id) {
+    DB_STATS_SCOPE();
     std::vector<BasePaymentDocumentDetail> details;
     if (!db) return details;
     
@@ -2444,7 +4013,7 @@ std::vector<BasePaymentDocumentDetail> DatabaseManager::getBasePaymentDocumentDe
                       "credit_account, kosgu_id, amount, note "
                       "FROM BasePaymentDocumentDetails WHERE document_id = ?;";
     sqlite3_stmt* stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement for getBasePaymentDocumentDetails: "
                   << sqlite3_errmsg(db) << std::endl;
@@ -2468,28 +4037,30 @@ std::vector<BasePaymentDocumentDetail> DatabaseManager::getBasePaymentDocumentDe
         d.note = v ? (const char*)v : "";
         details.push_back(d);
     }
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
     return details;
 }
 
 std::vector<BasePaymentDocumentDetail> DatabaseManager::getAllBasePaymentDocumentDetails() {
+    DB_STATS_SCOPE();
     std::vector<BasePaymentDocumentDetail> details;
     if (!db) return details;
     std::string sql = "SELECT id, document_id, operation_content, debit_account, "
                       "credit_account, kosgu_id, amount, note "
                       "FROM BasePaymentDocumentDetails;";
-    sqlite3_exec(db, sql.c_str(), base_payment_document_detail_select_callback, &details, nullptr);
+    selectRows<BasePaymentDocumentDetailRow>(sql, details, "BasePaymentDocumentDetails");
     return details;
 }
 
 bool DatabaseManager::updateBasePaymentDocumentDetail(const BasePaymentDocumentDetail& detail) {
+    DB_STATS_SCOPE();
     if (!db) return false;
     std::string sql =
         "UPDATE BasePaymentDocumentDetails SET document_id = ?, operation_content = ?, "
         "debit_account = ?, credit_account = ?, kosgu_id = ?, amount = ?, note = ? "
         "WHERE id = ?;";
     sqlite3_stmt* stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement for updateBasePaymentDocumentDetail: "
                   << sqlite3_errmsg(db) << std::endl;
@@ -2500,12 +4071,12 @@ bool DatabaseManager::updateBasePaymentDocumentDetail(const BasePaymentDocumentD
     sqlite3_bind_text(stmt, 3, detail.debit_account.c_str(), -1, SQLITE_STATIC);
     sqlite3_bind_text(stmt, 4, detail.credit_account.c_str(), -1, SQLITE_STATIC);
     sqlite3_bind_int(stmt, 5, detail.kosgu_id);
-    sqlite3_bind_double(stmt, 6, detail.amount);
+    bindMoney(stmt, 6, detail.amount);
     sqlite3_bind_text(stmt, 7, detail.note.c_str(), -1, SQLITE_STATIC);
     sqlite3_bind_int(stmt, 8, detail.id);
 
     rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
     if (rc != SQLITE_DONE) {
         std::cerr << "Failed to update BasePaymentDocumentDetail: "
                   << sqlite3_errmsg(db) << std::endl;
@@ -2515,10 +4086,11 @@ bool DatabaseManager::updateBasePaymentDocumentDetail(const BasePaymentDocumentD
 }
 
 bool DatabaseManager::deleteBasePaymentDocumentDetail(int id) {
+    DB_STATS_SCOPE();
     if (!db) return false;
     std::string sql = "DELETE FROM BasePaymentDocumentDetails WHERE id = ?;";
     sqlite3_stmt* stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement for deleteBasePaymentDocumentDetail: "
                   << sqlite3_errmsg(db) << std::endl;
@@ -2526,7 +4098,7 @@ bool DatabaseManager::deleteBasePaymentDocumentDetail(int id) {
     }
     sqlite3_bind_int(stmt, 1, id);
     rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
     if (rc != SQLITE_DONE) {
         std::cerr << "Failed to delete BasePaymentDocumentDetail: "
                   << sqlite3_errmsg(db) << std::endl;
@@ -2536,10 +4108,11 @@ bool DatabaseManager::deleteBasePaymentDocumentDetail(int id) {
 }
 
 bool DatabaseManager::deleteAllBasePaymentDocumentDetails(int document_id) {
+    DB_STATS_SCOPE();
     if (!db) return false;
     std::string sql = "DELETE FROM BasePaymentDocumentDetails WHERE document_id = ?;";
     sqlite3_stmt* stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement for deleteAllBasePaymentDocumentDetails: "
                   << sqlite3_errmsg(db) << std::endl;
@@ -2547,7 +4120,7 @@ bool DatabaseManager::deleteAllBasePaymentDocumentDetails(int document_id) {
     }
     sqlite3_bind_int(stmt, 1, document_id);
     rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
     if (rc != SQLITE_DONE) {
         std::cerr << "Failed to delete all BasePaymentDocumentDetails: "
                   << sqlite3_errmsg(db) << std::endl;
@@ -2557,6 +4130,7 @@ bool DatabaseManager::deleteAllBasePaymentDocumentDetails(int document_id) {
 }
 
 bool DatabaseManager::bulkUpdateBasePaymentDocumentDetails(const std::vector<int>& document_ids, const std::string& field_to_update, int new_id) {
+    DB_STATS_SCOPE();
     if (!db || document_ids.empty()) return false;
 
     std::string placeholders;
@@ -2590,10 +4164,11 @@ bool DatabaseManager::bulkUpdateBasePaymentDocumentDetails(const std::vector<int
 }
 
 int DatabaseManager::getBasePaymentDocumentDetailIdByContent(int document_id, const std::string& operation_content) {
+    DB_STATS_SCOPE();
     if (!db) return -1;
     std::string sql = "SELECT id FROM BasePaymentDocumentDetails WHERE document_id = ? AND operation_content = ?;";
     sqlite3_stmt* stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement for getBasePaymentDocumentDetailIdByContent: "
                   << sqlite3_errmsg(db) << std::endl;
@@ -2606,7 +4181,7 @@ int DatabaseManager::getBasePaymentDocumentDetailIdByContent(int document_id, co
     if (sqlite3_step(stmt) == SQLITE_ROW) {
         id = sqlite3_column_int(stmt, 0);
     }
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
     return id;
 }
 
@@ -2783,6 +4358,7 @@ static bool counterpartyNamesMatch(const std::string& name1, const std::string&
 }
 
 std::vector<DatabaseManager::PaymentMatch> DatabaseManager::findMatchingPayments(const BasePaymentDocument& doc, bool require_counterparty) {
+    DB_STATS_SCOPE();
     std::vector<PaymentMatch> matches;
     if (!db) return matches;
 
@@ -2796,7 +4372,7 @@ std::vector<DatabaseManager::PaymentMatch> DatabaseManager::findMatchingPayments
         "ORDER BY p.date DESC";
 
     sqlite3_stmt* stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement for findMatchingPayments: "
                   << sqlite3_errmsg(db) << std::endl;
@@ -2825,7 +4401,8 @@ std::vector<DatabaseManager::PaymentMatch> DatabaseManager::findMatchingPayments
         // Критерии совпадения:
         
         // 1. Совпадение по сумме
-        if (std::abs(match.amount - doc.total_amount) < 0.01) {
+        if (Money::fromDouble(match.amount) ==
+            Money::fromDouble(doc.total_amount)) {
             match.match_score += 30;
             match.match_reasons += "Сумма; ";
         }
@@ -2872,7 +4449,7 @@ std::vector<DatabaseManager::PaymentMatch> DatabaseManager::findMatchingPayments
         matches.push_back(match);
     }
 
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
 
     // Сортируем по score (по убыванию)
     std::sort(matches.begin(), matches.end(), 
@@ -2884,11 +4461,12 @@ std::vector<DatabaseManager::PaymentMatch> DatabaseManager::findMatchingPayments
 }
 
 bool DatabaseManager::linkBasePaymentDocumentToPayment(int doc_id, int payment_id) {
+    DB_STATS_SCOPE();
     if (!db) return false;
     
     std::string sql = "UPDATE BasePaymentDocuments SET payment_id = ? WHERE id = ?;";
     sqlite3_stmt* stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    int rc = prepareCached(sql, &stmt);
     if (rc != SQLITE_OK) {
         std::cerr << "Failed to prepare statement for linkBasePaymentDocumentToPayment: "
                   << sqlite3_errmsg(db) << std::endl;
@@ -2904,107 +4482,136 @@ bool DatabaseManager::linkBasePaymentDocumentToPayment(int doc_id, int payment_i
                   << sqlite3_errmsg(db) << std::endl;
     }
     
-    sqlite3_finalize(stmt);
+    releaseCached(stmt);
     return success;
 }
 
 // ==================== Reconciliation Methods ====================
 
-std::vector<DatabaseManager::ReconciliationRecord> DatabaseManager::getReconciliationData(const std::string& filter) {
-    std::vector<ReconciliationRecord> records;
-    if (!db) return records;
-
+using ReconciliationRow = RowDecoder<
+    &DatabaseManager::ReconciliationRecord::payment_id,
+    &DatabaseManager::ReconciliationRecord::payment_date,
+    &DatabaseManager::ReconciliationRecord::payment_doc_number,
+    &DatabaseManager::ReconciliationRecord::payment_amount,
+    &DatabaseManager::ReconciliationRecord::payment_description,
+    &DatabaseManager::ReconciliationRecord::counterparty_name,
+    &DatabaseManager::ReconciliationRecord::payment_detail_id,
+    &DatabaseManager::ReconciliationRecord::detail_amount,
+    &DatabaseManager::ReconciliationRecord::kosgu_code,
+    &DatabaseManager::ReconciliationRecord::base_doc_id,
+    &DatabaseManager::ReconciliationRecord::base_doc_date,
+    &DatabaseManager::ReconciliationRecord::base_doc_number,
+    &DatabaseManager::ReconciliationRecord::base_doc_name,
+    &DatabaseManager::ReconciliationRecord::base_doc_total,
+    &DatabaseManager::ReconciliationRecord::base_doc_for_checking,
+    &DatabaseManager::ReconciliationRecord::base_doc_checked,
+    &DatabaseManager::ReconciliationRecord::contract_id,
+    &DatabaseManager::ReconciliationRecord::contract_number,
+    &DatabaseManager::ReconciliationRecord::contract_date,
+    &DatabaseManager::ReconciliationRecord::base_detail_id,
+    &DatabaseManager::ReconciliationRecord::base_detail_content,
+    &DatabaseManager::ReconciliationRecord::base_detail_debit,
+    &DatabaseManager::ReconciliationRecord::base_detail_credit,
+    &DatabaseManager::ReconciliationRecord::base_detail_kosgu,
+    &DatabaseManager::ReconciliationRecord::base_detail_amount>;
+
+// Текст строки сверки, в котором ищется фильтр: те же поля и тот же
+// регистр (lower() SQLite, как и прежний ::tolower, меняет только ASCII)
+#define RECONCILIATION_FILTER_TEXT                                            \
+    "lower(p.date || ' ' || IFNULL(p.doc_number, '') || ' ' || "              \
+    "IFNULL(c.name, '') || ' ' || IFNULL(bpd.number, '') || ' ' || "          \
+    "IFNULL(bpdd.operation_content, ''))"
+
+RowCursor<DatabaseManager::ReconciliationRecord>
+DatabaseManager::openReconciliationCursor(const std::string &filter,
+                                          const ReconciliationPageKey &after,
+                                          int limit) {
+    DB_STATS_SCOPE();
+    // page - очередные limit платежей после ключа after в порядке
+    // (дата, номер, id), а при фильтре - только платежи, у которых есть
+    // подходящая строка. Порядок берётся из индекса idx_payments_date, так
+    // что страница не требует сортировки всей таблицы. Итоги документов
+    // основания считаются один раз на документ страницы (doc_totals), а не
+    // повторным соединением с расшифровками для каждой строки. Совпадение
+    // в полях самого платежа проверяется до подзапроса по документам.
     std::string sql =
+        "WITH page AS ("
+        "  SELECT p.id FROM Payments p "
+        "  LEFT JOIN Counterparties c ON c.id = p.counterparty_id "
+        "  WHERE p.date >= ?1 AND (p.date > ?1 "
+        "    OR IFNULL(p.doc_number, '') > ?2 "
+        "    OR (IFNULL(p.doc_number, '') = ?2 AND p.id > ?3)) "
+        "  AND (?4 = '' "
+        "    OR instr(lower(p.date || ' ' || IFNULL(p.doc_number, '') || ' ' || "
+        "      IFNULL(c.name, '')), ?4) > 0 "
+        "    OR EXISTS ("
+        "    SELECT 1 FROM (SELECT 1) "
+        "    LEFT JOIN PaymentDetails pd ON pd.payment_id = p.id "
+        "    LEFT JOIN BasePaymentDocuments bpd ON bpd.id = pd.invoice_id "
+        "    LEFT JOIN BasePaymentDocumentDetails bpdd "
+        "      ON bpdd.document_id = bpd.id "
+        "    WHERE instr(" RECONCILIATION_FILTER_TEXT ", ?4) > 0)) "
+        "  ORDER BY p.date, IFNULL(p.doc_number, ''), p.id "
+        "  LIMIT ?5"
+        "), doc_totals AS ("
+        "  SELECT document_id, SUM(" SQL_KOPECKS("amount") ") / 100.0 AS total "
+        "  FROM BasePaymentDocumentDetails "
+        "  WHERE document_id IN (SELECT pd.invoice_id FROM page "
+        "    CROSS JOIN PaymentDetails pd ON pd.payment_id = page.id) "
+        "  GROUP BY document_id"
+        ") "
         "SELECT "
-        "  p.id as payment_id, p.date as payment_date, p.doc_number as payment_doc_num, "
-        "  p.amount as payment_amount, p.description as payment_desc, c.name as counterparty, "
-        "  pd.id as pd_id, pd.amount as pd_amount, k.code as kosgu_code, "
-        "  bpd.id as bpd_id, bpd.date as bpd_date, bpd.number as bpd_number, "
-        "  bpd.document_name as bpd_name, "
-        "  IFNULL(SUM(bpdd2.amount), 0.0) as bpd_total, "
-        "  bpd.is_for_checking, bpd.is_checked, "
-        "  bpd.contract_id as contract_id, "
-        "  ctr.number as contract_number, ctr.date as contract_date, "
-        "  bpdd.id as bpdd_id, bpdd.operation_content, bpdd.debit_account, "
-        "  bpdd.credit_account, bpdd_k.code as bpdd_kosgu, bpdd.amount as bpdd_amount "
-        "FROM Payments p "
+        "  p.id, p.date, p.doc_number, p.amount, p.description, c.name, "
+        "  pd.id, pd.amount, k.code, "
+        "  bpd.id, bpd.date, bpd.number, bpd.document_name, "
+        "  IFNULL(dt.total, 0.0), bpd.is_for_checking, bpd.is_checked, "
+        "  bpd.contract_id, ctr.number, ctr.date, "
+        "  bpdd.id, bpdd.operation_content, bpdd.debit_account, "
+        "  bpdd.credit_account, bpdd_k.code, bpdd.amount "
+        "FROM page "
+        "JOIN Payments p ON p.id = page.id "
         "LEFT JOIN PaymentDetails pd ON p.id = pd.payment_id "
         "LEFT JOIN Counterparties c ON p.counterparty_id = c.id "
         "LEFT JOIN KOSGU k ON pd.kosgu_id = k.id "
         "LEFT JOIN BasePaymentDocuments bpd ON pd.invoice_id = bpd.id "
+        "LEFT JOIN doc_totals dt ON dt.document_id = bpd.id "
         "LEFT JOIN Contracts ctr ON bpd.contract_id = ctr.id "
         "LEFT JOIN BasePaymentDocumentDetails bpdd ON bpd.id = bpdd.document_id "
         "LEFT JOIN KOSGU bpdd_k ON bpdd.kosgu_id = bpdd_k.id "
-        "LEFT JOIN BasePaymentDocumentDetails bpdd2 ON bpd.id = bpdd2.document_id "
-        "WHERE p.id IS NOT NULL "
-        "GROUP BY p.id, pd.id, bpd.id, bpdd.id "
-        "ORDER BY p.date, p.doc_number";
-
-    sqlite3_stmt* stmt = nullptr;
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
-    if (rc != SQLITE_OK) {
-        std::cerr << "Failed to prepare statement for getReconciliationData: "
-                  << sqlite3_errmsg(db) << std::endl;
-        return records;
-    }
+        "WHERE ?4 = '' OR instr(" RECONCILIATION_FILTER_TEXT ", ?4) > 0 "
+        "ORDER BY p.date, IFNULL(p.doc_number, ''), p.id, pd.id, bpdd.id;";
+    RowCursor<ReconciliationRecord> cursor = openCursor<ReconciliationRecord>(
+        sql, &ReconciliationRow::decode<ReconciliationRecord>,
+        "getReconciliationData");
+    if (cursor.isOpen()) {
+        std::string f = filter;
+        std::transform(f.begin(), f.end(), f.begin(), ::tolower);
+        sqlite3_bind_text(cursor.stmt, 1, after.payment_date.c_str(), -1,
+                          SQLITE_TRANSIENT);
+        sqlite3_bind_text(cursor.stmt, 2, after.payment_doc_number.c_str(), -1,
+                          SQLITE_TRANSIENT);
+        sqlite3_bind_int(cursor.stmt, 3, after.payment_id);
+        sqlite3_bind_text(cursor.stmt, 4, f.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(cursor.stmt, 5, limit);
+    }
+    return cursor;
+}
 
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        ReconciliationRecord rec;
-        rec.payment_id = sqlite3_column_int(stmt, 0);
-        const unsigned char* v = sqlite3_column_text(stmt, 1);
-        rec.payment_date = v ? (const char*)v : "";
-        v = sqlite3_column_text(stmt, 2);
-        rec.payment_doc_number = v ? (const char*)v : "";
-        rec.payment_amount = sqlite3_column_double(stmt, 3);
-        v = sqlite3_column_text(stmt, 4);
-        rec.payment_description = v ? (const char*)v : "";
-        v = sqlite3_column_text(stmt, 5);
-        rec.counterparty_name = v ? (const char*)v : "";
-        rec.payment_detail_id = sqlite3_column_int(stmt, 6);
-        rec.detail_amount = sqlite3_column_double(stmt, 7);
-        v = sqlite3_column_text(stmt, 8);
-        rec.kosgu_code = v ? (const char*)v : "";
-
-        rec.base_doc_id = sqlite3_column_int(stmt, 9);
-        v = sqlite3_column_text(stmt, 10);
-        rec.base_doc_date = v ? (const char*)v : "";
-        v = sqlite3_column_text(stmt, 11);
-        rec.base_doc_number = v ? (const char*)v : "";
-        v = sqlite3_column_text(stmt, 12);
-        rec.base_doc_name = v ? (const char*)v : "";
-        rec.base_doc_total = sqlite3_column_double(stmt, 13);
-        rec.base_doc_for_checking = sqlite3_column_int(stmt, 14) != 0;
-        rec.base_doc_checked = sqlite3_column_int(stmt, 15) != 0;
-        rec.contract_id = sqlite3_column_int(stmt, 16);
-        v = sqlite3_column_text(stmt, 17);
-        rec.contract_number = v ? (const char*)v : "";
-        v = sqlite3_column_text(stmt, 18);
-        rec.contract_date = v ? (const char*)v : "";
-
-        rec.base_detail_id = sqlite3_column_int(stmt, 19);
-        v = sqlite3_column_text(stmt, 20);
-        rec.base_detail_content = v ? (const char*)v : "";
-        v = sqlite3_column_text(stmt, 21);
-        rec.base_detail_debit = v ? (const char*)v : "";
-        v = sqlite3_column_text(stmt, 22);
-        rec.base_detail_credit = v ? (const char*)v : "";
-        v = sqlite3_column_text(stmt, 23);
-        rec.base_detail_kosgu = v ? (const char*)v : "";
-        rec.base_detail_amount = sqlite3_column_double(stmt, 24);
-
-        // Фильтрация
-        if (!filter.empty()) {
-            std::string f = filter;
-            std::transform(f.begin(), f.end(), f.begin(), ::tolower);
-            std::string combined = rec.payment_date + " " + rec.payment_doc_number + " " +
-                                   rec.counterparty_name + " " + rec.base_doc_number + " " +
-                                   rec.base_detail_content;
-            std::transform(combined.begin(), combined.end(), combined.begin(), ::tolower);
-            if (combined.find(f) == std::string::npos) continue;
-        }
+#undef RECONCILIATION_FILTER_TEXT
 
-        records.push_back(rec);
-    }
-    sqlite3_finalize(stmt);
+std::vector<DatabaseManager::ReconciliationRecord>
+DatabaseManager::getReconciliationPage(const std::string &filter,
+                                       const ReconciliationPageKey &after,
+                                       int limit) {
+    DB_STATS_SCOPE();
+    std::vector<ReconciliationRecord> records;
+    RowCursor<ReconciliationRecord> cursor =
+        openReconciliationCursor(filter, after, limit);
+    drainCursor(cursor, records);
     return records;
 }
+
+std::vector<DatabaseManager::ReconciliationRecord> DatabaseManager::getReconciliationData(const std::string& filter) {
+    DB_STATS_SCOPE();
+    return getReconciliationPage(filter, ReconciliationPageKey(), -1);
+}
@@ -1,20 +1,31 @@
 #pragma once
 
+#include <atomic>
 #include <string>
 #include <vector>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
 #include <sqlite3.h>
 
 #include "Kosgu.h"
 #include "Counterparty.h"
 #include "Contract.h"
+#include "Date.h"
+#include "Money.h"
 #include "Payment.h"
+#include "PaymentStore.h"
 #include "PaymentDetail.h"
 #include "Settings.h"
 #include "Regex.h"
 #include "SuspiciousWord.h"
 #include "BasePaymentDocument.h"
+#include "DataChangeBus.h"
 
 struct ContractExportData; // Forward declaration
+template <typename Row> class RowCursor;
 
 class DatabaseManager {
 public:
@@ -22,17 +33,34 @@ public:
 ~DatabaseManager();
 
     bool open(const std::string& filepath);
+    // Соединение только для чтения (без миграций схемы) для фоновых читателей
+    bool openReadOnly(const std::string& filepath);
     void close();
     bool createDatabase(const std::string& filepath);
     bool backupTo(const std::string& backupFilepath);
     bool is_open() const;
     sqlite3* getDatabase() const { return db; }
+    // Прерывает выполняющийся на соединении запрос (sqlite3_interrupt);
+    // можно вызывать из другого потока
+    void interrupt();
+    // Пока флаг установлен, запросы на соединении завершаются с
+    // SQLITE_INTERRUPT. В отличие от interrupt() действует и на запросы,
+    // которые начнутся после установки флага. nullptr - снять проверку.
+    void setInterruptFlag(const std::atomic<bool>* flag);
+    // Запрос - одна инструкция, которая возвращает строки и не меняет базу
+    // (её можно выполнить на соединении только для чтения)
+    bool isReadOnlyQuery(const std::string& sql);
+
+    // Уведомления об изменениях (sqlite3_update_hook): строки, изменённые
+    // через это соединение, публикуются в шину после фиксации транзакции
+    void setChangeBus(DataChangeBus* bus);
 
     // Settings
     Settings getSettings();
     bool updateSettings(const Settings& settings);
 
     std::vector<Kosgu> getKosguEntries();
+    bool getKosguEntryById(int id, Kosgu& entry);
     bool addKosguEntry(Kosgu& entry);
     bool updateKosguEntry(const Kosgu& entry);
     bool deleteKosguEntry(int id);
@@ -51,9 +79,33 @@ public:
     int updateContractProcurementCode(const std::string& number, const std::string& date, const std::string& procurement_code);
     bool updateContractProcurementCode(int contract_id, const std::string& procurement_code);
     std::vector<Contract> getContracts();
+    bool getContractById(int id, Contract& contract);
     bool updateContract(const Contract& contract);
     bool updateContractFlags(int contract_id, bool is_for_checking, bool is_for_special_control);
     bool deleteContract(int id);
+
+    // Справочники идентификаторов для импорта и групповых операций:
+    // код -> КОСГУ, наименование (без ИНН) -> контрагент, номер и дата ->
+    // договор. Справочник загружается целиком при первом обращении, после
+    // чего поиск не обращается к базе. Отсутствующие записи (create = true)
+    // добавляются пакетом в одной точке сохранения. Справочник сбрасывается
+    // при изменении или удалении записей на этом соединении, при откате и
+    // при фиксации изменений другим соединением (PRAGMA data_version).
+    // Не найдено и не создано: -1.
+    int resolveKosguId(const std::string& code, bool create = true);
+    int resolveCounterpartyId(const std::string& name, bool create = true);
+    int resolveContractId(const std::string& number, const std::string& date,
+                          int counterparty_id = -1, bool create = true);
+    bool resolveKosguIds(const std::vector<std::string>& codes, std::vector<int>& ids,
+                         bool create = true);
+    bool resolveCounterpartyIds(const std::vector<std::string>& names, std::vector<int>& ids,
+                                bool create = true);
+    // keys - пары (номер, дата); counterparty_ids - контрагент для
+    // создаваемого договора (пустой вектор - без контрагента)
+    bool resolveContractIds(const std::vector<std::pair<std::string, std::string>>& keys,
+                            const std::vector<int>& counterparty_ids, std::vector<int>& ids,
+                            bool create = true);
+    void invalidateReferenceCache();
     void transferPaymentDetails(int from_contract_id, int to_contract_id);
     std::vector<ContractPaymentInfo> getPaymentInfoForContract(int contract_id);
 
@@ -68,6 +120,7 @@ public:
 
     // BasePaymentDocumentDetail methods
     bool addBasePaymentDocumentDetail(BasePaymentDocumentDetail& detail);
+    bool addBasePaymentDocumentDetails(std::vector<BasePaymentDocumentDetail>& details);
     std::vector<BasePaymentDocumentDetail> getBasePaymentDocumentDetails(int document_id);
     std::vector<BasePaymentDocumentDetail> getAllBasePaymentDocumentDetails();
     bool updateBasePaymentDocumentDetail(const BasePaymentDocumentDetail& detail);
@@ -121,9 +174,83 @@ public:
         double base_detail_amount;
     };
 
+    // Ключ постраничной выборки сверки - последний платёж предыдущей
+    // страницы; значение по умолчанию - начало выборки
+    struct ReconciliationPageKey {
+        std::string payment_date;
+        std::string payment_doc_number;
+        int payment_id = -1;
+    };
+
+    // Вся выборка сверки (для экспорта)
     std::vector<ReconciliationRecord> getReconciliationData(const std::string& filter = "");
+    // Строки сверки не более чем limit платежей, следующих за after
+    // (limit < 0 - без ограничения). filter - подстрока без учёта регистра
+    // (ASCII) в дате и номере ПП, контрагенте, номере ДО и содержании
+    // операции; отбор выполняется в запросе.
+    std::vector<ReconciliationRecord> getReconciliationPage(const std::string& filter,
+                                                            const ReconciliationPageKey& after,
+                                                            int limit);
 
     std::vector<Payment> getPayments();
+    bool getPaymentById(int id, Payment& payment);
+
+    // Отбор и порядок списка платежей (PaymentsView). Значения filter
+    // совпадают с пунктами списка "Фильтр по расшифровкам".
+    enum class PaymentListFilter {
+        All = 0,
+        WithoutKosgu,
+        WithoutContract, // кроме контрагентов, для которых договор не обязателен
+        WithoutInvoice,
+        WithoutDetails,
+        SuspiciousWords,
+        Incoming,
+        WithNote
+    };
+    struct PaymentListQuery {
+        // Каждое слово должно найтись в дате, номере или сумме (подстрокой)
+        // либо в назначении, получателе, примечании (по индексу PaymentsFts)
+        std::vector<std::string> terms;
+        PaymentListFilter filter = PaymentListFilter::All;
+        // Границы периода включительно; недействительная дата - без границы
+        Date date_from;
+        Date date_to;
+        // Столбцы: 0 дата, 1 номер, 2 сумма, 3 контрагент, 4 назначение,
+        // 5 примечание. Без сортировки - по id
+        struct SortKey {
+            int column;
+            bool descending;
+        };
+        std::vector<SortKey> sort;
+    };
+    struct PaymentListTotals {
+        Money amount;         // сумма отобранных платежей
+        Money details_amount; // сумма их расшифровок
+    };
+    // id отобранных платежей в порядке сортировки; отбор и сортировка
+    // выполняются в запросе, строки платежей не читаются
+    bool getPaymentIds(const PaymentListQuery& query, std::vector<int>& ids);
+    bool getPaymentListTotals(const PaymentListQuery& query, PaymentListTotals& totals);
+    // Платежи с указанными id в том же порядке; удалённые пропускаются
+    std::vector<Payment> getPaymentsByIds(const std::vector<int>& ids);
+    // Платежи в столбцовое хранилище, без промежуточных Payment; строки
+    // хранилища упорядочены по id
+    bool loadPaymentStore(PaymentStore& store);
+    // Только платежи с указанными id (удалённые пропускаются)
+    bool loadPaymentStore(const std::vector<int>& ids, PaymentStore& store);
+    // Снимок хранилища платежей в файле <база>.snapshot: читается через
+    // отображение в память за миллисекунды вместо полной выборки. Снимок
+    // принимается, если совпадают версия схемы, число платежей и
+    // наибольший id (data_version действует только в пределах соединения
+    // и для сверки между запусками не годится). Правки без изменения числа
+    // строк отметка не видит: после снимка нужна фоновая loadPaymentStore.
+    std::string paymentSnapshotPath();
+    // Версия схемы (PRAGMA user_version) для отметки снимка
+    uint32_t getSchemaVersion();
+    bool getPaymentSnapshotStamp(PaymentStore::SnapshotStamp& stamp);
+    bool loadPaymentSnapshot(PaymentStore& store);
+    bool savePaymentSnapshot(const PaymentStore& store);
+    void removePaymentSnapshot();
     bool addPayment(Payment& payment);
     bool updatePayment(const Payment& payment);
     bool deletePayment(int id);
@@ -134,7 +261,18 @@ public:
     std::vector<CounterpartyPaymentInfo> getAllCounterpartyPaymentInfo();
     std::vector<ContractExportData> getContractsForExport();
 
+    // Полнотекстовый поиск (FTS5). Возвращает id подходящих записей по
+    // возрастанию. Слова ищутся по префиксу, текст в кавычках - как фраза,
+    // все части должны встретиться: «оплата "по договору"».
+    std::vector<int> searchPayments(const std::string& text);
+    std::vector<int> searchBasePaymentDocumentDetails(const std::string& text);
+    // Выражение MATCH для строки поиска пользователя (пустое, если искать нечего)
+    static std::string buildFullTextQuery(const std::string& text);
+
     bool addPaymentDetail(PaymentDetail& detail);
+    // Пакетное добавление одним запросом в одной точке сохранения; id
+    // записываются в элементы. При ошибке не добавляется ни одна строка.
+    bool addPaymentDetails(std::vector<PaymentDetail>& details);
     std::vector<PaymentDetail> getPaymentDetails(int payment_id);
     std::vector<PaymentDetail> getAllPaymentDetails();
     bool updatePaymentDetail(const PaymentDetail& detail);
@@ -162,12 +300,240 @@ public:
     bool ClearContracts();
     bool ClearBasePaymentDocuments();
     bool CleanOrphanPaymentDetails();
+    // Пересчёт таблиц итогов по КОСГУ, договорам и контрагентам с нуля
+    bool rebuildAggregateTotals();
     
     bool executeSelect(const std::string& sql, std::vector<std::string>& columns, std::vector<std::vector<std::string>>& rows);
 
+    // Потоковое чтение больших выборок: строки декодируются по одной по мере
+    // обхода курсора, и вся выборка в памяти не держится. Пока курсор
+    // открыт, он удерживает подготовленный запрос (и снимок базы в WAL).
+    RowCursor<Payment> openPaymentsCursor();
+    RowCursor<PaymentDetail> openPaymentDetailsCursor();
+    RowCursor<KosguPaymentDetailInfo> openKosguPaymentInfoCursor();
+    RowCursor<ReconciliationRecord> openReconciliationCursor(const std::string& filter,
+                                                             const ReconciliationPageKey& after,
+                                                             int limit);
+    RowCursor<ContractExportData> openContractsForExportCursor();
+
+    // Построчный обход произвольного SELECT; visitor возвращает false, чтобы
+    // прекратить обход. Буфер строки переиспользуется между вызовами.
+    using SelectRowVisitor = std::function<bool(const std::vector<std::string>& columns,
+                                                const std::vector<std::string>& row)>;
+    bool streamSelect(const std::string& sql, const SelectRowVisitor& visitor);
+
+    // Транзакции и точки сохранения (SAVEPOINT)
+    bool beginTransaction();
+    bool commitTransaction();
+    bool rollbackTransaction();
+    bool inTransaction() const;
+    bool savepoint(const std::string& name);
+    bool releaseSavepoint(const std::string& name);
+    bool rollbackToSavepoint(const std::string& name);
+
+    // Статистика кэша подготовленных запросов
+    struct StatementCacheStats {
+        size_t prepared = 0; // сколько раз SQL компилировался (sqlite3_prepare)
+        size_t reused = 0;   // сколько раз выдан уже подготовленный запрос
+        size_t cached = 0;   // сколько запросов сейчас хранится в кэше
+    };
+    StatementCacheStats getStatementCacheStats();
+    void resetStatementCacheStats();
+
 private:
+    template <typename Row> friend class RowCursor;
+
+    template <typename Row>
+    RowCursor<Row> openCursor(const std::string& sql, void (*decode)(sqlite3_stmt*, Row&),
+                              const char* what);
+
+    // Сколько ждать освобождения блокировки записи другим соединением
+    static constexpr int busyTimeoutMs = 5000;
+
     bool execute(const std::string& sql);
     void checkAndUpdateDatabaseSchema();
-    
+
+    // Кэш подготовленных запросов. prepareCached() выдаёт готовый запрос из
+    // кэша (или компилирует новый), releaseCached() сбрасывает его и
+    // возвращает в кэш вместо sqlite3_finalize().
+    int prepareCached(const std::string& sql, sqlite3_stmt** stmt);
+    void releaseCached(sqlite3_stmt* stmt);
+    void clearStatementCache();
+    bool executeCached(const std::string& sql);
+    // SELECT с декодированием строк в структуры по номерам столбцов
+    template <typename Decoder, typename Row>
+    bool selectRows(const std::string& sql, std::vector<Row>& rows, const char* what);
+    template <typename Decoder, typename Row>
+    bool selectRowById(const std::string& sql, int id, Row& row);
+    std::vector<int> searchFullText(const std::string& fts_table, const std::string& text);
+    template <typename Row, typename Bind>
+    bool insertBatch(const std::string& sql, std::vector<Row>& rows, Bind bind, const char* what);
+
+    // Справочник идентификаторов (см. resolveKosguId)
+    struct ReferenceMap {
+        std::unordered_map<std::string, int> ids;
+        bool loaded = false;
+    };
+    bool prepareReferenceMap(ReferenceMap& map, const char* sql);
+    bool insertMissingKosgu(const std::vector<std::string>& codes);
+    ReferenceMap kosguByCode;
+    ReferenceMap counterpartyByName;
+    ReferenceMap contractByNumberDate; // ключ: номер + '\x1f' + дата
+    long long referenceDataVersion = -1;
+    // data_version уже проверена в текущей транзакции
+    bool referenceCheckedInTransaction = false;
+
+    // Накопление изменений до фиксации транзакции (см. setChangeBus)
+    void installChangeHooks();
+    static void onRowChanged(void* self, int op, const char* database, const char* table,
+                             sqlite3_int64 rowid);
+    static int onCommit(void* self);
+    static int onProgress(void* flag);
+    static void onRollback(void* self);
+    // Сводит изменения таблицы в текущей транзакции в Reload
+    void queueTableReload(const std::string& table);
+    // Убирает изменения строк таблиц, сведённых в Reload (перед публикацией)
+    void compactUncommittedChanges();
+    // Пересчитывает uncommittedCounts по uncommittedChanges
+    void recountUncommittedChanges();
+    // Больше изменённых строк одной таблицы за транзакцию сводятся в Reload
+    static constexpr size_t maxRowChangesPerTable = 1000;
+    DataChangeBus* changeBus = nullptr;
+    std::vector<DataChange> uncommittedChanges;
+    std::unordered_map<std::string, size_t> uncommittedCounts;
+    // Открытые точки сохранения: имя и размер uncommittedChanges при
+    // открытии. До фиксации uncommittedChanges только растёт, поэтому
+    // ROLLBACK TO отбрасывает изменения усечением до этого размера.
+    std::vector<std::pair<std::string, size_t>> savepointMarks;
+
     sqlite3* db;
+
+    std::unordered_map<std::string, std::vector<sqlite3_stmt*>> statementCache; // свободные запросы по тексту SQL
+    std::unordered_set<sqlite3_stmt*> checkedOutStatements; // выданные, ещё не возвращённые
+    std::mutex statementCacheMutex;
+    size_t statementsPrepared = 0;
+    size_t statementsReused = 0;
+};
+
+// Транзакционная сессия импорта (RAII).
+// Все изменения идут в одной транзакции; каждая строка источника
+// оборачивается в точку сохранения (beginRow/endRow), поэтому ошибочная
+// строка откатывается целиком, не затрагивая остальные. При commit_every > 0
+// транзакция фиксируется каждые commit_every строк. Если commit() не был
+// вызван (отмена, ошибка, исключение), деструктор откатывает всё, что не
+// было зафиксировано.
+class TransactionSession {
+public:
+    explicit TransactionSession(DatabaseManager* dbManager, int commit_every = 0);
+    ~TransactionSession();
+
+    TransactionSession(const TransactionSession&) = delete;
+    TransactionSession& operator=(const TransactionSession&) = delete;
+
+    bool isActive() const { return active; }
+    bool beginRow();
+    bool endRow(bool success);
+    bool commit();
+    void rollback();
+
+private:
+    DatabaseManager* dbManager;
+    int commitEvery;
+    int rowsInBatch = 0;
+    bool active = false;
+    bool inRow = false;
+};
+
+// Курсор по результату запроса DatabaseManager. Строки читаются из
+// подготовленного запроса по одной (next), пачками (nextBatch) или обходом
+// с досрочной остановкой (forEach). Запрос возвращается в кэш при
+// закрытии курсора или по достижении конца выборки.
+template <typename Row>
+class RowCursor {
+public:
+    using DecodeFn = void (*)(sqlite3_stmt*, Row&);
+
+    RowCursor() = default;
+    RowCursor(RowCursor&& other) noexcept
+        : owner(other.owner), stmt(other.stmt), decode(other.decode), error(other.error) {
+        other.stmt = nullptr;
+    }
+    RowCursor& operator=(RowCursor&& other) noexcept {
+        if (this != &other) {
+            close();
+            owner = other.owner;
+            stmt = other.stmt;
+            decode = other.decode;
+            error = other.error;
+            other.stmt = nullptr;
+        }
+        return *this;
+    }
+    RowCursor(const RowCursor&) = delete;
+    RowCursor& operator=(const RowCursor&) = delete;
+    ~RowCursor() { close(); }
+
+    bool isOpen() const { return stmt != nullptr; }
+    // Выборка прервана ошибкой SQLite (а не закончилась)
+    bool failed() const { return error; }
+
+    bool next(Row& row) {
+        if (!stmt)
+            return false;
+        int rc = sqlite3_step(stmt);
+        if (rc == SQLITE_ROW) {
+            decode(stmt, row);
+            return true;
+        }
+        if (rc != SQLITE_DONE) {
+            error = true;
+            std::cerr << "Cursor step failed: " << sqlite3_errstr(rc) << std::endl;
+        }
+        close();
+        return false;
+    }
+
+    // Заменяет содержимое batch следующими batch_size строками; 0 - конец
+    size_t nextBatch(std::vector<Row>& batch, size_t batch_size) {
+        batch.clear();
+        while (batch.size() < batch_size) {
+            batch.emplace_back();
+            if (!next(batch.back())) {
+                batch.pop_back();
+                break;
+            }
+        }
+        return batch.size();
+    }
+
+    // visitor(const Row&) возвращает false, чтобы прекратить обход.
+    // Строка-буфер переиспользуется, поэтому память не растёт с выборкой.
+    template <typename Visitor>
+    bool forEach(Visitor&& visitor) {
+        Row row{};
+        while (next(row)) {
+            if (!visitor(static_cast<const Row&>(row))) {
+                close();
+                break;
+            }
+        }
+        return !error;
+    }
+
+    void close() {
+        if (stmt) {
+            owner->releaseCached(stmt);
+            stmt = nullptr;
+        }
+    }
+
+private:
+    friend class DatabaseManager;
+    RowCursor(DatabaseManager* owner, sqlite3_stmt* stmt, DecodeFn decode)
+        : owner(owner), stmt(stmt), decode(decode) {}
+
+    DatabaseManager* owner = nullptr;
+    sqlite3_stmt* stmt = nullptr;
+    DecodeFn decode = nullptr;
+    bool error = false;
 };
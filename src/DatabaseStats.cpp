@@ -0,0 +1,235 @@
+#include "DatabaseStats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+// Самый внутренний замер на потоке: ему засчитываются выбранные строки
+static thread_local DatabaseStats::Scope *currentScope = nullptr;
+
+static size_t histogramBucket(double ms) {
+    double us = ms * 1000.0;
+    if (us < 1.0)
+        return 0;
+    size_t bucket = (size_t)std::floor(std::log2(us)) + 1;
+    return std::min(bucket, DatabaseStats::histogramBuckets - 1);
+}
+
+double DatabaseStats::MethodStats::percentileMs(double p) const {
+    if (calls == 0)
+        return 0.0;
+    uint64_t target = (uint64_t)std::ceil(p * (double)calls);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < histogramBuckets; i++) {
+        seen += histogram[i];
+        if (seen >= target) {
+            // Граница корзины не больше наибольшей длительности; последняя
+            // корзина сверху не ограничена
+            return i + 1 < histogramBuckets
+                       ? std::min(std::ldexp(1.0, (int)i) / 1000.0, maxMs)
+                       : maxMs;
+        }
+    }
+    return maxMs;
+}
+
+DatabaseStats &DatabaseStats::instance() {
+    static DatabaseStats stats;
+    return stats;
+}
+
+DatabaseStats::Scope::Scope(const char *method) : method(method) {
+    if (!instance().enabled())
+        return;
+    active = true;
+    parent = currentScope;
+    currentScope = this;
+    start = std::chrono::steady_clock::now();
+}
+
+DatabaseStats::Scope::~Scope() {
+    if (!active)
+        return;
+    double ms = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+    currentScope = parent;
+    instance().recordCall(method, ms, rows);
+}
+
+void DatabaseStats::attach(sqlite3 *db) {
+    if (!db)
+        return;
+    DatabaseStats &stats = instance();
+    std::lock_guard<std::mutex> lock(stats.connectionsMutex);
+    stats.connections.push_back(db);
+    stats.installTrace(db);
+}
+
+void DatabaseStats::detach(sqlite3 *db) {
+    if (!db)
+        return;
+    DatabaseStats &stats = instance();
+    std::lock_guard<std::mutex> lock(stats.connectionsMutex);
+    auto it = std::find(stats.connections.begin(), stats.connections.end(), db);
+    if (it != stats.connections.end())
+        stats.connections.erase(it);
+}
+
+void DatabaseStats::setEnabled(bool enabled) {
+    if (enabledFlag.exchange(enabled) != enabled)
+        updateTraces();
+}
+
+void DatabaseStats::setStatementProfiling(bool enabled) {
+    if (profilingFlag.exchange(enabled) != enabled)
+        updateTraces();
+}
+
+// Строки считаются для статистики вызовов, время инструкций - только при
+// профилировании; без них обратный вызов на каждую строку не нужен
+unsigned DatabaseStats::traceMask() const {
+    if (!enabledFlag)
+        return 0;
+    return SQLITE_TRACE_ROW | (profilingFlag ? SQLITE_TRACE_PROFILE : 0);
+}
+
+void DatabaseStats::installTrace(sqlite3 *db) const {
+    unsigned mask = traceMask();
+    sqlite3_trace_v2(db, mask, mask ? onTrace : nullptr, nullptr);
+}
+
+// Соединения работают в своих потоках; sqlite3_trace_v2 в
+// многопоточном режиме SQLite сам ждёт мьютекса соединения
+void DatabaseStats::updateTraces() {
+    std::lock_guard<std::mutex> lock(connectionsMutex);
+    for (sqlite3 *db : connections) {
+        installTrace(db);
+    }
+}
+
+int DatabaseStats::onTrace(unsigned type, void *, void *p, void *x) {
+    if (type == SQLITE_TRACE_ROW) {
+        if (currentScope)
+            currentScope->rows++;
+    } else if (type == SQLITE_TRACE_PROFILE) {
+        DatabaseStats &stats = instance();
+        if (stats.enabled() && stats.statementProfiling()) {
+            // x - время выполнения инструкции в наносекундах
+            const char *sql = sqlite3_sql(static_cast<sqlite3_stmt *>(p));
+            double ms = *static_cast<sqlite3_int64 *>(x) / 1e6;
+            stats.recordStatement(sql ? sql : "", ms);
+        }
+    }
+    return 0;
+}
+
+void DatabaseStats::recordCall(const char *method, double ms, uint64_t rows) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = methodStats.find(method);
+    if (it == methodStats.end()) {
+        it = methodStats.emplace(method, MethodStats()).first;
+        it->second.name = method;
+    }
+    MethodStats &stats = it->second;
+    stats.calls++;
+    stats.rows += rows;
+    stats.totalMs += ms;
+    stats.maxMs = std::max(stats.maxMs, ms);
+    stats.histogram[histogramBucket(ms)]++;
+}
+
+void DatabaseStats::recordStatement(const char *sql, double ms) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = statementStats.find(sql);
+    if (it == statementStats.end()) {
+        std::string key = statementStats.size() < maxStatements ? sql : "(прочие)";
+        it = statementStats.emplace(key, StatementStats()).first;
+        it->second.sql = key;
+    }
+    StatementStats &stats = it->second;
+    stats.calls++;
+    stats.totalMs += ms;
+    stats.maxMs = std::max(stats.maxMs, ms);
+}
+
+std::vector<DatabaseStats::MethodStats> DatabaseStats::methods() {
+    std::vector<MethodStats> result;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        result.reserve(methodStats.size());
+        for (const auto &entry : methodStats)
+            result.push_back(entry.second);
+    }
+    std::sort(result.begin(), result.end(),
+              [](const MethodStats &a, const MethodStats &b) {
+                  return a.totalMs > b.totalMs;
+              });
+    return result;
+}
+
+std::vector<DatabaseStats::StatementStats> DatabaseStats::statements() {
+    std::vector<StatementStats> result;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        result.reserve(statementStats.size());
+        for (const auto &entry : statementStats)
+            result.push_back(entry.second);
+    }
+    std::sort(result.begin(), result.end(),
+              [](const StatementStats &a, const StatementStats &b) {
+                  return a.totalMs > b.totalMs;
+              });
+    return result;
+}
+
+void DatabaseStats::reset() {
+    std::lock_guard<std::mutex> lock(mutex);
+    methodStats.clear();
+    statementStats.clear();
+}
+
+static std::string csvField(const std::string &text) {
+    std::string escaped = "\"";
+    for (char c : text) {
+        if (c == '"') {
+            escaped += "\"\"";
+        } else {
+            escaped += c;
+        }
+    }
+    escaped += "\"";
+    return escaped;
+}
+
+bool DatabaseStats::writeCsv(const std::string &path) {
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Cannot write statistics: " << path << std::endl;
+        return false;
+    }
+
+    file << "\"Метод\",\"Вызовов\",\"Строк\",\"Всего, мс\",\"Среднее, мс\","
+            "\"p50, мс\",\"p95, мс\",\"Макс, мс\"\n";
+    for (const auto &method : methods()) {
+        file << csvField(method.name) << "," << method.calls << ","
+             << method.rows << "," << method.totalMs << ","
+             << method.totalMs / method.calls << ","
+             << method.percentileMs(0.5) << "," << method.percentileMs(0.95)
+             << "," << method.maxMs << "\n";
+    }
+
+    std::vector<StatementStats> sql = statements();
+    if (!sql.empty()) {
+        file << "\n\"Запрос\",\"Выполнений\",\"Всего, мс\",\"Среднее, мс\","
+                "\"Макс, мс\"\n";
+        for (const auto &statement : sql) {
+            file << csvField(statement.sql) << "," << statement.calls << ","
+                 << statement.totalMs << ","
+                 << statement.totalMs / statement.calls << ","
+                 << statement.maxMs << "\n";
+        }
+    }
+    return file.good();
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sqlite3.h>
+
+// Статистика вызовов методов DatabaseManager по всем соединениям процесса
+// (поток UI, поток записи, пул чтения): число вызовов, суммарное и
+// наибольшее время, гистограмма длительностей и число строк, выбранных за
+// время вызова. При включённом профилировании запросов дополнительно
+// собирается время каждой SQL-инструкции (sqlite3_trace_v2).
+class DatabaseStats {
+public:
+    // Корзина i гистограммы - длительности от 2^(i-1) до 2^i мкс,
+    // последняя - всё, что дольше
+    static constexpr size_t histogramBuckets = 24;
+
+    struct MethodStats {
+        std::string name;
+        uint64_t calls = 0;
+        uint64_t rows = 0;
+        double totalMs = 0.0;
+        double maxMs = 0.0;
+        uint64_t histogram[histogramBuckets] = {};
+
+        // Верхняя граница корзины, в которую попадает доля p вызовов (мс)
+        double percentileMs(double p) const;
+    };
+
+    struct StatementStats {
+        std::string sql;
+        uint64_t calls = 0;
+        double totalMs = 0.0;
+        double maxMs = 0.0;
+    };
+
+    static DatabaseStats& instance();
+
+    // Замер одного вызова метода: от создания до разрушения. Строки,
+    // выбранные на этом потоке за время вызова, засчитываются методу; при
+    // вложенных вызовах - самому внутреннему.
+    class Scope {
+    public:
+        explicit Scope(const char* method);
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        friend class DatabaseStats;
+        const char* method;
+        std::chrono::steady_clock::time_point start;
+        uint64_t rows = 0;
+        Scope* parent = nullptr;
+        bool active = false;
+    };
+
+    // Подключает соединение: трассировка sqlite3_trace_v2 (счётчик строк,
+    // время инструкций) ставится на нём, только пока включена, и
+    // переставляется на всех подключённых соединениях при переключении.
+    // detach - до закрытия соединения.
+    static void attach(sqlite3* db);
+    static void detach(sqlite3* db);
+
+    void setEnabled(bool enabled);
+    bool enabled() const { return enabledFlag; }
+    void setStatementProfiling(bool enabled);
+    bool statementProfiling() const { return profilingFlag; }
+
+    // Копии для отображения; методы - по убыванию суммарного времени
+    std::vector<MethodStats> methods();
+    std::vector<StatementStats> statements();
+    void reset();
+    // Методы и инструкции в CSV (как экспорт договоров: запятая, кавычки)
+    bool writeCsv(const std::string& path);
+
+private:
+    DatabaseStats() = default;
+
+    void recordCall(const char* method, double ms, uint64_t rows);
+    void recordStatement(const char* sql, double ms);
+    static int onTrace(unsigned type, void* context, void* p, void* x);
+    unsigned traceMask() const;
+    void installTrace(sqlite3* db) const;
+    void updateTraces();
+
+    // Разные SQL (например, с IN-списками разной длины) сверх этого числа
+    // сводятся в одну строку, чтобы таблица не росла без предела
+    static constexpr size_t maxStatements = 500;
+
+    std::atomic<bool> enabledFlag{true};
+    std::atomic<bool> profilingFlag{false};
+    std::mutex mutex;
+    // Подключённые соединения; под connectionsMutex трассировка ставится
+    // и снимается, поэтому соединение не закроется во время переустановки
+    std::mutex connectionsMutex;
+    std::vector<sqlite3*> connections;
+    std::unordered_map<std::string, MethodStats> methodStats;
+    std::unordered_map<std::string, StatementStats> statementStats;
+};
+
+// Замер текущего метода DatabaseManager (имя - __func__)
+#define DB_STATS_SCOPE() DatabaseStats::Scope db_stats_scope_(__func__)
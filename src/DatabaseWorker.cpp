@@ -0,0 +1,175 @@
+#include "DatabaseWorker.h"
+
+#include <iostream>
+#include <utility>
+
+DatabaseWorker::DatabaseWorker() : worker(&DatabaseWorker::run, this) {}
+
+DatabaseWorker::~DatabaseWorker() { stop(); }
+
+void DatabaseWorker::setDatabasePath(const std::string &path) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (path == dbPath)
+        return;
+    dbPath = path;
+    pathChanged = true;
+}
+
+void DatabaseWorker::setChangeBus(DataChangeBus *bus) {
+    std::lock_guard<std::mutex> lock(mutex);
+    changeBus = bus;
+}
+
+bool DatabaseWorker::submit(Job job) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping)
+            return false;
+        jobs.push_back(std::move(job));
+    }
+    cv.notify_one();
+    return true;
+}
+
+bool DatabaseWorker::isBusy() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return running || !jobs.empty();
+}
+
+void DatabaseWorker::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+void DatabaseWorker::run() {
+    // Соединение принадлежит потоку записи и используется только в нём
+    DatabaseManager connection;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        cv.wait(lock, [this]() { return stopping || !jobs.empty(); });
+        if (stopping)
+            break;
+
+        Job job = std::move(jobs.front());
+        jobs.pop_front();
+        bool reopen = pathChanged;
+        std::string path = dbPath;
+        DataChangeBus *bus = changeBus;
+        pathChanged = false;
+        running = true;
+        lock.unlock();
+
+        connection.setChangeBus(bus);
+        if (reopen) {
+            connection.close();
+            if (!path.empty() && !connection.open(path)) {
+                std::cerr << "Database worker: cannot open " << path
+                          << std::endl;
+            }
+        }
+        job(connection.is_open() ? &connection : nullptr);
+
+        lock.lock();
+        running = false;
+    }
+}
+
+ReadConnectionPool::Lease::Lease(Lease &&other) noexcept
+    : pool(other.pool), connection(std::move(other.connection)),
+      generation(other.generation) {
+    other.pool = nullptr;
+}
+
+ReadConnectionPool::Lease &
+ReadConnectionPool::Lease::operator=(Lease &&other) noexcept {
+    if (this != &other) {
+        release();
+        pool = other.pool;
+        connection = std::move(other.connection);
+        generation = other.generation;
+        other.pool = nullptr;
+    }
+    return *this;
+}
+
+ReadConnectionPool::Lease::~Lease() { release(); }
+
+void ReadConnectionPool::Lease::release() {
+    if (pool && connection) {
+        pool->giveBack(std::move(connection), generation);
+    }
+    pool = nullptr;
+    connection.reset();
+}
+
+ReadConnectionPool::ReadConnectionPool(size_t max_connections)
+    : maxConnections(max_connections > 0 ? max_connections : 1) {}
+
+void ReadConnectionPool::setDatabasePath(const std::string &path) {
+    std::vector<std::unique_ptr<DatabaseManager>> stale;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (path == dbPath)
+            return;
+        dbPath = path;
+        ++generation;
+        stale.swap(idle);
+    }
+    // Соединения со старой базой закрываются вне блокировки
+    stale.clear();
+}
+
+ReadConnectionPool::Lease ReadConnectionPool::acquire() {
+    Lease lease;
+    std::unique_lock<std::mutex> lock(mutex);
+    if (dbPath.empty())
+        return lease;
+    cv.wait(lock, [this]() { return !idle.empty() || leased < maxConnections; });
+    if (dbPath.empty())
+        return lease;
+
+    if (!idle.empty()) {
+        lease.connection = std::move(idle.back());
+        idle.pop_back();
+    }
+    ++leased;
+    std::string path = dbPath;
+    int current_generation = generation;
+    lock.unlock();
+
+    if (!lease.connection) {
+        auto connection = std::make_unique<DatabaseManager>();
+        if (!connection->openReadOnly(path)) {
+            lock.lock();
+            --leased;
+            lock.unlock();
+            cv.notify_one();
+            return lease;
+        }
+        lease.connection = std::move(connection);
+    }
+    lease.pool = this;
+    lease.generation = current_generation;
+    return lease;
+}
+
+void ReadConnectionPool::giveBack(std::unique_ptr<DatabaseManager> connection,
+                                  int connection_generation) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        --leased;
+        if (connection_generation == generation) {
+            idle.push_back(std::move(connection));
+        }
+    }
+    cv.notify_one();
+    // Соединение с прежней базой (если база сменилась) закрывается здесь
+    connection.reset();
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "DatabaseManager.h"
+
+// Поток записи в базу. Владеет единственным пишущим соединением и выполняет
+// задания (импорт, массовые изменения) строго по одному в порядке
+// постановки, поэтому фоновые писатели не конкурируют между собой за
+// блокировку базы. Соединение открывается в самом потоке перед первым
+// заданием и переоткрывается при смене файла базы.
+class DatabaseWorker {
+public:
+    // Задание получает соединение потока записи или nullptr, если базу не
+    // удалось открыть (задание само сообщает об ошибке и сбрасывает флаги)
+    using Job = std::function<void(DatabaseManager*)>;
+
+    DatabaseWorker();
+    ~DatabaseWorker();
+    DatabaseWorker(const DatabaseWorker&) = delete;
+    DatabaseWorker& operator=(const DatabaseWorker&) = delete;
+
+    void setDatabasePath(const std::string& path);
+    // Шина, в которую соединение потока записи публикует изменения данных
+    void setChangeBus(DataChangeBus* bus);
+    bool submit(Job job);
+    bool isBusy();
+    // Дожидается завершения текущего задания и останавливает поток;
+    // задания, оставшиеся в очереди, отбрасываются
+    void stop();
+
+private:
+    void run();
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<Job> jobs;
+    std::string dbPath;
+    DataChangeBus* changeBus = nullptr;
+    bool pathChanged = false;
+    bool running = false;
+    bool stopping = false;
+    // Последним: поток запускается в конструкторе и сразу обращается к
+    // остальным членам
+    std::thread worker;
+};
+
+// Пул соединений только для чтения для фоновых читателей (экспорт,
+// отчёты). В режиме WAL каждое соединение читает согласованный снимок базы
+// и не ждёт пишущую транзакцию потока записи.
+class ReadConnectionPool {
+public:
+    // Соединение, выданное пулом; возвращается в пул в деструкторе
+    class Lease {
+    public:
+        Lease() = default;
+        Lease(Lease&& other) noexcept;
+        Lease& operator=(Lease&& other) noexcept;
+        ~Lease();
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        DatabaseManager* get() const { return connection.get(); }
+        DatabaseManager* operator->() const { return connection.get(); }
+        explicit operator bool() const { return connection != nullptr; }
+
+    private:
+        friend class ReadConnectionPool;
+        void release();
+
+        ReadConnectionPool* pool = nullptr;
+        std::unique_ptr<DatabaseManager> connection;
+        int generation = 0;
+    };
+
+    explicit ReadConnectionPool(size_t max_connections = 4);
+
+    // Закрывает простаивающие соединения; выданные соединения закрываются
+    // при возврате в пул
+    void setDatabasePath(const std::string& path);
+    // Блокирует, пока все соединения заняты; пустой Lease, если база не
+    // задана или не открывается
+    Lease acquire();
+
+private:
+    void giveBack(std::unique_ptr<DatabaseManager> connection, int generation);
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<std::unique_ptr<DatabaseManager>> idle;
+    std::string dbPath;
+    size_t maxConnections;
+    size_t leased = 0;
+    int generation = 0;
+};
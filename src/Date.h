@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Календарная дата как номер дня от 1970-01-01 (как date_day в таблице
+// Payments, см. миграцию 7). Сравнение и разность дат - целочисленные, без
+// разбора строк. В структурах дата по-прежнему хранится строкой
+// "ГГГГ-ММ-ДД" (её редактируют поля ввода), Date - ключ сортировки и отбора.
+struct Date {
+    static constexpr int32_t none = INT32_MIN;
+    int32_t days = none;
+
+    constexpr Date() = default;
+    constexpr explicit Date(int32_t day_number) : days(day_number) {}
+
+    bool valid() const { return days != none; }
+
+    static Date fromCivil(int year, unsigned month, unsigned day) {
+        // Номер дня по григорианскому календарю (алгоритм days_from_civil)
+        year -= month <= 2;
+        const int era = (year >= 0 ? year : year - 399) / 400;
+        const unsigned yoe = (unsigned)(year - era * 400);
+        const unsigned doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+        const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        return Date(era * 146097 + (int32_t)doe - 719468);
+    }
+
+    void toCivil(int &year, unsigned &month, unsigned &day) const {
+        const int32_t z = days + 719468;
+        const int era = (z >= 0 ? z : z - 146096) / 146097;
+        const unsigned doe = (unsigned)(z - era * 146097);
+        const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        const unsigned mp = (5 * doy + 2) / 153;
+        day = doy - (153 * mp + 2) / 5 + 1;
+        month = mp < 10 ? mp + 3 : mp - 9;
+        year = (int)yoe + era * 400 + (month <= 2);
+    }
+
+    // "ГГГГ-ММ-ДД", "ДД.ММ.ГГГГ" или "ДД.ММ.ГГ" (ГГ > 50 - 19ГГ), время
+    // после даты отбрасывается. false - не дата или такого дня нет.
+    static bool parse(std::string_view text, Date &date);
+
+    // "ГГГГ-ММ-ДД"; пустая строка для недействительной даты
+    std::string toString() const {
+        if (!valid())
+            return std::string();
+        int year;
+        unsigned month, day;
+        toCivil(year, month, day);
+        char text[32];
+        snprintf(text, sizeof(text), "%04d-%02u-%02u", year, month, day);
+        return text;
+    }
+
+    // Ключ сортировки строки с датой: номер дня или недействительная дата,
+    // если строка не разбирается. Считается один раз на строку.
+    static Date sortKey(std::string_view text) {
+        Date date;
+        return parse(text, date) ? date : Date();
+    }
+
+    // Порядок строк по их ключам sortKey(): даты по номеру дня,
+    // нераспознанные строки раньше дат и между собой сравниваются как текст
+    static int compareKeys(Date a, std::string_view a_text, Date b,
+                           std::string_view b_text) {
+        if (a.days != b.days)
+            return a.days < b.days ? -1 : 1;
+        return a.valid() ? 0 : a_text.compare(b_text);
+    }
+
+    bool operator==(Date other) const { return days == other.days; }
+    bool operator!=(Date other) const { return days != other.days; }
+    bool operator<(Date other) const { return days < other.days; }
+    bool operator<=(Date other) const { return days <= other.days; }
+    bool operator>(Date other) const { return days > other.days; }
+    bool operator>=(Date other) const { return days >= other.days; }
+};
+
+inline bool Date::parse(std::string_view text, Date &date) {
+    // Время (через пробел, 'T' или ';') не учитывается
+    size_t end = text.find_first_of(" \tT;");
+    if (end != std::string_view::npos)
+        text = text.substr(0, end);
+
+    auto number = [&](size_t pos, size_t len, int &value) {
+        value = 0;
+        for (size_t i = pos; i < pos + len; i++) {
+            if (text[i] < '0' || text[i] > '9')
+                return false;
+            value = value * 10 + (text[i] - '0');
+        }
+        return true;
+    };
+
+    int year, month, day;
+    if (text.size() == 10 && text[4] == '-' && text[7] == '-') {
+        if (!number(0, 4, year) || !number(5, 2, month) || !number(8, 2, day))
+            return false;
+    } else if (text.size() == 10 && text[2] == '.' && text[5] == '.') {
+        if (!number(0, 2, day) || !number(3, 2, month) || !number(6, 4, year))
+            return false;
+    } else if (text.size() == 8 && text[2] == '.' && text[5] == '.') {
+        if (!number(0, 2, day) || !number(3, 2, month) || !number(6, 2, year))
+            return false;
+        year += year > 50 ? 1900 : 2000;
+    } else {
+        return false;
+    }
+
+    static const unsigned char month_days[] = {31, 29, 31, 30, 31, 30,
+                                               31, 31, 30, 31, 30, 31};
+    if (month < 1 || month > 12 || day < 1 || day > month_days[month - 1])
+        return false;
+    bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    if (month == 2 && day == 29 && !leap)
+        return false;
+    date = fromCivil(year, (unsigned)month, (unsigned)day);
+    return true;
+}
+
+// Сортировка строк таблицы с ключами дат: key_of(item) разбирает даты
+// элемента один раз (Date или несколько), less(a, key_a, b, key_b) -
+// порядок элементов. Сортируется перестановка, затем элементы
+// переносятся на свои места.
+template <typename T, typename KeyOf, typename Less>
+void sortWithDateKeys(std::vector<T> &items, KeyOf key_of, Less less) {
+    using Key = decltype(key_of(std::declval<const T &>()));
+    std::vector<Key> keys;
+    keys.reserve(items.size());
+    for (const T &item : items)
+        keys.push_back(key_of(item));
+
+    std::vector<size_t> order(items.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t left, size_t right) {
+        return less(items[left], keys[left], items[right], keys[right]);
+    });
+
+    std::vector<T> sorted;
+    sorted.reserve(items.size());
+    for (size_t index : order)
+        sorted.push_back(std::move(items[index]));
+    items.swap(sorted);
+}
@@ -22,13 +22,12 @@ static std::string escape_csv(const std::string& s) {
 
 ExportManager::ExportManager(DatabaseManager* db) : dbManager(db) {}
 
-int ExportManager::ExportContractsForChecking(const std::string& filepath) {
-    if (!dbManager) {
+int ExportManager::ExportContractsForChecking(const std::string& filepath, DatabaseManager* source) {
+    DatabaseManager* db = source ? source : dbManager;
+    if (!db) {
         return 0;
     }
 
-    std::vector<ContractExportData> contracts = dbManager->getContractsForExport();
-
     std::ofstream file(filepath);
     if (!file.is_open()) {
         std::cerr << "Failed to open file for writing: " << filepath << std::endl;
@@ -48,8 +47,10 @@ int ExportManager::ExportContractsForChecking(const std::string& filepath) {
          << "\"Примечание\","
          << "\"ИКЗ\"\n";
 
+    // Строки пишутся по мере чтения выборки, без промежуточного вектора
     int index = 1;
-    for (const auto& contract : contracts) {
+    RowCursor<ContractExportData> cursor = db->openContractsForExportCursor();
+    cursor.forEach([&](const ContractExportData& contract) {
         file << index++ << ","
              << escape_csv("\xE2\x80\x8B" + contract.contract_number) << "," // Prepend ZWSP
              << escape_csv(contract.contract_date) << ","
@@ -58,8 +59,9 @@ int ExportManager::ExportContractsForChecking(const std::string& filepath) {
              << (contract.is_for_special_control ? "\"Да\"" : "\"Нет\"") << ","
              << escape_csv(contract.note) << ","
              << escape_csv("\xE2\x80\x8B" + contract.procurement_code) << "\n"; // Prepend ZWSP
-    }
+        return true;
+    });
 
     file.close();
-    return contracts.size();
+    return index - 1;
 }
@@ -17,7 +17,9 @@ struct ContractExportData {
 class ExportManager {
 public:
     ExportManager(DatabaseManager* db);
-    int ExportContractsForChecking(const std::string& filepath);
+    // source - соединение для чтения (из пула фоновых читателей);
+    // по умолчанию используется соединение, переданное в конструктор
+    int ExportContractsForChecking(const std::string& filepath, DatabaseManager* source = nullptr);
 
 private:
     DatabaseManager* dbManager;
@@ -1,157 +1,223 @@
 #include "ImportManager.h"
+#include "Date.h"
+#include "Money.h"
+#include "TsvReader.h"
 #include <algorithm>
-#include <fstream>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
 #include <iostream>
 #include <iomanip>
+#include <map>
 #include <regex>
-#include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 #include <cmath>
 
 
 ImportManager::ImportManager() {}
 
-// Helper to split a string by a delimiter
-static std::vector<std::string> split(const std::string &s, char delimiter) {
-    std::vector<std::string> tokens;
-    std::string token;
-    std::istringstream tokenStream(s);
-    while (std::getline(tokenStream, token, delimiter)) {
-        tokens.push_back(token);
-    }
-    return tokens;
+std::vector<PatternEngine::Stats> ImportManager::getLastPatternStats() {
+    std::lock_guard<std::mutex> lock(patternStatsMutex);
+    return lastPatternStats;
 }
 
-// Helper to trim whitespace only
-static std::string trim(const std::string &str) {
-    size_t first = str.find_first_not_of(" \t\n\r"); // Exclude "
-    if (std::string::npos == first)
-        return "";
-    size_t last = str.find_last_not_of(" \t\n\r"); // Exclude "
-    return str.substr(first, (last - first + 1));
+void ImportManager::publishPatternStats(const PatternEngine &patterns) {
+    std::vector<PatternEngine::Stats> stats = patterns.stats();
+    std::lock_guard<std::mutex> lock(patternStatsMutex);
+    lastPatternStats.swap(stats);
 }
 
-// Helper to safely get a value from a row based on the mapping
-static std::string get_value_from_row(const std::vector<std::string> &row,
-                                      const ColumnMapping &mapping,
-                                      const std::string &field_name) {
+// Номер столбца поля по сопоставлению; -1 - поле не сопоставлено.
+// Ищется один раз до чтения строк, а не для каждой строки
+static int mappedColumn(const ColumnMapping &mapping,
+                        const std::string &field_name) {
     auto it = mapping.find(field_name);
-    if (it == mapping.end() || it->second == -1) {
-        return ""; // Not mapped
-    }
-    int col_index = it->second;
-    if (col_index >= row.size()) {
-        return ""; // Index out of bounds
-    }
-    return trim(row[col_index]);
+    return it == mapping.end() ? -1 : it->second;
 }
 
-// Helper function to convert DD.MM.YY or DD.MM.YYYY to YYYY-MM-DD
-static std::string convertDateToDBFormat(const std::string &date_str_in) {
-    std::string date_str = date_str_in;
-    
-    // Удаляем время (разделители: пробел, 'T', точка с запятой и др.)
-    size_t delim_pos = date_str.find_first_of(" \tT;");
-    if (delim_pos != std::string::npos) {
-        date_str = date_str.substr(0, delim_pos);
-    }
-
-    if (date_str.length() == 10 && date_str[2] == '.' &&
-        date_str[5] == '.') { // DD.MM.YYYY
-        return date_str.substr(6, 4) + "-" + date_str.substr(3, 2) + "-" +
-               date_str.substr(0, 2);
-    } else if (date_str.length() == 8 && date_str[2] == '.' &&
-               date_str[5] == '.') { // DD.MM.YY
-        std::string year_short = date_str.substr(6, 2);
-        int year_int = std::stoi(year_short);
-        std::string full_year = (year_int > 50)
-                                    ? "19" + year_short
-                                    : "20" + year_short; // Heuristic
-        return full_year + "-" + date_str.substr(3, 2) + "-" +
-               date_str.substr(0, 2);
-    }
-    return date_str; // Return as is if format is unexpected
+// Поле строки без пробелов по краям; пустое, если столбец не сопоставлен
+// или в строке нет столько полей
+static std::string_view fieldAt(const std::vector<std::string_view> &row,
+                                int column) {
+    if (column < 0 || column >= static_cast<int>(row.size())) {
+        return std::string_view();
+    }
+    return trimField(row[column]);
 }
 
-bool ImportManager::ImportPaymentsFromTsv(const std::string &filepath,
-                                          DatabaseManager *dbManager,
-                                          const ColumnMapping &mapping,
-                                          std::atomic<float> &progress,
-                                          std::string &message,
-                                          std::mutex &message_mutex,
-                                          std::atomic<bool> &cancel_flag,
-                                          const std::string& contract_regex_str,
-                                          const std::string& kosgu_regex_str,
-                                          bool force_income_type,
-                                          bool is_return_import,
-                                          const std::string& custom_note
-                                          ) {
-    if (!dbManager) {
-        std::lock_guard<std::mutex> lock(message_mutex);
-        message = "Ошибка: Менеджер базы данных не инициализирован.";
-        return false;
+// Невидимые символы в начале поля: BOM, неразрывные и типографские
+// пробелы (U+00A0, U+2000..U+200F, U+202F, U+205F), пробелы ASCII
+static std::string_view stripInvisible(std::string_view text) {
+    while (!text.empty()) {
+        unsigned char c0 = static_cast<unsigned char>(text[0]);
+        unsigned char c1 = text.size() >= 2 ? static_cast<unsigned char>(text[1]) : 0;
+        unsigned char c2 = text.size() >= 3 ? static_cast<unsigned char>(text[2]) : 0;
+        if (c0 == 0xEF && c1 == 0xBB && c2 == 0xBF) {
+            text.remove_prefix(3); // UTF-8 BOM (U+FEFF)
+        } else if (c0 == 0xC2 && c1 == 0xA0) {
+            text.remove_prefix(2);
+        } else if (c0 == 0xE2 && c1 == 0x80 &&
+                   ((c2 >= 0x80 && c2 <= 0x8F) || c2 == 0xAF)) {
+            text.remove_prefix(3);
+        } else if (c0 == 0xE2 && c1 == 0x81 && c2 == 0x9F) {
+            text.remove_prefix(3);
+        } else if (std::isspace(c0)) {
+            text.remove_prefix(1);
+        } else {
+            break;
+        }
     }
+    return text;
+}
 
-    std::ifstream file(filepath);
-    if (!file.is_open()) {
-        std::lock_guard<std::mutex> lock(message_mutex);
-        message = "Ошибка: Не удалось открыть TSV файл: " + filepath;
-        return false;
+// DD.MM.YY, DD.MM.YYYY (и YYYY-MM-DD) с необязательным временем ->
+// YYYY-MM-DD; строка, которая не является датой, возвращается как есть
+static std::string convertDateToDBFormat(std::string_view date_str) {
+    Date date;
+    if (Date::parse(date_str, date)) {
+        return date.toString();
     }
+    return std::string(date_str);
+}
 
-    // Get total lines for progress
-    file.seekg(0, std::ios::beg);
-    size_t total_lines = std::count(std::istreambuf_iterator<char>(file),
-                                    std::istreambuf_iterator<char>(), '\n');
-    file.clear();
-    file.seekg(0, std::ios::beg);
-
-    std::string line;
-    std::getline(file, line); // Skip header line
+// Ошибок разбора в списке импорта платежей не больше; остальные только
+// считаются
+static const size_t maxImportErrors = 1000;
 
-    std::regex contract_regex(contract_regex_str);
-    std::regex kosgu_regex(kosgu_regex_str);
-    std::regex amount_regex(
-        "\\((\\d{3}-\\d{4}-\\d{10}-\\d{3}):\\s*([\\d=,]+)\\s*ЛС\\)");
+// Ошибка разбора значения столбца для списка ошибок импорта
+static std::string columnError(size_t line_num, const char *column,
+                               std::string_view value) {
+    return "Строка " + std::to_string(line_num) + ", «" + column +
+           "»: не удалось разобрать '" + std::string(value) + "'";
+}
 
-    size_t line_num = 0;
-    while (std::getline(file, line)) {
-        // Check for cancellation
-        if (cancel_flag) {
-            std::lock_guard<std::mutex> lock(message_mutex);
-            message = "Импорт отменен пользователем.";
-            progress = 0.0f; // Reset progress
-            return false; // Indicate cancellation
+// Ход импорта для индикатора. Доля - прочитанные байты от размера файла:
+// размер известен сразу, отдельный проход для подсчёта строк не нужен.
+// Доля пишется в атомарную переменную без блокировки, а сообщение с
+// номером строки собирается и публикуется под мьютексом не чаще
+// messageInterval - поток UI не ждёт мьютекс на каждой строке.
+class ImportProgress {
+public:
+    ImportProgress(size_t file_size, std::atomic<float> &progress,
+                   std::string &message, std::mutex &message_mutex,
+                   const char *line_prefix)
+        : file_size(file_size), progress(progress), message(message),
+          message_mutex(message_mutex), line_prefix(line_prefix) {}
+
+    // offset - позиция в файле после строки line_num
+    void update(size_t line_num, size_t offset) {
+        float fraction = file_size > 0
+                             ? static_cast<float>(offset) / file_size
+                             : 1.0f;
+        progress.store(fraction, std::memory_order_relaxed);
+
+        auto now = std::chrono::steady_clock::now();
+        if (now < next_message) {
+            return;
         }
+        next_message = now + messageInterval;
+        std::string text = line_prefix + std::to_string(line_num) + " (" +
+                           std::to_string(static_cast<int>(fraction * 100)) + "%)";
+        std::lock_guard<std::mutex> lock(message_mutex);
+        message.swap(text);
+    }
 
-        line_num++;
-        progress = static_cast<float>(line_num) / total_lines;
-        {
-            std::lock_guard<std::mutex> lock(message_mutex);
-            message = "Импорт строки " + std::to_string(line_num) + " из " +
-                      std::to_string(total_lines);
-        }
+private:
+    static constexpr std::chrono::milliseconds messageInterval{100};
+
+    size_t file_size;
+    std::atomic<float> &progress;
+    std::string &message;
+    std::mutex &message_mutex;
+    const char *line_prefix;
+    std::chrono::steady_clock::time_point next_message;
+};
+
+// Платёж, разобранный из строки файла без обращения к базе. Идентификаторы
+// справочников заполняет писатель перед записью пачки.
+struct ParsedPayment {
+    // Расшифровка "; в т.ч. KXXX=AMOUNT"
+    struct BreakdownItem {
+        std::string kosgu_code;
+        Money amount;
+        int kosgu_id = -1;
+    };
 
+    Payment payment;
+    Money amount;
+    std::string counterparty_name;
+    // Договор из назначения; дата - в формате базы
+    bool has_contract = false;
+    std::string contract_number;
+    std::string contract_date;
+    int contract_id = -1;
+    // Коды расшифровки попадают в справочник КОСГУ, даже если сама
+    // расшифровка не подошла (сумма не разобралась или больше платежа)
+    std::vector<BreakdownItem> breakdown;
+    bool use_breakdown = false;
+    // КОСГУ по kosgu_regex - когда расшифровка не подошла
+    bool has_kosgu = false;
+    std::string kosgu_code;
+    int kosgu_id = -1;
+};
+
+// Разбор строки платежа: поля, дата, сумма, договор и КОСГУ по шаблонам.
+// В базу не обращается; у каждого потока разбора своя копия (свой буфер
+// полей), скомпилированные шаблоны общие. kosgu_pattern == nullptr -
+// шаблон КОСГУ не задан.
+class PaymentRowParser {
+public:
+    PaymentRowParser(const ColumnMapping &mapping, const PatternEngine &engine,
+                     const PatternEngine::Pattern *contract_pattern,
+                     const PatternEngine::Pattern *kosgu_pattern,
+                     bool force_income_type, bool is_return_import,
+                     const std::string &custom_note)
+        : date_column(mappedColumn(mapping, "Дата")),
+          doc_number_column(mappedColumn(mapping, "Номер док.")),
+          type_column(mappedColumn(mapping, "Тип")),
+          payer_column(mappedColumn(mapping, "Плательщик")),
+          recipient_column(mappedColumn(mapping, "Контрагент")),
+          description_column(mappedColumn(mapping, "Назначение")),
+          note_column(mappedColumn(mapping, "Примечание")),
+          amount_column(mappedColumn(mapping, "Сумма")),
+          engine(engine), contract_pattern(contract_pattern),
+          kosgu_pattern(kosgu_pattern),
+          force_income_type(force_income_type),
+          is_return_import(is_return_import), custom_note(custom_note) {}
+
+    // false - строку пропустить (пустая или с нулевой суммой). Дата и
+    // сумма, которые не разобрались, добавляются в errors; такая дата
+    // записывается как есть, строка с такой суммой пропускается.
+    bool parse(std::string_view line, size_t line_num, ParsedPayment &parsed,
+               std::vector<std::string> &errors) {
         if (line.empty())
-            continue;
+            return false;
 
-        std::vector<std::string> row = split(line, '\t');
-        Payment payment;
+        splitFields(line, '\t', row);
+        Payment &payment = parsed.payment;
 
-        payment.date =
-            convertDateToDBFormat(get_value_from_row(row, mapping, "Дата"));
-        payment.doc_number = get_value_from_row(row, mapping, "Номер док.");
-        std::string type_str_from_file = get_value_from_row(row, mapping, "Тип");
+        std::string_view date_text = fieldAt(row, date_column);
+        Date date;
+        if (Date::parse(date_text, date)) {
+            payment.date = date.toString();
+        } else {
+            payment.date = date_text;
+            if (!date_text.empty())
+                errors.push_back(columnError(line_num, "Дата", date_text));
+        }
+        payment.doc_number = fieldAt(row, doc_number_column);
+        std::string type_str_from_file(fieldAt(row, type_column));
         std::transform(type_str_from_file.begin(), type_str_from_file.end(), type_str_from_file.begin(),
             [](unsigned char c){ return std::tolower(c); });
         payment.type = (type_str_from_file == "income" || type_str_from_file == "поступление" || type_str_from_file == "1");
 
-        std::string local_payer_name =
-            get_value_from_row(row, mapping, "Плательщик");
-        payment.recipient = get_value_from_row(row, mapping, "Контрагент");
-        payment.description = get_value_from_row(row, mapping, "Назначение");
-        payment.note = get_value_from_row(row, mapping, "Примечание");
+        std::string_view local_payer_name = fieldAt(row, payer_column);
+        payment.recipient = fieldAt(row, recipient_column);
+        payment.description = fieldAt(row, description_column);
+        payment.note = fieldAt(row, note_column);
 
         if (!custom_note.empty()) {
             if (!payment.note.empty()) {
@@ -161,66 +227,40 @@ bool ImportManager::ImportPaymentsFromTsv(const std::string &filepath,
             }
         }
 
-        try {
-            std::string amount_str = get_value_from_row(row, mapping, "Сумма");
-            std::replace(amount_str.begin(), amount_str.end(), ',', '.');
-            payment.amount = std::stod(amount_str);
-        } catch (const std::exception &) {
-            payment.amount = 0.0;
+        // Сумма в копейках; нераспознанная считается нулевой
+        Money payment_amount;
+        std::string_view amount_text = fieldAt(row, amount_column);
+        if (!Money::parse(amount_text, payment_amount) && !amount_text.empty()) {
+            errors.push_back(columnError(line_num, "Сумма", amount_text));
         }
-
         if (is_return_import) {
-            payment.amount *= -1;
+            payment_amount = -payment_amount;
         }
+        payment.amount = payment_amount.toDouble();
+        parsed.amount = payment_amount;
 
         // Пропускаем строки с нулевой суммой
-        if (std::abs(payment.amount) < 0.001) {
-            continue;
+        if (payment_amount.isZero()) {
+            return false;
         }
-        
+
         if (type_str_from_file.empty()) {
             payment.type = payment.recipient.empty();
         }
 
-
-        Counterparty counterparty;
         if (payment.type) { // true is income
-            counterparty.name = local_payer_name;
+            parsed.counterparty_name = local_payer_name;
         } else {
-            counterparty.name = payment.recipient;
-        }
-
-        int counterparty_id = -1;
-        if (!counterparty.name.empty()) {
-            counterparty_id =
-                dbManager->getCounterpartyIdByName(counterparty.name);
-            if (counterparty_id == -1) {
-                if (dbManager->addCounterparty(counterparty)) {
-                    counterparty_id = counterparty.id;
-                }
-            }
+            parsed.counterparty_name = payment.recipient;
         }
-        payment.counterparty_id = counterparty_id;
 
-        int current_contract_id = -1;
         std::smatch contract_matches;
-        if (std::regex_search(payment.description, contract_matches,
-                              contract_regex)) {
+        if (contract_pattern->search(payment.description, contract_matches)) {
             if (contract_matches.size() >= 3) {
-                std::string contract_number = contract_matches[1].str();
-                std::string contract_date_db_format =
+                parsed.has_contract = true;
+                parsed.contract_number = contract_matches[1].str();
+                parsed.contract_date =
                     convertDateToDBFormat(contract_matches[2].str());
-                current_contract_id = dbManager->getContractIdByNumberDate(
-                    contract_number, contract_date_db_format);
-                if (current_contract_id == -1) {
-                    Contract contract_obj{-1, contract_number,
-                                          contract_date_db_format,
-                                          counterparty_id};
-                    int new_contract_id = dbManager->addContract(contract_obj);
-                    if (new_contract_id != -1) {
-                        current_contract_id = new_contract_id;
-                    }
-                }
             }
         }
 
@@ -229,100 +269,412 @@ bool ImportManager::ImportPaymentsFromTsv(const std::string &filepath,
             payment.type = true; // true is 'income'
         }
 
-        if (!dbManager->addPayment(payment)) {
-            continue;
-        }
-        int new_payment_id = payment.id;
-
-        // --- Новая, более сложная логика обработки КОСГУ ---
-        bool handled = false;
-
         // Сначала ищем шаблон "; в т.ч. KXXX=AMOUNT ..."
-        std::string special_pattern_prefix = "; в т.ч.";
+        static const std::string special_pattern_prefix = "; в т.ч.";
         size_t special_pos = payment.description.find(special_pattern_prefix);
 
         if (special_pos != std::string::npos) {
-            std::string details_part = payment.description.substr(special_pos + special_pattern_prefix.length());
-            std::regex special_kosgu_regex("К(\\d{3})=([\\d.]+)");
-            auto details_begin = std::sregex_iterator(details_part.begin(), details_part.end(), special_kosgu_regex);
-            auto details_end = std::sregex_iterator();
-            
-            std::vector<PaymentDetail> details_to_add;
-            double total_details_amount = 0.0;
-            
-            if (std::distance(details_begin, details_end) > 0) {
-                for (std::sregex_iterator i = details_begin; i != details_end; ++i) {
-                    std::smatch match = *i;
-                    std::string kosgu_code = match[1].str();
-                    std::string amount_str = match[2].str();
-                    
-                    int kosgu_id = dbManager->getKosguIdByCode(kosgu_code);
-                    if (kosgu_id == -1) {
-                        Kosgu new_kosgu{-1, kosgu_code, "КОСГУ " + kosgu_code};
-                        if (dbManager->addKosguEntry(new_kosgu)) {
-                            kosgu_id = dbManager->getKosguIdByCode(kosgu_code);
-                        }
-                    }
-
-                    try {
-                        double detail_amount = std::stod(amount_str);
-                        total_details_amount += detail_amount;
-                        
-                        PaymentDetail detail;
-                        detail.payment_id = new_payment_id;
-                        detail.kosgu_id = kosgu_id;
-                        detail.contract_id = current_contract_id;
-                        detail.amount = detail_amount;
-                        details_to_add.push_back(detail);
-                    } catch (const std::exception& e) {
-                        total_details_amount = payment.amount + 1; // Force validation fail
-                        break;
-                    }
+            std::string_view details_part = std::string_view(payment.description)
+                .substr(special_pos + special_pattern_prefix.length());
+
+            Money total_details_amount;
+            bool details_valid = true;
+            size_t details_pos = 0;
+            std::string_view kosgu_code;
+            std::string_view amount_text;
+            while (engine.nextBreakdownItem(details_part, details_pos,
+                                            kosgu_code, amount_text)) {
+                ParsedPayment::BreakdownItem item;
+                item.kosgu_code = kosgu_code;
+                bool amount_valid = Money::parse(amount_text, item.amount);
+                parsed.breakdown.push_back(std::move(item));
+                if (!amount_valid) {
+                    details_valid = false;
+                    break;
                 }
+                total_details_amount += parsed.breakdown.back().amount;
+            }
 
-                // ВАЖНО: Проверяем сумму с небольшой погрешностью
-                if (total_details_amount > 0 && total_details_amount <= (payment.amount + 0.01)) {
-                    for (auto& detail : details_to_add) {
-                        dbManager->addPaymentDetail(detail);
-                    }
-                    handled = true;
-                }
+            if (!parsed.breakdown.empty()) {
+                // Суммы в копейках сравниваются точно, без погрешности
+                parsed.use_breakdown = details_valid && total_details_amount > Money() &&
+                                       total_details_amount <= payment_amount;
             }
         }
-        
-        // Если специальный шаблон не был обработан или обработан с ошибкой
-        if (!handled) {
-            PaymentDetail detail;
-            detail.payment_id = new_payment_id;
 
-            // --- FIX: Use the kosgu_regex if the special pattern fails ---
-            int kosgu_id_from_regex = -1;
+        // Если специальный шаблон не был обработан или обработан с ошибкой
+        if (!parsed.use_breakdown) {
             std::smatch kosgu_matches;
-            if (!kosgu_regex_str.empty() && std::regex_search(payment.description, kosgu_matches, kosgu_regex)) {
+            if (kosgu_pattern && kosgu_pattern->search(payment.description, kosgu_matches)) {
                 if (kosgu_matches.size() > 1) { // Assuming the code is in the first capture group
-                    std::string kosgu_code = kosgu_matches[1].str();
-                    kosgu_id_from_regex = dbManager->getKosguIdByCode(kosgu_code);
-                    if (kosgu_id_from_regex == -1) {
-                        Kosgu new_kosgu{-1, kosgu_code, "КОСГУ " + kosgu_code};
-                        if (dbManager->addKosguEntry(new_kosgu)) {
-                            kosgu_id_from_regex = dbManager->getKosguIdByCode(kosgu_code);
-                        }
+                    parsed.has_kosgu = true;
+                    parsed.kosgu_code = kosgu_matches[1].str();
+                }
+            }
+        }
+        return true;
+    }
+
+private:
+    int date_column;
+    int doc_number_column;
+    int type_column;
+    int payer_column;
+    int recipient_column;
+    int description_column;
+    int note_column;
+    int amount_column;
+    const PatternEngine &engine;
+    const PatternEngine::Pattern *contract_pattern;
+    const PatternEngine::Pattern *kosgu_pattern;
+    bool force_income_type;
+    bool is_return_import;
+    std::string custom_note;
+    std::vector<std::string_view> row;
+};
+
+// Разобранная пачка строк файла
+struct ParsedChunk {
+    std::vector<ParsedPayment> rows;
+    std::vector<std::string> errors; // ошибки разбора по столбцам
+    size_t lines = 0;      // строк файла в пачке, включая пропущенные
+    size_t end_offset = 0; // позиция в файле после пачки
+};
+
+// Разбор платежей в нескольких потоках. Потоки разбора по очереди берут
+// у читателя пачки по chunkLines строк и разбирают их параллельно, а
+// писатель (поток импорта) забирает готовые пачки строго по порядку,
+// поэтому платежи записываются в порядке строк файла. Пачек, разобранных
+// впрок, не больше maxChunksAhead - память не растёт, если запись
+// отстаёт. Исключение из потока разбора передаётся писателю.
+class PaymentParsePipeline {
+public:
+    PaymentParsePipeline(TsvReader &reader, const PaymentRowParser &parser,
+                         std::atomic<bool> &cancel_flag)
+        : reader(reader), cancel_flag(cancel_flag) {
+        // Одно ядро остаётся писателю
+        unsigned cores = std::thread::hardware_concurrency();
+        size_t threads = cores > 1 ? cores - 1 : 1;
+        maxChunksAhead = std::max<size_t>(threads * 4, 8);
+        for (size_t i = 0; i < threads; i++) {
+            workers.emplace_back(&PaymentParsePipeline::run, this, parser);
+        }
+    }
+
+    ~PaymentParsePipeline() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        space_cv.notify_all();
+        for (auto &worker : workers) {
+            worker.join();
+        }
+    }
+
+    PaymentParsePipeline(const PaymentParsePipeline &) = delete;
+    PaymentParsePipeline &operator=(const PaymentParsePipeline &) = delete;
+
+    // Следующая по порядку пачка; false - файл разобран целиком
+    bool next(ParsedChunk &chunk) {
+        std::unique_lock<std::mutex> lock(mutex);
+        ready_cv.wait(lock, [this]() {
+            return error || parsed.count(nextToWrite) > 0 ||
+                   (readerDone && nextToWrite >= chunkCount);
+        });
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        auto it = parsed.find(nextToWrite);
+        if (it == parsed.end()) {
+            return false;
+        }
+        chunk = std::move(it->second);
+        parsed.erase(it);
+        nextToWrite++;
+        space_cv.notify_all();
+        return true;
+    }
+
+private:
+    static constexpr size_t chunkLines = 256;
+
+    void run(PaymentRowParser parser) {
+        std::vector<std::string_view> lines;
+        lines.reserve(chunkLines);
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            space_cv.wait(lock, [this]() {
+                return stopping || readerDone ||
+                       nextToRead < nextToWrite + maxChunksAhead;
+            });
+            if (stopping || readerDone) {
+                return;
+            }
+
+            // Строки пачки выбираются под мьютексом: это только поиск '\n'
+            size_t index = nextToRead++;
+            lines.clear();
+            std::string_view line;
+            while (lines.size() < chunkLines && reader.nextLine(line)) {
+                lines.push_back(line);
+            }
+            ParsedChunk chunk;
+            chunk.lines = lines.size();
+            chunk.end_offset = reader.offset();
+            if (lines.size() < chunkLines) {
+                readerDone = true;
+                chunkCount = index + 1;
+                space_cv.notify_all();
+            }
+            lock.unlock();
+
+            try {
+                chunk.rows.reserve(lines.size());
+                for (size_t i = 0; i < lines.size(); i++) {
+                    // При отмене пачка остаётся неполной: писатель всё равно
+                    // откатывает импорт
+                    if (cancel_flag) {
+                        break;
+                    }
+                    // Номер строки данных (без заголовка), как в ошибках ЖО4
+                    size_t line_num = index * chunkLines + i + 1;
+                    ParsedPayment payment;
+                    if (parser.parse(lines[i], line_num, payment, chunk.errors)) {
+                        chunk.rows.push_back(std::move(payment));
                     }
                 }
+            } catch (...) {
+                lock.lock();
+                if (!error) {
+                    error = std::current_exception();
+                }
+                stopping = true;
+                ready_cv.notify_all();
+                space_cv.notify_all();
+                return;
             }
-            detail.kosgu_id = kosgu_id_from_regex;
-            // --- END FIX ---
 
-            detail.contract_id = current_contract_id;
-            detail.amount = payment.amount;
-            dbManager->addPaymentDetail(detail);
+            lock.lock();
+            parsed.emplace(index, std::move(chunk));
+            ready_cv.notify_all();
+        }
+    }
+
+    TsvReader &reader;
+    std::atomic<bool> &cancel_flag;
+    size_t maxChunksAhead = 8;
+
+    std::mutex mutex;
+    std::condition_variable ready_cv; // готова пачка (для писателя)
+    std::condition_variable space_cv; // писатель забрал пачку (для разбора)
+    std::map<size_t, ParsedChunk> parsed;
+    size_t nextToRead = 0;
+    size_t nextToWrite = 0;
+    size_t chunkCount = 0; // известно, когда readerDone
+    bool readerDone = false;
+    bool stopping = false;
+    std::exception_ptr error;
+    // Последним: потоки запускаются в конструкторе
+    std::vector<std::thread> workers;
+};
+
+// Идентификаторы контрагентов, договоров и КОСГУ для всей пачки - тремя
+// пакетными обращениями к справочникам. Новые записи получают те же
+// идентификаторы, что и при разрешении по строкам: в каждом справочнике
+// они добавляются в порядке появления в файле.
+static void resolvePaymentReferences(DatabaseManager *dbManager,
+                                     std::vector<ParsedPayment> &rows) {
+    std::vector<std::string> names;
+    std::vector<size_t> name_rows;
+    for (size_t i = 0; i < rows.size(); i++) {
+        rows[i].payment.counterparty_id = -1;
+        if (!rows[i].counterparty_name.empty()) {
+            names.push_back(rows[i].counterparty_name);
+            name_rows.push_back(i);
+        }
+    }
+    std::vector<int> ids;
+    if (!names.empty()) {
+        dbManager->resolveCounterpartyIds(names, ids);
+        for (size_t k = 0; k < name_rows.size(); k++) {
+            rows[name_rows[k]].payment.counterparty_id = ids[k];
+        }
+    }
+
+    std::vector<std::pair<std::string, std::string>> contract_keys;
+    std::vector<int> contract_counterparties;
+    std::vector<size_t> contract_rows;
+    for (size_t i = 0; i < rows.size(); i++) {
+        if (rows[i].has_contract) {
+            contract_keys.emplace_back(rows[i].contract_number, rows[i].contract_date);
+            contract_counterparties.push_back(rows[i].payment.counterparty_id);
+            contract_rows.push_back(i);
+        }
+    }
+    if (!contract_keys.empty()) {
+        dbManager->resolveContractIds(contract_keys, contract_counterparties, ids);
+        for (size_t k = 0; k < contract_rows.size(); k++) {
+            rows[contract_rows[k]].contract_id = ids[k];
         }
     }
 
-    file.close();
+    std::vector<std::string> kosgu_codes;
+    for (const auto &parsed : rows) {
+        for (const auto &item : parsed.breakdown) {
+            kosgu_codes.push_back(item.kosgu_code);
+        }
+        if (parsed.has_kosgu) {
+            kosgu_codes.push_back(parsed.kosgu_code);
+        }
+    }
+    if (!kosgu_codes.empty()) {
+        dbManager->resolveKosguIds(kosgu_codes, ids);
+        size_t k = 0;
+        for (auto &parsed : rows) {
+            for (auto &item : parsed.breakdown) {
+                item.kosgu_id = ids[k++];
+            }
+            if (parsed.has_kosgu) {
+                parsed.kosgu_id = ids[k++];
+            }
+        }
+    }
+}
+
+bool ImportManager::ImportPaymentsFromTsv(const std::string &filepath,
+                                          DatabaseManager *dbManager,
+                                          const ColumnMapping &mapping,
+                                          std::atomic<float> &progress,
+                                          std::string &message,
+                                          std::mutex &message_mutex,
+                                          std::atomic<bool> &cancel_flag,
+                                          const std::string& contract_regex_str,
+                                          const std::string& kosgu_regex_str,
+                                          bool force_income_type,
+                                          bool is_return_import,
+                                          const std::string& custom_note,
+                                          std::vector<std::string>& errors
+                                          ) {
+    errors.clear();
+    if (!dbManager) {
+        std::lock_guard<std::mutex> lock(message_mutex);
+        message = "Ошибка: Менеджер базы данных не инициализирован.";
+        return false;
+    }
+
+    TsvReader reader;
+    if (!reader.open(filepath)) {
+        std::lock_guard<std::mutex> lock(message_mutex);
+        message = "Ошибка: Не удалось открыть TSV файл: " + filepath;
+        return false;
+    }
+
+    ImportProgress import_progress(reader.size(), progress, message,
+                                   message_mutex, "Импорт строки ");
+
+    std::string_view line;
+    reader.nextLine(line); // Skip header line
+
+    // Шаблоны компилируются один раз на импорт: ошибка в шаблоне - до
+    // начала записи
+    PatternEngine patterns;
+    const PatternEngine::Pattern *contract_pattern =
+        patterns.add("Договор", contract_regex_str);
+    const PatternEngine::Pattern *kosgu_pattern =
+        kosgu_regex_str.empty() ? nullptr : patterns.add("КОСГУ", kosgu_regex_str);
+    PaymentRowParser parser(mapping, patterns, contract_pattern, kosgu_pattern,
+                            force_income_type, is_return_import, custom_note);
+
+    // Весь импорт - одна транзакция, каждая строка - точка сохранения
+    TransactionSession session(dbManager);
+
+    // Строки разбираются параллельно, а записываются здесь по порядку
+    PaymentParsePipeline pipeline(reader, parser, cancel_flag);
+    ParsedChunk chunk;
+    bool cancelled = false;
+    size_t line_num = 0;
+    size_t parse_errors = 0;
+    while (!cancelled && pipeline.next(chunk)) {
+        resolvePaymentReferences(dbManager, chunk.rows);
+
+        for (ParsedPayment &parsed : chunk.rows) {
+            // Check for cancellation
+            if (cancel_flag) {
+                cancelled = true;
+                break;
+            }
+
+            session.beginRow();
+
+            Payment &payment = parsed.payment;
+            if (!dbManager->addPayment(payment)) {
+                session.endRow(false);
+                continue;
+            }
+            int new_payment_id = payment.id;
+
+            if (parsed.use_breakdown) {
+                std::vector<PaymentDetail> details_to_add;
+                for (const auto &item : parsed.breakdown) {
+                    PaymentDetail detail;
+                    detail.payment_id = new_payment_id;
+                    detail.kosgu_id = item.kosgu_id;
+                    detail.contract_id = parsed.contract_id;
+                    detail.invoice_id = -1; // без документа основания
+                    detail.amount = item.amount.toDouble();
+                    details_to_add.push_back(detail);
+                }
+                dbManager->addPaymentDetails(details_to_add);
+            } else {
+                PaymentDetail detail;
+                detail.payment_id = new_payment_id;
+                detail.kosgu_id = parsed.kosgu_id;
+                detail.contract_id = parsed.contract_id;
+                detail.invoice_id = -1; // без документа основания
+                detail.amount = payment.amount;
+                dbManager->addPaymentDetail(detail);
+            }
+
+            session.endRow(true);
+        }
+
+        parse_errors += chunk.errors.size();
+        for (auto &error : chunk.errors) {
+            if (errors.size() >= maxImportErrors)
+                break;
+            errors.push_back(std::move(error));
+        }
+
+        line_num += chunk.lines;
+        import_progress.update(line_num, chunk.end_offset);
+    }
+
+    publishPatternStats(patterns);
+
+    // Ошибки откаченных строк не показываются: импорта не было
+    if (cancelled || cancel_flag) {
+        session.rollback();
+        errors.clear();
+        std::lock_guard<std::mutex> lock(message_mutex);
+        message = "Импорт отменен пользователем. Изменения отменены.";
+        progress = 0.0f; // Reset progress
+        return false; // Indicate cancellation
+    }
+
+    if (!session.commit()) {
+        errors.clear();
+        std::lock_guard<std::mutex> lock(message_mutex);
+        message = "Ошибка: не удалось зафиксировать импорт в базе данных.";
+        progress = 0.0f;
+        return false;
+    }
     {
         std::lock_guard<std::mutex> lock(message_mutex);
         message = "Импорт завершен.";
+        if (parse_errors > 0) {
+            message += " Ошибок разбора: " + std::to_string(parse_errors) + ".";
+        }
     }
     progress = 1.0f;
     return true; 
@@ -344,21 +696,17 @@ bool ImportManager::importIKZFromFile(
         return false;
     }
 
-    std::ifstream file(filepath);
-    if (!file.is_open()) {
+    TsvReader reader;
+    if (!reader.open(filepath)) {
         std::lock_guard<std::mutex> lock(message_mutex);
         message = "Ошибка: Не удалось открыть файл: " + filepath;
         return false;
     }
 
-    // 1. Get total lines and detect delimiter
-    file.seekg(0, std::ios::beg);
-    size_t total_lines = 0;
+    // 1. Detect delimiter
     char delimiter = ','; // Default to comma
-    std::string first_line;
-    if (std::getline(file, first_line)) {
-        total_lines = 1 + std::count(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>(), '\n');
-        
+    std::string_view first_line;
+    if (reader.nextLine(first_line)) {
         size_t comma_count = std::count(first_line.begin(), first_line.end(), ',');
         size_t tab_count = std::count(first_line.begin(), first_line.end(), '\t');
         if (tab_count > comma_count) {
@@ -370,81 +718,32 @@ bool ImportManager::importIKZFromFile(
         return true; // Not a failure, just nothing to do
     }
     
-    file.clear();
-    file.seekg(0, std::ios::beg);
-
-    // 2. Process file
+    // 2. Process file (заголовок уже прочитан)
     unfoundContracts.clear();
     successfulImports = 0;
-    std::string line;
-    std::getline(file, line); // Skip header line
+    std::string_view line;
+    std::vector<std::string_view> row;
 
+    // Обновления ИКЗ независимы друг от друга, поэтому фиксируем пакетами
+    TransactionSession session(dbManager, 1000);
+
+    ImportProgress import_progress(reader.size(), progress, message, message_mutex,
+                                   "Импорт строки ");
     size_t line_num = 1; // Start at 1 because we already read the header
-    while (std::getline(file, line)) {
+    while (reader.nextLine(line)) {
         line_num++;
-        progress = static_cast<float>(line_num) / total_lines;
-        {
-            std::lock_guard<std::mutex> lock(message_mutex);
-            message = "Импорт строки " + std::to_string(line_num) + " из " + std::to_string(total_lines);
-        }
+        import_progress.update(line_num, reader.offset());
 
         if (line.empty()) continue;
 
-        std::vector<std::string> row = split(line, delimiter);
+        splitFields(line, delimiter, row);
 
         if (row.size() < 3) continue; // Skip malformed lines
 
-        std::string contract_number = trim(row[0]);
-        std::string contract_date_raw = trim(row[1]);
-        std::string ikz = trim(row[2]);
-
-        // Функция для очистки невидимых символов из начала строки
-        auto strip_invisible_chars = [](std::string& str) {
-            while (!str.empty()) {
-                unsigned char c0 = static_cast<unsigned char>(str[0]);
-                // UTF-8 BOM (EF BB BF) - U+FEFF
-                if (str.size() >= 3 && c0 == 0xEF &&
-                    static_cast<unsigned char>(str[1]) == 0xBB &&
-                    static_cast<unsigned char>(str[2]) == 0xBF) {
-                    str.erase(0, 3);
-                }
-                // Неразрывный пробел U+00A0 (C2 A0)
-                else if (str.size() >= 2 && c0 == 0xC2 &&
-                         static_cast<unsigned char>(str[1]) == 0xA0) {
-                    str.erase(0, 2);
-                }
-                // U+2000..U+200F (E2 80 80 .. E2 80 8F)
-                else if (str.size() >= 3 && c0 == 0xE2 &&
-                         static_cast<unsigned char>(str[1]) == 0x80 &&
-                         static_cast<unsigned char>(str[2]) >= 0x80 &&
-                         static_cast<unsigned char>(str[2]) <= 0x8F) {
-                    str.erase(0, 3);
-                }
-                // U+202F NARROW NO-BREAK SPACE (E2 80 AF)
-                else if (str.size() >= 3 && c0 == 0xE2 &&
-                         static_cast<unsigned char>(str[1]) == 0x80 &&
-                         static_cast<unsigned char>(str[2]) == 0xAF) {
-                    str.erase(0, 3);
-                }
-                // U+205F MEDIUM MATHEMATICAL SPACE (E2 81 9F)
-                else if (str.size() >= 3 && c0 == 0xE2 &&
-                         static_cast<unsigned char>(str[1]) == 0x81 &&
-                         static_cast<unsigned char>(str[2]) == 0x9F) {
-                    str.erase(0, 3);
-                }
-                // Обычные ASCII пробелы
-                else if (std::isspace(c0)) {
-                    str.erase(0, 1);
-                }
-                else {
-                    break;
-                }
-            }
-        };
-
-        // Очищаем номер договора и ИКЗ от невидимых символов
-        strip_invisible_chars(contract_number);
-        strip_invisible_chars(ikz);
+        // Номер договора и ИКЗ - без невидимых символов в начале
+        std::string_view contract_number = stripInvisible(trimField(row[0]));
+        std::string_view contract_date_raw = trimField(row[1]);
+        std::string_view ikz = stripInvisible(trimField(row[2]));
 
         if (contract_number.empty() || contract_date_raw.empty() || ikz.empty()) {
             continue; // Skip lines with essential missing data
@@ -452,15 +751,25 @@ bool ImportManager::importIKZFromFile(
 
         std::string contract_date = convertDateToDBFormat(contract_date_raw);
 
-        int updated_count = dbManager->updateContractProcurementCode(contract_number, contract_date, ikz);
+        session.beginRow();
+        int updated_count = dbManager->updateContractProcurementCode(
+            std::string(contract_number), contract_date, std::string(ikz));
+        session.endRow(true);
         if (updated_count > 0) {
             successfulImports += updated_count;
         } else {
-            unfoundContracts.push_back({contract_number, contract_date_raw, ikz});
+            unfoundContracts.push_back({std::string(contract_number),
+                                        std::string(contract_date_raw),
+                                        std::string(ikz)});
         }
     }
 
-    file.close();
+    if (!session.commit()) {
+        std::lock_guard<std::mutex> lock(message_mutex);
+        message = "Ошибка: не удалось зафиксировать импорт ИКЗ в базе данных.";
+        progress = 0.0f;
+        return false;
+    }
     {
         std::lock_guard<std::mutex> lock(message_mutex);
         message = "Импорт завершен. Обновлено: " + std::to_string(successfulImports) + ". Не найдено: " + std::to_string(unfoundContracts.size());
@@ -469,15 +778,6 @@ bool ImportManager::importIKZFromFile(
     return true;
 }
 
-// Вспомогательная функция для получения значения из строки по mapping
-static std::string get_jo4_value(const std::vector<std::string>& row, const ColumnMapping& mapping, const std::string& field) {
-    auto it = mapping.find(field);
-    if (it == mapping.end()) return "";
-    int col_index = it->second;
-    if (col_index < 0 || col_index >= static_cast<int>(row.size())) return "";
-    return trim(row[col_index]);
-}
-
 bool ImportManager::ImportJournalOrder4FromTsv(
     const std::string& filepath,
     DatabaseManager* dbManager,
@@ -496,22 +796,28 @@ bool ImportManager::ImportJournalOrder4FromTsv(
         return false;
     }
 
-    std::ifstream file(filepath);
-    if (!file.is_open()) {
+    TsvReader reader;
+    if (!reader.open(filepath)) {
         std::lock_guard<std::mutex> lock(message_mutex);
         message = "Ошибка: Не удалось открыть TSV файл: " + filepath;
         return false;
     }
 
-    // Подсчёт строк для прогресса
-    file.seekg(0, std::ios::beg);
-    size_t total_lines = std::count(std::istreambuf_iterator<char>(file),
-                                    std::istreambuf_iterator<char>(), '\n');
-    file.clear();
-    file.seekg(0, std::ios::beg);
+    ImportProgress import_progress(reader.size(), progress, message, message_mutex,
+                                   "Импорт ЖО4 строки ");
 
-    std::string line;
-    std::getline(file, line); // Пропуск заголовка
+    std::string_view line;
+    reader.nextLine(line); // Пропуск заголовка
+
+    const int doc_date_column = mappedColumn(mapping, "Дата документа");
+    const int doc_number_column = mappedColumn(mapping, "Номер документа");
+    const int doc_name_column = mappedColumn(mapping, "Наименование документа");
+    const int counterparty_column = mappedColumn(mapping, "Наименование показателя");
+    const int operation_column = mappedColumn(mapping, "Содержание операции");
+    const int debit_column = mappedColumn(mapping, "Счет дебет");
+    const int credit_column = mappedColumn(mapping, "Счет кредит");
+    const int amount_column = mappedColumn(mapping, "Сумма");
+    std::vector<std::string_view> row;
 
     importedDocuments = 0;
     importedDetails = 0;
@@ -521,93 +827,59 @@ bool ImportManager::ImportJournalOrder4FromTsv(
     // Карта для отслеживания созданных документов (key: number+date)
     std::map<std::string, int> doc_cache;
 
-    // Функция для очистки невидимых символов
-    auto strip_invisible = [](std::string& str) {
-        while (!str.empty()) {
-            unsigned char c0 = static_cast<unsigned char>(str[0]);
-            if (str.size() >= 3 && c0 == 0xEF &&
-                static_cast<unsigned char>(str[1]) == 0xBB &&
-                static_cast<unsigned char>(str[2]) == 0xBF) {
-                str.erase(0, 3);
-            } else if (str.size() >= 2 && c0 == 0xC2 &&
-                       static_cast<unsigned char>(str[1]) == 0xA0) {
-                str.erase(0, 2);
-            } else if (str.size() >= 3 && c0 == 0xE2 &&
-                       static_cast<unsigned char>(str[1]) == 0x80 &&
-                       static_cast<unsigned char>(str[2]) >= 0x80 &&
-                       static_cast<unsigned char>(str[2]) <= 0x8F) {
-                str.erase(0, 3);
-            } else if (str.size() >= 3 && c0 == 0xE2 &&
-                       static_cast<unsigned char>(str[1]) == 0x80 &&
-                       static_cast<unsigned char>(str[2]) == 0xAF) {
-                str.erase(0, 3);
-            } else if (std::isspace(c0)) {
-                str.erase(0, 1);
-            } else {
-                break;
-            }
-        }
-    };
+    // Весь импорт - одна транзакция, каждая строка - точка сохранения
+    TransactionSession session(dbManager);
 
-    while (std::getline(file, line)) {
+    while (reader.nextLine(line)) {
         if (cancel_flag) {
+            session.rollback();
+            importedDocuments = 0;
+            importedDetails = 0;
+            errors.clear();
             std::lock_guard<std::mutex> lock(message_mutex);
-            message = "Импорт ЖО4 отменен пользователем.";
+            message = "Импорт ЖО4 отменен пользователем. Изменения отменены.";
             progress = 0.0f;
             return false;
         }
 
         line_num++;
-        progress = static_cast<float>(line_num) / total_lines;
-        {
-            std::lock_guard<std::mutex> lock(message_mutex);
-            message = "Импорт ЖО4 строки " + std::to_string(line_num) + " из " +
-                      std::to_string(total_lines);
-        }
+        import_progress.update(line_num, reader.offset());
 
         if (line.empty()) continue;
 
-        std::vector<std::string> row = split(line, '\t');
-
-        // Извлекаем поля
-        std::string doc_date = get_jo4_value(row, mapping, "Дата документа");
-        std::string doc_number = get_jo4_value(row, mapping, "Номер документа");
-        std::string doc_name = get_jo4_value(row, mapping, "Наименование документа");
-        std::string counterparty_name = get_jo4_value(row, mapping, "Наименование показателя");
-        std::string operation_content = get_jo4_value(row, mapping, "Содержание операции");
-        std::string debit_account = get_jo4_value(row, mapping, "Счет дебет");
-        std::string credit_account = get_jo4_value(row, mapping, "Счет кредит");
-        std::string amount_str = get_jo4_value(row, mapping, "Сумма");
-
-        // Конвертация даты
-        std::string date_db = doc_date;
-        if (doc_date.length() >= 8) {
-            date_db = convertDateToDBFormat(doc_date);
-        }
-
-        // Очистка от невидимых символов
-        strip_invisible(doc_number);
-        strip_invisible(doc_name);
-        strip_invisible(counterparty_name);
-
-        double amount = 0.0;
-        try {
-            // Заменяем запятую на точку
-            std::replace(amount_str.begin(), amount_str.end(), ',', '.');
-            amount = std::stod(amount_str);
-        } catch (...) {
-            errors.push_back("Строка " + std::to_string(line_num) + ": неверная сумма '" + amount_str + "'");
+        splitFields(line, '\t', row);
+
+        // Извлекаем поля; номер, наименование документа и контрагент - без
+        // невидимых символов в начале
+        std::string_view doc_date = fieldAt(row, doc_date_column);
+        std::string doc_number(stripInvisible(fieldAt(row, doc_number_column)));
+        std::string_view doc_name = stripInvisible(fieldAt(row, doc_name_column));
+        std::string counterparty_name(stripInvisible(fieldAt(row, counterparty_column)));
+        std::string_view operation_content = fieldAt(row, operation_column);
+        std::string_view debit_account = fieldAt(row, debit_column);
+        std::string_view credit_account = fieldAt(row, credit_column);
+        std::string_view amount_str = fieldAt(row, amount_column);
+
+        // Конвертация даты; нераспознанная записывается как есть
+        std::string date_db(doc_date);
+        Date date;
+        if (Date::parse(doc_date, date)) {
+            date_db = date.toString();
+        } else if (!doc_date.empty()) {
+            errors.push_back(columnError(line_num, "Дата документа", doc_date));
+        }
+
+        Money amount_value;
+        if (!Money::parse(amount_str, amount_value)) {
+            errors.push_back(columnError(line_num, "Сумма", amount_str));
             continue;
         }
 
-        // Поиск или создание контрагента
-        int counterparty_id = -1;
+        session.beginRow();
+
+        // Создание контрагента, если его ещё нет (документ хранит имя)
         if (!counterparty_name.empty()) {
-            counterparty_id = dbManager->getCounterpartyIdByName(counterparty_name);
-            if (counterparty_id == -1) {
-                Counterparty new_cp{-1, counterparty_name, ""};
-                counterparty_id = dbManager->addCounterparty(new_cp);
-            }
+            dbManager->resolveCounterpartyId(counterparty_name);
         }
 
         // Поиск или создание документа основания
@@ -621,6 +893,7 @@ bool ImportManager::ImportJournalOrder4FromTsv(
             doc_id = dbManager->getBasePaymentDocumentIdByNumberDate(doc_number, date_db);
         }
 
+        bool doc_created = false;
         if (doc_id == -1 && !doc_number.empty() && !date_db.empty()) {
             BasePaymentDocument new_doc;
             new_doc.date = date_db;
@@ -631,12 +904,11 @@ bool ImportManager::ImportJournalOrder4FromTsv(
             new_doc.payment_id = -1;
 
             doc_id = dbManager->addBasePaymentDocument(new_doc);
-            if (doc_id != -1) {
-                doc_cache[cache_key] = doc_id;
-                importedDocuments++;
-            }
+            doc_created = (doc_id != -1);
         }
 
+        bool row_ok = false;
+
         // Создание расшифровки документа
         if (doc_id != -1) {
             BasePaymentDocumentDetail new_detail;
@@ -644,27 +916,45 @@ bool ImportManager::ImportJournalOrder4FromTsv(
             new_detail.operation_content = operation_content;
             new_detail.debit_account = debit_account;
             new_detail.credit_account = credit_account;
-            new_detail.amount = amount;
+            new_detail.amount = amount_value.toDouble();
 
             // Автоопределение КОСГУ по счёту дебета
             if (!debit_account.empty()) {
                 // Поиск КОСГУ по коду (например, "201" -> КОСГУ 201)
-                std::string kosgu_code = debit_account.substr(0, 3);
-                int kosgu_id = dbManager->getKosguIdByCode(kosgu_code);
-                new_detail.kosgu_id = kosgu_id;
+                std::string kosgu_code(debit_account.substr(0, 3));
+                new_detail.kosgu_id =
+                    dbManager->resolveKosguId(kosgu_code, false);
             }
 
             if (dbManager->addBasePaymentDocumentDetail(new_detail)) {
-                importedDetails++;
+                row_ok = true;
             } else {
                 errors.push_back("Строка " + std::to_string(line_num) + ": ошибка создания расшифровки");
             }
         } else {
             errors.push_back("Строка " + std::to_string(line_num) + ": не удалось создать документ");
         }
+
+        // Ошибочная строка откатывается целиком, вместе с созданным для неё документом
+        session.endRow(row_ok);
+        if (row_ok) {
+            importedDetails++;
+            if (doc_created) {
+                doc_cache[cache_key] = doc_id;
+                importedDocuments++;
+            }
+        }
     }
 
-    file.close();
+    if (!session.commit()) {
+        importedDocuments = 0;
+        importedDetails = 0;
+        errors.clear();
+        std::lock_guard<std::mutex> lock(message_mutex);
+        message = "Ошибка: не удалось зафиксировать импорт ЖО4 в базе данных.";
+        progress = 0.0f;
+        return false;
+    }
     {
         std::lock_guard<std::mutex> lock(message_mutex);
         message = "Импорт ЖО4 завершен. Документов: " + std::to_string(importedDocuments) +
@@ -6,6 +6,7 @@
 #include <atomic>
 #include <mutex>
 #include "DatabaseManager.h"
+#include "PatternEngine.h"
 
 // Represents the mapping from a target field name (e.g., "Дата") 
 // to the index of the column in the source file.
@@ -32,6 +33,8 @@ public:
     );
 
     // Imports payments from a TSV file using a user-defined column mapping.
+    // errors - даты и суммы, которые не удалось разобрать (по столбцам);
+    // пусто, если импорт отменён или не зафиксирован
         bool ImportPaymentsFromTsv(
             const std::string& filepath,
             DatabaseManager* dbManager,
@@ -44,7 +47,8 @@ public:
             const std::string& kosgu_regex,
             bool force_income_type,
             bool is_return_import,
-            const std::string& custom_note
+            const std::string& custom_note,
+            std::vector<std::string>& errors
         );
 
     // Импорт журнала ордера №4 из TSV
@@ -60,4 +64,13 @@ public:
         int& importedDetails,
         std::vector<std::string>& errors
     );
+
+    // Совпадения и время шаблонов последнего импорта платежей
+    std::vector<PatternEngine::Stats> getLastPatternStats();
+
+private:
+    void publishPatternStats(const PatternEngine& patterns);
+
+    std::mutex patternStatsMutex;
+    std::vector<PatternEngine::Stats> lastPatternStats;
 };
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Файл, отображённый в память только для чтения. Содержимое читается
+// напрямую из страничного кеша, без read() в промежуточный буфер.
+// Отображение остаётся действительным, даже если файл заменён или удалён.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    // false - файла нет или его не удалось отобразить; пустой файл
+    // открывается с size() == 0
+    bool open(const std::string &path) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            ::close(fd);
+            return false;
+        }
+        length = (size_t)info.st_size;
+        if (length > 0) {
+            void *address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address == MAP_FAILED) {
+                ::close(fd);
+                length = 0;
+                return false;
+            }
+            // Файл читается от начала к концу
+            madvise(address, length, MADV_SEQUENTIAL);
+            bytes = static_cast<const char *>(address);
+        }
+        ::close(fd); // отображение держит файл само
+        return true;
+    }
+
+    void close() {
+        if (bytes)
+            munmap(const_cast<char *>(bytes), length);
+        bytes = nullptr;
+        length = 0;
+    }
+
+    const char *data() const { return bytes; }
+    size_t size() const { return length; }
+    std::string_view view() const { return std::string_view(bytes, length); }
+
+private:
+    const char *bytes = nullptr;
+    size_t length = 0;
+};
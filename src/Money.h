@@ -0,0 +1,160 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+// Денежная сумма в копейках. Суммирование и сравнение точные, без
+// погрешностей double. Поля amount в структурах остаются double (ввод и
+// вывод ImGui), перевод - на границе.
+struct Money {
+    int64_t kopecks = 0;
+
+    constexpr Money() = default;
+    constexpr explicit Money(int64_t value) : kopecks(value) {}
+
+    static Money fromDouble(double value) {
+        return Money(std::llround(value * 100.0));
+    }
+    double toDouble() const { return kopecks / 100.0; }
+
+    // Сумма в записи банковских выписок: "1234.56", "-1 234,56",
+    // "1234,5", "1234", "(1 234,56)" (отрицательная). Между разрядами
+    // допускаются пробелы (в том числе неразрывные U+00A0, узкие U+202F и
+    // тонкие U+2009) и апострофы; знаки после второго дробного округляются
+    // до копейки. Без исключений и выделения памяти, не зависит от локали.
+    // false - строка не сумма.
+    static bool parse(std::string_view text, Money &value);
+
+    // "1234.56" (как %.2f)
+    std::string toString() const {
+        char text[32];
+        int64_t whole = kopecks / 100;
+        int64_t cents = kopecks % 100;
+        snprintf(text, sizeof(text), "%s%lld.%02lld",
+                 kopecks < 0 && whole == 0 ? "-" : "", (long long)whole,
+                 (long long)(cents < 0 ? -cents : cents));
+        return text;
+    }
+
+    bool isZero() const { return kopecks == 0; }
+
+    Money operator-() const { return Money(-kopecks); }
+    Money operator+(Money other) const { return Money(kopecks + other.kopecks); }
+    Money operator-(Money other) const { return Money(kopecks - other.kopecks); }
+    Money &operator+=(Money other) {
+        kopecks += other.kopecks;
+        return *this;
+    }
+    Money &operator-=(Money other) {
+        kopecks -= other.kopecks;
+        return *this;
+    }
+    bool operator==(Money other) const { return kopecks == other.kopecks; }
+    bool operator!=(Money other) const { return kopecks != other.kopecks; }
+    bool operator<(Money other) const { return kopecks < other.kopecks; }
+    bool operator<=(Money other) const { return kopecks <= other.kopecks; }
+    bool operator>(Money other) const { return kopecks > other.kopecks; }
+    bool operator>=(Money other) const { return kopecks >= other.kopecks; }
+};
+
+inline bool Money::parse(std::string_view text, Money &value) {
+    // Цифры без разделителей разрядов собираются в буфер и читаются
+    // std::from_chars; знак, запятая и пробелы разбираются здесь
+    char digits[24];
+    size_t count = 0;
+    size_t i = 0;
+    // Длина пробела в позиции pos (UTF-8); 0 - не пробел
+    auto space_at = [&](size_t pos) -> size_t {
+        if (pos >= text.size())
+            return 0;
+        char c = text[pos];
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+            return 1;
+        if (text.compare(pos, 2, "\xC2\xA0") == 0) // неразрывный пробел
+            return 2;
+        if (text.compare(pos, 3, "\xE2\x80\xAF") == 0 || // узкий неразрывный
+            text.compare(pos, 3, "\xE2\x80\x89") == 0)   // тонкий
+            return 3;
+        return 0;
+    };
+    auto skip_spaces = [&]() {
+        while (size_t length = space_at(i))
+            i += length;
+    };
+
+    skip_spaces();
+    bool negative = false;
+    // Бухгалтерская запись отрицательной суммы: "(1 234,56)"
+    bool parenthesized = i < text.size() && text[i] == '(';
+    if (parenthesized) {
+        negative = true;
+        i++;
+        skip_spaces();
+    } else if (i < text.size() && (text[i] == '-' || text[i] == '+')) {
+        negative = text[i] == '-';
+        i++;
+        skip_spaces();
+    }
+
+    size_t integer_digits = 0;
+    while (i < text.size()) {
+        if (text[i] >= '0' && text[i] <= '9') {
+            if (count >= 16) // больше 10^16 рублей - не сумма
+                return false;
+            digits[count++] = text[i++];
+            integer_digits++;
+        } else if (integer_digits > 0 &&
+                   (text[i] == ' ' || text[i] == '\'' || space_at(i) > 1)) {
+            // Пробел или апостроф между группами разрядов, но не хвостовой
+            size_t next = i + (text[i] == '\'' ? 1 : space_at(i));
+            if (next >= text.size() || text[next] < '0' || text[next] > '9')
+                break;
+            i = next;
+        } else {
+            break;
+        }
+    }
+
+    size_t fraction_digits = 0;
+    bool round_up = false;
+    if (i < text.size() && (text[i] == ',' || text[i] == '.')) {
+        i++;
+        while (i < text.size() && text[i] >= '0' && text[i] <= '9') {
+            if (fraction_digits < 2) {
+                digits[count++] = text[i];
+                fraction_digits++;
+            } else if (fraction_digits == 2) {
+                // Лишние знаки: округление до копейки по третьему
+                round_up = text[i] >= '5';
+                fraction_digits++;
+            }
+            i++;
+        }
+    }
+    skip_spaces();
+    if (parenthesized) {
+        if (i >= text.size() || text[i] != ')')
+            return false;
+        i++;
+        skip_spaces();
+    }
+    if (i != text.size() || (integer_digits == 0 && fraction_digits == 0))
+        return false;
+    for (size_t scale = std::min<size_t>(fraction_digits, 2); scale < 2; scale++)
+        digits[count++] = '0';
+
+    int64_t kopecks = 0;
+    auto result = std::from_chars(digits, digits + count, kopecks);
+    if (result.ec != std::errc())
+        return false;
+    if (round_up)
+        kopecks++;
+    value = Money(negative ? -kopecks : kopecks);
+    return true;
+}
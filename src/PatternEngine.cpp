@@ -0,0 +1,278 @@
+#include "PatternEngine.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+
+// Длина символа UTF-8 по первому байту
+static size_t utf8Length(unsigned char c) {
+    if (c >= 0xF0)
+        return 4;
+    if (c >= 0xE0)
+        return 3;
+    if (c >= 0xC0)
+        return 2;
+    return 1;
+}
+
+// Закрывающая скобка группы, открытой в pattern[open]; npos - не найдена
+static size_t groupEnd(std::string_view pattern, size_t open) {
+    int depth = 0;
+    bool in_class = false;
+    for (size_t i = open; i < pattern.size(); i++) {
+        char c = pattern[i];
+        if (c == '\\') {
+            i++;
+        } else if (in_class) {
+            in_class = c != ']';
+        } else if (c == '[') {
+            in_class = true;
+        } else if (c == '(') {
+            depth++;
+        } else if (c == ')') {
+            if (--depth == 0)
+                return i;
+        }
+    }
+    return std::string_view::npos;
+}
+
+// Части шаблона, разделённые '|' верхнего уровня (не внутри групп и
+// классов символов)
+static std::vector<std::string_view> splitAlternatives(std::string_view pattern) {
+    std::vector<std::string_view> parts;
+    int depth = 0;
+    bool in_class = false;
+    size_t start = 0;
+    for (size_t i = 0; i < pattern.size(); i++) {
+        char c = pattern[i];
+        if (c == '\\') {
+            i++;
+        } else if (in_class) {
+            in_class = c != ']';
+        } else if (c == '[') {
+            in_class = true;
+        } else if (c == '(') {
+            depth++;
+        } else if (c == ')') {
+            depth--;
+        } else if (c == '|' && depth == 0) {
+            parts.push_back(pattern.substr(start, i - start));
+            start = i + 1;
+        }
+    }
+    parts.push_back(pattern.substr(start));
+    return parts;
+}
+
+// Строка, с которой начинается любое совпадение части шаблона из
+// обычных символов (и экранированных знаков препинания); символ перед
+// '?', '*' или '{' необязателен и в префикс не входит
+static std::string literalPrefix(std::string_view pattern) {
+    std::string prefix;
+    size_t i = 0;
+    while (i < pattern.size()) {
+        std::string unit;
+        char c = pattern[i];
+        if (c == '\\') {
+            if (i + 1 >= pattern.size())
+                break;
+            char escaped = pattern[i + 1];
+            // \d, \s, \b, \n, \1 и т.п. - не одиночный символ текста
+            if (std::isalnum(static_cast<unsigned char>(escaped)))
+                break;
+            unit.assign(1, escaped);
+            i += 2;
+        } else if (std::strchr(".[]()|^$*+?{}", c)) {
+            break;
+        } else {
+            size_t length = utf8Length(static_cast<unsigned char>(c));
+            unit.assign(pattern.substr(i, length));
+            i += length;
+        }
+        if (i < pattern.size()) {
+            char next = pattern[i];
+            if (next == '?' || next == '*' || next == '{')
+                break;
+            if (next == '+') {
+                prefix += unit;
+                break;
+            }
+        }
+        prefix += unit;
+    }
+    return prefix;
+}
+
+// Строки, с которых начинается любое совпадение шаблона; пусто - такие
+// строки не выводятся (тогда поиск идёт std::regex по всему тексту)
+static std::vector<std::string> requiredPrefixes(std::string_view pattern) {
+    std::vector<std::string_view> alternatives;
+    if (!pattern.empty() && pattern[0] == '(') {
+        // Ведущая группа (...) или (?:...) из вариантов, за которой нет
+        // квантификатора, допускающего её отсутствие
+        if (pattern.size() > 2 && pattern[1] == '?' && pattern[2] != ':')
+            return {}; // (?=...), (?!...)
+        size_t end = groupEnd(pattern, 0);
+        if (end == std::string_view::npos)
+            return {};
+        if (end + 1 < pattern.size() &&
+            std::strchr("?*{", pattern[end + 1]))
+            return {};
+        size_t body = pattern.compare(0, 3, "(?:") == 0 ? 3 : 1;
+        if (splitAlternatives(pattern).size() > 1)
+            return {};
+        alternatives = splitAlternatives(pattern.substr(body, end - body));
+    } else {
+        alternatives = splitAlternatives(pattern);
+    }
+
+    std::vector<std::string> prefixes;
+    for (std::string_view alternative : alternatives) {
+        std::string prefix = literalPrefix(alternative);
+        if (prefix.empty())
+            return {};
+        prefixes.push_back(std::move(prefix));
+    }
+    return prefixes;
+}
+
+PatternEngine::Pattern::Pattern(std::string name, const std::string &pattern)
+    : name(std::move(name)), source(pattern), regex(pattern),
+      prefixes(requiredPrefixes(pattern)) {}
+
+bool PatternEngine::Pattern::search(const std::string &text,
+                                    std::smatch &match) const {
+    auto start = std::chrono::steady_clock::now();
+    bool found = false;
+    uint64_t runs = 0;
+    if (prefixes.empty()) {
+        runs = 1;
+        found = std::regex_search(text, match, regex);
+    } else {
+        // Следующее вхождение каждой строки; после проверки позиции
+        // ищется дальше только та строка, что на ней стояла, поэтому
+        // каждая строка проходит текст один раз
+        std::string_view view(text);
+        size_t inline_next[8];
+        std::vector<size_t> heap_next;
+        size_t *next = inline_next;
+        if (prefixes.size() > 8) {
+            heap_next.resize(prefixes.size());
+            next = heap_next.data();
+        }
+        for (size_t k = 0; k < prefixes.size(); k++) {
+            next[k] = view.find(prefixes[k]);
+        }
+        while (!found) {
+            size_t candidate = *std::min_element(next, next + prefixes.size());
+            if (candidate == std::string_view::npos)
+                break;
+            runs++;
+            // Символ перед позицией доступен для \b и ^ (как при поиске
+            // по всему тексту)
+            auto flags = std::regex_constants::match_continuous;
+            if (candidate > 0)
+                flags |= std::regex_constants::match_prev_avail;
+            found = std::regex_search(text.begin() + candidate, text.end(),
+                                      match, regex, flags);
+            for (size_t k = 0; k < prefixes.size(); k++) {
+                if (next[k] == candidate)
+                    next[k] = view.find(prefixes[k], candidate + 1);
+            }
+        }
+        if (!found) {
+            match = std::smatch();
+        }
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    searches.fetch_add(1, std::memory_order_relaxed);
+    regexRuns.fetch_add(runs, std::memory_order_relaxed);
+    if (found)
+        hits.fetch_add(1, std::memory_order_relaxed);
+    nanoseconds.fetch_add(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(),
+        std::memory_order_relaxed);
+    return found;
+}
+
+const PatternEngine::Pattern *PatternEngine::add(const std::string &name,
+                                                 const std::string &pattern) {
+    patterns.push_back(std::unique_ptr<Pattern>(new Pattern(name, pattern)));
+    return patterns.back().get();
+}
+
+bool PatternEngine::nextBreakdownItem(std::string_view text, size_t &pos,
+                                      std::string_view &kosgu_code,
+                                      std::string_view &amount) const {
+    static const std::string_view letter = "К";
+    auto start = std::chrono::steady_clock::now();
+    // Назначение считается один раз - при первом вызове (pos == 0)
+    bool first = pos == 0;
+    bool found = false;
+    while (!found && pos < text.size()) {
+        size_t at = text.find(letter, pos);
+        if (at == std::string_view::npos) {
+            pos = text.size();
+            break;
+        }
+        size_t code_start = at + letter.size();
+        size_t i = code_start;
+        while (i < text.size() && i < code_start + 3 &&
+               std::isdigit(static_cast<unsigned char>(text[i])))
+            i++;
+        if (i == code_start + 3 && i < text.size() && text[i] == '=') {
+            size_t amount_start = ++i;
+            while (i < text.size() &&
+                   (std::isdigit(static_cast<unsigned char>(text[i])) ||
+                    text[i] == '.'))
+                i++;
+            if (i > amount_start) {
+                kosgu_code = text.substr(code_start, 3);
+                amount = text.substr(amount_start, i - amount_start);
+                pos = i;
+                found = true;
+                break;
+            }
+        }
+        pos = at + 1;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    if (first) {
+        breakdownSearches.fetch_add(1, std::memory_order_relaxed);
+        if (found)
+            breakdownHits.fetch_add(1, std::memory_order_relaxed);
+    }
+    breakdownNanoseconds.fetch_add(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(),
+        std::memory_order_relaxed);
+    return found;
+}
+
+std::vector<PatternEngine::Stats> PatternEngine::stats() const {
+    std::vector<Stats> result;
+    for (const auto &pattern : patterns) {
+        Stats stats;
+        stats.name = pattern->name;
+        stats.pattern = pattern->source;
+        stats.prefixes = pattern->prefixes;
+        stats.searches = pattern->searches;
+        stats.regexRuns = pattern->regexRuns;
+        stats.hits = pattern->hits;
+        stats.totalMs = pattern->nanoseconds / 1e6;
+        result.push_back(std::move(stats));
+    }
+
+    Stats breakdown;
+    breakdown.name = "Расшифровка «в т.ч.»";
+    breakdown.pattern = "К(\\d{3})=([\\d.]+)";
+    breakdown.builtin = true;
+    breakdown.searches = breakdownSearches;
+    breakdown.hits = breakdownHits;
+    breakdown.totalMs = breakdownNanoseconds / 1e6;
+    result.push_back(std::move(breakdown));
+    return result;
+}
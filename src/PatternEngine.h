@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Шаблоны для разбора назначений платежей при импорте. Пользовательский
+// шаблон (таблица Regexes) компилируется один раз на импорт. Если все
+// совпадения шаблона начинаются с одной из известных строк (например,
+// "(?:по контракту|Контракт|дог\.)..." или "К(\d{3})"), эти строки ищутся
+// простым поиском подстроки, а std::regex проверяется только с найденных
+// позиций (match_continuous) вместо прохода по всему тексту.
+// Встроенная расшифровка "К225=10.00" разбирается без std::regex.
+// Шаблоны неизменяемы и используются из нескольких потоков разбора
+// одновременно; счётчики совпадений и времени - общие для всех потоков.
+class PatternEngine {
+public:
+    // Счётчики шаблона за импорт
+    struct Stats {
+        std::string name;
+        std::string pattern;
+        // Встроенный разбор без std::regex
+        bool builtin = false;
+        // Строки, с которых начинается любое совпадение; пусто - поиск
+        // std::regex по всему тексту
+        std::vector<std::string> prefixes;
+        uint64_t searches = 0;
+        // Запусков std::regex (для префильтра - число найденных позиций)
+        uint64_t regexRuns = 0;
+        uint64_t hits = 0;
+        double totalMs = 0.0;
+    };
+
+    class Pattern {
+    public:
+        // Первое совпадение в тексте - те же группы, что дал бы
+        // std::regex_search. После префильтра match.position() и
+        // match.prefix() отсчитываются от начала совпадения, а не текста.
+        bool search(const std::string& text, std::smatch& match) const;
+
+    private:
+        friend class PatternEngine;
+        Pattern(std::string name, const std::string& pattern);
+
+        std::string name;
+        std::string source;
+        std::regex regex;
+        std::vector<std::string> prefixes;
+        mutable std::atomic<uint64_t> searches{0};
+        mutable std::atomic<uint64_t> regexRuns{0};
+        mutable std::atomic<uint64_t> hits{0};
+        mutable std::atomic<uint64_t> nanoseconds{0};
+    };
+
+    // Компилирует шаблон; при ошибке в шаблоне - std::regex_error, как у
+    // std::regex. Указатель действителен, пока жив PatternEngine.
+    const Pattern* add(const std::string& name, const std::string& pattern);
+
+    // Следующий элемент расшифровки "К<3 цифры>=<цифры и точки>" (как
+    // std::sregex_iterator по "К(\d{3})=([\d.]+)") начиная с pos; pos
+    // переводится за найденный элемент. Разбор назначения начинается с
+    // pos == 0: по таким вызовам считаются назначения и назначения с
+    // расшифровкой
+    bool nextBreakdownItem(std::string_view text, size_t& pos,
+                           std::string_view& kosgu_code,
+                           std::string_view& amount) const;
+
+    std::vector<Stats> stats() const;
+
+private:
+    std::vector<std::unique_ptr<Pattern>> patterns;
+    mutable std::atomic<uint64_t> breakdownSearches{0};
+    mutable std::atomic<uint64_t> breakdownHits{0};
+    mutable std::atomic<uint64_t> breakdownNanoseconds{0};
+};
@@ -0,0 +1,343 @@
+#include "PaymentStore.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <type_traits>
+
+#include <unistd.h>
+
+StringPool::StringPool() { clear(); }
+
+static size_t hashText(std::string_view text) {
+    return std::hash<std::string_view>()(text);
+}
+
+uint32_t StringPool::intern(std::string_view value) {
+    if (value.empty())
+        return 0;
+    if ((count + 1) * 2 > slots.size())
+        rehash(std::max<size_t>(16, slots.size() * 2));
+
+    size_t mask = slots.size() - 1;
+    size_t slot = hashText(value) & mask;
+    while (slots[slot] != 0) {
+        if (view(slots[slot]) == value)
+            return slots[slot];
+        slot = (slot + 1) & mask;
+    }
+
+    uint32_t handle = (uint32_t)text.size();
+    text.insert(text.end(), value.begin(), value.end());
+    text.push_back('\0');
+    slots[slot] = handle;
+    count++;
+    return handle;
+}
+
+// Таблица строится заново обходом буфера: после shrinkToFit() её нет
+void StringPool::rehash(size_t slot_count) {
+    while (slot_count < count * 2)
+        slot_count *= 2;
+    slots.assign(slot_count, 0);
+    size_t mask = slot_count - 1;
+    for (size_t handle = 1; handle < text.size();) {
+        std::string_view value = view((uint32_t)handle);
+        size_t slot = hashText(value) & mask;
+        while (slots[slot] != 0)
+            slot = (slot + 1) & mask;
+        slots[slot] = (uint32_t)handle;
+        handle += value.size() + 1;
+    }
+}
+
+// Таблица поиска нужна только при добавлении строк, после загрузки она
+// освобождается и при следующем intern() строится снова
+void StringPool::shrinkToFit() {
+    text.shrink_to_fit();
+    std::vector<uint32_t>().swap(slots);
+}
+
+void StringPool::clear() {
+    text.assign(1, '\0');
+    slots.clear();
+    count = 1;
+}
+
+// Таблица поиска строится при первом intern()
+void StringPool::assign(std::string_view bytes, size_t strings) {
+    text.assign(bytes.begin(), bytes.end());
+    slots.clear();
+    count = strings;
+}
+
+void PaymentStore::clear() {
+    ids.clear();
+    dates.clear();
+    rawDates.clear();
+    amounts.clear();
+    counterpartyIds.clear();
+    types.clear();
+    docNumbers.clear();
+    recipients.clear();
+    descriptions.clear();
+    notes.clear();
+    pool.clear();
+}
+
+void PaymentStore::shrinkToFit() {
+    ids.shrink_to_fit();
+    dates.shrink_to_fit();
+    amounts.shrink_to_fit();
+    counterpartyIds.shrink_to_fit();
+    types.shrink_to_fit();
+    docNumbers.shrink_to_fit();
+    recipients.shrink_to_fit();
+    descriptions.shrink_to_fit();
+    notes.shrink_to_fit();
+    pool.shrinkToFit();
+}
+
+void PaymentStore::reserve(size_t rows) {
+    ids.reserve(rows);
+    dates.reserve(rows);
+    amounts.reserve(rows);
+    counterpartyIds.reserve(rows);
+    types.reserve(rows);
+    docNumbers.reserve(rows);
+    recipients.reserve(rows);
+    descriptions.reserve(rows);
+    notes.reserve(rows);
+}
+
+void PaymentStore::append(int id, std::string_view date,
+                          std::string_view doc_number, bool type,
+                          double amount, std::string_view recipient,
+                          std::string_view description, int counterparty_id,
+                          std::string_view note) {
+    ids.push_back(id);
+    // Дата хранится номером дня, только если текст восстанавливается из
+    // него без изменений ("ГГГГ-ММ-ДД"); иначе сохраняется и сам текст
+    Date day;
+    bool iso = Date::parse(date, day) && date.size() == 10 && date[4] == '-';
+    if (!date.empty() && !iso) {
+        rawDates.emplace((Row)dates.size(), pool.intern(date));
+    }
+    dates.push_back(day.days);
+    amounts.push_back((int64_t)std::llround(amount * 100.0));
+    counterpartyIds.push_back(counterparty_id);
+    types.push_back(type ? 1 : 0);
+    docNumbers.push_back(pool.intern(doc_number));
+    recipients.push_back(pool.intern(recipient));
+    descriptions.push_back(pool.intern(description));
+    notes.push_back(pool.intern(note));
+}
+
+long PaymentStore::find(int id) const {
+    auto it = std::lower_bound(ids.begin(), ids.end(), id);
+    if (it == ids.end() || *it != id)
+        return -1;
+    return (long)(it - ids.begin());
+}
+
+std::string PaymentStore::date(Row row) const {
+    auto raw = rawDates.find(row);
+    if (raw != rawDates.end())
+        return std::string(pool.view(raw->second));
+    return Date(dates[row]).toString();
+}
+
+// Формат снимка: заголовок, затем столбцы ids, dates, amounts,
+// counterpartyIds, types, docNumbers, recipients, descriptions, notes, пары
+// (строка, дата текстом) из rawDates и буфер пула строк. Каждый блок
+// выровнен на 8 байт. Порядок байтов - как у машины, снимок не переносится
+// между платформами.
+namespace {
+
+const char SNAPSHOT_MAGIC[8] = {'F', 'A', 'P', 'A', 'Y', 'S', 'N', 'P'};
+// Увеличивается при любом изменении формата
+const uint32_t SNAPSHOT_FORMAT = 1;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t format;
+    uint32_t schemaVersion;
+    uint64_t rows;
+    int64_t maxId;
+    uint64_t rawDates;
+    uint64_t poolBytes;
+    uint64_t poolStrings;
+};
+
+size_t padded(size_t bytes) { return (bytes + 7) & ~(size_t)7; }
+
+size_t snapshotSize(const SnapshotHeader &header) {
+    size_t rows = header.rows;
+    return padded(sizeof(SnapshotHeader)) + padded(rows * sizeof(int)) +
+           padded(rows * sizeof(int32_t)) + padded(rows * sizeof(int64_t)) +
+           padded(rows * sizeof(int)) + padded(rows * sizeof(uint8_t)) +
+           4 * padded(rows * sizeof(uint32_t)) +
+           padded(header.rawDates * 2 * sizeof(uint32_t)) +
+           padded(header.poolBytes);
+}
+
+bool readHeader(std::string_view data, SnapshotHeader &header) {
+    if (data.size() < sizeof(SnapshotHeader))
+        return false;
+    memcpy(&header, data.data(), sizeof(SnapshotHeader));
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 ||
+        header.format != SNAPSHOT_FORMAT)
+        return false;
+    // Размеры проверяются до умножения, чтобы оно не переполнилось
+    if (header.rows > UINT32_MAX || header.rawDates > header.rows ||
+        header.poolBytes == 0 || header.poolBytes > UINT32_MAX ||
+        header.poolStrings == 0 || header.poolStrings > header.poolBytes)
+        return false;
+    return snapshotSize(header) == data.size();
+}
+
+} // namespace
+
+PaymentStore::SnapshotStamp PaymentStore::stamp(uint32_t schema_version) const {
+    SnapshotStamp result;
+    result.schemaVersion = schema_version;
+    result.rows = ids.size();
+    result.maxId = ids.empty() ? 0 : ids.back();
+    return result;
+}
+
+bool PaymentStore::writeSnapshot(const std::string &path,
+                                 uint32_t schema_version) const {
+    SnapshotHeader header = {};
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.format = SNAPSHOT_FORMAT;
+    SnapshotStamp current = stamp(schema_version);
+    header.schemaVersion = current.schemaVersion;
+    header.rows = current.rows;
+    header.maxId = current.maxId;
+    header.rawDates = rawDates.size();
+    std::string_view pool_bytes = pool.bytes();
+    header.poolBytes = pool_bytes.size();
+    header.poolStrings = pool.size();
+
+    std::vector<uint32_t> raw_dates;
+    raw_dates.reserve(rawDates.size() * 2);
+    for (const auto &raw : rawDates) {
+        raw_dates.push_back(raw.first);
+        raw_dates.push_back(raw.second);
+    }
+
+    // Своё имя временного файла у каждой записи: две записи подряд (из
+    // разных потоков или копий программы) не пишут в один файл
+    static std::atomic<unsigned> write_counter{0};
+    std::string temp_path = path + "." + std::to_string(getpid()) + "." +
+                            std::to_string(write_counter.fetch_add(1)) + ".tmp";
+    FILE *file = fopen(temp_path.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Cannot write snapshot: " << temp_path << std::endl;
+        return false;
+    }
+    bool ok = true;
+    auto write_block = [&](const void *data, size_t bytes) {
+        static const char zeros[8] = {};
+        if (!ok)
+            return;
+        ok = (bytes == 0 || fwrite(data, 1, bytes, file) == bytes) &&
+             (padded(bytes) == bytes ||
+              fwrite(zeros, 1, padded(bytes) - bytes, file) == padded(bytes) - bytes);
+    };
+    write_block(&header, sizeof(header));
+    write_block(ids.data(), ids.size() * sizeof(int));
+    write_block(dates.data(), dates.size() * sizeof(int32_t));
+    write_block(amounts.data(), amounts.size() * sizeof(int64_t));
+    write_block(counterpartyIds.data(), counterpartyIds.size() * sizeof(int));
+    write_block(types.data(), types.size() * sizeof(uint8_t));
+    write_block(docNumbers.data(), docNumbers.size() * sizeof(uint32_t));
+    write_block(recipients.data(), recipients.size() * sizeof(uint32_t));
+    write_block(descriptions.data(), descriptions.size() * sizeof(uint32_t));
+    write_block(notes.data(), notes.size() * sizeof(uint32_t));
+    write_block(raw_dates.data(), raw_dates.size() * sizeof(uint32_t));
+    write_block(pool_bytes.data(), pool_bytes.size());
+    ok = (fclose(file) == 0) && ok;
+
+    if (!ok || std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        std::cerr << "Cannot write snapshot: " << path << std::endl;
+        std::remove(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool PaymentStore::readSnapshotStamp(std::string_view data,
+                                     SnapshotStamp &stamp) {
+    SnapshotHeader header;
+    if (!readHeader(data, header))
+        return false;
+    stamp.schemaVersion = header.schemaVersion;
+    stamp.rows = header.rows;
+    stamp.maxId = header.maxId;
+    return true;
+}
+
+bool PaymentStore::readSnapshot(std::string_view data) {
+    SnapshotHeader header;
+    if (!readHeader(data, header))
+        return false;
+
+    // Размер файла уже сверен с заголовком: блоки читаются без проверок
+    // границ
+    size_t offset = padded(sizeof(SnapshotHeader));
+    auto read_block = [&](auto &column, size_t count) {
+        using Value = typename std::decay_t<decltype(column)>::value_type;
+        column.resize(count);
+        if (count > 0)
+            memcpy(column.data(), data.data() + offset, count * sizeof(Value));
+        offset += padded(count * sizeof(Value));
+    };
+
+    PaymentStore loaded;
+    size_t rows = header.rows;
+    read_block(loaded.ids, rows);
+    read_block(loaded.dates, rows);
+    read_block(loaded.amounts, rows);
+    read_block(loaded.counterpartyIds, rows);
+    read_block(loaded.types, rows);
+    read_block(loaded.docNumbers, rows);
+    read_block(loaded.recipients, rows);
+    read_block(loaded.descriptions, rows);
+    read_block(loaded.notes, rows);
+    std::vector<uint32_t> raw_dates;
+    read_block(raw_dates, header.rawDates * 2);
+    std::string_view pool_bytes(data.data() + offset, header.poolBytes);
+
+    // Номера строк пула должны указывать внутрь буфера, а буфер - кончаться
+    // нулём: иначе повреждённый снимок привёл бы к чтению за его пределами
+    if (pool_bytes.front() != '\0' || pool_bytes.back() != '\0')
+        return false;
+    // Число строк пула (по завершающим нулям) должно совпадать с
+    // заголовком: по нему при следующем intern() выбирается размер таблицы
+    // поиска, и заниженное значение дало бы переполненную таблицу
+    if ((uint64_t)std::count(pool_bytes.begin(), pool_bytes.end(), '\0') !=
+        header.poolStrings)
+        return false;
+    auto valid_handles = [&](const std::vector<uint32_t> &handles) {
+        uint32_t limit = (uint32_t)header.poolBytes;
+        return std::all_of(handles.begin(), handles.end(),
+                           [limit](uint32_t handle) { return handle < limit; });
+    };
+    if (!valid_handles(loaded.docNumbers) || !valid_handles(loaded.recipients) ||
+        !valid_handles(loaded.descriptions) || !valid_handles(loaded.notes))
+        return false;
+    for (size_t i = 0; i < raw_dates.size(); i += 2) {
+        if (raw_dates[i] >= rows || raw_dates[i + 1] >= header.poolBytes)
+            return false;
+        loaded.rawDates.emplace(raw_dates[i], raw_dates[i + 1]);
+    }
+    loaded.pool.assign(pool_bytes, header.poolStrings);
+
+    *this = std::move(loaded);
+    return true;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "Date.h"
+
+// Пул строк без повторов. Одинаковые значения (получатели, типовые
+// назначения) хранятся один раз. Строки лежат подряд в одном буфере,
+// каждая завершается нулём, а номер строки - её смещение в буфере
+// (4 байта вместо std::string в каждой записи).
+class StringPool {
+public:
+    StringPool();
+
+    // 0 - пустая строка
+    uint32_t intern(std::string_view text);
+    // Указатель действителен до следующего intern()
+    const char* c_str(uint32_t handle) const { return text.data() + handle; }
+    std::string_view view(uint32_t handle) const { return c_str(handle); }
+    size_t size() const { return count; }
+    void shrinkToFit();
+    void clear();
+
+    // Буфер строк целиком (для снимка) и его восстановление
+    std::string_view bytes() const { return std::string_view(text.data(), text.size()); }
+    void assign(std::string_view bytes, size_t strings);
+
+private:
+    void rehash(size_t slot_count);
+
+    std::vector<char> text;
+    // Открытая адресация: смещения строк, 0 - свободная ячейка
+    std::vector<uint32_t> slots;
+    size_t count = 1;
+};
+
+// Платежи в виде столбцов (struct of arrays): id, номер дня даты, сумма в копейках,
+// контрагент и номера строк пула вместо std::string. Строка i хранилища -
+// i-й элемент каждого столбца, строки упорядочены по id. Отбор обходит
+// нужные столбцы подряд и возвращает номера строк, а не копии платежей.
+class PaymentStore {
+public:
+    using Row = uint32_t;
+
+    void clear();
+    void reserve(size_t rows);
+    // Строки добавляются по возрастанию id
+    void append(int id, std::string_view date, std::string_view doc_number,
+                bool type, double amount, std::string_view recipient,
+                std::string_view description, int counterparty_id,
+                std::string_view note);
+
+    size_t size() const { return ids.size(); }
+    bool empty() const { return ids.empty(); }
+    // Номер строки платежа или -1
+    long find(int id) const;
+
+    int id(Row row) const { return ids[row]; }
+    std::string date(Row row) const;
+    const char* docNumber(Row row) const { return pool.c_str(docNumbers[row]); }
+    int64_t amountKopecks(Row row) const { return amounts[row]; }
+    double amount(Row row) const { return amounts[row] / 100.0; }
+    const char* recipient(Row row) const { return pool.c_str(recipients[row]); }
+    const char* description(Row row) const { return pool.c_str(descriptions[row]); }
+    int counterpartyId(Row row) const { return counterpartyIds[row]; }
+
+    // Освобождает запас ёмкости после загрузки
+    void shrinkToFit();
+
+    // Снимок хранилища в файле: заголовок и столбцы подряд в том же виде,
+    // что и в памяти, поэтому чтение - копирование блоков без разбора.
+    // По отметке снимка проверяется, что он сделан с той же базы.
+    struct SnapshotStamp {
+        uint32_t schemaVersion = 0;
+        uint64_t rows = 0;
+        int64_t maxId = 0;
+
+        bool operator==(const SnapshotStamp& other) const {
+            return schemaVersion == other.schemaVersion && rows == other.rows &&
+                   maxId == other.maxId;
+        }
+        bool operator!=(const SnapshotStamp& other) const { return !(*this == other); }
+    };
+    SnapshotStamp stamp(uint32_t schema_version) const;
+    // Запись во временный файл и переименование: читатели видят либо
+    // старый снимок, либо новый целиком
+    bool writeSnapshot(const std::string& path, uint32_t schema_version) const;
+    // Отметка из заголовка; false - не снимок или другой формат
+    static bool readSnapshotStamp(std::string_view data, SnapshotStamp& stamp);
+    // Заменяет содержимое хранилища снимком. При повреждённом снимке
+    // возвращает false, хранилище не меняется
+    bool readSnapshot(std::string_view data);
+
+private:
+    std::vector<int> ids;
+    // Номера дней (Date::days); даты не в виде ГГГГ-ММ-ДД хранятся текстом
+    // в rawDates
+    std::vector<int32_t> dates;
+    std::unordered_map<Row, uint32_t> rawDates;
+    std::vector<int64_t> amounts;
+    std::vector<int> counterpartyIds;
+    std::vector<uint8_t> types;
+    std::vector<uint32_t> docNumbers;
+    std::vector<uint32_t> recipients;
+    std::vector<uint32_t> descriptions;
+    std::vector<uint32_t> notes;
+    StringPool pool;
+};
@@ -0,0 +1,105 @@
+#include "QueryExecutor.h"
+
+#include <algorithm>
+
+void QueryState::cancel() {
+    std::lock_guard<std::mutex> lock(mutex);
+    cancelled = true;
+    if (connection) {
+        connection->interrupt();
+    }
+}
+
+bool QueryState::isCancelled() { return cancelled; }
+
+bool QueryState::attach(DatabaseManager *db) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (cancelled)
+        return false;
+    connection = db;
+    connection->setInterruptFlag(&cancelled);
+    return true;
+}
+
+void QueryState::detach() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (connection) {
+        connection->setInterruptFlag(nullptr);
+    }
+    connection = nullptr;
+}
+
+QueryExecutor::QueryExecutor(ReadConnectionPool &pool, size_t threads)
+    : pool(pool) {
+    if (threads == 0)
+        threads = 1;
+    for (size_t i = 0; i < threads; i++) {
+        workers.emplace_back(&QueryExecutor::run, this);
+    }
+}
+
+QueryExecutor::~QueryExecutor() { stop(); }
+
+void QueryExecutor::enqueue(std::shared_ptr<QueryState> state, Job job) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!stopping) {
+            jobs.push_back({std::move(state), std::move(job)});
+            cv.notify_one();
+            return;
+        }
+    }
+    job(nullptr);
+}
+
+void QueryExecutor::stop() {
+    std::deque<QueuedJob> abandoned;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        abandoned.swap(jobs);
+        for (auto &state : running) {
+            state->cancel();
+        }
+    }
+    cv.notify_all();
+    for (auto &worker : workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    for (auto &queued : abandoned) {
+        queued.job(nullptr);
+    }
+}
+
+void QueryExecutor::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        cv.wait(lock, [this]() { return stopping || !jobs.empty(); });
+        if (stopping)
+            break;
+
+        QueuedJob queued = std::move(jobs.front());
+        jobs.pop_front();
+        running.push_back(queued.state);
+        lock.unlock();
+
+        {
+            ReadConnectionPool::Lease connection;
+            if (!queued.state->isCancelled()) {
+                connection = pool.acquire();
+            }
+            if (connection && queued.state->attach(connection.get())) {
+                queued.job(connection.get());
+                queued.state->detach();
+            } else {
+                queued.job(nullptr);
+            }
+        }
+
+        lock.lock();
+        running.erase(
+            std::find(running.begin(), running.end(), queued.state));
+    }
+}
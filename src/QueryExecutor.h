@@ -0,0 +1,147 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "DatabaseWorker.h"
+
+// Состояние фонового запроса, общее для задачи и исполнителя. Отмена
+// прерывает выполняющийся запрос через sqlite3_interrupt на соединении,
+// которое его выполняет.
+class QueryState {
+public:
+    void cancel();
+    bool isCancelled();
+    // Текст исключения, которым завершился запрос; пустой - без ошибки.
+    // Пишется до готовности результата и читается после неё
+    const std::string& error() const { return errorText; }
+
+private:
+    friend class QueryExecutor;
+    // false, если задача уже отменена и запускать её не нужно
+    bool attach(DatabaseManager* connection);
+    void detach();
+
+    std::mutex mutex;
+    DatabaseManager* connection = nullptr;
+    // Проверяется и обработчиком прогресса соединения: отмена, пришедшая
+    // до начала выполнения запроса, не теряется
+    std::atomic<bool> cancelled{false};
+    std::string errorText;
+};
+
+// Результат фонового запроса. Представление опрашивает ready() в каждом
+// кадре и забирает результат через get(), когда он готов. Исключение
+// запроса в UI-поток не передаётся: результат пустой, а failed() и error()
+// сообщают об ошибке.
+template <typename Result>
+class QueryTask {
+public:
+    QueryTask() = default;
+
+    // Задача запущена и результат ещё не забран
+    bool pending() const { return future.valid(); }
+    bool ready() const {
+        return future.valid() &&
+               future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+    // Только после ready(); повторно результат не выдаётся
+    Result get() { return future.get(); }
+    // После ready(): запрос завершился исключением
+    bool failed() const { return state && !state->error().empty(); }
+    std::string error() const { return state ? state->error() : std::string(); }
+    // Прерывает запрос; результат отменённой задачи неполный и отбрасывается
+    void cancel() {
+        if (state)
+            state->cancel();
+        future = std::future<Result>();
+        state.reset();
+    }
+
+private:
+    friend class QueryExecutor;
+    std::future<Result> future;
+    std::shared_ptr<QueryState> state;
+};
+
+// Выполняет запросы представлений в фоновых потоках на соединениях из
+// пула только для чтения, чтобы тяжёлые выборки не останавливали отрисовку.
+// Запрос - функция от DatabaseManager&, её результат передаётся в QueryTask.
+class QueryExecutor {
+public:
+    explicit QueryExecutor(ReadConnectionPool& pool, size_t threads = 2);
+    ~QueryExecutor();
+    QueryExecutor(const QueryExecutor&) = delete;
+    QueryExecutor& operator=(const QueryExecutor&) = delete;
+
+    template <typename Query>
+    QueryTask<std::invoke_result_t<Query, DatabaseManager&>> submit(Query query);
+
+    // Прерывает выполняющиеся запросы и останавливает потоки; задачи из
+    // очереди завершаются пустым результатом
+    void stop();
+
+private:
+    using Job = std::function<void(DatabaseManager*)>;
+    struct QueuedJob {
+        std::shared_ptr<QueryState> state;
+        Job job;
+    };
+
+    void enqueue(std::shared_ptr<QueryState> state, Job job);
+    void run();
+
+    ReadConnectionPool& pool;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<QueuedJob> jobs;
+    std::vector<std::shared_ptr<QueryState>> running;
+    bool stopping = false;
+    // Последним: потоки запускаются в конструкторе
+    std::vector<std::thread> workers;
+};
+
+template <typename Query>
+QueryTask<std::invoke_result_t<Query, DatabaseManager&>>
+QueryExecutor::submit(Query query) {
+    using Result = std::invoke_result_t<Query, DatabaseManager&>;
+    auto promise = std::make_shared<std::promise<Result>>();
+    QueryTask<Result> task;
+    task.future = promise->get_future();
+    task.state = std::make_shared<QueryState>();
+
+    // connection == nullptr: база не открыта, задача отменена или
+    // исполнитель остановлен - результат пустой
+    enqueue(task.state, [promise, state = task.state, query = std::move(query)](
+                            DatabaseManager* connection) mutable {
+        try {
+            if (connection) {
+                promise->set_value(query(*connection));
+            } else {
+                promise->set_value(Result{});
+            }
+            return;
+        } catch (const std::exception& e) {
+            state->errorText = e.what();
+        } catch (...) {
+            state->errorText = "unknown exception";
+        }
+        std::cerr << "Background query failed: " << state->errorText << std::endl;
+        promise->set_value(Result{});
+    });
+    return task;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <sqlite3.h>
+#include <string>
+
+// Чтение значения столбца результата по номеру прямо в поле структуры,
+// без разбора текста. NULL даёт те же значения, что и прежние
+// обработчики sqlite3_exec: -1 для идентификаторов, 0.0, false и "".
+inline void readColumn(sqlite3_stmt *stmt, int column, int &value) {
+    value = sqlite3_column_type(stmt, column) == SQLITE_NULL
+                ? -1
+                : sqlite3_column_int(stmt, column);
+}
+
+inline void readColumn(sqlite3_stmt *stmt, int column, double &value) {
+    value = sqlite3_column_double(stmt, column);
+}
+
+inline void readColumn(sqlite3_stmt *stmt, int column, bool &value) {
+    value = sqlite3_column_int(stmt, column) == 1;
+}
+
+inline void readColumn(sqlite3_stmt *stmt, int column, std::string &value) {
+    const char *text =
+        reinterpret_cast<const char *>(sqlite3_column_text(stmt, column));
+    if (text) {
+        value.assign(text, sqlite3_column_bytes(stmt, column));
+    } else {
+        value.clear();
+    }
+}
+
+// Отображение строки результата на структуру, заданное на этапе компиляции:
+// i-й указатель на член соответствует i-му столбцу SELECT. Порядок
+// столбцов в запросе должен совпадать с порядком полей в списке.
+//
+//   using KosguRow = RowDecoder<&Kosgu::id, &Kosgu::code, &Kosgu::name>;
+//   KosguRow::decode(stmt, entry);
+template <auto... Fields> struct RowDecoder {
+    static constexpr int columnCount = sizeof...(Fields);
+
+    template <typename Row> static void decode(sqlite3_stmt *stmt, Row &row) {
+        int column = 0;
+        (readColumn(stmt, column++, row.*Fields), ...);
+    }
+};
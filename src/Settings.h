@@ -13,4 +13,6 @@ struct Settings {
     int font_size = 24;
     std::string zakupki_url_template = "https://zakupki.gov.ru/epz/contract/contractCard/common-info.html?reestrNumber={IKZ}";
     std::string zakupki_url_search_template = "https://zakupki.gov.ru/epz/contract/search/results.html?searchString={NUMBER}";
+    // Снимок платежей рядом с файлом базы для быстрого открытия
+    bool use_snapshot = true;
 };
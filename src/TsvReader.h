@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "MappedFile.h"
+
+// Чтение текстового файла с разделителями (TSV, CSV без кавычек) через
+// отображение в память. Строки и поля - std::string_view внутрь
+// отображения: на строку не выделяется память и ничего не копируется.
+// Представления действительны, пока жив TsvReader.
+class TsvReader {
+public:
+    // false - файл не открылся; пустой файл читается как файл без строк
+    bool open(const std::string &path) {
+        position = 0;
+        return file.open(path);
+    }
+
+    // Следующая строка без перевода строки (и '\r' перед ним); false - конец
+    // файла. Последняя строка без '\n' тоже выдаётся.
+    bool nextLine(std::string_view &line) {
+        std::string_view text = file.view();
+        if (position >= text.size())
+            return false;
+        const char *begin = text.data() + position;
+        const void *newline = memchr(begin, '\n', text.size() - position);
+        size_t length = newline ? (size_t)(static_cast<const char *>(newline) - begin)
+                                : text.size() - position;
+        position += length + (newline ? 1 : 0);
+        if (length > 0 && begin[length - 1] == '\r')
+            length--;
+        line = std::string_view(begin, length);
+        return true;
+    }
+
+    // Прочитано байт и размер файла (для индикатора хода чтения)
+    size_t offset() const { return position; }
+    size_t size() const { return file.size(); }
+
+private:
+    MappedFile file;
+    size_t position = 0;
+};
+
+// Делит строку на поля по разделителю в переиспользуемый вектор. Как и
+// прежнее деление через std::getline: пустая строка - ни одного поля,
+// пустое поле после последнего разделителя не добавляется.
+inline void splitFields(std::string_view line, char delimiter,
+                        std::vector<std::string_view> &fields) {
+    fields.clear();
+    size_t start = 0;
+    while (start < line.size()) {
+        size_t end = line.find(delimiter, start);
+        if (end == std::string_view::npos) {
+            fields.push_back(line.substr(start));
+            break;
+        }
+        fields.push_back(line.substr(start, end - start));
+        start = end + 1;
+    }
+}
+
+// Без пробелов, табуляций и переводов строки по краям
+inline std::string_view trimField(std::string_view field) {
+    size_t first = field.find_first_not_of(" \t\n\r");
+    if (first == std::string_view::npos)
+        return std::string_view();
+    size_t last = field.find_last_not_of(" \t\n\r");
+    return field.substr(first, last - first + 1);
+}
+
+// Поля строки копиями (для предпросмотра, где строки хранятся дольше файла)
+inline std::vector<std::string> fieldStrings(std::string_view line, char delimiter) {
+    std::vector<std::string_view> fields;
+    splitFields(line, delimiter, fields);
+    return std::vector<std::string>(fields.begin(), fields.end());
+}
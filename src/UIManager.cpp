@@ -1,11 +1,13 @@
 #include "UIManager.h"
 #include <algorithm>
+#include <cstdio>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <string>
 #include <vector>
 
+#include "DatabaseStats.h"
 #include "IconsFontAwesome6.h"
 #include "ImGuiFileDialog.h"
 #include "ImportManager.h"
@@ -81,10 +83,28 @@ UIManager::UIManager()
       importManager(nullptr),
       window(nullptr),
       cancelImport(false) {
+    dbWorker.setChangeBus(&changeBus);
     LoadRecentDbPaths();
 }
 
-UIManager::~UIManager() {
+UIManager::~UIManager() { Shutdown(); }
+
+void UIManager::Shutdown() {
+    if (shutDown)
+        return;
+    shutDown = true;
+
+    // Прерываем импорт и дожидаемся потока записи до закрытия представлений
+    cancelImport = true;
+    dbWorker.stop();
+    // Поток записи остановлен, задания из его очереди (в том числе запись
+    // снимка) отброшены: снимок платежей, прочитанных из базы, пишется здесь
+    if (paymentSnapshotEnabled && paymentStoreFromDatabase &&
+        !currentDbPath.empty()) {
+        dbManager->savePaymentSnapshot(*paymentStore);
+    }
+    queryExecutor.stop();
+
     // Save changes in all visible views before destruction
     for (auto &view : allViews) {
         if (view->IsVisible) {
@@ -134,6 +154,9 @@ void UIManager::SaveRecentDbPaths() {
 
 void UIManager::SetDatabaseManager(DatabaseManager *manager) {
     dbManager = manager;
+    if (dbManager) {
+        dbManager->setChangeBus(&changeBus);
+    }
     for (auto &view : allViews) {
         view->SetDatabaseManager(manager);
     }
@@ -157,8 +180,11 @@ void UIManager::SetExportManager(ExportManager *manager) {
 void UIManager::SetWindow(GLFWwindow *w) { window = w; }
 
 bool UIManager::LoadDatabase(const std::string &path) {
+    FlushPaymentSnapshot();
     if (dbManager->open(path)) {
         currentDbPath = path;
+        dbWorker.setDatabasePath(path);
+        readPool.setDatabasePath(path);
         SetWindowTitle(currentDbPath);
         AddRecentDbPath(path);
 
@@ -167,6 +193,21 @@ bool UIManager::LoadDatabase(const std::string &path) {
         ApplyTheme(settings.theme);
         ApplyFont(settings.font_size);
 
+        // Платежи из снимка доступны сразу, из базы - по готовности
+        auto store = std::make_shared<PaymentStore>();
+        paymentSnapshotEnabled = settings.use_snapshot;
+        if (settings.use_snapshot) {
+            dbManager->loadPaymentSnapshot(*store);
+        } else {
+            QueuePaymentSnapshot(false);
+        }
+        paymentStore = std::move(store);
+        paymentStoreVersion++;
+        paymentStoreFromDatabase = false;
+        paymentStoreStale = false;
+        paymentSnapshotStale = false;
+        RefreshPaymentStore();
+
         return true;
     }
     return false;
@@ -196,6 +237,10 @@ void UIManager::ShowServiceView() {
 }
 
 void UIManager::SaveAllViews() {
+    // Во время импорта правки недоступны; несохранённое раньше сохранится
+    // после импорта (или в Shutdown, который сначала прерывает импорт)
+    if (isImporting)
+        return;
     for (const auto& view : allViews) {
         view->ForceSave();
     }
@@ -402,7 +447,7 @@ void UIManager::HandleFileDialogs() {
             // Find ServiceView and trigger import
             for (auto& view : allViews) {
                 if (auto* serviceView = dynamic_cast<ServiceView*>(view.get())) {
-                    serviceView->StartIKZImport(filePathName, importManager, dbManager,
+                    serviceView->StartIKZImport(filePathName, importManager, dbWorker,
                                                importProgress, importMessage, importMutex,
                                                isImporting);
                     break;
@@ -412,13 +457,21 @@ void UIManager::HandleFileDialogs() {
         ImGuiFileDialog::Instance()->Close();
     }
 
+    if (ImGuiFileDialog::Instance()->Display("SaveDbStatsDlgKey")) {
+        if (ImGuiFileDialog::Instance()->IsOk()) {
+            DatabaseStats::instance().writeCsv(
+                ImGuiFileDialog::Instance()->GetFilePathName());
+        }
+        ImGuiFileDialog::Instance()->Close();
+    }
+
     if (ImGuiFileDialog::Instance()->Display("ExportContractsDlgKey")) {
         if (ImGuiFileDialog::Instance()->IsOk()) {
             std::string filePathName = ImGuiFileDialog::Instance()->GetFilePathName();
             // Find ServiceView and trigger export
             for (auto& view : allViews) {
                 if (auto* serviceView = dynamic_cast<ServiceView*>(view.get())) {
-                    serviceView->StartContractsExport(filePathName, exportManager,
+                    serviceView->StartContractsExport(filePathName, exportManager, queryExecutor,
                                                      importProgress, importMessage, importMutex,
                                                      isImporting);
                     break;
@@ -429,10 +482,118 @@ void UIManager::HandleFileDialogs() {
     }
 }
 
+void UIManager::RefreshPaymentStore() {
+    paymentStoreTask.cancel();
+    if (currentDbPath.empty())
+        return;
+    paymentStoreTask = queryExecutor.submit([](DatabaseManager &db) {
+        auto store = std::make_shared<PaymentStore>();
+        if (!db.loadPaymentStore(*store))
+            return std::shared_ptr<PaymentStore>();
+        return store;
+    });
+}
+
+// Платежи перечитываются, когда изменений нет paymentRefreshDelay и импорт
+// не идёт: правка строки, групповая операция и импорт дают одну загрузку,
+// а не загрузку на каждую фиксацию
+static const auto paymentRefreshDelay = std::chrono::milliseconds(500);
+// Снимок нужен только при следующем открытии базы, поэтому
+// переписывается редко
+static const auto paymentSnapshotInterval = std::chrono::seconds(60);
+
+void UIManager::UpdatePaymentStore(bool payments_changed, bool settings_changed) {
+    auto now = std::chrono::steady_clock::now();
+    if (payments_changed) {
+        paymentStoreStale = true;
+        paymentStoreChangedAt = now;
+    }
+    if (settings_changed &&
+        dbManager->getSettings().use_snapshot != paymentSnapshotEnabled) {
+        paymentSnapshotEnabled = !paymentSnapshotEnabled;
+        paymentSnapshotStale = paymentSnapshotEnabled;
+        if (!paymentSnapshotEnabled) {
+            QueuePaymentSnapshot(false);
+        }
+    }
+
+    // Загрузка за раз одна: изменения во время загрузки перечитываются
+    // следующей
+    if (paymentStoreStale && !isImporting && !paymentStoreTask.pending() &&
+        now - paymentStoreChangedAt >= paymentRefreshDelay) {
+        paymentStoreStale = false;
+        RefreshPaymentStore();
+    }
+    if (paymentStoreTask.ready()) {
+        std::shared_ptr<PaymentStore> store = paymentStoreTask.get();
+        if (store) {
+            paymentStore = std::move(store);
+            paymentStoreVersion++;
+            paymentStoreFromDatabase = true;
+            paymentSnapshotStale = paymentSnapshotEnabled;
+        }
+    }
+
+    if (paymentSnapshotStale &&
+        now - paymentSnapshotSavedAt >= paymentSnapshotInterval) {
+        paymentSnapshotSavedAt = now;
+        FlushPaymentSnapshot();
+    }
+}
+
+void UIManager::FlushPaymentSnapshot() {
+    if (paymentSnapshotStale && !currentDbPath.empty()) {
+        QueuePaymentSnapshot(true);
+    }
+    paymentSnapshotStale = false;
+}
+
+// Снимок пишется и удаляется заданием потока записи: задания выполняются
+// по одному в порядке постановки, поэтому записи и удаление не
+// пересекаются, а UI-поток их не ждёт. Путь и версия схемы берутся
+// сейчас - к началу задания может быть открыта другая база.
+void UIManager::QueuePaymentSnapshot(bool write) {
+    std::string path = dbManager->paymentSnapshotPath();
+    if (path.empty())
+        return;
+    if (!write) {
+        dbWorker.submit([path](DatabaseManager *) { std::remove(path.c_str()); });
+        return;
+    }
+    uint32_t schema_version = dbManager->getSchemaVersion();
+    std::shared_ptr<const PaymentStore> store = paymentStore;
+    dbWorker.submit([store, path, schema_version](DatabaseManager *) {
+        store->writeSnapshot(path, schema_version);
+    });
+}
+
 void UIManager::Render() {
-    // Render all views
+    // Раздаём представлениям изменения, зафиксированные с прошлого кадра
+    std::vector<DataChange> changes = changeBus.takePending();
+    if (!changes.empty()) {
+        for (auto &view : allViews) {
+            view->OnDataChanged(changes);
+        }
+    }
+    // Платежи перечитываются после изменения платежей, снимок - после
+    // загрузки платежей или включения в настройках
+    bool payments_changed = false;
+    bool settings_changed = false;
+    for (const auto &change : changes) {
+        payments_changed = payments_changed || change.table == "Payments";
+        settings_changed = settings_changed || change.table == "Settings";
+    }
+    UpdatePaymentStore(payments_changed, settings_changed);
+
+    // Render all views; пока идёт импорт, представления, пишущие через
+    // соединение UI-потока, показываются недоступными
     for (auto &view : allViews) {
+        bool locked = isImporting && view->WritesThroughUiConnection();
+        if (locked)
+            ImGui::BeginDisabled();
         view->Render();
+        if (locked)
+            ImGui::EndDisabled();
     }
 
     // Remove closed views
@@ -4,12 +4,16 @@
 #include <vector>
 #include <string>
 #include <atomic>
+#include <chrono>
 #include <mutex>
 #include <memory> // Required for std::unique_ptr
 #include <type_traits> // Required for std::is_same_v
 
 #include "Kosgu.h"
 #include "DatabaseManager.h"
+#include "DatabaseWorker.h"
+#include "PaymentStore.h"
+#include "QueryExecutor.h"
 #include "PdfReporter.h"
 #include "views/BaseView.h"
 #include "views/PaymentsView.h"
@@ -36,6 +40,10 @@ class UIManager {
 public:
     UIManager();
     ~UIManager();
+    // Останавливает фоновые потоки, пишет снимок платежей и сохраняет
+    // представления. Вызывается до уничтожения DatabaseManager и
+    // ImportManager, которыми пользуются потоки и представления
+    void Shutdown();
     void Render();
     void SetDatabaseManager(DatabaseManager* dbManager);
     void SetPdfReporter(PdfReporter* pdfReporter);
@@ -69,7 +77,7 @@ public:
         view->SetDatabaseManager(dbManager);
         view->SetPdfReporter(pdfReporter);
 
-        if constexpr (std::is_same_v<T, ImportMapView> || std::is_same_v<T, JO4ImportMapView> || std::is_same_v<T, PaymentsView> || std::is_same_v<T, ContractsView> || std::is_same_v<T, KosguView> || std::is_same_v<T, CounterpartiesView> || std::is_same_v<T, SettingsView> || std::is_same_v<T, ServiceView>) {
+        if constexpr (std::is_same_v<T, ImportMapView> || std::is_same_v<T, JO4ImportMapView> || std::is_same_v<T, PaymentsView> || std::is_same_v<T, BasePaymentsView> || std::is_same_v<T, ContractsView> || std::is_same_v<T, KosguView> || std::is_same_v<T, CounterpartiesView> || std::is_same_v<T, SettingsView> || std::is_same_v<T, ServiceView>) {
             viewPtr->SetUIManager(this);
         }
         
@@ -101,6 +109,32 @@ public:
     ExportManager* exportManager = nullptr;
     std::vector<std::unique_ptr<BaseView>> allViews;
 
+    // Изменения данных от всех соединений; раздаются представлениям в Render()
+    DataChangeBus changeBus;
+
+    // Фоновая запись (импорт) и фоновое чтение (экспорт) идут через
+    // отдельные соединения, а не через соединение UI-потока dbManager.
+    // Объявлены после allViews, чтобы поток записи останавливался раньше,
+    // чем уничтожаются представления, чьи задания он выполняет.
+    DatabaseWorker dbWorker;
+    ReadConnectionPool readPool;
+    // Фоновые запросы представлений (на соединениях из readPool)
+    QueryExecutor queryExecutor{readPool};
+
+    // Платежи для представлений (столбцы «ПП», поиск по платежам). При
+    // открытии базы читаются из снимка, затем перечитываются из базы в
+    // фоне; номер версии меняется при каждой замене содержимого. Изменения
+    // платежей копятся и перечитываются одним запросом, когда запись
+    // стихнет; снимок переписывается не чаще раза в минуту, при смене
+    // базы и при выходе.
+    const PaymentStore& GetPaymentStore() const { return *paymentStore; }
+    uint64_t GetPaymentStoreVersion() const { return paymentStoreVersion; }
+    bool IsPaymentStoreLoading() const {
+        return paymentStoreStale || paymentStoreTask.pending();
+    }
+    // Фоновая загрузка платежей из базы
+    void RefreshPaymentStore();
+
 private:
     void LoadRecentDbPaths();
     void SaveRecentDbPaths();
@@ -109,5 +143,30 @@ private:
     PdfReporter* pdfReporter;
     GLFWwindow* window;
     int viewIdCounter = 0;
+
+    // Перечитывание платежей после изменений и запись снимка по таймеру
+    void UpdatePaymentStore(bool payments_changed, bool settings_changed);
+    // Ставит запись отставшего снимка в очередь (перед сменой базы)
+    void FlushPaymentSnapshot();
+    // Запись (write) или удаление снимка открытой базы в потоке записи
+    void QueuePaymentSnapshot(bool write);
+
+    // Не меняется после загрузки: фоновая запись снимка читает его
+    // одновременно с отрисовкой
+    std::shared_ptr<const PaymentStore> paymentStore =
+        std::make_shared<PaymentStore>();
+    uint64_t paymentStoreVersion = 0;
+    bool paymentSnapshotEnabled = true;
+    QueryTask<std::shared_ptr<PaymentStore>> paymentStoreTask;
+    // Платежи прочитаны из базы, а не только из снимка
+    bool paymentStoreFromDatabase = false;
+    // Платежи изменились после последней загрузки; время последнего
+    // изменения
+    bool paymentStoreStale = false;
+    std::chrono::steady_clock::time_point paymentStoreChangedAt;
+    // Снимок отстаёт от paymentStore; время последней записи
+    bool paymentSnapshotStale = false;
+    std::chrono::steady_clock::time_point paymentSnapshotSavedAt;
+    bool shutDown = false;
 };
 
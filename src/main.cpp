@@ -114,9 +114,13 @@ int main(int, char **) {
 
         // --- Рендеринг главного меню ---
         if (ImGui::BeginMainMenuBar()) {
+            // Смена базы и импорт справочников через соединение UI-потока
+            // недоступны, пока импорт держит транзакцию записи
+            bool db_idle = !uiManager.isImporting;
             if (ImGui::BeginMenu(ICON_FA_FILE " Файл")) {
                 if (ImGui::MenuItem(ICON_FA_FILE_CIRCLE_PLUS
-                                    " Создать новую базу")) {
+                                    " Создать новую базу", nullptr, false,
+                                    db_idle)) {
 
                     uiManager.SaveAllViews();
                     ImGuiFileDialog::Instance()->OpenDialog(
@@ -124,14 +128,16 @@ int main(int, char **) {
                         ".db");
                 }
                 if (ImGui::MenuItem(ICON_FA_FOLDER_OPEN
-                                    " Открыть базу данных")) {
+                                    " Открыть базу данных", nullptr, false,
+                                    db_idle)) {
 
                     uiManager.SaveAllViews();
                     ImGuiFileDialog::Instance()->OpenDialog(
                         "OpenDbFileDlgKey", "Выберите файл базы данных", ".db");
                 }
                 if (ImGui::MenuItem(ICON_FA_FLOPPY_DISK
-                                    " Сохранить базу как...")) {
+                                    " Сохранить базу как...", nullptr, false,
+                                    db_idle)) {
 
                     uiManager.SaveAllViews();
                     if (!uiManager.currentDbPath.empty()) {
@@ -150,7 +156,7 @@ int main(int, char **) {
                 }
                 ImGui::Separator();
                 if (ImGui::BeginMenu(ICON_FA_CLOCK_ROTATE_LEFT
-                                     " Недавние файлы")) {
+                                     " Недавние файлы", db_idle)) {
                     for (const auto &path : uiManager.recentDbPaths) {
                         if (ImGui::MenuItem(path.c_str())) {
 
@@ -232,7 +238,8 @@ int main(int, char **) {
                     }
                     ImGui::EndMenu();
                 }
-                if (ImGui::BeginMenu(ICON_FA_UPLOAD " Импорт справочников")) {
+                if (ImGui::BeginMenu(ICON_FA_UPLOAD " Импорт справочников",
+                                     db_idle)) {
                     if (ImGui::MenuItem("КОСГУ")) {
                         ImGuiFileDialog::Instance()->OpenDialog(
                             "ImportKosguDlgKey", "Импорт КОСГУ", ".csv");
@@ -317,6 +324,8 @@ int main(int, char **) {
     }
 
     // --- Очистка ресурсов ---
+    // До уничтожения менеджеров, объявленных после uiManager
+    uiManager.Shutdown();
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
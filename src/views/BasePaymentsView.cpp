@@ -1,5 +1,6 @@
 #include "BasePaymentsView.h"
 #include "../CustomWidgets.h"
+#include "../Date.h"
 #include "../IconsFontAwesome6.h"
 #include "../UIManager.h"
 #include <algorithm>
@@ -42,10 +43,14 @@ void BasePaymentsView::RefreshDropdownData() {
         counterpartiesForDropdown = dbManager->getCounterparties();
         contractsForDropdown = dbManager->getContracts();
         kosguForDropdown = dbManager->getKosguEntries();
-        paymentsForDropdown = dbManager->getPayments();
     }
 }
 
+const PaymentStore &BasePaymentsView::Payments() const {
+    static const PaymentStore empty;
+    return uiManager ? uiManager->GetPaymentStore() : empty;
+}
+
 void BasePaymentsView::UpdateFilteredDocuments() {
     m_filtered_documents.clear();
 
@@ -88,21 +93,20 @@ void BasePaymentsView::UpdateFilteredDocuments() {
             // Проверяем номер, контрагента и назначение привязанного платежа
             bool payment_matches = false;
             if (doc.payment_id > 0) {
-                for (const auto& pay : paymentsForDropdown) {
-                    if (pay.id == doc.payment_id) {
-                        std::string pay_num = pay.doc_number;
-                        std::transform(pay_num.begin(), pay_num.end(), pay_num.begin(), ::tolower);
-                        std::string pay_desc = pay.description;
-                        std::transform(pay_desc.begin(), pay_desc.end(), pay_desc.begin(), ::tolower);
-                        std::string pay_cp = pay.recipient;
-                        std::transform(pay_cp.begin(), pay_cp.end(), pay_cp.begin(), ::tolower);
-
-                        if (pay_num.find(search) != std::string::npos ||
-                            pay_desc.find(search) != std::string::npos ||
-                            pay_cp.find(search) != std::string::npos) {
-                            payment_matches = true;
-                        }
-                        break;
+                const PaymentStore &payments = Payments();
+                long pay = payments.find(doc.payment_id);
+                if (pay != -1) {
+                    std::string pay_num = payments.docNumber(pay);
+                    std::transform(pay_num.begin(), pay_num.end(), pay_num.begin(), ::tolower);
+                    std::string pay_desc = payments.description(pay);
+                    std::transform(pay_desc.begin(), pay_desc.end(), pay_desc.begin(), ::tolower);
+                    std::string pay_cp = payments.recipient(pay);
+                    std::transform(pay_cp.begin(), pay_cp.end(), pay_cp.begin(), ::tolower);
+
+                    if (pay_num.find(search) != std::string::npos ||
+                        pay_desc.find(search) != std::string::npos ||
+                        pay_cp.find(search) != std::string::npos) {
+                        payment_matches = true;
                     }
                 }
             }
@@ -171,14 +175,16 @@ void BasePaymentsView::SortDocuments(const ImGuiTableSortSpecs* sort_specs) {
 
     const ImGuiTableColumnSortSpecs* specs = &sort_specs->Specs[0];
     try {
-        std::sort(m_filtered_documents.begin(), m_filtered_documents.end(),
-            [specs](const BasePaymentDocument& a, const BasePaymentDocument& b) {
+        sortWithDateKeys(m_filtered_documents,
+            [](const BasePaymentDocument& doc) { return Date::sortKey(doc.date); },
+            [specs](const BasePaymentDocument& a, Date a_date,
+                    const BasePaymentDocument& b, Date b_date) {
                 bool result = false;
                 switch (specs->ColumnUserID) {
                     case 0: // ID
                         result = a.id < b.id; break;
                     case 1: // Дата
-                        result = a.date < b.date; break;
+                        result = Date::compareKeys(a_date, a.date, b_date, b.date) < 0; break;
                     case 2: // Номер
                         result = a.number < b.number; break;
                     case 3: // Наименование
@@ -278,6 +284,14 @@ void BasePaymentsView::Render() {
         RefreshDropdownData();
         m_dataDirty = false;
     }
+    // Платежи загрузились из базы (или изменились): отбор учитывает и их поля
+    if (uiManager &&
+        uiManager->GetPaymentStoreVersion() != paymentStoreVersion) {
+        paymentStoreVersion = uiManager->GetPaymentStoreVersion();
+        if (filterText[0] != '\0') {
+            UpdateFilteredDocuments();
+        }
+    }
 
     ImGui::Begin(Title.c_str(), &IsVisible);
 
@@ -465,60 +479,37 @@ void BasePaymentsView::Render() {
             ImGui::Text("%s", doc.document_name.c_str());
             ImGui::TableNextColumn();
             ImGui::Text("%s", doc.counterparty_name.c_str());
+            // Столбцы «ПП» - из хранилища платежей по id
+            const PaymentStore &payments = Payments();
+            long pay = doc.payment_id > 0 ? payments.find(doc.payment_id) : -1;
             ImGui::TableNextColumn();
             // ПП №
-            if (doc.payment_id > 0) {
-                bool found = false;
-                for (const auto &pay : paymentsForDropdown) {
-                    if (pay.id == doc.payment_id) {
-                        ImGui::Text("%s", pay.doc_number.c_str());
-                        found = true;
-                        break;
-                    }
-                }
-                if (!found) ImGui::Text("%d", doc.payment_id);
+            if (pay != -1) {
+                ImGui::Text("%s", payments.docNumber(pay));
+            } else if (doc.payment_id > 0) {
+                ImGui::Text("%d", doc.payment_id);
             }
             ImGui::TableNextColumn();
             // ПП дата
-            if (doc.payment_id > 0) {
-                for (const auto &pay : paymentsForDropdown) {
-                    if (pay.id == doc.payment_id) {
-                        ImGui::Text("%s", pay.date.c_str());
-                        break;
-                    }
-                }
+            if (pay != -1) {
+                ImGui::Text("%s", payments.date(pay).c_str());
             }
             ImGui::TableNextColumn();
             // ПП контрагент
-            if (doc.payment_id > 0) {
-                for (const auto &pay : paymentsForDropdown) {
-                    if (pay.id == doc.payment_id) {
-                        ImGui::Text("%s", pay.recipient.c_str());
-                        break;
-                    }
-                }
+            if (pay != -1) {
+                ImGui::Text("%s", payments.recipient(pay));
             }
             ImGui::TableNextColumn();
             // ПП сумма
-            if (doc.payment_id > 0) {
-                for (const auto &pay : paymentsForDropdown) {
-                    if (pay.id == doc.payment_id) {
-                        ImGui::Text("%.2f", pay.amount);
-                        break;
-                    }
-                }
+            if (pay != -1) {
+                ImGui::Text("%.2f", payments.amount(pay));
             }
             ImGui::TableNextColumn();
             // ПП назначение
-            if (doc.payment_id > 0) {
-                for (const auto &pay : paymentsForDropdown) {
-                    if (pay.id == doc.payment_id) {
-                        ImGui::Text("%s", pay.description.c_str());
-                        if (ImGui::IsItemHovered(ImGuiHoveredFlags_DelayShort)) {
-                            ImGui::SetTooltip("%s", pay.description.c_str());
-                        }
-                        break;
-                    }
+            if (pay != -1) {
+                ImGui::Text("%s", payments.description(pay));
+                if (ImGui::IsItemHovered(ImGuiHoveredFlags_DelayShort)) {
+                    ImGui::SetTooltip("%s", payments.description(pay));
                 }
             }
             ImGui::TableNextColumn();
@@ -8,7 +8,7 @@
 #include "../Contract.h"
 #include "../Counterparty.h"
 #include "../Kosgu.h"
-#include "../Payment.h"
+#include "../PaymentStore.h"
 
 class UIManager;
 
@@ -40,7 +40,10 @@ private:
     std::vector<Counterparty> counterpartiesForDropdown;
     std::vector<Contract> contractsForDropdown;
     std::vector<Kosgu> kosguForDropdown;
-    std::vector<Payment> paymentsForDropdown;
+    // Платежи для столбцов «ПП» и поиска по ним (строка ищется по id);
+    // общие для представлений, хранятся в UIManager
+    const PaymentStore& Payments() const;
+    uint64_t paymentStoreVersion = 0;
     char filterText[256];
     char counterpartyFilter[256];
     float list_view_height = 200.0f;
@@ -23,6 +23,13 @@ public:
 
     virtual void OnDeactivate() {}
     virtual void ForceSave() {}
+    // Изменения данных, зафиксированные с прошлого кадра (из любого
+    // соединения). Вызывается в UI-потоке до Render().
+    virtual void OnDataChanged(const std::vector<DataChange>& changes) {}
+    // Представление пишет в базу через соединение UI-потока. Пока импорт
+    // держит транзакцию записи, такие представления недоступны: иначе
+    // сохранение ждало бы busy_timeout и завершалось SQLITE_BUSY
+    virtual bool WritesThroughUiConnection() const { return true; }
 
     bool IsVisible = false;
 
@@ -1,5 +1,6 @@
 #include "ContractsView.h"
 #include "../CustomWidgets.h"
+#include "../Date.h"
 #include "../IconsFontAwesome6.h"
 #include "../SuspiciousWord.h"
 #include "../UIManager.h" // Added include for UIManager
@@ -112,13 +113,81 @@ void ContractsView::SaveChanges() {
     isDirty = false;
 }
 
+// Перечитывает договор вместе с итогом; удалённый договор убирается
+bool ContractsView::PatchContract(int id) {
+    auto it = std::find_if(contracts.begin(), contracts.end(),
+                           [id](const Contract &c) { return c.id == id; });
+    Contract fresh{};
+    if (!dbManager->getContractById(id, fresh)) {
+        if (it == contracts.end())
+            return false;
+        contracts.erase(it);
+        return true;
+    }
+    if (it == contracts.end()) {
+        contracts.push_back(fresh);
+    } else {
+        *it = fresh;
+    }
+    return true;
+}
+
+void ContractsView::OnDataChanged(const std::vector<DataChange> &changes) {
+    if (!dbManager || contracts.empty())
+        return;
+
+    bool reload = false;
+    bool changed = false;
+    bool dropdowns_changed = false;
+    for (const auto &change : changes) {
+        if (change.table == "Counterparties" ||
+            change.table == "SuspiciousWords") {
+            dropdowns_changed = true;
+            continue;
+        }
+        // Строка ContractTotals имеет тот же rowid, что и договор
+        if (change.table != "Contracts" && change.table != "ContractTotals")
+            continue;
+        if (change.type == DataChange::Reload) {
+            reload = true;
+        } else if (!reload) {
+            changed |= PatchContract((int)change.rowid);
+        }
+    }
+    if (dropdowns_changed) {
+        RefreshDropdownData();
+    }
+    if (reload) {
+        contracts = dbManager->getContracts();
+    }
+    if (!reload && !changed)
+        return;
+
+    int selected_id = selectedContractIndex != -1 ? selectedContract.id : -1;
+    UpdateFilteredContracts();
+    ApplyStoredSorting();
+    selectedContractIndex = -1;
+    for (int i = 0; i < (int)m_filtered_contracts.size(); i++) {
+        if (m_filtered_contracts[i].id == selected_id) {
+            selectedContractIndex = i;
+            break;
+        }
+    }
+}
+
 void ContractsView::SortContracts(const ImGuiTableSortSpecs *sort_specs) {
     // Сохраняем текущую сортировку для восстановления
     StoreSortSpecs(sort_specs);
 
-    std::sort(
-        m_filtered_contracts.begin(), m_filtered_contracts.end(),
-        [&](const Contract &a, const Contract &b) {
+    // Ключи дат заключения и окончания
+    using DateKeys = std::pair<Date, Date>;
+    sortWithDateKeys(
+        m_filtered_contracts,
+        [](const Contract &c) {
+            return DateKeys(Date::sortKey(c.date), Date::sortKey(c.end_date));
+        },
+        [&](const Contract &a, const DateKeys &a_keys, const Contract &b,
+            const DateKeys &b_keys) {
             for (int i = 0; i < sort_specs->SpecsCount; i++) {
                 const ImGuiTableColumnSortSpecs *column_spec =
                     &sort_specs->Specs[i];
@@ -140,7 +209,8 @@ void ContractsView::SortContracts(const ImGuiTableSortSpecs *sort_specs) {
                     delta = a.number.compare(b.number);
                     break;
                 case 2:
-                    delta = a.date.compare(b.date);
+                    delta = Date::compareKeys(a_keys.first, a.date,
+                                              b_keys.first, b.date);
                     break;
                 case 3:
                     delta = get_cp_name(a.counterparty_id)
@@ -157,7 +227,8 @@ void ContractsView::SortContracts(const ImGuiTableSortSpecs *sort_specs) {
                                                                 : 0;
                     break;
                 case 6:
-                    delta = a.end_date.compare(b.end_date);
+                    delta = Date::compareKeys(a_keys.second, a.end_date,
+                                              b_keys.second, b.end_date);
                     break;
                 case 7:
                     delta = a.procurement_code.compare(b.procurement_code);
@@ -1263,9 +1334,11 @@ void ContractsView::UpdateFilteredContracts() {
 }
 
 void ContractsView::SortPaymentInfo(const ImGuiTableSortSpecs* sort_specs) {
-    std::sort(
-        m_sorted_payment_info.begin(), m_sorted_payment_info.end(),
-        [&](const ContractPaymentInfo &a, const ContractPaymentInfo &b) {
+    sortWithDateKeys(
+        m_sorted_payment_info,
+        [](const ContractPaymentInfo &info) { return Date::sortKey(info.date); },
+        [&](const ContractPaymentInfo &a, Date a_date,
+            const ContractPaymentInfo &b, Date b_date) {
             for (int i = 0; i < sort_specs->SpecsCount; i++) {
                 const ImGuiTableColumnSortSpecs *column_spec =
                     &sort_specs->Specs[i];
@@ -1273,7 +1346,7 @@ void ContractsView::SortPaymentInfo(const ImGuiTableSortSpecs* sort_specs) {
 
                 switch (column_spec->ColumnIndex) {
                 case 0: // Дата
-                    delta = a.date.compare(b.date);
+                    delta = Date::compareKeys(a_date, a.date, b_date, b.date);
                     break;
                 case 1: // Номер док.
                     delta = a.doc_number.compare(b.doc_number);
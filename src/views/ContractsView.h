@@ -22,10 +22,13 @@ public:
     void OnDeactivate() override;
     void ForceSave() override;
 
+    void OnDataChanged(const std::vector<DataChange>& changes) override;
+
 private:
     void RefreshData();
     void RefreshDropdownData();
     void SaveChanges();
+    bool PatchContract(int id);
 
     std::vector<Contract> contracts;
     Contract selectedContract;
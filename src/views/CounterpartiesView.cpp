@@ -1,5 +1,6 @@
 #include "CounterpartiesView.h"
 #include "../CustomWidgets.h"
+#include "../Date.h"
 #include "../IconsFontAwesome6.h"
 #include "../UIManager.h"
 #include <algorithm>
@@ -31,10 +32,16 @@ void CounterpartiesView::RefreshData() {
     if (dbManager) {
         counterparties = dbManager->getCounterparties();
 
-        auto all_payment_info = dbManager->getAllCounterpartyPaymentInfo();
-        m_counterparty_details_map.clear();
-        for (const auto &info : all_payment_info) {
-            m_counterparty_details_map[info.counterparty_id].push_back(info);
+        // Назначения платежей всех контрагентов - тяжёлая выборка, её
+        // читаем в фоне; до готовности фильтр работает только по именам
+        paymentInfoTask.cancel();
+        if (uiManager) {
+            paymentInfoTask = uiManager->queryExecutor.submit(
+                [](DatabaseManager &db) {
+                    return db.getAllCounterpartyPaymentInfo();
+                });
+        } else {
+            ApplyPaymentInfo(dbManager->getAllCounterpartyPaymentInfo());
         }
 
         UpdateFilteredCounterparties();
@@ -51,6 +58,14 @@ void CounterpartiesView::RefreshData() {
     }
 }
 
+void CounterpartiesView::ApplyPaymentInfo(
+    const std::vector<CounterpartyPaymentInfo> &all_payment_info) {
+    m_counterparty_details_map.clear();
+    for (const auto &info : all_payment_info) {
+        m_counterparty_details_map[info.counterparty_id].push_back(info);
+    }
+}
+
 std::pair<std::vector<std::string>, std::vector<std::vector<std::string>>>
 CounterpartiesView::GetDataAsStrings() {
     std::vector<std::string> headers = {"ID", "Наименование", "ИНН",
@@ -221,6 +236,13 @@ void CounterpartiesView::Render() {
         if (dbManager && counterparties.empty()) {
             RefreshData();
         }
+        if (paymentInfoTask.ready()) {
+            ApplyPaymentInfo(paymentInfoTask.get());
+            if (filterText[0] != '\0') {
+                UpdateFilteredCounterparties();
+                ApplyStoredSorting();
+            }
+        }
 
         // Панель управления
         if (ImGui::Button(ICON_FA_PLUS " Добавить")) {
@@ -352,6 +374,10 @@ void CounterpartiesView::Render() {
                 filter_changed = true;
             }
         }
+        if (paymentInfoTask.pending()) {
+            ImGui::SameLine();
+            CustomWidgets::Spinner("##counterparty_payment_info");
+        }
 
         if (filter_changed) {
             SaveChanges();
@@ -553,9 +579,11 @@ void CounterpartiesView::Render() {
 }
 
 void CounterpartiesView::SortPaymentInfo(const ImGuiTableSortSpecs* sort_specs) {
-    std::sort(
-        m_sorted_payment_info.begin(), m_sorted_payment_info.end(),
-        [&](const ContractPaymentInfo &a, const ContractPaymentInfo &b) {
+    sortWithDateKeys(
+        m_sorted_payment_info,
+        [](const ContractPaymentInfo &info) { return Date::sortKey(info.date); },
+        [&](const ContractPaymentInfo &a, Date a_date,
+            const ContractPaymentInfo &b, Date b_date) {
             for (int i = 0; i < sort_specs->SpecsCount; i++) {
                 const ImGuiTableColumnSortSpecs *column_spec =
                     &sort_specs->Specs[i];
@@ -563,7 +591,7 @@ void CounterpartiesView::SortPaymentInfo(const ImGuiTableSortSpecs* sort_specs)
 
                 switch (column_spec->ColumnIndex) {
                 case 0: // Дата
-                    delta = a.date.compare(b.date);
+                    delta = Date::compareKeys(a_date, a.date, b_date, b.date);
                     break;
                 case 1: // Номер док.
                     delta = a.doc_number.compare(b.doc_number);
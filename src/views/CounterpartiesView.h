@@ -1,6 +1,7 @@
 #pragma once
 
 #include "BaseView.h"
+#include "../QueryExecutor.h"
 #include <vector>
 #include <map>
 #include "../Counterparty.h"
@@ -25,6 +26,9 @@ private:
     std::vector<Counterparty> counterparties;
     std::vector<Counterparty> m_filtered_counterparties;
     std::map<int, std::vector<CounterpartyPaymentInfo>> m_counterparty_details_map;
+    // Назначения платежей для фильтра загружаются в фоне
+    QueryTask<std::vector<CounterpartyPaymentInfo>> paymentInfoTask;
+    void ApplyPaymentInfo(const std::vector<CounterpartyPaymentInfo>& all_payment_info);
 
     struct SortSpec { int column_index; int sort_direction; };
     std::vector<SortSpec> m_stored_sort_specs;
@@ -1,25 +1,12 @@
 #include "ImportMapView.h"
 #include "../IconsFontAwesome6.h"
 #include "../ImportManager.h"
+#include "../TsvReader.h"
 #include "../UIManager.h"
 #include "imgui.h"
 #include "imgui_stdlib.h"
-#include <fstream>
 #include <iostream>
 #include <regex>
-#include <sstream>
-#include <thread>
-
-// Helper to split a string by a delimiter
-static std::vector<std::string> split(const std::string &s, char delimiter) {
-    std::vector<std::string> tokens;
-    std::string token;
-    std::istringstream tokenStream(s);
-    while (std::getline(tokenStream, token, delimiter)) {
-        tokens.push_back(token);
-    }
-    return tokens;
-}
 
 static std::string get_regex_match(const std::string &text,
                                    const std::string &pattern) {
@@ -69,23 +56,24 @@ void ImportMapView::Reset() {
     kosgu_pattern_buffer.clear();
     import_started = false;
     custom_note_buffer.clear();
+    import_errors.clear();
 }
 
 void ImportMapView::ReadPreviewData() {
     if (importFilePath.empty())
         return;
 
-    std::ifstream file(importFilePath);
-    if (!file.is_open()) {
+    TsvReader file;
+    if (!file.open(importFilePath)) {
         std::cerr << "ERROR: Could not open file for reading header: "
                   << importFilePath << std::endl;
         return;
     }
 
     // Read header
-    std::string headerLine;
-    if (std::getline(file, headerLine)) {
-        fileHeaders = split(headerLine, '\t');
+    std::string_view headerLine;
+    if (file.nextLine(headerLine)) {
+        fileHeaders = fieldStrings(headerLine, '\t');
     }
 
     // Read first N data rows based on settings
@@ -95,10 +83,10 @@ void ImportMapView::ReadPreviewData() {
         lines_to_read = settings.import_preview_lines;
     }
 
-    std::string dataLine;
+    std::string_view dataLine;
     int line_count = 0;
-    while (std::getline(file, dataLine) && line_count < lines_to_read) {
-        sampleData.push_back(split(dataLine, '\t'));
+    while (line_count < lines_to_read && file.nextLine(dataLine)) {
+        sampleData.push_back(fieldStrings(dataLine, '\t'));
         line_count++;
     }
 }
@@ -121,9 +109,14 @@ void ImportMapView::Render() {
         return;
     }
 
-    // If import has finished, close the window
+    // If import has finished, close the window; ошибки разбора остаются
+    // на экране, пока окно не закроют
     if (import_started && uiManager && !uiManager->isImporting) {
-        IsVisible = false;
+        if (import_errors.empty()) {
+            IsVisible = false;
+        } else {
+            RenderImportErrors();
+        }
         return;
     }
 
@@ -333,17 +326,19 @@ void ImportMapView::Render() {
                 import_started = true;
                 uiManager->isImporting = true;
                 *cancel_flag = false; // Reset cancel flag before starting new import
-                std::thread([this]() {
+                // Импорт выполняется в потоке записи на его собственном
+                // соединении; UI продолжает читать снимок базы через WAL
+                uiManager->dbWorker.submit([this](DatabaseManager* writer) {
                     uiManager->importManager->ImportPaymentsFromTsv(
-                        importFilePath, dbManager, currentMapping,
+                        importFilePath, writer, currentMapping,
                         uiManager->importProgress, uiManager->importMessage,
                         uiManager->importMutex, *(this->cancel_flag),
                         contract_pattern_buffer,
                         kosgu_pattern_buffer,
                         force_income_type, is_return_import,
-                        custom_note_buffer);
+                        custom_note_buffer, import_errors);
                     uiManager->isImporting = false;
-                }).detach();
+                });
             }
         }
         ImGui::SameLine();
@@ -355,6 +350,27 @@ void ImportMapView::Render() {
     ImGui::End();
 }
 
+void ImportMapView::RenderImportErrors() {
+    ImGui::SetNextWindowSize(ImVec2(700, 750), ImGuiCond_FirstUseEver);
+    if (ImGui::Begin(Title.c_str(), &IsVisible)) {
+        ImGui::Text("Файл: %s", importFilePath.c_str());
+        ImGui::Text("Импорт завершен. Значения, которые не удалось разобрать "
+                    "(строки с такой суммой пропущены):");
+        ImGui::Separator();
+        float footer_height = ImGui::GetFrameHeightWithSpacing();
+        ImGui::BeginChild("ImportErrors", ImVec2(0, -footer_height), true,
+                          ImGuiWindowFlags_HorizontalScrollbar);
+        for (const auto &error : import_errors) {
+            ImGui::TextUnformatted(error.c_str());
+        }
+        ImGui::EndChild();
+        if (ImGui::Button("Закрыть")) {
+            IsVisible = false;
+        }
+    }
+    ImGui::End();
+}
+
 std::pair<std::vector<std::string>, std::vector<std::vector<std::string>>> ImportMapView::GetDataAsStrings() {
     // This view doesn't present tabular data for export, so return empty.
     return {};
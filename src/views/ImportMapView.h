@@ -29,6 +29,7 @@ private:
     void Reset();
     void ReadPreviewData();
     void RefreshRegexes();
+    void RenderImportErrors();
 
     UIManager* uiManager = nullptr;
     std::string importFilePath;
@@ -49,5 +50,8 @@ private:
     bool force_income_type = false;
     bool is_return_import = false;
     std::string custom_note_buffer;
+    // Ошибки разбора последнего импорта; пишет поток записи, читается
+    // после окончания импорта
+    std::vector<std::string> import_errors;
     std::atomic<bool>* cancel_flag = nullptr;
 };
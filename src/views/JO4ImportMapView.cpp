@@ -1,31 +1,11 @@
 #include "JO4ImportMapView.h"
 #include "../CustomWidgets.h"
 #include "../IconsFontAwesome6.h"
+#include "../TsvReader.h"
 #include "../UIManager.h"
 #include <algorithm>
 #include <cstring>
-#include <fstream>
 #include <iostream>
-#include <sstream>
-#include <thread>
-
-static std::string trim(const std::string &str) {
-    size_t first = str.find_first_not_of(" \t\n\r");
-    if (first == std::string::npos)
-        return "";
-    size_t last = str.find_last_not_of(" \t\n\r");
-    return str.substr(first, (last - first + 1));
-}
-
-static std::vector<std::string> split(const std::string &s, char delimiter) {
-    std::vector<std::string> tokens;
-    std::string token;
-    std::istringstream tokenStream(s);
-    while (std::getline(tokenStream, token, delimiter)) {
-        tokens.push_back(token);
-    }
-    return tokens;
-}
 
 JO4ImportMapView::JO4ImportMapView() {
     Title = "Импорт ЖО4";
@@ -68,15 +48,15 @@ void JO4ImportMapView::ReadPreviewData() {
     if (importFilePath.empty())
         return;
 
-    std::ifstream file(importFilePath);
-    if (!file.is_open()) {
+    TsvReader file;
+    if (!file.open(importFilePath)) {
         std::cerr << "ERROR: Could not open file: " << importFilePath << std::endl;
         return;
     }
 
-    std::string headerLine;
-    if (std::getline(file, headerLine)) {
-        fileHeaders = split(headerLine, '\t');
+    std::string_view headerLine;
+    if (file.nextLine(headerLine)) {
+        fileHeaders = fieldStrings(headerLine, '\t');
     }
 
     int lines_to_read = 20;
@@ -84,10 +64,10 @@ void JO4ImportMapView::ReadPreviewData() {
         lines_to_read = dbManager->getSettings().import_preview_lines;
     }
 
-    std::string dataLine;
+    std::string_view dataLine;
     int line_count = 0;
-    while (std::getline(file, dataLine) && line_count < lines_to_read) {
-        sampleData.push_back(split(dataLine, '\t'));
+    while (line_count < lines_to_read && file.nextLine(dataLine)) {
+        sampleData.push_back(fieldStrings(dataLine, '\t'));
         line_count++;
     }
 }
@@ -106,7 +86,6 @@ void JO4ImportMapView::StartImport() {
     uiManager->isImporting = true;
 
     // Сохраняем всё что нужно для потока заранее
-    auto* db = dbManager;
     auto* prog = &uiManager->importProgress;
     auto* msg = &uiManager->importMessage;
     auto* mtx = &uiManager->importMutex;
@@ -115,7 +94,8 @@ void JO4ImportMapView::StartImport() {
     std::string path = importFilePath;
     ColumnMapping mapping = currentMapping;
 
-    std::thread([db, prog, msg, mtx, cancel, importing, path, mapping]() mutable {
+    // Импорт выполняется в потоке записи на его собственном соединении
+    uiManager->dbWorker.submit([prog, msg, mtx, cancel, importing, path, mapping](DatabaseManager* db) mutable {
         // Сбрасываем флаг отмены и прогресс в самом потоке
         cancel->store(false);
         prog->store(0.0f);
@@ -143,7 +123,7 @@ void JO4ImportMapView::StartImport() {
         );
 
         *importing = false;
-    }).detach();
+    });
 }
 
 void JO4ImportMapView::Render() {
@@ -248,8 +228,12 @@ void JO4ImportMapView::Render() {
         if (import_started && uiManager) {
             ImGui::Text("Импорт...");
             ImGui::ProgressBar(uiManager->importProgress, ImVec2(-1, 0));
-            if (!uiManager->importMessage.empty()) {
-                ImGui::TextWrapped("%s", uiManager->importMessage.c_str());
+            {
+                // Сообщение пишет поток импорта
+                std::lock_guard<std::mutex> lock(uiManager->importMutex);
+                if (!uiManager->importMessage.empty()) {
+                    ImGui::TextWrapped("%s", uiManager->importMessage.c_str());
+                }
             }
         } else {
             // Import button
@@ -1,6 +1,8 @@
 #include "KosguView.h"
 #include "../CustomWidgets.h"
+#include "../Date.h"
 #include "../IconsFontAwesome6.h"
+#include "../Money.h"
 #include "../UIManager.h"
 #include <algorithm>
 #include <cstring>
@@ -66,9 +68,8 @@ void KosguView::SaveChanges() {
 
     if (dbManager && selectedKosgu.id != -1) {
         dbManager->updateKosguEntry(selectedKosgu);
-        // Обновляем из БД и применяем сортировку
-        kosguEntries = dbManager->getKosguEntries();
-        m_filtered_kosgu_entries = kosguEntries;
+        // Перечитываем только изменённую запись и применяем сортировку
+        PatchKosgu(selectedKosgu.id);
         UpdateFilteredKosgu();
         ApplyStoredSorting();
         // Находим обновлённую запись
@@ -84,16 +85,71 @@ void KosguView::SaveChanges() {
     isDirty = false;
 }
 
+// Перечитывает запись КОСГУ вместе с итогом; удалённая запись убирается
+bool KosguView::PatchKosgu(int id) {
+    auto it = std::find_if(kosguEntries.begin(), kosguEntries.end(),
+                           [id](const Kosgu &k) { return k.id == id; });
+    Kosgu fresh{};
+    if (!dbManager->getKosguEntryById(id, fresh)) {
+        if (it == kosguEntries.end())
+            return false;
+        kosguEntries.erase(it);
+        return true;
+    }
+    if (it == kosguEntries.end()) {
+        kosguEntries.push_back(fresh);
+    } else {
+        *it = fresh;
+    }
+    return true;
+}
+
+void KosguView::OnDataChanged(const std::vector<DataChange> &changes) {
+    if (!dbManager || kosguEntries.empty())
+        return;
+
+    bool reload = false;
+    bool changed = false;
+    for (const auto &change : changes) {
+        // Строка KosguTotals имеет тот же rowid, что и запись КОСГУ
+        if (change.table != "KOSGU" && change.table != "KosguTotals")
+            continue;
+        if (change.type == DataChange::Reload) {
+            reload = true;
+        } else if (!reload) {
+            changed |= PatchKosgu((int)change.rowid);
+        }
+    }
+    if (reload) {
+        kosguEntries = dbManager->getKosguEntries();
+    }
+    if (!reload && !changed)
+        return;
+
+    int selected_id = selectedKosguIndex != -1 ? selectedKosgu.id : -1;
+    UpdateFilteredKosgu();
+    ApplyStoredSorting();
+    selectedKosguIndex = -1;
+    for (int i = 0; i < (int)m_filtered_kosgu_entries.size(); i++) {
+        if (m_filtered_kosgu_entries[i].id == selected_id) {
+            selectedKosguIndex = i;
+            break;
+        }
+    }
+}
+
 void KosguView::UpdateFilteredKosgu() {
     if (!dbManager)
         return;
 
-    // 1. Fetch all payment info once
-    auto all_payment_info = dbManager->getAllKosguPaymentInfo();
+    // 1. Fetch all payment info once, grouping rows as they are read
     std::map<int, std::vector<KosguPaymentDetailInfo>> details_by_kosgu;
-    for (const auto &info : all_payment_info) {
+    RowCursor<KosguPaymentDetailInfo> cursor =
+        dbManager->openKosguPaymentInfoCursor();
+    cursor.forEach([&](const KosguPaymentDetailInfo &info) {
         details_by_kosgu[info.kosgu_id].push_back(info);
-    }
+        return true;
+    });
 
     // 2. Text filter pass
     std::vector<Kosgu> text_filtered_entries;
@@ -175,7 +231,7 @@ void KosguView::UpdateFilteredKosgu() {
         }
     } else { // "С платежами" или "Без платежей"
         for (const auto &entry : text_filtered_entries) {
-            bool has_payments = (entry.total_amount > 0.001);
+            bool has_payments = Money::fromDouble(entry.total_amount) > Money();
             if (m_filter_index == 1 && has_payments) {
                 m_filtered_kosgu_entries.push_back(entry);
             } else if (m_filter_index == 2 && !has_payments) {
@@ -223,25 +279,20 @@ static void SortKosgu(std::vector<Kosgu> &kosguEntries,
               });
 }
 
-static std::string ConvertDateForSort(const std::string& date) {
-    if (date.length() == 10 && date[2] == '.' && date[5] == '.') {
-        return date.substr(6, 4) + "." + date.substr(3, 2) + "." + date.substr(0, 2);
-    }
-    return date;
-}
-
 // Вспомогательная функция для сортировки
 static void SortPaymentInfo(std::vector<ContractPaymentInfo> &paymentInfo,
                       const ImGuiTableSortSpecs *sort_specs) {
-    std::sort(paymentInfo.begin(), paymentInfo.end(),
-              [&](const ContractPaymentInfo &a, const ContractPaymentInfo &b) {
+    sortWithDateKeys(paymentInfo,
+              [](const ContractPaymentInfo &info) { return Date::sortKey(info.date); },
+              [&](const ContractPaymentInfo &a, Date a_date,
+                  const ContractPaymentInfo &b, Date b_date) {
                   for (int i = 0; i < sort_specs->SpecsCount; i++) {
                       const ImGuiTableColumnSortSpecs *column_spec =
                           &sort_specs->Specs[i];
                       int delta = 0;
                       switch (column_spec->ColumnIndex) {
                       case 0:
-                          delta = ConvertDateForSort(a.date).compare(ConvertDateForSort(b.date));
+                          delta = Date::compareKeys(a_date, a.date, b_date, b.date);
                           break;
                       case 1:
                           delta = a.doc_number.compare(b.doc_number);
@@ -17,9 +17,12 @@ public:
     void OnDeactivate() override;
     void ForceSave() override;
 
+    void OnDataChanged(const std::vector<DataChange>& changes) override;
+
 private:
     void RefreshData();
     void SaveChanges();
+    bool PatchKosgu(int id);
 
     std::vector<Kosgu> kosguEntries;
     Kosgu selectedKosgu;
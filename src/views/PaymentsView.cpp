@@ -46,9 +46,8 @@ void PaymentsView::SetPdfReporter(PdfReporter *reporter) {
 
 void PaymentsView::RefreshData() {
     if (dbManager) {
-        payments = dbManager->getPayments();
-        UpdateFilteredPayments(); // Ensure the filter is applied to the new
-                                  // data
+        listLoaded = true;
+        UpdateFilteredPayments();
         selectedPaymentIndex = -1;
         paymentDetails.clear();
         selectedDetailIndex = -1;
@@ -61,21 +60,40 @@ void PaymentsView::RefreshDropdownData() {
         kosguForDropdown = dbManager->getKosguEntries();
         contractsForDropdown = dbManager->getContracts();
         baseDocsForDropdown = dbManager->getBasePaymentDocuments();
-        suspiciousWordsForFilter = dbManager->getSuspiciousWords();
+        Settings settings = dbManager->getSettings();
+        period_from = Date();
+        period_to = Date();
+        Date::parse(settings.period_start_date, period_from);
+        Date::parse(settings.period_end_date, period_to);
+        counterpartyIndexById.clear();
+        for (size_t i = 0; i < counterpartiesForDropdown.size(); i++) {
+            counterpartyIndexById[counterpartiesForDropdown[i].id] = i;
+        }
     }
 }
 
+const Counterparty *PaymentsView::FindCounterparty(int id) const {
+    auto it = counterpartyIndexById.find(id);
+    return it != counterpartyIndexById.end()
+               ? &counterpartiesForDropdown[it->second]
+               : nullptr;
+}
+
 std::pair<std::vector<std::string>, std::vector<std::vector<std::string>>>
 PaymentsView::GetDataAsStrings() {
     std::vector<std::string> headers = {"Дата",  "Номер",      "Тип",
                                         "Сумма", "Получатель", "Назначение"};
     std::vector<std::vector<std::string>> rows; // Declared here
 
-    for (const auto &p : payments) {
+    if (!dbManager)
+        return {headers, rows};
+    RowCursor<Payment> cursor = dbManager->openPaymentsCursor();
+    cursor.forEach([&](const Payment &p) {
         rows.push_back({p.date, p.doc_number,
                         (p.type ? "поступление" : "расход"),
                         std::to_string(p.amount), p.recipient, p.description});
-    }
+        return true;
+    });
     return {headers, rows};
 }
 
@@ -97,19 +115,9 @@ void PaymentsView::SaveChanges() {
         selectedPayment.note = noteBuffer;
         dbManager->updatePayment(selectedPayment);
 
-        // Обновляем из БД и применяем сортировку
-        payments = dbManager->getPayments();
-        m_filtered_payments = payments;
+        // Строка может сменить место в списке или выйти из отбора - список
+        // перезапрашивается, выбор восстанавливается по id
         UpdateFilteredPayments();
-        ApplyStoredSorting();
-        // Находим обновлённую запись
-        for (int i = 0; i < (int)m_filtered_payments.size(); i++) {
-            if (m_filtered_payments[i].id == selectedPayment.id) {
-                selectedPaymentIndex = i;
-                selectedPayment = m_filtered_payments[i];
-                break;
-            }
-        }
         originalPayment = selectedPayment;
         descriptionBuffer = selectedPayment.description;
         noteBuffer = selectedPayment.note;
@@ -117,6 +125,58 @@ void PaymentsView::SaveChanges() {
     isDirty = false;
 }
 
+void PaymentsView::OnDataChanged(const std::vector<DataChange> &changes) {
+    // Список ещё не загружен - он будет прочитан при отрисовке
+    if (!dbManager || !listLoaded)
+        return;
+
+    bool list_changed = false;
+    bool details_changed = false;
+    bool dropdowns_changed = false;
+    for (const auto &change : changes) {
+        if (change.table == "Payments") {
+            list_changed = true;
+        } else if (change.table == "PaymentDetails") {
+            // Отбор по расшифровкам и итоги зависят от расшифровок
+            list_changed = true;
+            details_changed = true;
+        } else if (change.table == "Counterparties" ||
+                   change.table == "SuspiciousWords") {
+            // Используются в отборе и сортировке списка
+            list_changed = true;
+            dropdowns_changed = true;
+        } else if (change.table == "KOSGU" || change.table == "Contracts" ||
+                   change.table == "BasePaymentDocuments") {
+            dropdowns_changed = true;
+        } else if (change.table == "Settings") {
+            // Изменился период отбора
+            dropdowns_changed = true;
+            list_changed = list_changed || period_filter;
+        }
+    }
+
+    if (dropdowns_changed) {
+        RefreshDropdownData();
+    }
+    if (list_changed) {
+        UpdateFilteredPayments();
+    }
+    // Расшифровки выбранного платежа перечитываем, если их не редактируют
+    if (details_changed && selectedPayment.id != -1 && !isDetailDirty &&
+        !isAddingDetail) {
+        int selected_detail_id =
+            selectedDetailIndex != -1 ? selectedDetail.id : -1;
+        paymentDetails = dbManager->getPaymentDetails(selectedPayment.id);
+        selectedDetailIndex = -1;
+        for (int i = 0; i < (int)paymentDetails.size(); i++) {
+            if (paymentDetails[i].id == selected_detail_id) {
+                selectedDetailIndex = i;
+                break;
+            }
+        }
+    }
+}
+
 void PaymentsView::SaveDetailChanges() {
     if (!isDetailDirty)
         return;
@@ -136,67 +196,9 @@ void PaymentsView::SaveDetailChanges() {
 }
 
 void PaymentsView::SortPayments(const ImGuiTableSortSpecs *sort_specs) {
-    // Сохраняем текущую сортировку
+    // Сортировка выполняется запросом списка id
     StoreSortSpecs(sort_specs);
-
-    std::sort(m_filtered_payments.begin(), m_filtered_payments.end(),
-              [&](const Payment &a, const Payment &b) {
-                  for (int i = 0; i < sort_specs->SpecsCount; i++) {
-                      const ImGuiTableColumnSortSpecs *column_spec =
-                          &sort_specs->Specs[i];
-                      int delta = 0;
-                      switch (column_spec->ColumnIndex) {
-                      case 0:
-                          delta = a.date.compare(b.date);
-                          break;
-                      case 1:
-                          delta = a.doc_number.compare(b.doc_number);
-                          break;
-                      case 2:
-                          delta = (a.amount < b.amount)   ? -1
-                                  : (a.amount > b.amount) ? 1
-                                                          : 0;
-                          break;
-                      case 3: {
-                          std::string a_cp_name = " ";
-                          std::string b_cp_name = " ";
-                          auto it_a = std::find_if(
-                              counterpartiesForDropdown.begin(),
-                              counterpartiesForDropdown.end(),
-                              [&](const Counterparty &cp) {
-                                  return cp.id == a.counterparty_id;
-                              });
-                          if (it_a != counterpartiesForDropdown.end())
-                              a_cp_name = it_a->name;
-                          auto it_b = std::find_if(
-                              counterpartiesForDropdown.begin(),
-                              counterpartiesForDropdown.end(),
-                              [&](const Counterparty &cp) {
-                                  return cp.id == b.counterparty_id;
-                              });
-                          if (it_b != counterpartiesForDropdown.end())
-                              b_cp_name = it_b->name;
-                          delta = a_cp_name.compare(b_cp_name);
-                          break;
-                      }
-                      case 4:
-                          delta = a.description.compare(b.description);
-                          break;
-                      case 5:
-                          delta = a.note.compare(b.note);
-                          break;
-                      default:
-                          break;
-                      }
-                      if (delta != 0) {
-                          return (column_spec->SortDirection ==
-                                  ImGuiSortDirection_Ascending)
-                                     ? (delta < 0)
-                                     : (delta > 0);
-                      }
-                  }
-                  return false;
-              });
+    UpdateFilteredPayments();
 }
 
 void PaymentsView::StoreSortSpecs(const ImGuiTableSortSpecs* sort_specs) {
@@ -211,21 +213,6 @@ void PaymentsView::StoreSortSpecs(const ImGuiTableSortSpecs* sort_specs) {
     }
 }
 
-void PaymentsView::ApplyStoredSorting() {
-    if (m_stored_sort_specs.empty()) {
-        return;
-    }
-    std::vector<ImGuiTableColumnSortSpecs> fake_specs(m_stored_sort_specs.size());
-    for (size_t i = 0; i < m_stored_sort_specs.size(); i++) {
-        fake_specs[i].ColumnIndex = m_stored_sort_specs[i].column_index;
-        fake_specs[i].SortDirection = static_cast<ImGuiSortDirection>(m_stored_sort_specs[i].sort_direction);
-    }
-    ImGuiTableSortSpecs wrapped_specs;
-    wrapped_specs.Specs = fake_specs.data();
-    wrapped_specs.SpecsCount = fake_specs.size();
-    SortPayments(&wrapped_specs);
-}
-
 void PaymentsView::Render() {
     if (!IsVisible) {
         if (isDirty) {
@@ -242,10 +229,17 @@ void PaymentsView::Render() {
 
     if (ImGui::Begin(GetTitle(), &IsVisible)) {
 
-        if (dbManager && payments.empty()) {
-            RefreshData();
+        if (dbManager && !listLoaded) {
             RefreshDropdownData();
-            UpdateFilteredPayments(); // Initial filter
+            RefreshData();
+        }
+        if (idsTask.ready()) {
+            ApplyPaymentIds(idsTask.get());
+        }
+        if (totalsTask.ready()) {
+            DatabaseManager::PaymentListTotals totals = totalsTask.get();
+            total_filtered_amount = totals.amount;
+            total_filtered_details_amount = totals.details_amount;
         }
 
         // --- Progress Bar Popup ---
@@ -285,53 +279,24 @@ void PaymentsView::Render() {
             if (dbManager) {
                 dbManager->addPayment(newPayment);
                 new_id = newPayment.id;
-                payments = dbManager->getPayments();
-                m_filtered_payments = payments;
+                // Новая запись выбирается и прокручивается в видимую
+                // область, когда придёт обновлённый список
+                select_after_load_id = new_id;
                 UpdateFilteredPayments();
-                ApplyStoredSorting();
             }
 
-            // Находим новую запись в отсортированном списке
-            selectedPaymentIndex = -1;
-            scroll_to_item_index = -1;
-            scroll_pending = false;
-            for (int i = 0; i < (int)m_filtered_payments.size(); i++) {
-                if (m_filtered_payments[i].id == new_id) {
-                    selectedPaymentIndex = i;
-                    scroll_to_item_index = i;
-                    break;
-                }
-            }
-            if (selectedPaymentIndex == -1) {
-                // Новая запись отфильтрована — добавляем вручную
-                auto new_it = std::find_if(payments.begin(), payments.end(),
-                    [&](const Payment &p) { return p.id == new_id; });
-                if (new_it != payments.end()) {
-                    m_filtered_payments.push_back(*new_it);
-                    ApplyStoredSorting();
-                    for (int i = 0; i < (int)m_filtered_payments.size(); i++) {
-                        if (m_filtered_payments[i].id == new_id) {
-                            selectedPaymentIndex = i;
-                            scroll_to_item_index = i;
-                            break;
-                        }
-                    }
-                }
-            }
-            if (selectedPaymentIndex != -1) {
-                selectedPayment = m_filtered_payments[selectedPaymentIndex];
-                originalPayment = selectedPayment;
-            }
+            selectedPayment = newPayment;
+            originalPayment = selectedPayment;
             descriptionBuffer = selectedPayment.description;
             noteBuffer = selectedPayment.note;
-            paymentDetails = dbManager ? dbManager->getPaymentDetails(new_id > 0 ? new_id : selectedPayment.id) : std::vector<PaymentDetail>();
+            paymentDetails = dbManager ? dbManager->getPaymentDetails(new_id) : std::vector<PaymentDetail>();
             isAdding = false;
             isDirty = false;
         }
         ImGui::SameLine();
         if (ImGui::Button(ICON_FA_TRASH " Удалить")) {
             if (selectedPaymentIndex != -1) {
-                payment_id_to_delete = payments[selectedPaymentIndex].id;
+                payment_id_to_delete = selectedPayment.id;
                 show_delete_payment_popup = true;
             }
         }
@@ -357,8 +322,23 @@ void PaymentsView::Render() {
                     "LEFT JOIN KOSGU k ON pd.kosgu_id = k.id "
                     "LEFT JOIN Counterparties c ON p.counterparty_id = c.id ";
 
-                // Добавляем WHERE для фильтрации по выбранным платежам
+                // Добавляем WHERE для фильтрации по выбранным платежам.
+                // Назначение и получатель ищутся по индексу PaymentsFts
                 if (filterText[0] != '\0') {
+                    std::string match =
+                        DatabaseManager::buildFullTextQuery(filterText);
+                    std::string escaped_match;
+                    for (char ch : match) {
+                        if (ch == '\'')
+                            escaped_match += '\'';
+                        escaped_match += ch;
+                    }
+                    std::string text_clause =
+                        match.empty()
+                            ? ""
+                            : "OR p.id IN (SELECT rowid FROM PaymentsFts "
+                              "WHERE PaymentsFts MATCH '" +
+                                  escaped_match + "') ";
                     query += "WHERE (LOWER(p.date) LIKE LOWER('%" +
                              std::string(filterText) +
                              "%') "
@@ -366,14 +346,7 @@ void PaymentsView::Render() {
                              std::string(filterText) +
                              "%') "
                              "OR LOWER(p.amount) LIKE LOWER('%" +
-                             std::string(filterText) +
-                             "%') "
-                             "OR LOWER(p.description) LIKE LOWER('%" +
-                             std::string(filterText) +
-                             "%') "
-                             "OR LOWER(p.recipient) LIKE LOWER('%" +
-                             std::string(filterText) +
-                             "%') "
+                             std::string(filterText) + "%') " + text_clause +
                              "OR LOWER(k.code) LIKE LOWER('%" +
                              std::string(filterText) +
                              "%') "
@@ -428,13 +401,13 @@ void PaymentsView::Render() {
         char group_delete_message[256];
         snprintf(group_delete_message, sizeof(group_delete_message),
                  "Вы уверены, что хотите удалить расшифровки для %zu платежей?",
-                 m_filtered_payments.size());
+                 m_filtered_ids.size());
 
         if (CustomWidgets::ConfirmationModal(
                 "Удалить все расшифровки?", "Удалить все расшифровки?",
                 group_delete_message, "Да", "Нет", show_group_delete_popup)) {
-            if (!m_filtered_payments.empty() && current_operation == NONE) {
-                items_to_process = m_filtered_payments;
+            if (!m_filtered_ids.empty() && current_operation == NONE) {
+                LoadFilteredPayments();
                 processed_items = 0;
                 current_operation = DELETE_DETAILS;
             }
@@ -452,6 +425,16 @@ void PaymentsView::Render() {
             filter_changed = true;
         }
 
+        ImGui::SameLine();
+        if (ImGui::Checkbox("За период", &period_filter)) {
+            filter_changed = true;
+        }
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("Период из настроек: %s - %s",
+                              period_from.valid() ? period_from.toString().c_str() : "...",
+                              period_to.valid() ? period_to.toString().c_str() : "...");
+        }
+
         ImGui::SameLine();
         float avail_width = ImGui::GetContentRegionAvail().x;
         ImGui::PushItemWidth(avail_width - ImGui::GetStyle().ItemSpacing.x);
@@ -473,7 +456,7 @@ void PaymentsView::Render() {
         if (ImGui::CollapsingHeader("Групповые операции")) {
 
             if (ImGui::Button("Добавить расшифровку по КОСГУ")) {
-                if (!m_filtered_payments.empty() && current_operation == NONE) {
+                if (!m_filtered_ids.empty() && current_operation == NONE) {
                     show_add_kosgu_popup = true;
                     groupKosguId = -1;
                     memset(groupKosguFilter, 0, sizeof(groupKosguFilter));
@@ -481,7 +464,7 @@ void PaymentsView::Render() {
             }
             ImGui::SameLine();
             if (ImGui::Button("Заменить")) {
-                if (!m_filtered_payments.empty() && current_operation == NONE) {
+                if (!m_filtered_ids.empty() && current_operation == NONE) {
                     show_replace_popup = true;
                     // Reset state for the popup
                     replacement_target = 0;
@@ -498,7 +481,7 @@ void PaymentsView::Render() {
             }
             ImGui::SameLine();
             if (ImGui::Button("Определить по regex и проставить")) {
-                if (!m_filtered_payments.empty() && current_operation == NONE) {
+                if (!m_filtered_ids.empty() && current_operation == NONE) {
                     show_apply_regex_popup = true;
                     // Reset state
                     regex_target = 0;
@@ -511,7 +494,7 @@ void PaymentsView::Render() {
             }
             ImGui::SameLine();
             if (ImGui::Button("Удалить расшифровки")) {
-                if (!m_filtered_payments.empty() && current_operation == NONE) {
+                if (!m_filtered_ids.empty() && current_operation == NONE) {
                     show_group_delete_popup = true;
                 }
             }
@@ -528,7 +511,7 @@ void PaymentsView::Render() {
                                    &show_apply_regex_popup,
                                    ImGuiWindowFlags_AlwaysAutoResize)) {
             ImGui::Text("Применить regex для %zu отфильтрованных платежей:",
-                        m_filtered_payments.size());
+                        m_filtered_ids.size());
             ImGui::Text("Будет обновлена первая расшифровка без установленного "
                         "значения.\nДля КОСГУ будет добавлена расшифровка по "
                         "остатку если нужно.");
@@ -550,10 +533,11 @@ void PaymentsView::Render() {
             ImGui::Separator();
             if (ImGui::Button("Найти и проставить", ImVec2(120, 0))) {
                 if (dbManager && selected_regex_id != -1 &&
-                    !m_filtered_payments.empty() && current_operation == NONE) {
-                    items_to_process = m_filtered_payments;
+                    !m_filtered_ids.empty() && current_operation == NONE) {
+                    LoadFilteredPayments();
                     processed_items = 0;
                     current_operation = APPLY_REGEX;
+                    PrepareApplyRegex();
                 }
                 show_apply_regex_popup = false;
                 ImGui::CloseCurrentPopup();
@@ -571,7 +555,7 @@ void PaymentsView::Render() {
                                    ImGuiWindowFlags_AlwaysAutoResize)) {
             ImGui::Text("Добавить расшифровку с КОСГУ для %zu отфильтрованных "
                         "платежей:",
-                        m_filtered_payments.size());
+                        m_filtered_ids.size());
             ImGui::Separator();
 
             std::vector<CustomWidgets::ComboItem> kosguItems;
@@ -586,8 +570,8 @@ void PaymentsView::Render() {
 
             if (ImGui::Button("ОК", ImVec2(120, 0))) {
                 if (dbManager && groupKosguId != -1 &&
-                    !m_filtered_payments.empty() && current_operation == NONE) {
-                    items_to_process = m_filtered_payments;
+                    !m_filtered_ids.empty() && current_operation == NONE) {
+                    LoadFilteredPayments();
                     processed_items = 0;
                     current_operation = ADD_KOSGU;
                 }
@@ -611,7 +595,7 @@ void PaymentsView::Render() {
                                    ImGuiWindowFlags_AlwaysAutoResize)) {
             ImGui::Text("Заменить во всех расшифровках для %zu отфильтрованных "
                         "платежей:",
-                        m_filtered_payments.size());
+                        m_filtered_ids.size());
 
             ImGui::Separator();
 
@@ -644,7 +628,7 @@ void PaymentsView::Render() {
             ImGui::Separator();
 
             if (ImGui::Button("ОК", ImVec2(120, 0))) {
-                if (dbManager && !m_filtered_payments.empty() &&
+                if (dbManager && !m_filtered_ids.empty() &&
                     current_operation == NONE) {
 
                     int new_id = -1;
@@ -656,7 +640,7 @@ void PaymentsView::Render() {
                         new_id = replacement_invoice_id;
 
                     if (new_id != -1) {
-                        items_to_process = m_filtered_payments;
+                        LoadFilteredPayments();
                         processed_items = 0;
                         current_operation = REPLACE;
                     }
@@ -675,13 +659,17 @@ void PaymentsView::Render() {
 
         // --- Totals Display ---
         ImGui::Separator();
-        ImGui::Text("платежей: %zu", m_filtered_payments.size());
+        ImGui::Text("платежей: %zu", m_filtered_ids.size());
+        if (idsTask.pending() || totalsTask.pending()) {
+            ImGui::SameLine();
+            CustomWidgets::Spinner("##PaymentsLoading");
+        }
         // ImGui::SameLine(ImGui::GetWindowContentRegionMax().x - 750);
         ImGui::SameLine();
-        ImGui::Text("Сумма: %.2f", total_filtered_amount);
+        ImGui::Text("Сумма: %s", total_filtered_amount.toString().c_str());
         ImGui::SameLine();
         // ImGui::SameLine(ImGui::GetWindowContentRegionMax().x - 400);
-        ImGui::Text("// %.2f", total_filtered_details_amount);
+        ImGui::Text("// %s", total_filtered_details_amount.toString().c_str());
 
         // --- Список платежей ---
         ImGui::BeginChild("PaymentsList", ImVec2(0, list_view_height), true,
@@ -713,7 +701,7 @@ void PaymentsView::Render() {
             }
 
             // Прокрутка к новой записи: SetScrollY вызывается ОДИН раз
-            if (scroll_to_item_index >= 0 && scroll_to_item_index < (int)m_filtered_payments.size()) {
+            if (scroll_to_item_index >= 0 && scroll_to_item_index < (int)m_filtered_ids.size()) {
                 if (!scroll_pending) {
                     float row_y = scroll_to_item_index * ImGui::GetTextLineHeightWithSpacing();
                     ImGui::SetScrollY(row_y);
@@ -722,23 +710,23 @@ void PaymentsView::Render() {
             }
 
             ImGuiListClipper clipper;
-            clipper.Begin(m_filtered_payments.size());
+            clipper.Begin(m_filtered_ids.size());
             bool need_to_break = false;
             while (clipper.Step() && !need_to_break) {
+                // Строки окна (и страница вокруг него) читаются одним
+                // запросом на страницу, остальные в памяти не держатся
+                PrefetchRows(clipper.DisplayStart, clipper.DisplayEnd);
                 for (int i = clipper.DisplayStart;
                      i < clipper.DisplayEnd && !need_to_break; ++i) {
-                    const auto &payment = m_filtered_payments[i];
+                    const Payment *row = GetPaymentRow(i);
                     ImGui::TableNextRow();
                     ImGui::TableNextColumn();
-
-                    // Find the original index in the main 'payments' vector
-                    int original_index = -1;
-                    for (size_t j = 0; j < payments.size(); ++j) {
-                        if (payments[j].id == payment.id) {
-                            original_index = j;
-                            break;
-                        }
+                    if (!row) {
+                        // Платёж удалён, список ещё не перезапрошен
+                        ImGui::TextDisabled("...");
+                        continue;
                     }
+                    const Payment &payment = *row;
 
                     bool is_selected = (selectedPaymentIndex == i);
                     char label[128];
@@ -750,8 +738,8 @@ void PaymentsView::Render() {
                             SaveChanges();
                             SaveDetailChanges();
                             selectedPaymentIndex = i;
-                            selectedPayment = m_filtered_payments[i];
-                            originalPayment = m_filtered_payments[i];
+                            selectedPayment = payment;
+                            originalPayment = payment;
                             descriptionBuffer = selectedPayment.description;
                             noteBuffer = selectedPayment.note;
                             if (dbManager) {
@@ -783,14 +771,10 @@ void PaymentsView::Render() {
                         ImGui::Text("%.2f", payment.amount);
 
                         ImGui::TableNextColumn();
-                        auto cp_it = std::find_if(
-                            counterpartiesForDropdown.begin(),
-                            counterpartiesForDropdown.end(),
-                            [&](const Counterparty &cp) {
-                                return cp.id == payment.counterparty_id;
-                            });
-                        if (cp_it != counterpartiesForDropdown.end()) {
-                            ImGui::Text("%s", cp_it->name.c_str());
+                        const Counterparty *cp =
+                            FindCounterparty(payment.counterparty_id);
+                        if (cp) {
+                            ImGui::Text("%s", cp->name.c_str());
                         } else {
                             ImGui::Text("N/A");
                         }
@@ -813,7 +797,7 @@ void PaymentsView::Render() {
 
         ImGui::BeginChild("PaymentEditor", ImVec2(editor_width, 0), true);
         if ((selectedPaymentIndex != -1 &&
-             selectedPaymentIndex < (int)payments.size()) ||
+             selectedPaymentIndex < (int)m_filtered_ids.size()) ||
             isAdding) {
             if (isAdding) {
                 ImGui::Text("Добавление нового платежа");
@@ -1312,182 +1296,221 @@ void PaymentsView::Render() {
     ImGui::End();
 }
 
+DatabaseManager::PaymentListQuery PaymentsView::BuildPaymentListQuery() const {
+    DatabaseManager::PaymentListQuery query;
+    // Слова фильтра разделяются запятыми, должны совпасть все
+    std::stringstream ss{std::string(filterText)};
+    std::string term;
+    while (std::getline(ss, term, ',')) {
+        size_t first = term.find_first_not_of(" \t");
+        if (std::string::npos == first)
+            continue;
+        size_t last = term.find_last_not_of(" \t");
+        query.terms.push_back(term.substr(first, (last - first + 1)));
+    }
+    query.filter = static_cast<DatabaseManager::PaymentListFilter>(
+        missing_info_filter_index);
+    if (period_filter) {
+        query.date_from = period_from;
+        query.date_to = period_to;
+    }
+    for (const auto &spec : m_stored_sort_specs) {
+        DatabaseManager::PaymentListQuery::SortKey key;
+        key.column = spec.column_index;
+        key.descending = spec.sort_direction != ImGuiSortDirection_Ascending;
+        query.sort.push_back(key);
+    }
+    return query;
+}
+
 void PaymentsView::UpdateFilteredPayments() {
-    total_filtered_amount = 0.0;
-    total_filtered_details_amount = 0.0;
+    if (!dbManager)
+        return;
 
-    std::map<int, std::vector<PaymentDetail>> details_by_payment;
-    if (dbManager) {
-        auto all_details = dbManager->getAllPaymentDetails();
-        for (const auto &detail : all_details) {
-            details_by_payment[detail.payment_id].push_back(detail);
-        }
+    // Незавершённые запросы со старым фильтром больше не нужны
+    idsTask.cancel();
+    totalsTask.cancel();
+    DatabaseManager::PaymentListQuery query = BuildPaymentListQuery();
+    if (uiManager) {
+        idsTask = uiManager->queryExecutor.submit(
+            [query](DatabaseManager &db) {
+                std::vector<int> ids;
+                db.getPaymentIds(query, ids);
+                return ids;
+            });
+        totalsTask = uiManager->queryExecutor.submit(
+            [query](DatabaseManager &db) {
+                DatabaseManager::PaymentListTotals totals;
+                db.getPaymentListTotals(query, totals);
+                return totals;
+            });
+        return;
     }
 
-    // Create filtered list
-    std::vector<Payment> text_filtered_payments;
-    if (filterText[0] != '\0') {
-        std::string filter_str(filterText);
-        std::stringstream ss(filter_str);
-        std::string term;
-        std::vector<std::string> search_terms;
-        while (std::getline(ss, term, ',')) {
-            size_t first = term.find_first_not_of(" \t");
-            if (std::string::npos == first)
-                continue;
-            size_t last = term.find_last_not_of(" \t");
-            search_terms.push_back(term.substr(first, (last - first + 1)));
+    std::vector<int> ids;
+    dbManager->getPaymentIds(query, ids);
+    DatabaseManager::PaymentListTotals totals;
+    dbManager->getPaymentListTotals(query, totals);
+    total_filtered_amount = totals.amount;
+    total_filtered_details_amount = totals.details_amount;
+    ApplyPaymentIds(std::move(ids));
+}
+
+void PaymentsView::ApplyPaymentIds(std::vector<int> &&ids) {
+    m_filtered_ids = std::move(ids);
+    rowPages.clear();
+
+    if (select_after_load_id != -1) {
+        int new_id = select_after_load_id;
+        select_after_load_id = -1;
+        auto it = std::find(m_filtered_ids.begin(), m_filtered_ids.end(), new_id);
+        if (it == m_filtered_ids.end()) {
+            // Новая запись не проходит фильтр — показываем её в конце списка
+            m_filtered_ids.push_back(new_id);
+            it = m_filtered_ids.end() - 1;
         }
+        selectedPaymentIndex = (int)(it - m_filtered_ids.begin());
+        scroll_to_item_index = selectedPaymentIndex;
+        scroll_pending = false;
+        return;
+    }
 
-        if (!search_terms.empty()) {
-            for (const auto &p : payments) {
-                bool all_terms_match = true;
-                for (const auto &current_term : search_terms) {
-                    bool term_found_in_payment = false;
-                    if (strcasestr(p.date.c_str(), current_term.c_str()) !=
-                        nullptr)
-                        term_found_in_payment = true;
-                    if (!term_found_in_payment &&
-                        strcasestr(p.doc_number.c_str(),
-                                   current_term.c_str()) != nullptr)
-                        term_found_in_payment = true;
-                    if (!term_found_in_payment &&
-                        strcasestr(p.description.c_str(),
-                                   current_term.c_str()) != nullptr)
-                        term_found_in_payment = true;
-                    if (!term_found_in_payment &&
-                        strcasestr(p.recipient.c_str(), current_term.c_str()) !=
-                            nullptr)
-                        term_found_in_payment = true;
-                    if (!term_found_in_payment &&
-                        strcasestr(p.note.c_str(), current_term.c_str()) !=
-                            nullptr)
-                        term_found_in_payment = true;
-                    if (!term_found_in_payment) {
-                        char amount_str[32];
-                        snprintf(amount_str, sizeof(amount_str), "%.2f",
-                                 p.amount);
-                        if (strcasestr(amount_str, current_term.c_str()) !=
-                            nullptr)
-                            term_found_in_payment = true;
-                    }
+    // Выбранный платёж сохраняем, если он остался в отборе
+    if (selectedPaymentIndex != -1) {
+        auto it = std::find(m_filtered_ids.begin(), m_filtered_ids.end(),
+                            selectedPayment.id);
+        selectedPaymentIndex = it != m_filtered_ids.end()
+                                   ? (int)(it - m_filtered_ids.begin())
+                                   : -1;
+    }
+}
 
-                    if (!term_found_in_payment) {
-                        all_terms_match = false;
-                        break;
-                    }
-                }
-                if (all_terms_match) {
-                    text_filtered_payments.push_back(p);
-                }
-            }
-        } else {
-            text_filtered_payments = payments;
+void PaymentsView::LoadFilteredPayments() {
+    // Групповой операции нужны только id, суммы, контрагенты и назначения -
+    // они читаются в столбцы без копий Payment
+    items_to_process.clear();
+    if (dbManager)
+        dbManager->loadPaymentStore(m_filtered_ids, items_to_process);
+}
+
+PaymentsView::RowPage &PaymentsView::LoadRowPage(int page) {
+    for (auto &cached : rowPages) {
+        if (cached.page == page) {
+            cached.last_used = ++rowPageClock;
+            return cached;
         }
-    } else {
-        text_filtered_payments = payments;
     }
 
-    // Missing info filter
-    m_filtered_payments.clear();
-    if (missing_info_filter_index == 0) {
-        m_filtered_payments = text_filtered_payments;
-    } else if (missing_info_filter_index == 5) { // "Подозрительные слова"
-        if (!suspiciousWordsForFilter.empty()) {
-            for (const auto &p : text_filtered_payments) {
-                bool suspicious_found = false;
-                for (const auto &sw : suspiciousWordsForFilter) {
-                    if (strcasestr(p.description.c_str(), sw.word.c_str()) !=
-                        nullptr) {
-                        suspicious_found = true;
-                        break;
-                    }
-                }
-                if (suspicious_found) {
-                    m_filtered_payments.push_back(p);
-                }
-            }
-        }
-    } else if (missing_info_filter_index == 6) { // "Поступления"
-        for (const auto &p : text_filtered_payments) {
-            if (p.type) { // If payment type is true (receipt)
-                m_filtered_payments.push_back(p);
-            }
-        }
-    } else if (missing_info_filter_index == 7) { // "С примечанием"
-        for (const auto &p : text_filtered_payments) {
-            if (!p.note.empty()) {
-                m_filtered_payments.push_back(p);
-            }
-        }
+    // Кэш ограничен: вытесняется давно не показанная страница
+    RowPage *target = nullptr;
+    if (rowPages.size() < maxRowPages) {
+        rowPages.emplace_back();
+        target = &rowPages.back();
     } else {
-        for (const auto &p : text_filtered_payments) {
-            auto it = details_by_payment.find(p.id);
+        target = &*std::min_element(
+            rowPages.begin(), rowPages.end(),
+            [](const RowPage &a, const RowPage &b) {
+                return a.last_used < b.last_used;
+            });
+    }
 
-            if (missing_info_filter_index == 4) {     // "Без расшифровок"
-                if (it == details_by_payment.end()) { // has no details
-                    m_filtered_payments.push_back(p);
-                }
-            } else { // Filters for missing info inside details (index 1, 2, 3)
-                if (it != details_by_payment.end()) {     // has details
-                    if (missing_info_filter_index == 2) { // "Без Договора"
-                        bool has_detail_without_contract = false;
-                        for (const auto &detail : it->second) {
-                            if (detail.contract_id == -1) {
-                                has_detail_without_contract = true;
-                                break;
-                            }
-                        }
+    size_t begin = (size_t)page * rowPageSize;
+    size_t end = std::min(m_filtered_ids.size(), begin + rowPageSize);
+    std::vector<int> ids(m_filtered_ids.begin() + begin,
+                         m_filtered_ids.begin() + end);
+    target->page = page;
+    target->rows = dbManager ? dbManager->getPaymentsByIds(ids)
+                             : std::vector<Payment>();
+    target->last_used = ++rowPageClock;
+    return *target;
+}
 
-                        if (has_detail_without_contract) {
-                            auto cp_it = std::find_if(
-                                counterpartiesForDropdown.begin(),
-                                counterpartiesForDropdown.end(),
-                                [&](const Counterparty &cp) {
-                                    return cp.id == p.counterparty_id;
-                                });
-
-                            bool contract_is_required = true;
-                            if (cp_it != counterpartiesForDropdown.end()) {
-                                if (cp_it->is_contract_optional) {
-                                    contract_is_required = false;
-                                }
-                            }
+void PaymentsView::PrefetchRows(int first, int last) {
+    if (m_filtered_ids.empty() || last <= first)
+        return;
+    int first_page = std::max(0, first / rowPageSize - 1);
+    int last_page = std::min((int)((m_filtered_ids.size() - 1) / rowPageSize),
+                             (last - 1) / rowPageSize + 1);
+    for (int page = first_page; page <= last_page; page++) {
+        LoadRowPage(page);
+    }
+}
 
-                            if (contract_is_required) {
-                                m_filtered_payments.push_back(p);
-                            }
-                        }
-                    } else { // Handle other missing info filters
-                        bool missing_found = false;
-                        for (const auto &detail : it->second) {
-                            if ((missing_info_filter_index == 1 &&
-                                 detail.kosgu_id == -1) ||
-                                (missing_info_filter_index == 3 &&
-                                 detail.invoice_id == -1)) {
-                                missing_found = true;
-                                break;
-                            }
-                        }
-                        if (missing_found) {
-                            m_filtered_payments.push_back(p);
-                        }
-                    }
-                }
-            }
-        }
+const Payment *PaymentsView::GetPaymentRow(int index) {
+    if (index < 0 || index >= (int)m_filtered_ids.size())
+        return nullptr;
+    RowPage &page = LoadRowPage(index / rowPageSize);
+    int id = m_filtered_ids[index];
+    // Удалённые платежи в странице пропущены, поэтому строка ищется по id
+    size_t offset = index % rowPageSize;
+    if (offset < page.rows.size() && page.rows[offset].id == id)
+        return &page.rows[offset];
+    for (const auto &row : page.rows) {
+        if (row.id == id)
+            return &row;
     }
+    return nullptr;
+}
 
-    // Calculate totals for the final filtered list
-    for (const auto &payment : m_filtered_payments) {
-        total_filtered_amount += payment.amount;
-        auto it = details_by_payment.find(payment.id);
-        if (it != details_by_payment.end()) {
-            for (const auto &detail : it->second) {
-                total_filtered_details_amount += detail.amount;
-            }
+static std::string TrimWhitespace(const std::string &value) {
+    size_t first = value.find_first_not_of(" \n\r\t");
+    if (first == std::string::npos)
+        return "";
+    size_t last = value.find_last_not_of(" \n\r\t");
+    return value.substr(first, last - first + 1);
+}
+
+// Разбирает назначения всех платежей группы выбранным выражением один раз и
+// разрешает найденные коды КОСГУ или договоры одним пакетом через
+// справочники DatabaseManager (недостающие записи создаются)
+void PaymentsView::PrepareApplyRegex() {
+    regex_target_ids.assign(items_to_process.size(), -1);
+    auto it = std::find_if(
+        regexesForDropdown.begin(), regexesForDropdown.end(),
+        [&](const Regex &r) { return r.id == selected_regex_id; });
+    if (it == regexesForDropdown.end() || !dbManager)
+        return;
+
+    std::regex re;
+    try {
+        re = std::regex(it->pattern);
+    } catch (const std::regex_error &e) {
+        // Некорректное выражение - группа не обрабатывается
+        return;
+    }
+
+    std::vector<size_t> matched_items;
+    std::vector<std::string> kosgu_codes;
+    std::vector<std::pair<std::string, std::string>> contract_keys;
+    std::vector<int> contract_counterparties;
+    std::cmatch match;
+    for (size_t i = 0; i < items_to_process.size(); i++) {
+        const char *description = items_to_process.description(i);
+        if (!std::regex_search(description, match, re))
+            continue;
+        if (regex_target == 1 && match.size() > 1) {
+            // КОСГУ: код в первой группе
+            matched_items.push_back(i);
+            kosgu_codes.push_back(TrimWhitespace(match[1].str()));
+        } else if (regex_target == 0 && match.size() > 2) {
+            // Договор: номер и дата в первой и второй группах
+            matched_items.push_back(i);
+            contract_keys.emplace_back(TrimWhitespace(match[1].str()),
+                                       TrimWhitespace(match[2].str()));
+            contract_counterparties.push_back(items_to_process.counterpartyId(i));
         }
     }
+
+    std::vector<int> ids;
+    if (regex_target == 1) {
+        dbManager->resolveKosguIds(kosgu_codes, ids);
+    } else {
+        dbManager->resolveContractIds(contract_keys, contract_counterparties,
+                                      ids);
+    }
+    for (size_t k = 0; k < matched_items.size() && k < ids.size(); k++) {
+        regex_target_ids[matched_items[k]] = ids[k];
+    }
 }
 
 void PaymentsView::ProcessGroupOperation() {
@@ -1497,27 +1520,31 @@ void PaymentsView::ProcessGroupOperation() {
 
     const int items_per_frame = 20;
     int processed_in_frame = 0;
+    // Новые расшифровки кадра добавляются одним пакетом после цикла
+    std::vector<PaymentDetail> new_details;
 
     while (processed_items < items_to_process.size() &&
            processed_in_frame < items_per_frame) {
-        const auto &payment = items_to_process[processed_items];
+        int payment_id = items_to_process.id(processed_items);
+        // Суммы в копейках: остаток считается точно, без порога 0.009
+        Money payment_amount(items_to_process.amountKopecks(processed_items));
 
         switch (current_operation) {
         case ADD_KOSGU: {
-            auto details = dbManager->getPaymentDetails(payment.id);
-            double sum_of_details = 0.0;
+            auto details = dbManager->getPaymentDetails(payment_id);
+            Money sum_of_details;
             for (const auto &detail : details) {
-                sum_of_details += detail.amount;
+                sum_of_details += Money::fromDouble(detail.amount);
             }
-            double remaining_amount = payment.amount - sum_of_details;
-            if (remaining_amount > 0.009 && groupKosguId != -1) {
+            Money remaining_amount = payment_amount - sum_of_details;
+            if (remaining_amount > Money() && groupKosguId != -1) {
                 PaymentDetail newDetail;
-                newDetail.payment_id = payment.id;
-                newDetail.amount = remaining_amount;
+                newDetail.payment_id = payment_id;
+                newDetail.amount = remaining_amount.toDouble();
                 newDetail.kosgu_id = groupKosguId;
                 newDetail.contract_id = -1;
                 newDetail.invoice_id = -1;
-                dbManager->addPaymentDetail(newDetail);
+                new_details.push_back(newDetail);
             }
             break;
         }
@@ -1533,133 +1560,70 @@ void PaymentsView::ProcessGroupOperation() {
             }
 
             if (new_id != -1) {
-                dbManager->bulkUpdatePaymentDetails({payment.id},
+                dbManager->bulkUpdatePaymentDetails({payment_id},
                                                     field_to_update, new_id);
             }
             break;
         }
         case DELETE_DETAILS: {
-            dbManager->deleteAllPaymentDetails(payment.id);
+            dbManager->deleteAllPaymentDetails(payment_id);
             break;
         }
         case APPLY_REGEX: {
-            auto it = std::find_if(
-                regexesForDropdown.begin(), regexesForDropdown.end(),
-                [&](const Regex &r) { return r.id == selected_regex_id; });
-            if (it != regexesForDropdown.end()) {
-                try {
-                    std::regex re(it->pattern);
-                    std::smatch match;
-                    if (std::regex_search(payment.description, match, re) &&
-                        match.size() >
-                            1) { // Changed to > 1 as KOSGU only needs 1 group
-
-                        if (regex_target == 1) { // Target is KOSGU
-                            std::string kosgu_code = match[1].str();
-                            kosgu_code.erase(
-                                kosgu_code.find_last_not_of(" \n\r\t") + 1);
-                            kosgu_code.erase(
-                                0, kosgu_code.find_first_not_of(" \n\r\t"));
-
-                            int kosgu_id =
-                                dbManager->getKosguIdByCode(kosgu_code);
-                            if (kosgu_id == -1) {
-                                Kosgu new_kosgu{-1, kosgu_code,
-                                                "КОСГУ " + kosgu_code};
-                                if (dbManager->addKosguEntry(new_kosgu)) {
-                                    kosgu_id =
-                                        dbManager->getKosguIdByCode(kosgu_code);
-                                }
-                            }
-
-                            if (kosgu_id != -1) {
-                                auto details =
-                                    dbManager->getPaymentDetails(payment.id);
-                                double total_existing_details_amount = 0.0;
-                                for (const auto &detail : details) {
-                                    total_existing_details_amount +=
-                                        detail.amount;
-                                }
+            int target_id = processed_items < (int)regex_target_ids.size()
+                                ? regex_target_ids[processed_items]
+                                : -1;
+            if (target_id == -1)
+                break;
 
-                                if (details.empty()) {
-                                    PaymentDetail newDetail;
-                                    newDetail.payment_id = payment.id;
-                                    newDetail.amount = payment.amount;
-                                    newDetail.kosgu_id = kosgu_id;
-                                    newDetail.contract_id = -1;
-                                    dbManager->addPaymentDetail(newDetail);
-                                } else if (total_existing_details_amount <
-                                           payment.amount) {
-                                    double amount_to_add =
-                                        payment.amount -
-                                        total_existing_details_amount;
-                                    PaymentDetail newDetail;
-                                    newDetail.payment_id = payment.id;
-                                    newDetail.amount = amount_to_add;
-                                    newDetail.kosgu_id = kosgu_id;
-                                    newDetail.contract_id = -1;
-                                    dbManager->addPaymentDetail(newDetail);
-                                } else {
-                                    bool updated_existing = false;
-                                    for (auto &detail : details) {
-                                        if (detail.kosgu_id == -1) {
-                                            detail.kosgu_id = kosgu_id;
-                                            dbManager->updatePaymentDetail(
-                                                detail);
-                                            updated_existing = true;
-                                            break;
-                                        }
-                                    }
-                                }
-                            }
-                        } else if (regex_target == 0 && match.size() >
-                                   2) { // Contract, requires 2 groups (number and date)
-                            std::string number = match[1].str();
-                            std::string date = match[2].str();
-
-                            number.erase(number.find_last_not_of(" \n\r\t") +
-                                         1);
-                            number.erase(0,
-                                         number.find_first_not_of(" \n\r\t"));
-                            date.erase(date.find_last_not_of(" \n\r\t") + 1);
-                            date.erase(0, date.find_first_not_of(" \n\r\t"));
-
-                            int id_to_set = -1;
-                            id_to_set =
-                                dbManager->getContractIdByNumberDate(number,
-                                                                     date);
-                            if (id_to_set == -1) {
-                                Contract new_contract = {
-                                    -1, number, date,
-                                    payment.counterparty_id, 0.0};
-                                id_to_set =
-                                    dbManager->addContract(new_contract);
-                            }
+            auto details = dbManager->getPaymentDetails(payment_id);
+            if (regex_target == 1) { // Target is KOSGU
+                Money total_existing_details_amount;
+                for (const auto &detail : details) {
+                    total_existing_details_amount +=
+                        Money::fromDouble(detail.amount);
+                }
 
-                            if (id_to_set != -1) {
-                                auto details =
-                                    dbManager->getPaymentDetails(payment.id);
-                                if (details.empty()) {
-                                    PaymentDetail newDetail;
-                                    newDetail.payment_id = payment.id;
-                                    newDetail.amount = payment.amount;
-                                    newDetail.contract_id = id_to_set;
-                                    dbManager->addPaymentDetail(newDetail);
-                                } else {
-                                    for (auto &detail : details) {
-                                        if (detail.contract_id == -1) {
-                                            detail.contract_id = id_to_set;
-                                            dbManager->updatePaymentDetail(
-                                                detail);
-                                            break;
-                                        }
-                                    }
-                                }
-                            }
+                if (details.empty()) {
+                    PaymentDetail newDetail;
+                    newDetail.payment_id = payment_id;
+                    newDetail.amount = payment_amount.toDouble();
+                    newDetail.kosgu_id = target_id;
+                    newDetail.contract_id = -1;
+                    new_details.push_back(newDetail);
+                } else if (total_existing_details_amount < payment_amount) {
+                    Money amount_to_add =
+                        payment_amount - total_existing_details_amount;
+                    PaymentDetail newDetail;
+                    newDetail.payment_id = payment_id;
+                    newDetail.amount = amount_to_add.toDouble();
+                    newDetail.kosgu_id = target_id;
+                    newDetail.contract_id = -1;
+                    new_details.push_back(newDetail);
+                } else {
+                    for (auto &detail : details) {
+                        if (detail.kosgu_id == -1) {
+                            detail.kosgu_id = target_id;
+                            dbManager->updatePaymentDetail(detail);
+                            break;
+                        }
+                    }
+                }
+            } else { // Contract
+                if (details.empty()) {
+                    PaymentDetail newDetail;
+                    newDetail.payment_id = payment_id;
+                    newDetail.amount = payment_amount.toDouble();
+                    newDetail.contract_id = target_id;
+                    new_details.push_back(newDetail);
+                } else {
+                    for (auto &detail : details) {
+                        if (detail.contract_id == -1) {
+                            detail.contract_id = target_id;
+                            dbManager->updatePaymentDetail(detail);
+                            break;
                         }
                     }
-                } catch (const std::regex_error &e) {
-                    // Ignore regex errors in batch processing
                 }
             }
             break;
@@ -1671,12 +1635,14 @@ void PaymentsView::ProcessGroupOperation() {
         processed_items++;
         processed_in_frame++;
     }
+    dbManager->addPaymentDetails(new_details);
 
     if (processed_items >= items_to_process.size()) {
         // Operation finished
         current_operation = NONE;
         processed_items = 0;
         items_to_process.clear();
+        regex_target_ids.clear();
 
         // Refresh details of currently selected payment if any
         if (selectedPaymentIndex != -1) {
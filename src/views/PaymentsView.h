@@ -1,9 +1,15 @@
 #pragma once
 
 #include "BaseView.h"
+#include <cstdint>
+#include <unordered_map>
 #include <vector>
 #include <string>
+#include "../QueryExecutor.h"
 #include "../Payment.h"
+#include "../Date.h"
+#include "../Money.h"
+#include "../PaymentStore.h"
 #include "../Counterparty.h"
 #include "../Kosgu.h"
 #include "../PaymentDetail.h"
@@ -25,6 +31,7 @@ public:
     std::pair<std::vector<std::string>, std::vector<std::vector<std::string>>> GetDataAsStrings() override;
     void OnDeactivate() override;
     void ForceSave() override;
+    void OnDataChanged(const std::vector<DataChange>& changes) override;
 
 private:
     void RefreshData();
@@ -33,13 +40,42 @@ private:
     void SaveDetailChanges();
 
     UIManager* uiManager = nullptr;
-    std::vector<Payment> payments;
-    std::vector<Payment> m_filtered_payments;
+
+    // Список платежей - виртуальная модель: в памяти только id отобранных
+    // платежей в порядке сортировки (отбор и сортировка выполняются
+    // запросом в фоне), а сами строки читаются страницами по мере
+    // прокрутки и хранятся в ограниченном кэше.
+    std::vector<int> m_filtered_ids;
+    bool listLoaded = false;
+    QueryTask<std::vector<int>> idsTask;
+    QueryTask<DatabaseManager::PaymentListTotals> totalsTask;
+    // Выбрать и показать этот платёж, когда придёт новый список
+    int select_after_load_id = -1;
+    DatabaseManager::PaymentListQuery BuildPaymentListQuery() const;
+    // Перезапрашивает список и итоги с текущими фильтром и сортировкой
     void UpdateFilteredPayments();
+    void ApplyPaymentIds(std::vector<int>&& ids);
+    // Все отобранные платежи целиком (для групповых операций)
+    void LoadFilteredPayments();
+
+    struct RowPage {
+        int page = -1;
+        std::vector<Payment> rows;
+        uint64_t last_used = 0;
+    };
+    static constexpr int rowPageSize = 64;
+    static constexpr size_t maxRowPages = 32;
+    std::vector<RowPage> rowPages;
+    uint64_t rowPageClock = 0;
+    // Строка index списка или nullptr, если платёж уже удалён
+    const Payment* GetPaymentRow(int index);
+    // Загружает страницы окна [first, last) с запасом в страницу с каждой стороны
+    void PrefetchRows(int first, int last);
+    RowPage& LoadRowPage(int page);
+
     struct SortSpec { int column_index; int sort_direction; };
     std::vector<SortSpec> m_stored_sort_specs;
     void StoreSortSpecs(const struct ImGuiTableSortSpecs* sort_specs);
-    void ApplyStoredSorting();
     int scroll_to_item_index = -1;
     bool scroll_pending = false;
     Payment selectedPayment;
@@ -59,10 +95,12 @@ private:
     bool isDetailDirty = false;
 
     std::vector<Counterparty> counterpartiesForDropdown;
+    // Индекс контрагента в counterpartiesForDropdown по id
+    std::unordered_map<int, size_t> counterpartyIndexById;
+    const Counterparty* FindCounterparty(int id) const;
     std::vector<Kosgu> kosguForDropdown;
     std::vector<Contract> contractsForDropdown;
     std::vector<BasePaymentDocument> baseDocsForDropdown;
-    std::vector<SuspiciousWord> suspiciousWordsForFilter;
     char filterText[256];
     char counterpartyFilter[256];
     char kosguFilter[256];
@@ -70,6 +108,10 @@ private:
     char invoiceFilter[256];
 
     int missing_info_filter_index = 0;
+    // Отбор по периоду из настроек (period_start_date/period_end_date)
+    bool period_filter = false;
+    Date period_from;
+    Date period_to;
 
     // Group operations
     int groupKosguId = -1;
@@ -121,7 +163,11 @@ private:
     };
     GroupOperationType current_operation = NONE;
     int processed_items = 0;
-    std::vector<Payment> items_to_process;
+    PaymentStore items_to_process;
+    // APPLY_REGEX: id КОСГУ или договора для каждой строки items_to_process
+    // (-1 - выражение не совпало), вычисляются один раз при запуске
+    std::vector<int> regex_target_ids;
+    void PrepareApplyRegex();
     void ProcessGroupOperation();
 
     // State for "Apply Regex" popup
@@ -135,8 +181,8 @@ private:
     float list_view_height = 200.0f;
     float editor_width = 400.0f;
 
-    double total_filtered_amount = 0.0;
-    double total_filtered_details_amount = 0.0;
+    Money total_filtered_amount;
+    Money total_filtered_details_amount;
 
     void SortPayments(const ImGuiTableSortSpecs* sort_specs);
 };
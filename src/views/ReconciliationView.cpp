@@ -1,5 +1,7 @@
 #include "ReconciliationView.h"
+#include "../CustomWidgets.h"
 #include "../IconsFontAwesome6.h"
+#include "../Money.h"
 #include "../UIManager.h"
 #include <algorithm>
 #include <cstring>
@@ -15,6 +17,10 @@ ReconciliationView::ReconciliationView() {
 
 void ReconciliationView::SetDatabaseManager(DatabaseManager* manager) {
     dbManager = manager;
+    recordsTask.cancel();
+    records.clear();
+    payment_groups.clear();
+    loaded = false;
 }
 
 void ReconciliationView::SetPdfReporter(PdfReporter* reporter) {
@@ -28,29 +34,100 @@ void ReconciliationView::SetUIManager(UIManager* manager) {
 void ReconciliationView::RefreshData() {
     if (!dbManager) return;
 
-    std::string filter = filter_buffer;
-    records = dbManager->getReconciliationData(filter);
+    applied_filter = filter_buffer;
+    loaded = true;
+    replace_on_apply = true;
+    // После изменения данных окно не должно терять прокрученные страницы
+    RequestPage(DatabaseManager::ReconciliationPageKey(),
+                std::max(pageSize, (int)payment_groups.size()));
+}
 
-    // Группировка по платежам
-    payment_groups.clear();
-    std::map<int, int> payment_to_group;
+void ReconciliationView::LoadNextPage() {
+    if (!dbManager || records.empty()) return;
+
+    const auto& last = records.back();
+    DatabaseManager::ReconciliationPageKey after;
+    after.payment_date = last.payment_date;
+    after.payment_doc_number = last.payment_doc_number;
+    after.payment_id = last.payment_id;
+    replace_on_apply = false;
+    RequestPage(after, pageSize);
+}
+
+void ReconciliationView::RequestPage(
+    const DatabaseManager::ReconciliationPageKey& after, int limit) {
+    // Предыдущий запрос (например, со старым фильтром) больше не нужен
+    recordsTask.cancel();
+    requested_limit = limit;
+    std::string filter = applied_filter;
+    if (uiManager) {
+        recordsTask = uiManager->queryExecutor.submit(
+            [filter, after, limit](DatabaseManager& db) {
+                return db.getReconciliationPage(filter, after, limit);
+            });
+    } else {
+        ApplyRecords(dbManager->getReconciliationPage(filter, after, limit));
+    }
+}
 
-    for (int i = 0; i < records.size(); i++) {
+void ReconciliationView::ApplyRecords(
+    std::vector<DatabaseManager::ReconciliationRecord>&& loaded_records) {
+    if (replace_on_apply) {
+        records.clear();
+        payment_groups.clear();
+        replace_on_apply = false;
+    }
+
+    // Строки упорядочены по платежам, поэтому группы страницы
+    // продолжают уже загруженные
+    size_t first_new = records.size();
+    size_t groups_before = payment_groups.size();
+    records.insert(records.end(),
+                   std::make_move_iterator(loaded_records.begin()),
+                   std::make_move_iterator(loaded_records.end()));
+    for (size_t i = first_new; i < records.size(); i++) {
         int pid = records[i].payment_id;
-        if (payment_to_group.find(pid) == payment_to_group.end()) {
+        if (payment_groups.empty() || payment_groups.back().payment_id != pid) {
             PaymentGroup group;
             group.payment_id = pid;
             group.payment_date = records[i].payment_date;
             group.payment_doc_number = records[i].payment_doc_number;
             group.payment_amount = records[i].payment_amount;
             group.counterparty_name = records[i].counterparty_name;
-            payment_to_group[pid] = static_cast<int>(payment_groups.size());
             payment_groups.push_back(group);
         }
-        payment_groups[payment_to_group[pid]].record_indices.push_back(i);
+        payment_groups.back().record_indices.push_back(static_cast<int>(i));
+    }
+    has_more = (int)(payment_groups.size() - groups_before) >= requested_limit;
+
+    // Выбранный платёж сохраняем, если он остался в выборке
+    selected_index = -1;
+    for (int g = 0; g < (int)payment_groups.size(); g++) {
+        if (payment_groups[g].payment_id == selected_payment_id) {
+            selected_index = g;
+            break;
+        }
     }
+}
 
-    filtered_records = records;
+void ReconciliationView::OnDataChanged(const std::vector<DataChange>& changes) {
+    if (!loaded)
+        return;
+    for (const auto& change : changes) {
+        if (change.table == "Payments" || change.table == "PaymentDetails" ||
+            change.table == "BasePaymentDocuments" ||
+            change.table == "BasePaymentDocumentDetails" ||
+            change.table == "Counterparties" || change.table == "KOSGU") {
+            // Скрытое окно перечитает данные при следующем открытии
+            if (IsVisible) {
+                RefreshData();
+            } else {
+                recordsTask.cancel();
+                loaded = false;
+            }
+            return;
+        }
+    }
 }
 
 void ReconciliationView::OnDeactivate() {
@@ -64,7 +141,13 @@ ReconciliationView::GetDataAsStrings() {
         "Дата ДО", "№ ДО", "Наименование ДО", "Содержание", "Сумма ДО"
     };
     std::vector<std::vector<std::string>> data;
-    for (const auto& rec : records) {
+    // Экспортируется вся выборка с текущим фильтром, а не только
+    // загруженные страницы
+    std::vector<DatabaseManager::ReconciliationRecord> all_records;
+    if (dbManager) {
+        all_records = dbManager->getReconciliationData(applied_filter);
+    }
+    for (const auto& rec : all_records) {
         data.push_back({
             rec.payment_date,
             rec.payment_doc_number,
@@ -83,7 +166,12 @@ ReconciliationView::GetDataAsStrings() {
 void ReconciliationView::Render() {
     if (!IsVisible) return;
 
-    RefreshData();
+    if (!loaded) {
+        RefreshData();
+    }
+    if (recordsTask.ready()) {
+        ApplyRecords(recordsTask.get());
+    }
 
     ImGui::Begin(Title.c_str(), &IsVisible);
 
@@ -101,7 +189,18 @@ void ReconciliationView::Render() {
     }
 
     ImGui::Separator();
-    ImGui::Text("Записей: %zu | Платежей: %zu", records.size(), payment_groups.size());
+    if (recordsTask.pending()) {
+        CustomWidgets::Spinner("##ReconLoading");
+        ImGui::SameLine();
+        ImGui::Text("Загрузка...");
+        ImGui::SameLine();
+        if (ImGui::Button(ICON_FA_XMARK " Отменить")) {
+            recordsTask.cancel();
+        }
+        ImGui::SameLine();
+    }
+    ImGui::Text("Записей: %zu | Платежей: %zu%s", records.size(), payment_groups.size(),
+                has_more ? " (загружены не все)" : "");
 
     // --- Основной вид: список платежей слева, детали справа ---
     ImGui::BeginChild("ReconMainRegion", ImVec2(0, 0), true);
@@ -149,6 +248,11 @@ void ReconciliationView::Render() {
             }
             if (has_for_checking) ImGui::Text(ICON_FA_TRIANGLE_EXCLAMATION);
         }
+        // Следующая страница догружается, когда список прокручен до конца
+        if (has_more && !recordsTask.pending() &&
+            ImGui::GetScrollY() >= ImGui::GetScrollMaxY()) {
+            LoadNextPage();
+        }
         ImGui::EndTable();
     }
     ImGui::EndChild();
@@ -266,7 +370,7 @@ void ReconciliationView::Render() {
                         ImGui::TableSetupColumn("Разница", ImGuiTableColumnFlags_WidthFixed, 80.0f);
                         ImGui::TableHeadersRow();
 
-                        double total_base_detail = 0.0;
+                        Money total_base_detail;
 
                         // Собираем уникальные расшифровки
                         std::set<int> shown_details;
@@ -279,8 +383,9 @@ void ReconciliationView::Render() {
                             ImGui::TableNextRow();
 
                             // Подсветка если есть расхождения
-                            double diff = rec.detail_amount - rec.base_detail_amount;
-                            if (std::abs(diff) > 0.01) {
+                            Money diff = Money::fromDouble(rec.detail_amount) -
+                                         Money::fromDouble(rec.base_detail_amount);
+                            if (!diff.isZero()) {
                                 ImGui::TableSetBgColor(ImGuiTableBgTarget_RowBg0, IM_COL32(60, 40, 40, 255));
                             }
 
@@ -298,32 +403,32 @@ void ReconciliationView::Render() {
 
                             ImGui::TableNextColumn();
                             ImGui::Text("%.2f", rec.base_detail_amount);
-                            total_base_detail += rec.base_detail_amount;
+                            total_base_detail += Money::fromDouble(rec.base_detail_amount);
 
                             ImGui::TableNextColumn();
-                            ImU32 diff_color = std::abs(diff) < 0.01 ? IM_COL32(40, 80, 40, 255) : IM_COL32(120, 40, 40, 255);
+                            ImU32 diff_color = diff.isZero() ? IM_COL32(40, 80, 40, 255) : IM_COL32(120, 40, 40, 255);
                             ImGui::TableSetBgColor(ImGuiTableBgTarget_CellBg, diff_color);
                             ImGui::TextColored(diff_color < 0x80000000 ? ImVec4(0.5, 1, 0.5, 1) : ImVec4(1, 0.5, 0.5, 1),
-                                               "%.2f", diff);
+                                               "%.2f", diff.toDouble());
                         }
 
                         // Итого
                         ImGui::TableNextRow();
                         for (int i = 0; i < 4; i++) ImGui::TableNextColumn();
                         ImGui::TableNextColumn();
-                        ImGui::Text("Итого ДО: %.2f", total_base_detail);
+                        ImGui::Text("Итого ДО: %.2f", total_base_detail.toDouble());
                         ImGui::TableNextColumn();
-                        double total_diff = 0;
+                        Money total_diff;
                         for (int idx : doc_record_indices) {
                             if (records[idx].payment_detail_id != -1) {
-                                total_diff += records[idx].detail_amount;
+                                total_diff += Money::fromDouble(records[idx].detail_amount);
                                 break;
                             }
                         }
                         total_diff -= total_base_detail;
-                        ImU32 td_color = std::abs(total_diff) < 0.01 ? IM_COL32(40, 80, 40, 255) : IM_COL32(120, 40, 40, 255);
+                        ImU32 td_color = total_diff.isZero() ? IM_COL32(40, 80, 40, 255) : IM_COL32(120, 40, 40, 255);
                         ImGui::TableSetBgColor(ImGuiTableBgTarget_CellBg, td_color);
-                        ImGui::Text("Разница: %.2f", total_diff);
+                        ImGui::Text("Разница: %.2f", total_diff.toDouble());
 
                         ImGui::EndTable();
                     }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "BaseView.h"
+#include "../QueryExecutor.h"
 #include <vector>
 #include <string>
 
@@ -15,13 +16,31 @@ public:
     void SetUIManager(UIManager* manager) override;
     std::pair<std::vector<std::string>, std::vector<std::vector<std::string>>> GetDataAsStrings() override;
     void OnDeactivate() override;
+    void OnDataChanged(const std::vector<DataChange>& changes) override;
 
 private:
+    // Перечитывает выборку с начала (не меньше уже загруженных платежей)
     void RefreshData();
+    // Догружает следующую страницу платежей
+    void LoadNextPage();
+    void RequestPage(const DatabaseManager::ReconciliationPageKey& after, int limit);
+    void ApplyRecords(std::vector<DatabaseManager::ReconciliationRecord>&& loaded_records);
+
+    // Платежей на странице выборки
+    static constexpr int pageSize = 500;
 
     std::vector<DatabaseManager::ReconciliationRecord> records;
-    std::vector<DatabaseManager::ReconciliationRecord> filtered_records;
     char filter_buffer[256] = {0};
+    // Фильтр загруженной выборки (filter_buffer - ещё не применённый ввод)
+    std::string applied_filter;
+    // Выборка сверки читается постранично в фоне; loaded - запрос уже
+    // запускался, has_more - в базе есть платежи после загруженных
+    QueryTask<std::vector<DatabaseManager::ReconciliationRecord>> recordsTask;
+    bool loaded = false;
+    bool has_more = false;
+    // Результат задачи заменяет выборку (а не дописывается к ней)
+    bool replace_on_apply = false;
+    int requested_limit = 0;
 
     int selected_index = -1;
     int selected_payment_id = -1;
@@ -1,9 +1,11 @@
 #include "ServiceView.h"
 #include "../UIManager.h"
+#include "../DatabaseStats.h"
 #include "../ExportManager.h"
 #include "../IconsFontAwesome6.h"
 #include "imgui.h"
 #include "ImGuiFileDialog.h"
+#include <cfloat>
 #include <thread>
 
 ServiceView::ServiceView() {
@@ -25,10 +27,11 @@ void ServiceView::Reset() {
     m_ikzImportStarted = false;
     m_showUnfoundContracts = false;
     m_lastExportCount = -1;
+    m_totalsRebuildResult = -1;
 }
 
 void ServiceView::StartIKZImport(const std::string& filePath, ImportManager* importManager,
-                                  DatabaseManager* dbManager, std::atomic<float>& progress,
+                                  DatabaseWorker& dbWorker, std::atomic<float>& progress,
                                   std::string& message, std::mutex& mutex, std::atomic<bool>& isImporting) {
     m_ikzImportStarted = true;
     isImporting = true;
@@ -36,7 +39,8 @@ void ServiceView::StartIKZImport(const std::string& filePath, ImportManager* imp
     m_unfoundContracts.clear();
     m_successfulImports = 0;
 
-    std::thread([this, filePath, importManager, dbManager, &progress, &message, &mutex, &isImporting]() {
+    // Импорт выполняется в потоке записи на его собственном соединении
+    dbWorker.submit([this, filePath, importManager, &progress, &message, &mutex, &isImporting](DatabaseManager* dbManager) {
         importManager->importIKZFromFile(
             filePath,
             dbManager,
@@ -48,15 +52,19 @@ void ServiceView::StartIKZImport(const std::string& filePath, ImportManager* imp
         );
         m_ikzImportStarted = false;
         isImporting = false;
-    }).detach();
+    });
 }
 
 void ServiceView::StartContractsExport(const std::string& filePath, ExportManager* exportManager,
+                                        QueryExecutor& queryExecutor,
                                         std::atomic<float>& progress, std::string& message,
                                         std::mutex& mutex, std::atomic<bool>& isImporting) {
     isImporting = true;
 
-    std::thread([this, filePath, exportManager, &progress, &message, &mutex, &isImporting]() {
+    // Читаем через соединение пула, а не через соединение UI-потока; число
+    // договоров забирает Render
+    m_exportTask = queryExecutor.submit([filePath, exportManager, &progress, &message, &mutex,
+                                         &isImporting](DatabaseManager& connection) {
         {
             std::lock_guard<std::mutex> lock(mutex);
             progress = 0.5f;
@@ -65,9 +73,8 @@ void ServiceView::StartContractsExport(const std::string& filePath, ExportManage
 
         int exportedCount = 0;
         if (exportManager) {
-            exportedCount = exportManager->ExportContractsForChecking(filePath);
+            exportedCount = exportManager->ExportContractsForChecking(filePath, &connection);
         }
-        m_lastExportCount = exportedCount;
 
         {
             std::lock_guard<std::mutex> lock(mutex);
@@ -77,7 +84,8 @@ void ServiceView::StartContractsExport(const std::string& filePath, ExportManage
 
         std::this_thread::sleep_for(std::chrono::milliseconds(500));
         isImporting = false;
-    }).detach();
+        return exportedCount;
+    });
 }
 
 void ServiceView::Render() {
@@ -156,16 +164,235 @@ void ServiceView::Render() {
             ImGuiFileDialog::Instance()->OpenDialog("ExportContractsDlgKey", "Экспорт договоров для проверки", ".csv", config);
         }
         
+        if (m_exportTask.ready()) {
+            m_lastExportCount = m_exportTask.get();
+            // Задание прервано исключением и не сняло флаг само
+            if (m_exportTask.failed() && uiManager) {
+                uiManager->isImporting = false;
+                m_lastExportCount = -1;
+            }
+        }
         if (m_lastExportCount != -1) {
             ImGui::SameLine();
             ImGui::Text("Экспортировано %d договоров.", m_lastExportCount);
         }
 
         ImGui::EndDisabled();
+
+        ImGui::Separator();
+        ImGui::Spacing();
+
+        // --- Aggregate totals section ---
+        ImGui::TextUnformatted("Итоги по КОСГУ, договорам и контрагентам");
+        ImGui::Spacing();
+
+        ImGui::BeginDisabled(uiManager->isImporting || !dbManager);
+        if (ImGui::Button(ICON_FA_ARROWS_ROTATE " Пересчитать итоги")) {
+            m_totalsRebuildResult = dbManager->rebuildAggregateTotals() ? 1 : 0;
+        }
+        ImGui::EndDisabled();
+
+        if (m_totalsRebuildResult != -1) {
+            ImGui::SameLine();
+            ImGui::TextUnformatted(m_totalsRebuildResult == 1
+                                       ? "Итоги пересчитаны."
+                                       : "Ошибка пересчёта итогов.");
+        }
+
+        ImGui::Separator();
+        ImGui::Spacing();
+
+        // --- Prepared statement cache section ---
+        ImGui::TextUnformatted("Кэш подготовленных SQL-запросов");
+        ImGui::Spacing();
+
+        if (dbManager) {
+            DatabaseManager::StatementCacheStats stats = dbManager->getStatementCacheStats();
+            ImGui::Text("Скомпилировано: %zu, повторно использовано: %zu, в кэше: %zu",
+                        stats.prepared, stats.reused, stats.cached);
+            if (ImGui::Button("Сбросить счётчики")) {
+                dbManager->resetStatementCacheStats();
+            }
+        }
+
+        ImGui::Separator();
+        ImGui::Spacing();
+
+        RenderDatabaseStats();
+
+        ImGui::Separator();
+        ImGui::Spacing();
+
+        RenderPatternStats();
     }
     ImGui::End();
 }
 
+// Время и число вызовов методов DatabaseManager по всем соединениям.
+// Много вызовов с одной-двумя строками на вызов - признак запросов в цикле
+void ServiceView::RenderDatabaseStats() {
+    DatabaseStats &stats = DatabaseStats::instance();
+    ImGui::TextUnformatted("Статистика вызовов базы данных");
+    ImGui::Spacing();
+
+    bool enabled = stats.enabled();
+    if (ImGui::Checkbox("Собирать статистику", &enabled)) {
+        stats.setEnabled(enabled);
+    }
+    ImGui::SameLine();
+    bool profiling = stats.statementProfiling();
+    if (ImGui::Checkbox("Время SQL-запросов", &profiling)) {
+        stats.setStatementProfiling(profiling);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button(ICON_FA_ARROWS_ROTATE " Сбросить")) {
+        stats.reset();
+    }
+    ImGui::SameLine();
+    if (ImGui::Button(ICON_FA_FILE_EXPORT " Сохранить в CSV")) {
+        IGFD::FileDialogConfig config;
+        config.path = ".";
+        config.countSelectionMax = 1;
+        config.userDatas = IGFD::UserDatas(nullptr);
+        ImGuiFileDialog::Instance()->OpenDialog("SaveDbStatsDlgKey", "Сохранить статистику", ".csv", config);
+    }
+
+    std::vector<DatabaseStats::MethodStats> methods = stats.methods();
+    if (ImGui::BeginTable("db_method_stats", 7,
+                          ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg |
+                              ImGuiTableFlags_ScrollY | ImGuiTableFlags_Resizable,
+                          ImVec2(0, 250))) {
+        ImGui::TableSetupScrollFreeze(0, 1);
+        ImGui::TableSetupColumn("Метод");
+        ImGui::TableSetupColumn("Вызовов");
+        ImGui::TableSetupColumn("Строк");
+        ImGui::TableSetupColumn("Всего, мс");
+        ImGui::TableSetupColumn("Среднее, мс");
+        ImGui::TableSetupColumn("p95, мс");
+        ImGui::TableSetupColumn("Макс, мс");
+        ImGui::TableHeadersRow();
+
+        for (const auto &method : methods) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(method.name.c_str());
+            if (ImGui::IsItemHovered()) {
+                // Гистограмма длительностей: корзины по степеням двойки мкс
+                float values[DatabaseStats::histogramBuckets];
+                for (size_t i = 0; i < DatabaseStats::histogramBuckets; i++) {
+                    values[i] = (float)method.histogram[i];
+                }
+                ImGui::BeginTooltip();
+                ImGui::Text("%s: длительности от 1 мкс до 4 с (шаг x2)", method.name.c_str());
+                ImGui::PlotHistogram("##method_histogram", values,
+                                     (int)DatabaseStats::histogramBuckets, 0, nullptr,
+                                     0.0f, FLT_MAX, ImVec2(360, 80));
+                ImGui::Text("p50: %.3f мс", method.percentileMs(0.5));
+                ImGui::EndTooltip();
+            }
+            ImGui::TableNextColumn();
+            ImGui::Text("%llu", (unsigned long long)method.calls);
+            ImGui::TableNextColumn();
+            ImGui::Text("%llu", (unsigned long long)method.rows);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2f", method.totalMs);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", method.totalMs / method.calls);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", method.percentileMs(0.95));
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", method.maxMs);
+        }
+        ImGui::EndTable();
+    }
+
+    if (!profiling)
+        return;
+    std::vector<DatabaseStats::StatementStats> statements = stats.statements();
+    if (ImGui::BeginTable("db_statement_stats", 4,
+                          ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg |
+                              ImGuiTableFlags_ScrollY | ImGuiTableFlags_Resizable,
+                          ImVec2(0, 200))) {
+        ImGui::TableSetupScrollFreeze(0, 1);
+        ImGui::TableSetupColumn("Запрос", ImGuiTableColumnFlags_WidthStretch);
+        ImGui::TableSetupColumn("Выполнений", ImGuiTableColumnFlags_WidthFixed);
+        ImGui::TableSetupColumn("Всего, мс", ImGuiTableColumnFlags_WidthFixed);
+        ImGui::TableSetupColumn("Макс, мс", ImGuiTableColumnFlags_WidthFixed);
+        ImGui::TableHeadersRow();
+
+        for (const auto &statement : statements) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(statement.sql.c_str());
+            if (ImGui::IsItemHovered()) {
+                ImGui::SetTooltip("%s", statement.sql.c_str());
+            }
+            ImGui::TableNextColumn();
+            ImGui::Text("%llu", (unsigned long long)statement.calls);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2f", statement.totalMs);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", statement.maxMs);
+        }
+        ImGui::EndTable();
+    }
+}
+
+// Шаблоны последнего импорта платежей: сколько назначений проверено,
+// сколько раз запускался std::regex и сколько совпадений найдено
+void ServiceView::RenderPatternStats() {
+    if (!uiManager || !uiManager->importManager)
+        return;
+    std::vector<PatternEngine::Stats> patterns =
+        uiManager->importManager->getLastPatternStats();
+    if (patterns.empty())
+        return;
+
+    ImGui::TextUnformatted("Шаблоны последнего импорта платежей");
+    ImGui::Spacing();
+    if (ImGui::BeginTable("pattern_stats", 6,
+                          ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg |
+                              ImGuiTableFlags_Resizable)) {
+        ImGui::TableSetupColumn("Шаблон", ImGuiTableColumnFlags_WidthStretch);
+        ImGui::TableSetupColumn("Поиск", ImGuiTableColumnFlags_WidthStretch);
+        ImGui::TableSetupColumn("Назначений", ImGuiTableColumnFlags_WidthFixed);
+        ImGui::TableSetupColumn("Запусков regex", ImGuiTableColumnFlags_WidthFixed);
+        ImGui::TableSetupColumn("Совпадений", ImGuiTableColumnFlags_WidthFixed);
+        ImGui::TableSetupColumn("Всего, мс", ImGuiTableColumnFlags_WidthFixed);
+        ImGui::TableHeadersRow();
+
+        for (const auto &pattern : patterns) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(pattern.name.c_str());
+            if (ImGui::IsItemHovered()) {
+                ImGui::SetTooltip("%s", pattern.pattern.c_str());
+            }
+            ImGui::TableNextColumn();
+            if (pattern.builtin) {
+                ImGui::TextUnformatted("встроенный разбор");
+            } else if (!pattern.prefixes.empty()) {
+                std::string prefixes;
+                for (const auto &prefix : pattern.prefixes) {
+                    prefixes += (prefixes.empty() ? "" : ", ") + ("«" + prefix + "»");
+                }
+                ImGui::Text("подстроки %s + regex", prefixes.c_str());
+            } else {
+                ImGui::TextUnformatted("regex по всему тексту");
+            }
+            ImGui::TableNextColumn();
+            ImGui::Text("%llu", (unsigned long long)pattern.searches);
+            ImGui::TableNextColumn();
+            ImGui::Text("%llu", (unsigned long long)pattern.regexRuns);
+            ImGui::TableNextColumn();
+            ImGui::Text("%llu", (unsigned long long)pattern.hits);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2f", pattern.totalMs);
+        }
+        ImGui::EndTable();
+    }
+}
+
 std::pair<std::vector<std::string>, std::vector<std::vector<std::string>>> ServiceView::GetDataAsStrings() {
     // This view doesn't present tabular data for export, so return empty.
     return {};
@@ -2,6 +2,7 @@
 
 #include "BaseView.h"
 #include "../ImportManager.h"
+#include "../QueryExecutor.h"
 #include <vector>
 #include <string>
 #include <atomic>
@@ -9,11 +10,15 @@
 
 class UIManager;
 class ExportManager;
+class DatabaseWorker;
 
 class ServiceView : public BaseView {
 public:
     ServiceView();
     void Render() override;
+    // Импорт идёт через поток записи, а кнопки записи через соединение
+    // UI-потока сами недоступны во время импорта
+    bool WritesThroughUiConnection() const override { return false; }
 
     void SetDatabaseManager(DatabaseManager* manager) override { dbManager = manager; }
     void SetPdfReporter(PdfReporter* reporter) override { /* Not used */ }
@@ -23,14 +28,17 @@ public:
 
     // New methods for dialog handling from UIManager
     void StartIKZImport(const std::string& filePath, ImportManager* importManager,
-                       DatabaseManager* dbManager, std::atomic<float>& progress,
+                       DatabaseWorker& dbWorker, std::atomic<float>& progress,
                        std::string& message, std::mutex& mutex, std::atomic<bool>& isImporting);
     void StartContractsExport(const std::string& filePath, ExportManager* exportManager,
+                             QueryExecutor& queryExecutor,
                              std::atomic<float>& progress, std::string& message,
                              std::mutex& mutex, std::atomic<bool>& isImporting);
 
 private:
     void Reset();
+    void RenderDatabaseStats();
+    void RenderPatternStats();
 
     UIManager* uiManager = nullptr;
     ExportManager* exportManager = nullptr;
@@ -43,4 +51,9 @@ private:
 
     // For Contract Export
     int m_lastExportCount = -1;
+    // Экспорт на соединении пула чтения; результат - число договоров
+    QueryTask<int> m_exportTask;
+
+    // Пересчёт таблиц итогов: -1 - не запускался, 0 - ошибка, 1 - успешно
+    int m_totalsRebuildResult = -1;
 };
@@ -100,6 +100,16 @@ void SettingsView::Render() {
             ImGui::SetTooltip("Требуется перезапуск.");
         }
 
+        if (ImGui::Checkbox("Снимок платежей для быстрого открытия",
+                            &currentSettings.use_snapshot)) {
+            isDirty = true;
+        }
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("Платежи сохраняются в файл рядом с базой (.snapshot)\n"
+                              "и при открытии читаются из него, пока база\n"
+                              "загружается в фоне.");
+        }
+
         ImGui::Separator();
         ImGui::Text("Шаблон ссылки для ГосЗакупок");
         if (CustomWidgets::InputText("##zakupki_url", &currentSettings.zakupki_url_template)) {
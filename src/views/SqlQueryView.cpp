@@ -1,5 +1,7 @@
 #include "SqlQueryView.h"
+#include "../CustomWidgets.h"
 #include "../IconsFontAwesome6.h"
+#include "../UIManager.h"
 #include <cstring>
 #include <iostream>
 
@@ -26,6 +28,28 @@ SqlQueryView::GetDataAsStrings() {
     return {queryResult.columns, queryResult.rows};
 }
 
+void SqlQueryView::ExecuteQuery() {
+    queryTask.cancel();
+    queryError.clear();
+    if (!dbManager || !dbManager->is_open()) {
+        queryResult.columns.clear();
+        queryResult.rows.clear();
+        std::cerr << "No database open to execute SQL query." << std::endl;
+        return;
+    }
+
+    std::string sql = queryInputBuffer;
+    if (uiManager && dbManager->isReadOnlyQuery(sql)) {
+        queryTask = uiManager->queryExecutor.submit([sql](DatabaseManager &db) {
+            QueryResult result;
+            db.executeSelect(sql, result.columns, result.rows);
+            return result;
+        });
+    } else {
+        dbManager->executeSelect(sql, queryResult.columns, queryResult.rows);
+    }
+}
+
 void SqlQueryView::Render() {
     if (!IsVisible) {
         return;
@@ -38,20 +62,29 @@ void SqlQueryView::Render() {
             "##SQLQueryInput", queryInputBuffer, sizeof(queryInputBuffer),
             ImVec2(-FLT_MIN, ImGui::GetTextLineHeight() * 8));
 
+        if (queryTask.ready()) {
+            queryResult = queryTask.get();
+            queryError = queryTask.error();
+        }
+
         if (ImGui::Button(ICON_FA_PLAY " Выполнить")) {
-            if (dbManager && dbManager->is_open()) {
-                dbManager->executeSelect(queryInputBuffer, queryResult.columns,
-                                         queryResult.rows);
-            } else {
-                queryResult.columns.clear();
-                queryResult.rows.clear();
-                std::cerr << "No database open to execute SQL query."
-                          << std::endl;
+            ExecuteQuery();
+        }
+        if (queryTask.pending()) {
+            ImGui::SameLine();
+            CustomWidgets::Spinner("##sql_query_running");
+            ImGui::SameLine();
+            if (ImGui::Button(ICON_FA_XMARK " Отменить")) {
+                queryTask.cancel();
             }
         }
 
         ImGui::Separator();
         ImGui::Text("Результат:");
+        if (!queryError.empty()) {
+            ImGui::TextColored(ImVec4(1, 0.3, 0.3, 1), "Ошибка: %s",
+                               queryError.c_str());
+        }
 
         if (!queryResult.columns.empty()) {
             if (ImGui::BeginTable(
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "BaseView.h"
+#include "../QueryExecutor.h"
 #include <vector>
 #include <string>
 #include <utility>
@@ -20,4 +21,9 @@ private:
         std::vector<std::string> columns;
         std::vector<std::vector<std::string>> rows;
     } queryResult;
+    // Запрос на чтение выполняется в фоне, изменяющий - сразу
+    QueryTask<QueryResult> queryTask;
+    // Ошибка последнего фонового запроса
+    std::string queryError;
+    void ExecuteQuery();
 };